@@ -0,0 +1,47 @@
+#include <Arduino.h>
+#include <ModbusSlave.h>
+
+/**
+ * Firmware de referencia para las medidas de ciclos en simavr (env:uno_bench).
+ * Un esclavo con FC03/FC16 sobre una tabla en RAM, igual que un sketch típico.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_CONTROL_PIN 8
+#define BENCH_BAUDRATE 115200
+#define BENCH_REGISTERS 128
+
+Modbus slave(Serial, BENCH_UNIT_ADDRESS, BENCH_CONTROL_PIN);
+uint16_t registers[BENCH_REGISTERS];
+
+uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS]);
+    }
+    return STATUS_OK;
+}
+
+uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+void setup()
+{
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+
+    Serial.begin(BENCH_BAUDRATE);
+    slave.begin(BENCH_BAUDRATE);
+}
+
+void loop()
+{
+    slave.poll();
+}
@@ -0,0 +1,12 @@
+#!/bin/sh
+# Compila el firmware de referencia, el ejecutor de simavr y muestra ciclos y tamaños.
+# Requiere PlatformIO, simavr (cabeceras y libsimavr) y libelf.
+set -e
+cd "$(dirname "$0")/../.."
+
+SIMAVR_CFLAGS=${SIMAVR_CFLAGS:-"-I/usr/include/simavr -I/usr/local/include/simavr"}
+SIMAVR_LIBS=${SIMAVR_LIBS:-"-lsimavr -lelf"}
+
+pio run -e uno_bench
+cc -O2 -o .pio/build/uno_bench/simavr_runner bench/avr/simavr_runner.c $SIMAVR_CFLAGS $SIMAVR_LIBS
+.pio/build/uno_bench/simavr_runner .pio/build/uno_bench/firmware.elf
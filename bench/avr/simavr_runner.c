@@ -0,0 +1,319 @@
+/**
+ * Ejecuta bench/avr/firmware.cpp en simavr, inyecta tramas Modbus por la UART0
+ * al ritmo de la línea y mide en ciclos de CPU el tiempo desde el último byte de
+ * la solicitud hasta la subida del pin DE y hasta el primer byte de la respuesta.
+ * Comprueba cada respuesta (longitud, CRC, unidad, código de función y, en FC03, los
+ * valores escritos antes con FC16) para no medir una ruta de error. También informa el
+ * tamaño de .text/.data/.bss, leído de las cabeceras de sección del ELF, y de la flash.
+ *
+ *     simavr_runner firmware.elf
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <gelf.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+#include <avr_uart.h>
+#include <avr_ioport.h>
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_BAUDRATE 115200
+#define BENCH_FREQUENCY 16000000
+#define BENCH_CONTROL_PORT 'B' /* Pin 8 del Uno = PB0. */
+#define BENCH_CONTROL_BIT 0
+#define BENCH_SILENCE_MICROSECONDS 750 /* 1.5T por encima de 19200 baudios. */
+#define BENCH_MAX_FRAME 256
+#define BENCH_REGISTERS 128 /* Igual que en firmware.cpp. */
+
+static avr_cycle_count_t firstResponseCycle;
+static avr_cycle_count_t controlPinCycle;
+static uint8_t response[BENCH_MAX_FRAME];
+static int responseLength;
+static uint16_t registers[BENCH_REGISTERS]; /* Lo que debe contener la tabla del firmware. */
+
+static void onUartOutput(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    avr_t *avr = (avr_t *)param;
+    if (responseLength == 0)
+    {
+        firstResponseCycle = avr->cycle;
+    }
+    if (responseLength < BENCH_MAX_FRAME)
+    {
+        response[responseLength] = value;
+    }
+    responseLength++;
+}
+
+static void onControlPin(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    avr_t *avr = (avr_t *)param;
+    if (value && controlPinCycle == 0)
+    {
+        controlPinCycle = avr->cycle;
+    }
+}
+
+static uint16_t crc16(const uint8_t *buffer, int length)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= buffer[i];
+        for (int j = 0; j < 8; j++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static int buildFrame(uint8_t *frame, uint8_t functionCode, uint16_t address, uint16_t count)
+{
+    int length = 0;
+    frame[length++] = BENCH_UNIT_ADDRESS;
+    frame[length++] = functionCode;
+    frame[length++] = address >> 8;
+    frame[length++] = address & 0xFF;
+    frame[length++] = count >> 8;
+    frame[length++] = count & 0xFF;
+    if (functionCode == 16)
+    {
+        frame[length++] = count * 2;
+        for (int i = 0; i < count * 2; i++)
+        {
+            frame[length++] = (uint8_t)(i * 37 + 11);
+        }
+    }
+    uint16_t crc = crc16(frame, length);
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    return length;
+}
+
+/**
+ * Lee el tamaño de las secciones .text, .data y .bss de las cabeceras del ELF.
+ */
+static int readSectionSizes(const char *path, unsigned *text, unsigned *data, unsigned *bss)
+{
+    *text = *data = *bss = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || elf_version(EV_CURRENT) == EV_NONE)
+    {
+        return -1;
+    }
+    Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+    size_t names;
+    if (!elf || elf_getshdrstrndx(elf, &names) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    for (Elf_Scn *section = elf_nextscn(elf, NULL); section; section = elf_nextscn(elf, section))
+    {
+        GElf_Shdr header;
+        const char *name = gelf_getshdr(section, &header) ? elf_strptr(elf, names, header.sh_name) : NULL;
+        if (!name)
+        {
+            continue;
+        }
+        if (strcmp(name, ".text") == 0)
+        {
+            *text = header.sh_size;
+        }
+        else if (strcmp(name, ".data") == 0)
+        {
+            *data = header.sh_size;
+        }
+        else if (strcmp(name, ".bss") == 0)
+        {
+            *bss = header.sh_size;
+        }
+    }
+    elf_end(elf);
+    close(fd);
+    return 0;
+}
+
+/**
+ * Comprueba la respuesta recibida a frame y, si es una escritura correcta, actualiza registers[].
+ */
+static int checkResponse(const uint8_t *frame, uint8_t functionCode, uint16_t address, uint16_t count)
+{
+    int expected = functionCode == 3 ? 5 + count * 2 : 8;
+    if (responseLength != expected ||
+        crc16(response, expected - 2) != (uint16_t)(response[expected - 2] | (response[expected - 1] << 8)) ||
+        response[0] != BENCH_UNIT_ADDRESS || response[1] != functionCode)
+    {
+        return 0;
+    }
+    if (functionCode == 16)
+    {
+        // Eco de la dirección y la cantidad de la solicitud.
+        if (memcmp(response + 2, frame + 2, 4) != 0)
+        {
+            return 0;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            registers[(address + i) % BENCH_REGISTERS] = (frame[7 + i * 2] << 8) | frame[8 + i * 2];
+        }
+        return 1;
+    }
+    if (response[2] != count * 2)
+    {
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (((response[3 + i * 2] << 8) | response[4 + i * 2]) != registers[(address + i) % BENCH_REGISTERS])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int runUntil(avr_t *avr, avr_cycle_count_t cycle)
+{
+    while (avr->cycle < cycle)
+    {
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s firmware.elf\n", argv[0]);
+        return 1;
+    }
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(argv[1], &firmware) != 0)
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    if (!firmware.mmcu[0])
+    {
+        strcpy(firmware.mmcu, "atmega328p");
+    }
+    if (!firmware.frequency)
+    {
+        firmware.frequency = BENCH_FREQUENCY;
+    }
+
+    avr_t *avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (!avr)
+    {
+        fprintf(stderr, "unknown mcu %s\n", firmware.mmcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    // La UART no debe volcarse a stdout: se observa byte a byte.
+    uint32_t flags = 0;
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    avr_irq_t *uartInput = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onUartOutput, avr);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_CONTROL_PORT), BENCH_CONTROL_BIT), onControlPin, avr);
+
+    // firmware.flashsize es la imagen de la flash: .text más los valores iniciales de .data.
+    unsigned text, data, bss;
+    if (readSectionSizes(argv[1], &text, &data, &bss) != 0)
+    {
+        fprintf(stderr, "cannot read the section headers of %s\n", argv[1]);
+        return 1;
+    }
+    printf("firmware  .text %u  .data %u  .bss %u  (flash %u, SRAM %u)\n",
+           text, data, bss, firmware.flashsize, data + bss);
+
+    avr_cycle_count_t charCycles = (avr_cycle_count_t)firmware.frequency * 10 / BENCH_BAUDRATE;
+    avr_cycle_count_t silenceCycles = (avr_cycle_count_t)firmware.frequency / 1000000 * BENCH_SILENCE_MICROSECONDS;
+
+    // Deja arrancar el firmware (init(), begin() y el silencio inicial de 3.5T).
+    if (runUntil(avr, avr->cycle + firmware.frequency / 20) < 0)
+    {
+        fprintf(stderr, "firmware stopped during start-up\n");
+        return 1;
+    }
+
+    struct
+    {
+        const char *name;
+        uint8_t functionCode;
+        uint16_t count;
+    } scenarios[] = {
+        {"FC16 x123", 16, 123},
+        {"FC03 x1", 3, 1},
+        {"FC03 x10", 3, 10},
+        {"FC03 x125", 3, 125},
+        {"FC16 x1", 16, 1},
+        {"FC16 x10", 16, 10},
+    };
+
+    // La primera escritura llena la tabla, así que las lecturas comprueban valores distintos de cero.
+    int failures = 0;
+    printf("%-10s %5s %5s %12s %12s %12s\n", "frame", "req", "resp", "to DE", "to 1st byte", "minus 1.5T");
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        uint8_t frame[BENCH_MAX_FRAME];
+        int length = buildFrame(frame, scenarios[s].functionCode, 0, scenarios[s].count);
+
+        firstResponseCycle = 0;
+        controlPinCycle = 0;
+        responseLength = 0;
+
+        // Un byte por tiempo de carácter, como en la línea.
+        avr_cycle_count_t lastByteCycle = 0;
+        for (int i = 0; i < length; i++)
+        {
+            runUntil(avr, avr->cycle + charCycles);
+            avr_raise_irq(uartInput, frame[i]);
+            lastByteCycle = avr->cycle + charCycles;
+        }
+
+        // Espera la respuesta completa (o 50 ms).
+        avr_cycle_count_t timeout = avr->cycle + firmware.frequency / 20;
+        int expected = scenarios[s].functionCode == 3 ? 5 + scenarios[s].count * 2 : 8;
+        while (avr->cycle < timeout && responseLength < expected)
+        {
+            if (runUntil(avr, avr->cycle + charCycles) < 0)
+            {
+                break;
+            }
+        }
+        runUntil(avr, avr->cycle + silenceCycles * 4);
+
+        if (!checkResponse(frame, scenarios[s].functionCode, 0, scenarios[s].count))
+        {
+            printf("%-10s %5d %5d %12s %12s %12s\n", scenarios[s].name, length, responseLength, "-",
+                   responseLength == 0 ? "no response" : "bad response", "-");
+            failures++;
+            continue;
+        }
+        long long toControl = controlPinCycle ? (long long)(controlPinCycle - lastByteCycle) : -1;
+        long long toFirstByte = (long long)(firstResponseCycle - lastByteCycle);
+        printf("%-10s %5d %5d %12lld %12lld %12lld\n", scenarios[s].name, length, responseLength,
+               toControl, toFirstByte, toFirstByte - (long long)silenceCycles);
+    }
+
+    avr_terminate(avr);
+    return failures == 0 ? 0 : 1;
+}
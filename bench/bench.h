@@ -0,0 +1,110 @@
+#ifndef MODBUS_BENCH_H
+#define MODBUS_BENCH_H
+#include <ModbusSlave.h>
+#include <MockStream.h>
+#include <deque>
+#include <vector>
+
+/**
+ * Utilidades compartidas por las pruebas de rendimiento en el host (env:native).
+ */
+
+typedef std::vector<uint8_t> Frame;
+
+uint16_t benchCRC(const uint8_t *buffer, size_t length);
+void benchAppendCRC(Frame &frame);
+bool benchCheckCRC(const Frame &frame);
+
+Frame benchReadRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t length);
+Frame benchWriteSingleRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t value);
+Frame benchWriteMultipleRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t length);
+
+/**
+ * Entrega una trama al esclavo con el reloj manual: inyecta los bytes, deja pasar
+ * el silencio de fin de trama y llama a poll() hasta que la respuesta se ha enviado.
+ *
+ * @return El número de llamadas a poll() realizadas.
+ */
+int benchTransact(Modbus &slave, MockStream &stream, const Frame &request, unsigned long silenceInMicroSecond);
+
+/**
+ * Línea serie simulada con el reloj manual: los bytes que un extremo escribe en su
+ * MockStream llegan al MockStream del otro extremo de uno en uno, a la velocidad
+ * del bus. Para la dirección contraria se usa otra BenchWire.
+ */
+class BenchWire
+{
+public:
+  BenchWire(MockStream &from, MockStream &to, unsigned long baudRate);
+  void transfer();
+  void setCorruptionRate(long oneIn);
+  size_t pending();
+  uint64_t totalCorrupted() { return _totalCorrupted; }
+
+private:
+  MockStream &_from;
+  MockStream &_to;
+  unsigned long _charTimeInMicroSecond;
+  unsigned long _lastArrival = 0;
+  std::deque<std::pair<unsigned long, uint8_t> > _line;
+  long _corruptionRate = 0;
+  uint64_t _totalCorrupted = 0;
+};
+
+struct BenchReplayRecord
+{
+  uint32_t time;
+  bool isTransmit;
+  Frame data;
+};
+
+struct BenchReplayResult
+{
+  uint64_t polls;
+  uint64_t receivedBytes;
+  uint64_t expectedBytes;
+  uint64_t transmittedBytes;
+  uint64_t mismatches;
+  uint64_t cpuNanos;
+  unsigned long duration;
+};
+
+/**
+ * Reproduce una captura de ModbusCapture contra un esclavo con el reloj manual.
+ */
+class BenchReplay
+{
+public:
+  bool load(const Frame &file);
+  bool loadFile(const char *path);
+  uint32_t baudRate() { return _baudRate; }
+  size_t numberOfRecords() { return _records.size(); }
+  std::vector<uint8_t> respondingUnits();
+  BenchReplayResult run(Modbus &slave, MockStream &stream, double speed, unsigned long step);
+
+private:
+  std::vector<BenchReplayRecord> _records;
+  uint32_t _baudRate = 0;
+};
+
+int runPollBenchmark(int argc, char **argv);
+int runTcpBenchmark(int argc, char **argv);
+int runGatewayBenchmark(int argc, char **argv);
+int runSerialBenchmark(int argc, char **argv);
+int runMultiPortBenchmark(int argc, char **argv);
+int runMasterBenchmark(int argc, char **argv);
+int runChangesBenchmark(int argc, char **argv);
+int runScatterBenchmark(int argc, char **argv);
+int runFileBenchmark(int argc, char **argv);
+int runReplayBenchmark(int argc, char **argv);
+int runResyncBenchmark(int argc, char **argv);
+int runThreadsBenchmark(int argc, char **argv);
+int runDuplexBenchmark(int argc, char **argv);
+int runTypedBenchmark(int argc, char **argv);
+int runBroadcastBenchmark(int argc, char **argv);
+int runPersistBenchmark(int argc, char **argv);
+int runCacheBenchmark(int argc, char **argv);
+int runDeferredBenchmark(int argc, char **argv);
+int runServiceBenchmark(int argc, char **argv);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Difusión con el reloj manual: un maestro reparte un bloque de consignas (FC16 de 10
+ * registros) a ocho unidades emuladas, las direcciones 1 a 8, en un solo Modbus. Compara
+ * ocho transacciones unicast, cada una con su respuesta y el silencio de 3.5T, con una
+ * trama de difusión a la dirección 0. Comprueba tras cada reparto que todas las unidades
+ * tienen las consignas nuevas y que la difusión no transmite nada, y cuenta las llamadas
+ * a la devolución de llamada cuando las ocho unidades comparten una misma devolución de
+ * llamada, que distingue la unidad con getUnitAddress().
+ */
+
+#define BENCH_UNITS 8
+#define BENCH_REGISTERS 10
+#define BENCH_TIMEOUT 50000
+#define BENCH_STEP 10
+
+static MockStream slaveStream(MODBUS_MAX_BUFFER);
+static MockStream masterStream(MODBUS_MAX_BUFFER);
+static ModbusSlave units[BENCH_UNITS] = {ModbusSlave(1), ModbusSlave(2), ModbusSlave(3), ModbusSlave(4),
+                                         ModbusSlave(5), ModbusSlave(6), ModbusSlave(7), ModbusSlave(8)};
+static Modbus slave(slaveStream, units, BENCH_UNITS);
+static uint16_t setpoints[BENCH_UNITS][BENCH_REGISTERS];
+static uint64_t callbackCalls;
+
+template <int unit>
+static uint8_t writeSetpoints(uint8_t fc, uint16_t address, uint16_t length)
+{
+    callbackCalls++;
+    for (uint16_t i = 0; i < length && address + i < BENCH_REGISTERS; i++)
+    {
+        setpoints[unit][address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+/**
+ * Una sola devolución de llamada para todas las unidades: getUnitAddress() dice cuál se atiende.
+ */
+static uint8_t writeSharedSetpoints(uint8_t fc, uint16_t address, uint16_t length)
+{
+    callbackCalls++;
+    uint8_t unit = slave.getUnitAddress() - 1;
+    if (unit >= BENCH_UNITS)
+    {
+        return STATUS_SLAVE_DEVICE_FAILURE;
+    }
+    for (uint16_t i = 0; i < length && address + i < BENCH_REGISTERS; i++)
+    {
+        setpoints[unit][address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static const ModbusCallback unitCallbacks[BENCH_UNITS] = {
+    writeSetpoints<0>, writeSetpoints<1>, writeSetpoints<2>, writeSetpoints<3>,
+    writeSetpoints<4>, writeSetpoints<5>, writeSetpoints<6>, writeSetpoints<7>};
+
+struct BroadcastResult
+{
+    long stale;
+    long timeouts;
+    uint64_t requestBytes;
+    uint64_t responseBytes;
+    uint64_t callbacks;
+    unsigned long duration;
+};
+
+/**
+ * Deja correr la línea y el esclavo hasta que el maestro recibe expected bytes o vence el plazo.
+ */
+static bool runLine(BenchWire &requestWire, BenchWire &responseWire, size_t expected, unsigned long timeout)
+{
+    unsigned long start = micros();
+    while ((size_t)masterStream.available() < expected && micros() - start < timeout)
+    {
+        requestWire.transfer();
+        slave.poll();
+        responseWire.transfer();
+        hostAdvanceMicros(BENCH_STEP);
+    }
+    bool isComplete = (size_t)masterStream.available() >= expected;
+    while (masterStream.available() > 0)
+    {
+        masterStream.read();
+    }
+    return isComplete;
+}
+
+static BroadcastResult run(unsigned long baudRate, bool isBroadcast, bool isShared, long updates)
+{
+    for (int u = 0; u < BENCH_UNITS; u++)
+    {
+        units[u].cbVector[CB_WRITE_HOLDING_REGISTERS] = isShared ? writeSharedSetpoints : unitCallbacks[u];
+
+        // Sin restos de la pasada anterior, que ocultarían una unidad sin actualizar.
+        for (int i = 0; i < BENCH_REGISTERS; i++)
+        {
+            setpoints[u][i] = 0xFFFF;
+        }
+    }
+    BenchWire requestWire(masterStream, slaveStream, baudRate);
+    BenchWire responseWire(slaveStream, masterStream, baudRate);
+    slave.begin(baudRate);
+    hostAdvanceMicros(100000);
+
+    unsigned long charTime = 11000000UL / baudRate;
+    unsigned long silence = 7 * (baudRate > 19200 ? 250 : 5000000UL / baudRate);
+    BroadcastResult result = BroadcastResult();
+    uint64_t sentBytes = slave.getTotalBytesSent();
+    uint64_t calls = callbackCalls;
+    unsigned long start = micros();
+
+    for (long update = 0; update < updates; update++)
+    {
+        Frame request = benchWriteMultipleRequest(isBroadcast ? 0 : 1, FC_WRITE_MULTIPLE_REGISTERS, 0, BENCH_REGISTERS);
+        for (int i = 0; i < BENCH_REGISTERS; i++)
+        {
+            uint16_t value = update * BENCH_REGISTERS + i;
+            request[7 + i * 2] = highByte(value);
+            request[8 + i * 2] = lowByte(value);
+        }
+
+        for (int u = 0; u < (isBroadcast ? 1 : BENCH_UNITS); u++)
+        {
+            request[0] = isBroadcast ? 0 : u + 1;
+            request.resize(request.size() - 2);
+            benchAppendCRC(request);
+            masterStream.write(request.data(), request.size());
+            result.requestBytes += request.size();
+
+            // Sin respuesta que esperar, el maestro sólo deja pasar su trama y el silencio de 3.5T.
+            if (isBroadcast)
+            {
+                runLine(requestWire, responseWire, 1, request.size() * charTime + silence);
+                continue;
+            }
+            result.timeouts += !runLine(requestWire, responseWire, 8, BENCH_TIMEOUT);
+            runLine(requestWire, responseWire, 1, silence);
+        }
+
+        // Todas las unidades deben tener ya las consignas nuevas.
+        for (int u = 0; u < BENCH_UNITS; u++)
+        {
+            const uint16_t *values = setpoints[u];
+            bool isStale = false;
+            for (int i = 0; i < BENCH_REGISTERS; i++)
+            {
+                isStale = isStale || values[i] != (uint16_t)(update * BENCH_REGISTERS + i);
+            }
+            result.stale += isStale;
+        }
+    }
+    result.duration = micros() - start;
+    result.responseBytes = slave.getTotalBytesSent() - sentBytes;
+    result.callbacks = callbackCalls - calls;
+    return result;
+}
+
+int runBroadcastBenchmark(int argc, char **argv)
+{
+    long updates = argc > 1 ? atol(argv[1]) : 500;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+
+    unsigned long baudRates[] = {19200, 115200};
+    printf("%ld setpoint updates (FC16 of %d registers) to %d units\n", updates, BENCH_REGISTERS, BENCH_UNITS);
+    printf("%-8s %-10s %-8s %8s %9s %10s %10s %10s %12s\n",
+           "baud", "mode", "map", "stale", "timeouts", "req bytes", "resp bytes", "callbacks", "ms/update");
+    long failures = 0;
+    for (size_t b = 0; b < sizeof(baudRates) / sizeof(baudRates[0]); b++)
+    {
+        for (int mode = 0; mode < 4; mode++)
+        {
+            bool isBroadcast = mode % 2 == 1;
+            bool isShared = mode >= 2;
+            BroadcastResult result = run(baudRates[b], isBroadcast, isShared, updates);
+            printf("%-8lu %-10s %-8s %8ld %9ld %10llu %10llu %10llu %12.2f\n", baudRates[b],
+                   isBroadcast ? "broadcast" : "unicast", isShared ? "shared" : "per-unit", result.stale, result.timeouts,
+                   (unsigned long long)result.requestBytes, (unsigned long long)result.responseBytes,
+                   (unsigned long long)result.callbacks, result.duration / 1000.0 / updates);
+
+            // Cada unidad recibe su llamada, también cuando comparten la devolución de llamada.
+            failures += result.stale + result.timeouts + (result.callbacks != (uint64_t)updates * BENCH_UNITS);
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Caché de respuestas FC03/FC04 con el reloj manual. Comprueba que un acierto devuelve
+ * la misma trama byte a byte sin llamar a la devolución de llamada, la caducidad tras
+ * maxAge, la validez por rango, la invalidación por FC06/FC16 (también en difusión) y
+ * que no se guardan difusiones ni excepciones. Después compara el tiempo de CPU por
+ * lectura repetida con y sin caché.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 200
+#define BENCH_CACHE_ENTRIES 4
+#define BENCH_MAX_AGE 1000000
+#define BENCH_RANGE_MAX_AGE 100000
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+static ModbusCacheEntry cache[BENCH_CACHE_ENTRIES];
+static ModbusCacheRange cacheRanges[] = {
+    {FC_READ_INPUT_REGISTERS, 0, 10, BENCH_RANGE_MAX_AGE},
+    {FC_READ_HOLDING_REGISTERS, 100, 20, 0},
+};
+static uint64_t readCalls;
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    readCalls++;
+    if (address + length > BENCH_REGISTERS)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length && address + i < BENCH_REGISTERS; i++)
+    {
+        registers[address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+/**
+ * Envía una solicitud y devuelve la respuesta; callbackCalls recibe las llamadas a la devolución de llamada.
+ */
+static Frame transact(const Frame &request, unsigned long silence, uint64_t &callbackCalls)
+{
+    uint64_t before = readCalls;
+    stream.clearOutput();
+    benchTransact(slave, stream, request, silence);
+    callbackCalls = readCalls - before;
+    return stream.output();
+}
+
+/**
+ * Cambia todos los registros, para que una respuesta tomada de la caché se distinga de una nueva.
+ */
+static void changeRegisters(uint16_t seed)
+{
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = seed * 100 + i;
+    }
+}
+
+/**
+ * Comprueba que una respuesta FC03/FC04 sea válida y lleve los valores actuales de los registros.
+ */
+static bool isFresh(const Frame &response, uint16_t address, uint16_t length)
+{
+    if (response.size() != 5u + length * 2 || !benchCheckCRC(response) || (response[1] & 0x80))
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (word(response[3 + i * 2], response[4 + i * 2]) != registers[address + i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Cuenta las entradas ocupadas que guardan una difusión o una excepción.
+ */
+static long forbiddenEntries()
+{
+    long forbidden = 0;
+    for (int i = 0; i < BENCH_CACHE_ENTRIES; i++)
+    {
+        forbidden += cache[i].responseLength > 0 && (cache[i].request[0] == 0 || (cache[i].response[1] & 0x80));
+    }
+    return forbidden;
+}
+
+static long checkCache(unsigned long silence)
+{
+    long failures = 0;
+    uint64_t calls;
+    Frame holding = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 10);
+    Frame input = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_INPUT_REGISTERS, 0, 10);
+    Frame excluded = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 100, 10);
+
+    // Un acierto repite la trama guardada byte a byte, sin llamar a la devolución de llamada.
+    slave.invalidateResponseCache();
+    changeRegisters(1);
+    Frame first = transact(holding, silence, calls);
+    failures += !isFresh(first, 0, 10) || calls != 1;
+    changeRegisters(2);
+    Frame hit = transact(holding, silence, calls);
+    failures += hit != first || calls != 0;
+
+    // Pasado maxAge la entrada caduca y la respuesta lleva los valores nuevos.
+    hostAdvanceMicros(BENCH_MAX_AGE / 2);
+    failures += transact(holding, silence, calls) != first || calls != 0;
+    hostAdvanceMicros(BENCH_MAX_AGE / 2 + 1);
+    failures += !isFresh(transact(holding, silence, calls), 0, 10) || calls != 1;
+
+    // El rango de FC04 0..9 caduca a los 100 ms y el de FC03 100..119 no se guarda nunca.
+    Frame stored = transact(input, silence, calls);
+    changeRegisters(3);
+    hostAdvanceMicros(BENCH_RANGE_MAX_AGE / 2);
+    failures += transact(input, silence, calls) != stored || calls != 0;
+    hostAdvanceMicros(BENCH_RANGE_MAX_AGE / 2 + 1);
+    failures += !isFresh(transact(input, silence, calls), 0, 10) || calls != 1;
+    for (int i = 0; i < 2; i++)
+    {
+        failures += !isFresh(transact(excluded, silence, calls), 100, 10) || calls != 1;
+    }
+
+    // FC06 y FC16 invalidan las lecturas FC03 que se solapan, y sólo esas.
+    Frame writes[] = {
+        benchWriteSingleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_REGISTER, 9, 0x1234),
+        benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 8, 4),
+        benchWriteSingleRequest(0, FC_WRITE_REGISTER, 0, 0x4321),
+    };
+    Frame distant = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 50, 10);
+    for (size_t w = 0; w < sizeof(writes) / sizeof(writes[0]); w++)
+    {
+        transact(holding, silence, calls);
+        Frame distantStored = transact(distant, silence, calls);
+        transact(writes[w], silence, calls);
+        failures += !isFresh(transact(holding, silence, calls), 0, 10) || calls != 1;
+        failures += transact(distant, silence, calls) != distantStored || calls != 0;
+    }
+
+    // Las lecturas en difusión se ignoran y las excepciones no se guardan.
+    Frame broadcast = benchReadRequest(0, FC_READ_HOLDING_REGISTERS, 20, 10);
+    Frame outOfRange = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, BENCH_REGISTERS - 5, 10);
+    for (int i = 0; i < 2; i++)
+    {
+        failures += transact(broadcast, silence, calls).size() != 0 || calls != 0;
+        Frame exception = transact(outOfRange, silence, calls);
+        failures += exception.size() != 5 || !benchCheckCRC(exception) || exception[2] != STATUS_ILLEGAL_DATA_ADDRESS || calls != 1;
+    }
+    failures += forbiddenEntries();
+    return failures;
+}
+
+int runCacheBenchmark(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.begin(115200);
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    slave.enableResponseCache(cache, BENCH_CACHE_ENTRIES, BENCH_MAX_AGE);
+    slave.setResponseCacheRanges(cacheRanges, sizeof(cacheRanges) / sizeof(cacheRanges[0]));
+    long failures = checkCache(silence);
+    printf("cache check: %ld failures (hit, expiry, per-range maxAge, FC06/FC16 invalidation, broadcast, exceptions)\n", failures);
+
+    uint16_t lengths[] = {1, 10, 29};
+    printf("%-10s %12s %12s %12s\n", "request", "ns uncached", "ns cached", "cached calls");
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+    {
+        Frame request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, lengths[l]);
+        double perRequest[2];
+        uint64_t callbacks = 0;
+        for (int cached = 0; cached < 2; cached++)
+        {
+            slave.enableResponseCache(cache, cached ? BENCH_CACHE_ENTRIES : 0, BENCH_MAX_AGE);
+            readCalls = 0;
+            uint64_t start = hostCpuNanos();
+            for (long i = 0; i < iterations; i++)
+            {
+                stream.clearOutput();
+                benchTransact(slave, stream, request, silence);
+            }
+            perRequest[cached] = (double)(hostCpuNanos() - start) / iterations;
+            callbacks = readCalls;
+        }
+        printf("FC03 x%-4u %12.0f %12.0f %12llu\n", lengths[l], perRequest[0], perRequest[1], (unsigned long long)callbacks);
+    }
+    return failures == 0 ? 0 : 1;
+}
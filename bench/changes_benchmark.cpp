@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Informe por excepción a 9600 baudios: un esclavo con BENCH_REGISTERS registros en un
+ * ModbusChangeTracker cambia unos pocos por ciclo y dos maestros mantienen una copia.
+ * Uno la refresca con FC03 (125 registros por solicitud) y otro con FC_READ_CHANGES
+ * paginado; un tercero, también con FC_READ_CHANGES, sólo sondea cada BENCH_LAG_CYCLES
+ * ciclos con su propio cursor. Compara los bytes en la línea y el tiempo de bus por
+ * ciclo y comprueba que cada copia coincide con el esclavo. Antes comprueba que un
+ * maestro cuyo cursor cae dentro de las generaciones nuevas tras un reinicio del esclavo
+ * recibe los valores de arranque gracias al epoch.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_BAUDRATE 9600
+#define BENCH_REGISTERS 200
+#define BENCH_MAX_READ 125
+#define BENCH_LAG_CYCLES 5
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+static uint16_t generations[BENCH_REGISTERS];
+static ModbusChangeTracker tracker(registers, generations, 0, BENCH_REGISTERS);
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return tracker.readToBuffer(slave, address, length);
+}
+
+static uint8_t readChanges(uint8_t fc, uint16_t cursor, uint16_t address)
+{
+    return slave.writeChangesToBuffer(tracker, cursor, address);
+}
+
+/**
+ * Una copia de los registros del esclavo y el tráfico que costó mantenerla.
+ */
+struct BenchMirror
+{
+    uint16_t values[BENCH_REGISTERS];
+    uint16_t epoch;
+    uint16_t cursor;
+    uint64_t bytes;
+    uint64_t frames;
+    long errors;
+};
+
+static uint16_t readWord(const Frame &frame, size_t index)
+{
+    return (frame[index] << 8) | frame[index + 1];
+}
+
+/**
+ * Envía una solicitud al esclavo y devuelve su respuesta, contando ambas tramas.
+ */
+static Frame transact(BenchMirror &mirror, const Frame &request, unsigned long silence)
+{
+    stream.clearOutput();
+    benchTransact(slave, stream, request, silence);
+    Frame response = stream.output();
+    mirror.bytes += request.size() + response.size();
+    mirror.frames += 2;
+    if (!benchCheckCRC(response) || response[1] != request[1])
+    {
+        mirror.errors++;
+        return Frame();
+    }
+    return response;
+}
+
+static void refreshPolling(BenchMirror &mirror, unsigned long silence)
+{
+    for (uint16_t address = 0; address < BENCH_REGISTERS; address += BENCH_MAX_READ)
+    {
+        uint16_t length = min(BENCH_REGISTERS - address, BENCH_MAX_READ);
+        Frame response = transact(mirror, benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, length), silence);
+        for (uint16_t i = 0; i < length && !response.empty(); i++)
+        {
+            mirror.values[address + i] = readWord(response, 3 + i * 2);
+        }
+    }
+}
+
+/**
+ * Una ronda de FC_READ_CHANGES: pagina con el mismo cursor hasta MODBUS_CHANGES_END y
+ * se queda con la generación de la primera página como cursor de la siguiente ronda.
+ * Si el epoch cambia, el esclavo se reinició y la ronda empieza de nuevo con
+ * MODBUS_CHANGES_FULL_SYNC.
+ */
+static void refreshChanges(BenchMirror &mirror, unsigned long silence)
+{
+    uint16_t address = 0;
+    uint16_t nextCursor = mirror.cursor;
+    bool isFirstPage = true;
+    while (address != MODBUS_CHANGES_END)
+    {
+        // FC_READ_CHANGES comparte formato de solicitud con FC03 (cursor, dirección).
+        Frame response = transact(mirror, benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_CHANGES, mirror.cursor, address), silence);
+        if (response.empty())
+        {
+            return;
+        }
+        uint16_t epoch = readWord(response, 3);
+        if (epoch != mirror.epoch)
+        {
+            mirror.epoch = epoch;
+            mirror.cursor = MODBUS_CHANGES_FULL_SYNC;
+            address = 0;
+            isFirstPage = true;
+            continue;
+        }
+        if (isFirstPage)
+        {
+            nextCursor = readWord(response, 5);
+            isFirstPage = false;
+        }
+        address = readWord(response, 7);
+
+        uint8_t pairs = (response[2] - 6) / 4;
+        for (uint8_t i = 0; i < pairs; i++)
+        {
+            mirror.values[readWord(response, 9 + i * 4) % BENCH_REGISTERS] = readWord(response, 11 + i * 4);
+        }
+    }
+    mirror.cursor = nextCursor;
+}
+
+static long mismatches(BenchMirror &mirror)
+{
+    long count = 0;
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        count += mirror.values[i] != registers[i];
+    }
+    return count;
+}
+
+/**
+ * Tiempo de bus en milisegundos: 10 bits por carácter y 3,5 caracteres de silencio por trama.
+ */
+static double lineTime(BenchMirror &mirror, long cycles)
+{
+    double charTime = 10.0 / BENCH_BAUDRATE;
+    return (mirror.bytes + mirror.frames * 3.5) * charTime * 1e3 / cycles;
+}
+
+/**
+ * El esclavo se reinicia con los valores de arranque y vuelve a la generación 1; después
+ * cambia un solo registro hasta superar el cursor del maestro. Con el mismo epoch el
+ * maestro no ve los registros que volvieron al valor de arranque, con uno nuevo sí.
+ *
+ * @return El número de fallos.
+ */
+static long checkRestart(unsigned long silence)
+{
+    long failures = 0;
+    for (uint16_t epoch = 1; epoch <= 2; epoch++)
+    {
+        for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+        {
+            registers[i] = i;
+        }
+        tracker.begin(1);
+        BenchMirror mirror = {};
+        mirror.cursor = MODBUS_CHANGES_FULL_SYNC;
+        refreshChanges(mirror, silence);
+        for (uint16_t i = 0; i < BENCH_REGISTERS; i += 4)
+        {
+            tracker.set(i, 1000 + i);
+        }
+        refreshChanges(mirror, silence);
+        uint16_t cursor = mirror.cursor;
+
+        // Reinicio: los registros vuelven a su valor de arranque en la generación 1.
+        for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+        {
+            registers[i] = i;
+        }
+        tracker.begin(epoch);
+        for (uint16_t value = 0; tracker.getGeneration() < cursor + 10; value++)
+        {
+            tracker.set(BENCH_REGISTERS - 1, value);
+        }
+        refreshChanges(mirror, silence);
+
+        bool isRestartSeen = epoch != 1;
+        failures += cursor < 10 || mirror.errors != 0 || (mismatches(mirror) == 0) != isRestartSeen;
+    }
+    return failures;
+}
+
+int runChangesBenchmark(int argc, char **argv)
+{
+    long cycles = argc > 1 ? atol(argv[1]) : 200;
+
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_READ_CHANGES] = readChanges;
+    slave.begin(BENCH_BAUDRATE);
+
+    unsigned long silence = 7 * 5000000UL / BENCH_BAUDRATE + 100;
+    hostAdvanceMicros(silence * 4);
+
+    long failures = checkRestart(silence);
+    printf("restart check: %ld failures (cursor inside the new generations, same and new epoch)\n", failures);
+
+    int changesPerCycle[] = {1, 5, 20, 100};
+
+    printf("%-8s %10s %10s %10s %10s %8s %10s %10s %9s\n",
+           "changes", "fc03 B", "fc65 B", "fc03 ms", "fc65 ms", "ratio", "lagged B", "frames", "mismatch");
+
+    for (size_t s = 0; s < sizeof(changesPerCycle) / sizeof(changesPerCycle[0]); s++)
+    {
+        srand(1);
+        for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+        {
+            registers[i] = i;
+        }
+        tracker.begin();
+
+        BenchMirror polling = {}, changes = {}, lagged = {};
+        changes.cursor = MODBUS_CHANGES_FULL_SYNC;
+        lagged.cursor = MODBUS_CHANGES_FULL_SYNC;
+
+        // La sincronización completa inicial no cuenta para las medias.
+        refreshPolling(polling, silence);
+        refreshChanges(changes, silence);
+        refreshChanges(lagged, silence);
+        polling.bytes = polling.frames = 0;
+        changes.bytes = changes.frames = 0;
+        lagged.bytes = lagged.frames = 0;
+
+        long mismatch = 0;
+        for (long cycle = 1; cycle <= cycles; cycle++)
+        {
+            for (int i = 0; i < changesPerCycle[s]; i++)
+            {
+                tracker.set(rand() % BENCH_REGISTERS, rand());
+            }
+
+            refreshPolling(polling, silence);
+            refreshChanges(changes, silence);
+            mismatch += mismatches(polling) + mismatches(changes);
+            if (cycle % BENCH_LAG_CYCLES == 0)
+            {
+                refreshChanges(lagged, silence);
+                mismatch += mismatches(lagged);
+            }
+        }
+
+        double pollingTime = lineTime(polling, cycles);
+        double changesTime = lineTime(changes, cycles);
+        printf("%-8d %10.1f %10.1f %10.1f %10.1f %8.1f %10.1f %10.1f %9ld\n",
+               changesPerCycle[s], (double)polling.bytes / cycles, (double)changes.bytes / cycles,
+               pollingTime, changesTime, pollingTime / changesTime,
+               (double)lagged.bytes / cycles, (double)changes.frames / cycles,
+               mismatch + polling.errors + changes.errors + lagged.errors);
+        failures += mismatch + polling.errors + changes.errors + lagged.errors;
+    }
+    return failures == 0 ? 0 : 1;
+}
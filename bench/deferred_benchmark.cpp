@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "bench.h"
+
+/**
+ * Respuestas diferidas con el reloj manual: la devolución de llamada de FC03 devuelve
+ * STATUS_PENDING y el bucle principal completa la respuesta más tarde con
+ * completeResponse(). Comprueba la respuesta completada (datos o excepción), que una
+ * solicitud recibida mientras tanto se descarta al caducar, que una finalización tardía
+ * no transmite nada, y que processPdu() y processFrame() responden BUSY mientras hay una
+ * respuesta pendiente o si la devolución de llamada intenta diferir la suya.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 100
+#define BENCH_LENGTH 10
+#define BENCH_DEFERRED_TIMEOUT 50000
+#define BENCH_STEP 1000
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+static bool isDeferring;
+static uint16_t pendingAddress;
+static uint16_t pendingLength;
+static uint64_t readCalls;
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    readCalls++;
+    if (address + length > BENCH_REGISTERS)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    if (isDeferring)
+    {
+        pendingAddress = address;
+        pendingLength = length;
+        return STATUS_PENDING;
+    }
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+/**
+ * Inyecta una solicitud y deja pasar el silencio de fin de trama para que poll() la procese.
+ */
+static void sendRequest(const Frame &request, unsigned long silence)
+{
+    stream.inject(request.data(), request.size());
+    slave.poll();
+    hostAdvanceMicros(silence);
+    slave.poll();
+}
+
+/**
+ * Llama a poll() hasta que la respuesta en curso termine de transmitirse.
+ */
+static void drain(unsigned long silence)
+{
+    for (int i = 0; i < 8 && !slave.isIdle(); i++)
+    {
+        hostAdvanceMicros(silence);
+        slave.poll();
+    }
+}
+
+/**
+ * Espera delay microsegundos atendiendo poll() y completa la respuesta diferida con los registros actuales.
+ *
+ * @return Lo que devuelve completeResponse().
+ */
+static uint16_t completeAfter(unsigned long delay, uint8_t status)
+{
+    for (unsigned long waited = 0; waited < delay; waited += BENCH_STEP)
+    {
+        hostAdvanceMicros(BENCH_STEP);
+        slave.poll();
+    }
+    for (uint16_t i = 0; i < pendingLength; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[pendingAddress + i]);
+    }
+    return slave.completeResponse(status);
+}
+
+static bool isAnswer(const Frame &response, uint16_t address, uint16_t length)
+{
+    if (response.size() != 5u + length * 2 || !benchCheckCRC(response) || response[0] != BENCH_UNIT_ADDRESS ||
+        response[1] != FC_READ_HOLDING_REGISTERS)
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (word(response[3 + i * 2], response[4 + i * 2]) != registers[address + i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isBusy(const Frame &response)
+{
+    return response.size() == 5 && benchCheckCRC(response) && response[1] == (FC_READ_HOLDING_REGISTERS | 0x80) &&
+           response[2] == STATUS_SLAVE_DEVICE_BUSY;
+}
+
+static long checkDeferred(unsigned long silence)
+{
+    long failures = 0;
+    Frame request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 20, BENCH_LENGTH);
+    Frame other = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 40, BENCH_LENGTH);
+
+    // Nada sale hasta completeResponse(), que transmite los datos escritos en el búfer entretanto.
+    isDeferring = true;
+    stream.clearOutput();
+    sendRequest(request, silence);
+    failures += !slave.isResponsePending() || stream.output().size() != 0;
+    completeAfter(BENCH_DEFERRED_TIMEOUT / 2, STATUS_OK);
+    failures += slave.isResponsePending();
+    drain(silence);
+    failures += !isAnswer(stream.output(), 20, BENCH_LENGTH) || !slave.isIdle();
+
+    // Un estado de error se transmite como excepción.
+    stream.clearOutput();
+    sendRequest(request, silence);
+    completeAfter(BENCH_STEP, STATUS_SLAVE_DEVICE_FAILURE);
+    drain(silence);
+    Frame exception = stream.output();
+    failures += exception.size() != 5 || !benchCheckCRC(exception) || exception[1] != (FC_READ_HOLDING_REGISTERS | 0x80) ||
+                exception[2] != STATUS_SLAVE_DEVICE_FAILURE;
+
+    // Mientras hay una respuesta pendiente, processPdu() y processFrame() responden BUSY sin llamar a la devolución de llamada.
+    stream.clearOutput();
+    sendRequest(request, silence);
+    uint64_t calls = readCalls;
+    uint8_t pdu[5] = {FC_READ_HOLDING_REGISTERS, 0, 40, 0, BENCH_LENGTH};
+    uint8_t pduResponse[MODBUS_MAX_PDU];
+    failures += slave.processPdu(BENCH_UNIT_ADDRESS, pdu, sizeof(pdu), pduResponse) != 2 ||
+                pduResponse[0] != (FC_READ_HOLDING_REGISTERS | 0x80) || pduResponse[1] != STATUS_SLAVE_DEVICE_BUSY;
+    uint8_t frame[MODBUS_MAX_BUFFER];
+    std::copy(other.begin(), other.end(), frame);
+    uint16_t frameLength = slave.processFrame(frame, other.size(), sizeof(frame));
+    failures += !isBusy(Frame(frame, frame + frameLength)) || readCalls != calls || !slave.isResponsePending();
+
+    // Otra solicitud llega y la respuesta caduca: ambas se descartan y una finalización tardía no transmite nada.
+    sendRequest(other, silence);
+    failures += readCalls != calls;
+    failures += completeAfter(BENCH_DEFERRED_TIMEOUT + silence, STATUS_OK) != 0;
+    drain(silence);
+    failures += stream.output().size() != 0 || slave.isResponsePending() || !slave.isIdle();
+
+    // El esclavo sigue atendiendo: la siguiente solicitud se responde con normalidad.
+    isDeferring = false;
+    benchTransact(slave, stream, other, silence);
+    failures += !isAnswer(stream.output(), 40, BENCH_LENGTH);
+
+    // Fuera del puerto RTU una devolución de llamada no puede diferir: BUSY, y nada queda pendiente.
+    isDeferring = true;
+    failures += slave.processPdu(BENCH_UNIT_ADDRESS, pdu, sizeof(pdu), pduResponse) != 2 ||
+                pduResponse[1] != STATUS_SLAVE_DEVICE_BUSY || slave.isResponsePending();
+    std::copy(other.begin(), other.end(), frame);
+    frameLength = slave.processFrame(frame, other.size(), sizeof(frame));
+    failures += !isBusy(Frame(frame, frame + frameLength)) || slave.isResponsePending();
+    isDeferring = false;
+    return failures;
+}
+
+int runDeferredBenchmark(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 100;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 7 + 3;
+    }
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.setDeferredTimeout(BENCH_DEFERRED_TIMEOUT);
+    slave.begin(115200);
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    long failures = checkDeferred(silence);
+    printf("deferred check: %ld failures (completion, exception, BUSY via processPdu/processFrame, late completion)\n", failures);
+
+    // Completar antes de la caducidad responde siempre; después, nunca.
+    unsigned long delays[] = {1000, 10000, 45000, 55000, 100000};
+    printf("deferred timeout %u us, %ld transactions per delay\n", BENCH_DEFERRED_TIMEOUT, transactions);
+    printf("%10s %10s %10s %10s\n", "delay us", "answered", "dropped", "wrong");
+    isDeferring = true;
+    for (size_t d = 0; d < sizeof(delays) / sizeof(delays[0]); d++)
+    {
+        long answered = 0;
+        long dropped = 0;
+        long wrong = 0;
+        for (long t = 0; t < transactions; t++)
+        {
+            uint16_t address = (t * 13) % (BENCH_REGISTERS - BENCH_LENGTH);
+            registers[address] = t;
+            stream.clearOutput();
+            sendRequest(benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, BENCH_LENGTH), silence);
+            completeAfter(delays[d], STATUS_OK);
+            drain(silence);
+
+            Frame response = stream.output();
+            bool isLate = delays[d] > BENCH_DEFERRED_TIMEOUT;
+            if (response.empty())
+            {
+                dropped++;
+                wrong += !isLate;
+            }
+            else
+            {
+                answered++;
+                wrong += isLate || !isAnswer(response, address, BENCH_LENGTH);
+            }
+        }
+        printf("%10lu %10ld %10ld %10ld\n", delays[d], answered, dropped, wrong);
+        failures += wrong;
+    }
+    isDeferring = false;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Dúplex completo con el reloj manual: un maestro en un enlace de 4 hilos alterna FC03 y
+ * FC16 de 10 registros y mantiene hasta window solicitudes sin responder, separadas por
+ * 3.5T en su línea de transmisión. Cada dirección va por su BenchWire y el búfer de
+ * transmisión del esclavo sólo se vacía a la velocidad de la línea. Compara poll() en
+ * semidúplex con enableFullDuplex(): respuestas correctas, erróneas y perdidas,
+ * transacciones por segundo y ocupación de cada línea. Antes comprueba que una cola en
+ * la que no cabe la respuesta más larga se rechaza.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 30
+#define BENCH_WRITE_ADDRESS 40
+#define BENCH_UART_BUFFER 64
+#define BENCH_TIMEOUT 100000
+#define BENCH_STEP 10
+
+/**
+ * MockStream cuyo búfer de transmisión se vacía a la velocidad de la línea, como una UART.
+ */
+class UartStream : public MockStream
+{
+public:
+    UartStream() : MockStream(BENCH_UART_BUFFER) {}
+    void attach(BenchWire *wire) { _wire = wire; }
+    int availableForWrite() { return _wire != NULL ? max(0, BENCH_UART_BUFFER - (int)_wire->pending()) : BENCH_UART_BUFFER; }
+
+private:
+    BenchWire *_wire = NULL;
+};
+
+static UartStream slaveStream;
+static MockStream masterStream(MODBUS_MAX_BUFFER);
+static Modbus slave(slaveStream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_WRITE_ADDRESS + BENCH_REGISTERS];
+static uint8_t responseQueue[2 * (MODBUS_MAX_BUFFER + 2)];
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+struct DuplexMode
+{
+    const char *name;
+    bool isFullDuplex;
+    size_t window;
+};
+
+struct DuplexResult
+{
+    long answered;
+    long wrong;
+    long lost;
+    uint64_t requestBytes;
+    uint64_t responseBytes;
+    unsigned long duration;
+};
+
+static DuplexResult run(unsigned long baudRate, const DuplexMode &mode, long transactions)
+{
+    BenchWire requestWire(masterStream, slaveStream, baudRate);
+    BenchWire responseWire(slaveStream, masterStream, baudRate);
+    slaveStream.attach(&responseWire);
+    slave.enableFullDuplex(mode.isFullDuplex ? responseQueue : NULL, sizeof(responseQueue));
+    slave.begin(baudRate);
+    hostAdvanceMicros(100000);
+
+    unsigned long charTime = 11000000UL / baudRate;
+    unsigned long silence = 7 * (baudRate > 19200 ? 250 : 5000000UL / baudRate);
+    DuplexResult result = DuplexResult();
+    uint64_t sentBytes = slave.getTotalBytesSent();
+    std::deque<size_t> expected;
+    std::deque<uint8_t> functionCodes;
+    Frame received;
+    long sent = 0;
+    unsigned long start = micros();
+    unsigned long lineFree = start;
+    unsigned long lastActivity = start;
+
+    while (result.answered + result.wrong + result.lost < transactions)
+    {
+        // Con window 1 el maestro espera la respuesta y 3.5T antes de la siguiente solicitud.
+        if (sent < transactions && expected.size() < mode.window && (long)(micros() - lineFree) >= 0)
+        {
+            bool isWrite = sent % 4 == 3;
+            Frame request = isWrite ? benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, BENCH_WRITE_ADDRESS, BENCH_REGISTERS)
+                                    : benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, BENCH_REGISTERS);
+            masterStream.write(request.data(), request.size());
+            expected.push_back(isWrite ? 8 : 5 + BENCH_REGISTERS * 2);
+            functionCodes.push_back(request[1]);
+            result.requestBytes += request.size();
+            lineFree = micros() + request.size() * charTime + silence;
+            lastActivity = micros();
+            sent++;
+        }
+
+        requestWire.transfer();
+        slave.poll();
+        responseWire.transfer();
+
+        while (masterStream.available() > 0)
+        {
+            received.push_back(masterStream.read());
+            lastActivity = micros();
+        }
+
+        // Las respuestas llegan en el orden de las solicitudes.
+        while (!expected.empty() && received.size() >= expected.front())
+        {
+            Frame response(received.begin(), received.begin() + expected.front());
+            received.erase(received.begin(), received.begin() + expected.front());
+            bool isCorrect = benchCheckCRC(response) && response[1] == functionCodes.front();
+            result.answered += isCorrect;
+            result.wrong += !isCorrect;
+            expected.pop_front();
+            functionCodes.pop_front();
+            if (mode.window == 1)
+            {
+                lineFree = micros() + silence;
+            }
+        }
+
+        // Sin bytes durante el plazo, el maestro da por perdidas las solicitudes sin responder.
+        if (!expected.empty() && micros() - lastActivity > BENCH_TIMEOUT)
+        {
+            result.lost += expected.size();
+            expected.clear();
+            functionCodes.clear();
+            received.clear();
+        }
+        hostAdvanceMicros(BENCH_STEP);
+    }
+
+    // Deja terminar la última respuesta antes de la siguiente ejecución.
+    for (unsigned long elapsed = 0; elapsed < BENCH_TIMEOUT; elapsed += BENCH_STEP)
+    {
+        requestWire.transfer();
+        slave.poll();
+        responseWire.transfer();
+        hostAdvanceMicros(BENCH_STEP);
+    }
+    while (masterStream.available() > 0)
+    {
+        masterStream.read();
+    }
+    slaveStream.attach(NULL);
+    result.duration = micros() - start - BENCH_TIMEOUT;
+    result.responseBytes = slave.getTotalBytesSent() - sentBytes;
+    return result;
+}
+
+/**
+ * enableFullDuplex() rechaza una cola menor que MODBUS_MAX_BUFFER + 2 sin cambiar de modo.
+ *
+ * @return El número de fallos.
+ */
+static long checkQueueSize()
+{
+    long failures = 0;
+    failures += slave.enableFullDuplex(responseQueue, MODBUS_MAX_BUFFER + 1);
+    failures += !slave.enableFullDuplex(responseQueue, MODBUS_MAX_BUFFER + 2);
+    failures += slave.enableFullDuplex(responseQueue, 16);
+    failures += !slave.enableFullDuplex(NULL, 0);
+    return failures;
+}
+
+int runDuplexBenchmark(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 2000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+
+    long failures = checkQueueSize();
+    printf("queue size check: %ld failures (queues below MODBUS_MAX_BUFFER + 2 rejected)\n", failures);
+
+    DuplexMode modes[] = {
+        {"half", false, 1},
+        {"half", false, 2},
+        {"half", false, 4},
+        {"full", true, 1},
+        {"full", true, 2},
+        {"full", true, 4},
+    };
+    unsigned long baudRates[] = {19200, 115200};
+
+    printf("%ld transactions (three FC03 for every FC16, %d registers each)\n", transactions, BENCH_REGISTERS);
+    printf("%-8s %-6s %7s %10s %8s %8s %10s %9s %9s\n",
+           "baud", "duplex", "window", "answered", "wrong", "lost", "trans/s", "req line", "resp line");
+    for (size_t b = 0; b < sizeof(baudRates) / sizeof(baudRates[0]); b++)
+    {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+        {
+            DuplexResult result = run(baudRates[b], modes[m], transactions);
+            double lineTime = 11e6 / baudRates[b] / result.duration;
+            printf("%-8lu %-6s %7lu %10ld %8ld %8ld %10.1f %8.0f%% %8.0f%%\n", baudRates[b], modes[m].name,
+                   (unsigned long)modes[m].window, result.answered, result.wrong, result.lost,
+                   result.answered * 1e6 / result.duration, result.requestBytes * lineTime * 100,
+                   result.responseBytes * lineTime * 100);
+
+            // En semidúplex las solicitudes solapadas se pierden o se mezclan: es la referencia.
+            failures += modes[m].isFullDuplex ? result.wrong + result.lost : 0;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * Transferencia de archivos con el reloj manual y la línea a la velocidad del bus
+ * (BenchWire): un maestro mínimo lee y escribe BENCH_FILES archivos de BENCH_RECORDS
+ * registros con FC20/FC21 y, como referencia, la misma memoria como registros
+ * holding con FC03/FC16. Informa los bytes útiles por segundo para cada velocidad
+ * y comprueba el contenido transferido.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_FILES 2
+#define BENCH_RECORDS 8192
+#define BENCH_FILE_BYTES (BENCH_RECORDS * 2)
+#define BENCH_MAX_FILE_RECORDS 121
+#define BENCH_MAX_READ 125
+#define BENCH_MAX_WRITE 123
+#define BENCH_STEP 10
+
+static MockStream masterStream(MODBUS_MAX_BUFFER);
+static MockStream slaveStream(MODBUS_MAX_BUFFER);
+static Modbus slave(slaveStream, BENCH_UNIT_ADDRESS);
+static uint8_t files[BENCH_FILES][BENCH_FILE_BYTES];
+static uint8_t copy[BENCH_FILES][BENCH_FILE_BYTES];
+
+/**
+ * Archivos 1..BENCH_FILES en RAM; los registros holding 0..BENCH_FILES * BENCH_RECORDS - 1
+ * son los mismos bytes, para comparar con FC03/FC16.
+ */
+class BenchFileProvider : public ModbusFileProvider
+{
+public:
+    uint8_t readRecords(uint16_t fileNumber, uint16_t recordNumber, uint8_t *buffer, uint16_t length)
+    {
+        uint8_t *source = locate(fileNumber, recordNumber, length);
+        if (source == NULL)
+        {
+            return STATUS_ILLEGAL_DATA_ADDRESS;
+        }
+        memcpy(buffer, source, length * 2);
+        return STATUS_OK;
+    }
+
+    uint8_t writeRecords(uint16_t fileNumber, uint16_t recordNumber, const uint8_t *buffer, uint16_t length)
+    {
+        uint8_t *destination = locate(fileNumber, recordNumber, length);
+        if (destination == NULL)
+        {
+            return STATUS_ILLEGAL_DATA_ADDRESS;
+        }
+        memcpy(destination, buffer, length * 2);
+        return STATUS_OK;
+    }
+
+private:
+    uint8_t *locate(uint16_t fileNumber, uint16_t recordNumber, uint16_t length)
+    {
+        if (fileNumber < 1 || fileNumber > BENCH_FILES || (uint32_t)recordNumber + length > BENCH_RECORDS)
+        {
+            return NULL;
+        }
+        return files[fileNumber - 1] + recordNumber * 2;
+    }
+};
+
+static BenchFileProvider provider;
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint8_t *source = (uint8_t *)files + (address + i) * 2;
+        slave.writeRegisterToBuffer(i, (source[0] << 8) | source[1]);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t value = slave.readRegisterFromBuffer(i);
+        uint8_t *destination = (uint8_t *)files + (address + i) * 2;
+        destination[0] = value >> 8;
+        destination[1] = value & 0xFF;
+    }
+    return STATUS_OK;
+}
+
+static Frame fileRequest(uint8_t functionCode, uint16_t fileNumber, uint16_t recordNumber, uint16_t length, const uint8_t *data)
+{
+    Frame frame = {BENCH_UNIT_ADDRESS, functionCode, 0, 6,
+                   (uint8_t)(fileNumber >> 8), (uint8_t)(fileNumber & 0xFF),
+                   (uint8_t)(recordNumber >> 8), (uint8_t)(recordNumber & 0xFF),
+                   (uint8_t)(length >> 8), (uint8_t)(length & 0xFF)};
+    if (data != NULL)
+    {
+        frame.insert(frame.end(), data, data + length * 2);
+    }
+    frame[2] = frame.size() - 3;
+    benchAppendCRC(frame);
+    return frame;
+}
+
+static Frame writeRequest(uint16_t address, uint16_t length, const uint8_t *data)
+{
+    Frame frame = {BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS,
+                   (uint8_t)(address >> 8), (uint8_t)(address & 0xFF),
+                   (uint8_t)(length >> 8), (uint8_t)(length & 0xFF), (uint8_t)(length * 2)};
+    frame.insert(frame.end(), data, data + length * 2);
+    benchAppendCRC(frame);
+    return frame;
+}
+
+/**
+ * Envía una solicitud por la línea y espera la respuesta completa y el silencio de 3.5T.
+ */
+class BenchFileMaster
+{
+public:
+    BenchFileMaster(unsigned long baudRate)
+        : _request(masterStream, slaveStream, baudRate), _response(slaveStream, masterStream, baudRate),
+          _silence(7 * 5500000UL / baudRate)
+    {
+    }
+
+    Frame transact(const Frame &request)
+    {
+        masterStream.write(request.data(), request.size());
+        _lineBytes += request.size();
+
+        Frame response;
+        unsigned long lastByte = 0;
+        while (true)
+        {
+            _request.transfer();
+            slave.poll();
+            _response.transfer();
+            while (masterStream.available() > 0)
+            {
+                response.push_back(masterStream.read());
+                lastByte = micros();
+            }
+
+            size_t expected = expectedLength(response);
+            if (expected > 0 && response.size() >= expected && micros() - lastByte >= _silence)
+            {
+                break;
+            }
+            hostAdvanceMicros(BENCH_STEP);
+        }
+        _lineBytes += response.size();
+        _frames++;
+        return response;
+    }
+
+    uint64_t lineBytes() { return _lineBytes; }
+    uint64_t frames() { return _frames; }
+
+private:
+    BenchWire _request;
+    BenchWire _response;
+    unsigned long _silence;
+    uint64_t _lineBytes = 0;
+    uint64_t _frames = 0;
+
+    /**
+     * Longitud de la respuesta según su cabecera, o cero si aún no se puede saber.
+     */
+    static size_t expectedLength(const Frame &response)
+    {
+        if (response.size() < 3)
+        {
+            return 0;
+        }
+        if (response[1] & 0x80)
+        {
+            return 5;
+        }
+        return response[1] == FC_WRITE_MULTIPLE_REGISTERS ? 8 : (size_t)response[2] + 5;
+    }
+};
+
+static void fill(uint8_t pattern)
+{
+    for (int f = 0; f < BENCH_FILES; f++)
+    {
+        for (int i = 0; i < BENCH_FILE_BYTES; i++)
+        {
+            copy[f][i] = (uint8_t)(i * 7 + f * 31 + pattern);
+        }
+    }
+}
+
+struct FileMode
+{
+    const char *name;
+    bool isFileRecord;
+    bool isWrite;
+};
+
+/**
+ * Transfiere todos los archivos en el modo dado.
+ *
+ * @return El número de bytes transferidos que no coinciden o de respuestas erróneas.
+ */
+static long transfer(BenchFileMaster &master, const FileMode &mode)
+{
+    long errors = 0;
+    for (uint16_t f = 0; f < BENCH_FILES; f++)
+    {
+        uint16_t chunk = mode.isFileRecord ? BENCH_MAX_FILE_RECORDS : mode.isWrite ? BENCH_MAX_WRITE : BENCH_MAX_READ;
+        for (uint16_t record = 0; record < BENCH_RECORDS; record += chunk)
+        {
+            uint16_t length = min(BENCH_RECORDS - record, chunk);
+            uint8_t *data = copy[f] + record * 2;
+            // Con FC03/FC16 los archivos son registros holding consecutivos.
+            uint16_t address = f * BENCH_RECORDS + record;
+
+            Frame request = mode.isFileRecord ? fileRequest(mode.isWrite ? FC_WRITE_FILE_RECORD : FC_READ_FILE_RECORD, f + 1, record, length, mode.isWrite ? data : NULL)
+                            : mode.isWrite    ? writeRequest(address, length, data)
+                                              : benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, length);
+            Frame response = master.transact(request);
+            if (!benchCheckCRC(response) || response[1] != request[1])
+            {
+                errors++;
+                continue;
+            }
+
+            if (!mode.isWrite)
+            {
+                // FC20: 1 x Bytes, 1 x Length, 1 x Reference; FC03: 1 x Bytes.
+                memcpy(data, response.data() + (mode.isFileRecord ? 5 : 3), length * 2);
+            }
+        }
+    }
+    return errors;
+}
+
+int runFileBenchmark(int argc, char **argv)
+{
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.setFileProvider(&provider);
+
+    unsigned long baudRates[] = {9600, 19200, 38400, 115200};
+    FileMode modes[] = {
+        {"FC03", false, false},
+        {"FC20", true, false},
+        {"FC16", false, true},
+        {"FC21", true, true},
+    };
+
+    printf("%zu files of %d bytes\n", (size_t)BENCH_FILES, BENCH_FILE_BYTES);
+    printf("%-8s %-6s %10s %12s %12s %10s %8s\n", "baud", "mode", "frames", "payload B/s", "line B", "efficiency", "errors");
+
+    for (size_t b = 0; b < sizeof(baudRates) / sizeof(baudRates[0]); b++)
+    {
+        slave.begin(baudRates[b]);
+        hostAdvanceMicros(100000);
+
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+        {
+            FileMode &mode = modes[m];
+
+            // La lectura parte de los archivos del esclavo; la escritura, de la copia del maestro.
+            fill(m);
+            if (!mode.isWrite)
+            {
+                memcpy(files, copy, sizeof(files));
+                memset(copy, 0, sizeof(copy));
+            }
+            else
+            {
+                memset(files, 0, sizeof(files));
+            }
+
+            BenchFileMaster master(baudRates[b]);
+            unsigned long start = micros();
+            long errors = transfer(master, mode);
+            unsigned long elapsed = micros() - start;
+            errors += memcmp(files, copy, sizeof(files)) != 0;
+
+            double payload = sizeof(files);
+            printf("%-8lu %-6s %10lu %12.0f %12lu %9.1f%% %8ld\n",
+                   baudRates[b], mode.name, (unsigned long)master.frames(), payload * 1e6 / elapsed,
+                   (unsigned long)master.lineBytes(), 100.0 * payload / master.lineBytes(), errors);
+        }
+    }
+
+    // Un archivo inexistente y una lectura que no cabe en una trama responden con una excepción.
+    BenchFileMaster master(115200);
+    Frame missing = master.transact(fileRequest(FC_READ_FILE_RECORD, BENCH_FILES + 1, 0, 10, NULL));
+    Frame tooLarge = master.transact(fileRequest(FC_READ_FILE_RECORD, 1, 0, BENCH_MAX_FILE_RECORDS + 1, NULL));
+    printf("missing file: exception %d, oversized read: exception %d\n",
+           missing[1] & 0x80 ? missing[2] : 0, tooLarge[1] & 0x80 ? tooLarge[2] : 0);
+    return 0;
+}
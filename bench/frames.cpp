@@ -0,0 +1,85 @@
+#include "bench.h"
+
+uint16_t benchCRC(const uint8_t *buffer, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= buffer[i];
+        for (int j = 0; j < 8; j++)
+        {
+            crc = (crc & 0x0001) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+void benchAppendCRC(Frame &frame)
+{
+    uint16_t crc = benchCRC(frame.data(), frame.size());
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+}
+
+bool benchCheckCRC(const Frame &frame)
+{
+    if (frame.size() < 4)
+    {
+        return false;
+    }
+    uint16_t crc = benchCRC(frame.data(), frame.size() - 2);
+    return frame[frame.size() - 2] == (crc & 0xFF) && frame[frame.size() - 1] == (crc >> 8);
+}
+
+Frame benchReadRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t length)
+{
+    Frame frame = {unitAddress, functionCode,
+                   (uint8_t)(address >> 8), (uint8_t)(address & 0xFF),
+                   (uint8_t)(length >> 8), (uint8_t)(length & 0xFF)};
+    benchAppendCRC(frame);
+    return frame;
+}
+
+Frame benchWriteSingleRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t value)
+{
+    // FC05 y FC06 comparten formato (dirección, valor).
+    return benchReadRequest(unitAddress, functionCode, address, value);
+}
+
+Frame benchWriteMultipleRequest(uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t length)
+{
+    uint8_t byteCount = functionCode == FC_WRITE_MULTIPLE_COILS ? (length + 7) / 8 : length * 2;
+    Frame frame = {unitAddress, functionCode,
+                   (uint8_t)(address >> 8), (uint8_t)(address & 0xFF),
+                   (uint8_t)(length >> 8), (uint8_t)(length & 0xFF),
+                   byteCount};
+    for (uint8_t i = 0; i < byteCount; i++)
+    {
+        frame.push_back((uint8_t)(i * 37 + 11));
+    }
+    benchAppendCRC(frame);
+    return frame;
+}
+
+int benchTransact(Modbus &slave, MockStream &stream, const Frame &request, unsigned long silenceInMicroSecond)
+{
+    int polls = 0;
+    uint64_t written = stream.totalBytesWritten();
+
+    stream.inject(request.data(), request.size());
+    slave.poll();
+    polls++;
+
+    // Silencio de fin de trama; después poll() procesa, transmite y libera el bus.
+    for (int i = 0; i < 8; i++)
+    {
+        hostAdvanceMicros(silenceInMicroSecond);
+        slave.poll();
+        polls++;
+        if (stream.totalBytesWritten() != written && slave.isIdle())
+        {
+            break;
+        }
+    }
+    return polls;
+}
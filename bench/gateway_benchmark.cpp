@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <ModbusTcpGateway.h>
+#include <LinuxSerialStream.h>
+#include "bench.h"
+
+/**
+ * Rendimiento de ModbusTcpGateway en loopback: los clientes TCP leen registros a
+ * través de la pasarela, que los reenvía por un pseudoterminal a un esclavo RTU
+ * simulado (unidades 2 y 3) en otro hilo. La unidad 4 no existe y agota su tiempo
+ * de espera. Cada escenario dura un tiempo fijo y compara las transacciones de los
+ * clientes (reparto por turnos) y las lecturas deduplicadas.
+ */
+
+#define BENCH_BAUDRATE 115200
+#define BENCH_REGISTERS 1024
+#define BENCH_READ_LENGTH 10
+#define BENCH_MISSING_UNIT 4
+#define BENCH_MISSING_UNIT_TIMEOUT 20000
+#define BENCH_MAX_CLIENTS 16
+
+static ModbusSlave rtuSlaves[] = {ModbusSlave(2), ModbusSlave(3)};
+static Modbus *rtu;
+static uint16_t registers[BENCH_REGISTERS];
+static volatile bool isSlaveRunning;
+static volatile bool isClientRunning;
+
+struct GatewayClient
+{
+    pthread_t thread;
+    uint16_t port;
+    int depth;
+    uint8_t unitAddress;
+    uint16_t firstAddress;
+    bool isSameAddress;
+    long transactions;
+    long errors;
+};
+
+struct GatewayScenario
+{
+    const char *name;
+    int numberOfClients;
+    int depth;
+    bool isSameAddress;
+    bool isMissingUnit;
+};
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        rtu->writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS]);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = rtu->readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static void *runSlave(void *argument)
+{
+    while (isSlaveRunning)
+    {
+        rtu->poll();
+    }
+    return NULL;
+}
+
+static bool readAll(int fd, uint8_t *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t received = recv(fd, buffer, length, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        buffer += received;
+        length -= received;
+    }
+    return true;
+}
+
+static int connectGateway(uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *runClient(void *argument)
+{
+    GatewayClient *client = (GatewayClient *)argument;
+
+    int fd = connectGateway(client->port);
+    if (fd < 0)
+    {
+        client->errors++;
+        return NULL;
+    }
+
+    uint16_t transactionId = 0;
+    uint8_t request[MODBUS_TCP_MBAP_SIZE + 5];
+    uint8_t response[MODBUS_TCP_MAX_ADU];
+    while (isClientRunning)
+    {
+        for (int i = 0; i < client->depth; i++)
+        {
+            uint16_t id = transactionId + i;
+            uint16_t address = client->isSameAddress ? 0 : (client->firstAddress + id * 7) % (BENCH_REGISTERS - BENCH_READ_LENGTH);
+            uint8_t adu[] = {(uint8_t)(id >> 8), (uint8_t)id, 0, 0, 0, 6, client->unitAddress,
+                             FC_READ_HOLDING_REGISTERS, (uint8_t)(address >> 8), (uint8_t)address, 0, BENCH_READ_LENGTH};
+            memcpy(request, adu, sizeof(request));
+            if (send(fd, request, sizeof(request), MSG_NOSIGNAL) != sizeof(request))
+            {
+                client->errors++;
+                close(fd);
+                return NULL;
+            }
+        }
+
+        // Las respuestas llegan en orden: la pasarela atiende en orden las solicitudes de cada cliente.
+        for (int i = 0; i < client->depth; i++)
+        {
+            uint16_t id = transactionId + i;
+            uint16_t address = client->isSameAddress ? 0 : (client->firstAddress + id * 7) % (BENCH_REGISTERS - BENCH_READ_LENGTH);
+            if (!readAll(fd, response, MODBUS_TCP_MBAP_SIZE) ||
+                !readAll(fd, response + MODBUS_TCP_MBAP_SIZE, word(response[4], response[5]) - 1))
+            {
+                client->errors++;
+                close(fd);
+                return NULL;
+            }
+
+            bool valid = word(response[0], response[1]) == id;
+            if (client->unitAddress == BENCH_MISSING_UNIT)
+            {
+                valid = valid && response[7] == (FC_READ_HOLDING_REGISTERS | 0x80) &&
+                        response[8] == STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+            }
+            else
+            {
+                valid = valid && response[7] == FC_READ_HOLDING_REGISTERS &&
+                        word(response[9], response[10]) == registers[address];
+            }
+            client->transactions++;
+            client->errors += !valid;
+        }
+        transactionId += client->depth;
+    }
+
+    close(fd);
+    return NULL;
+}
+
+/**
+ * Envía una ADU de FC03 (value es la cantidad) o FC06 (value es el valor) desde el hilo principal.
+ */
+static bool sendAdu(int fd, uint16_t id, uint8_t unitAddress, uint8_t functionCode, uint16_t address, uint16_t value)
+{
+    uint8_t adu[] = {highByte(id), lowByte(id), 0, 0, 0, 6, unitAddress, functionCode,
+                     highByte(address), lowByte(address), highByte(value), lowByte(value)};
+    return send(fd, adu, sizeof(adu), MSG_NOSIGNAL) == sizeof(adu);
+}
+
+/**
+ * Atiende la pasarela desde el hilo principal hasta que cada cliente de fds ha recibido
+ * sus counts ADU, o pasa un segundo. Las ADU de cada cliente quedan en orden de llegada.
+ */
+static bool receiveAdus(ModbusTcpGateway &gateway, const int *fds, const size_t *counts, std::vector<Frame> *adus, int numberOfClients)
+{
+    std::vector<Frame> buffers(numberOfClients);
+    uint64_t start = hostNanos();
+    bool isDone = false;
+    while (!isDone && hostNanos() - start < 1000000000ULL)
+    {
+        gateway.poll(1);
+        isDone = true;
+        for (int i = 0; i < numberOfClients; i++)
+        {
+            uint8_t data[MODBUS_TCP_MAX_ADU];
+            ssize_t received = recv(fds[i], data, sizeof(data), MSG_DONTWAIT);
+            if (received > 0)
+            {
+                buffers[i].insert(buffers[i].end(), data, data + received);
+            }
+            while (buffers[i].size() >= MODBUS_TCP_MBAP_SIZE &&
+                   buffers[i].size() >= (size_t)6 + word(buffers[i][4], buffers[i][5]))
+            {
+                size_t length = 6 + word(buffers[i][4], buffers[i][5]);
+                adus[i].push_back(Frame(buffers[i].begin(), buffers[i].begin() + length));
+                buffers[i].erase(buffers[i].begin(), buffers[i].begin() + length);
+            }
+            isDone = isDone && adus[i].size() >= counts[i];
+        }
+    }
+    return isDone;
+}
+
+/**
+ * Orden por cliente con lecturas deduplicadas. El cliente C ocupa el bus con una lectura,
+ * el cliente B deja en cola una lectura del registro X y el cliente A envía una escritura
+ * FC06 de X seguida de una lectura de X, idéntica a la de B. La de B va antes al bus por
+ * turno, así que la lectura de A no puede unirse a ella: A debe recibir sus respuestas en
+ * orden y leer el valor que acaba de escribir.
+ */
+static long checkOrdering(ModbusTcpGateway &gateway, int rounds)
+{
+    // Las conexiones ocupan los huecos en orden: B, A y C.
+    int fds[3];
+    for (int i = 0; i < 3; i++)
+    {
+        fds[i] = connectGateway(gateway.getPort());
+        for (int j = 0; j < 10; j++)
+        {
+            gateway.poll(1);
+        }
+    }
+    int b = fds[0], a = fds[1], c = fds[2];
+
+    long failures = 0;
+    const uint16_t address = 500;
+    for (int round = 0; round < rounds; round++)
+    {
+        uint16_t value = 1000 + round;
+        sendAdu(c, 1, 2, FC_READ_HOLDING_REGISTERS, 0, BENCH_READ_LENGTH);
+        for (int i = 0; i < 1000 && gateway.getQueueLength() < 1; i++)
+        {
+            gateway.poll(0);
+        }
+        sendAdu(b, 1, 2, FC_READ_HOLDING_REGISTERS, address, 1);
+        for (int i = 0; i < 1000 && gateway.getQueueLength() < 2; i++)
+        {
+            gateway.poll(0);
+        }
+        sendAdu(a, 1, 2, FC_WRITE_REGISTER, address, value);
+        sendAdu(a, 2, 2, FC_READ_HOLDING_REGISTERS, address, 1);
+
+        std::vector<Frame> adus[3];
+        const size_t counts[] = {1, 2, 1};
+        if (!receiveAdus(gateway, fds, counts, adus, 3))
+        {
+            failures++;
+            continue;
+        }
+        const Frame &write = adus[1][0];
+        const Frame &read = adus[1][1];
+        failures += word(write[0], write[1]) != 1 || write[7] != FC_WRITE_REGISTER;
+        failures += word(read[0], read[1]) != 2 || read[7] != FC_READ_HOLDING_REGISTERS || word(read[9], read[10]) != value;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        close(fds[i]);
+    }
+    return failures;
+}
+
+/**
+ * Respuestas RTU malformadas a través de una pasarela cuyo bus es un MockStream: una
+ * lectura válida, la misma cortada antes del CRC (el búfer aún guarda la anterior, con
+ * el mismo CRC) y una cabecera que anuncia 252 bytes. Las dos últimas deben llegar al
+ * cliente como la excepción 0x0B, nunca como datos.
+ */
+static long checkMalformedResponses()
+{
+    MockStream rogueStream(MODBUS_MAX_BUFFER);
+    ModbusTcpGateway rogue(rogueStream, BENCH_BAUDRATE);
+    if (!rogue.begin(0, "127.0.0.1"))
+    {
+        return 1;
+    }
+    int fd = connectGateway(rogue.getPort());
+
+    Frame valid;
+    valid.push_back(5);
+    valid.push_back(FC_READ_HOLDING_REGISTERS);
+    valid.push_back(BENCH_READ_LENGTH * 2);
+    for (int i = 0; i < BENCH_READ_LENGTH * 2; i++)
+    {
+        valid.push_back(i);
+    }
+    benchAppendCRC(valid);
+    Frame truncated(valid.begin(), valid.end() - 3);
+    Frame oversized(valid.begin(), valid.begin() + 2);
+    oversized.push_back(252);
+    oversized.resize(MODBUS_MAX_BUFFER + 8, 0x55);
+
+    const Frame *responses[] = {&valid, &truncated, &valid, &oversized, &valid};
+    const bool isValid[] = {true, false, true, false, true};
+    long failures = 0;
+    for (size_t r = 0; r < sizeof(responses) / sizeof(responses[0]); r++)
+    {
+        rogueStream.clearOutput();
+        sendAdu(fd, r, 5, FC_READ_HOLDING_REGISTERS, 0, BENCH_READ_LENGTH);
+        for (int i = 0; i < 1000 && rogueStream.output().size() < 8; i++)
+        {
+            rogue.poll(1);
+        }
+        rogueStream.inject(responses[r]->data(), responses[r]->size());
+
+        std::vector<Frame> adus;
+        const size_t count = 1;
+        if (!receiveAdus(rogue, &fd, &count, &adus, 1))
+        {
+            failures++;
+            continue;
+        }
+        const Frame &adu = adus[0];
+        if (isValid[r])
+        {
+            failures += adu.size() != MODBUS_TCP_MBAP_SIZE + 2 + BENCH_READ_LENGTH * 2 || adu[7] != FC_READ_HOLDING_REGISTERS ||
+                        memcmp(adu.data() + 9, valid.data() + 3, BENCH_READ_LENGTH * 2) != 0;
+        }
+        else
+        {
+            failures += adu.size() != MODBUS_TCP_MBAP_SIZE + 2 || adu[7] != (FC_READ_HOLDING_REGISTERS | 0x80) ||
+                        adu[8] != STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+        }
+    }
+    close(fd);
+    rogue.end();
+    return failures;
+}
+
+int runGatewayBenchmark(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+    hostUseManualClock(false);
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 3;
+    }
+
+    LinuxSerialStream masterStream;
+    LinuxSerialStream slaveStream;
+    char slaveName[64];
+    if (!masterStream.beginPty(slaveName, sizeof(slaveName)) || !slaveStream.begin(slaveName, BENCH_BAUDRATE))
+    {
+        perror("pty");
+        return 1;
+    }
+
+    // El esclavo RTU simulado, en su propio hilo.
+    rtu = new Modbus(slaveStream, rtuSlaves, 2);
+    rtuSlaves[0].cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    rtuSlaves[1].cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    rtuSlaves[0].cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    rtu->begin(BENCH_BAUDRATE);
+    isSlaveRunning = true;
+    pthread_t slaveThread;
+    pthread_create(&slaveThread, NULL, runSlave, NULL);
+
+    ModbusTcpGateway gateway(masterStream, BENCH_BAUDRATE, masterStream.getFd());
+    gateway.setUnitTimeout(BENCH_MISSING_UNIT, BENCH_MISSING_UNIT_TIMEOUT);
+    if (!gateway.begin(0, "127.0.0.1"))
+    {
+        perror("begin");
+        return 1;
+    }
+
+    GatewayScenario scenarios[] = {
+        {"single", 1, 1, false, false},
+        {"pipelined", 1, 4, false, false},
+        {"fair", 8, 4, false, false},
+        {"same-read", 8, 4, true, false},
+        {"timeouts", 8, 4, false, true},
+    };
+
+    printf("%-10s %7s %5s %9s %9s %8s %8s %8s %8s %6s\n",
+           "scenario", "clients", "depth", "trans/s", "bus/s", "dedup", "timeouts", "min", "max", "errors");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        GatewayScenario &scenario = scenarios[s];
+        GatewayClient clients[BENCH_MAX_CLIENTS];
+        uint64_t busTransactions = gateway.getTotalBusTransactions();
+        uint64_t deduplicated = gateway.getTotalDeduplicated();
+        uint64_t timeouts = gateway.getTotalTimeouts();
+
+        isClientRunning = true;
+        for (int i = 0; i < scenario.numberOfClients; i++)
+        {
+            GatewayClient &client = clients[i];
+            memset(&client, 0, sizeof(client));
+            client.port = gateway.getPort();
+            client.depth = scenario.depth;
+            client.isSameAddress = scenario.isSameAddress;
+            client.firstAddress = i * 97;
+            client.unitAddress = scenario.isMissingUnit && i == 0 ? BENCH_MISSING_UNIT : 2 + i % 2;
+            pthread_create(&client.thread, NULL, runClient, &client);
+        }
+
+        uint64_t start = hostNanos();
+        while (hostNanos() - start < seconds * 1e9)
+        {
+            gateway.poll(10);
+        }
+        isClientRunning = false;
+
+        // Atienda lo que queda en curso hasta que todos los clientes terminen.
+        bool isJoined[BENCH_MAX_CLIENTS] = {false};
+        int finished = 0;
+        while (finished < scenario.numberOfClients)
+        {
+            gateway.poll(1);
+            for (int i = 0; i < scenario.numberOfClients; i++)
+            {
+                if (!isJoined[i] && pthread_tryjoin_np(clients[i].thread, NULL) == 0)
+                {
+                    isJoined[i] = true;
+                    finished++;
+                }
+            }
+        }
+        double elapsed = (hostNanos() - start) / 1e9;
+
+        long total = 0, errors = 0, minimum = -1, maximum = 0;
+        for (int i = 0; i < scenario.numberOfClients; i++)
+        {
+            total += clients[i].transactions;
+            errors += clients[i].errors;
+            if (clients[i].unitAddress != BENCH_MISSING_UNIT)
+            {
+                minimum = minimum < 0 || clients[i].transactions < minimum ? clients[i].transactions : minimum;
+                maximum = clients[i].transactions > maximum ? clients[i].transactions : maximum;
+            }
+        }
+
+        printf("%-10s %7d %5d %9.0f %9.0f %8llu %8llu %8ld %8ld %6ld\n",
+               scenario.name, scenario.numberOfClients, scenario.depth,
+               total / elapsed, (gateway.getTotalBusTransactions() - busTransactions) / elapsed,
+               (unsigned long long)(gateway.getTotalDeduplicated() - deduplicated),
+               (unsigned long long)(gateway.getTotalTimeouts() - timeouts),
+               minimum, maximum, errors);
+    }
+
+    long ordering = checkOrdering(gateway, 50);
+    printf("per-client order: %ld failures (FC06 then FC03 of the same register behind another client's read)\n", ordering);
+
+    gateway.end();
+    isSlaveRunning = false;
+    pthread_join(slaveThread, NULL);
+
+    long malformed = checkMalformedResponses();
+    printf("malformed responses: %ld failures (truncated frame, byte count past the buffer)\n", malformed);
+    return ordering == 0 && malformed == 0 ? 0 : 1;
+}
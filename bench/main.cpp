@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * Pruebas de rendimiento de la biblioteca en el host.
+ *
+ *     pio run -e native && .pio/build/native/program <suite> [opciones]
+ */
+
+struct BenchSuite
+{
+    const char *name;
+    const char *description;
+    int (*run)(int argc, char **argv);
+};
+
+static const BenchSuite suites[] = {
+    {"poll", "Modbus::poll() throughput per function code and payload size [iterations]", runPollBenchmark},
+    {"tcp", "ModbusTcpServer loopback throughput per clients and pipeline depth [transactions]", runTcpBenchmark},
+    {"gateway", "ModbusTcpGateway over a pty to a simulated RTU slave: fairness, de-duplication, timeouts [seconds]", runGatewayBenchmark},
+    {"serial", "LinuxSerialStream end-to-end over a pty: round-trip latency [iterations] [baud]", runSerialBenchmark},
+    {"multiport", "ModbusMultiPort serving one engine on three ports: throughput, memory, per-port statistics [iterations]", runMultiPortBenchmark},
+    {"master", "ModbusMaster scan list against simulated slaves at line rate: coalescing, timeouts, retries [seconds]", runMasterBenchmark},
+    {"changes", "ModbusChangeTracker report-by-exception (FC 65) against an FC03 sweep at 9600 baud: bytes and line time [cycles]", runChangesBenchmark},
+    {"scatter", "FC_READ_SCATTER (FC 66) against one FC01..FC04 frame per block at 19200 baud: bytes, line time, limits [screens]", runScatterBenchmark},
+    {"file", "FC20/FC21 file records against FC03/FC16 at line rate: payload bytes per second per baud rate", runFileBenchmark},
+    {"replay", "ModbusCapture recording replayed through poll() at 1x..8x, comparing every transmitted byte [save <file> | <file> [speed]]", runReplayBenchmark},
+    {"resync", "Frame resynchronisation against silence framing on a link that stretches, bunches and adds noise [transactions]", runResyncBenchmark},
+    {"threads", "ModbusRegisterImage reads and ModbusWriteQueue writes against a pthread control loop: torn reads, lost writes [transactions]", runThreadsBenchmark},
+    {"duplex", "Full-duplex response queue against half-duplex polling with a pipelining master at 19200 and 115200 baud [transactions]", runDuplexBenchmark},
+    {"typed", "ModbusTypedMap against per-register conversion in the callback: correctness for every word order, ns per request [iterations]", runTypedBenchmark},
+    {"broadcast", "Broadcast FC16 to eight emulated units against eight unicast round trips at line rate [updates]", runBroadcastBenchmark},
+    {"persist", "ModbusPersistentRegisters on a counting mock EEPROM: coalescing, wear levelling, reload, power loss [bursts]", runPersistBenchmark},
+    {"cache", "Response cache for FC03/FC04: hits, expiry, per-range maxAge, invalidation, ns per repeated read [iterations]", runCacheBenchmark},
+    {"deferred", "STATUS_PENDING and completeResponse(): completion, expiry, late completion, BUSY on other transports [transactions]", runDeferredBenchmark},
+    {"service", "Modbus::service()/nextDeadline() under the manual clock: deadline per state, time budget, calls per transaction [transactions]", runServiceBenchmark},
+};
+
+static void usage(const char *program)
+{
+    printf("usage: %s <suite> [options]\n\n", program);
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+    {
+        printf("  %-10s %s\n", suites[i].name, suites[i].description);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = argc > 1 ? argv[1] : "poll";
+    for (size_t i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+    {
+        if (strcmp(name, suites[i].name) == 0)
+        {
+            return suites[i].run(argc - 1, argv + 1);
+        }
+    }
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ModbusMaster.h>
+#include "bench.h"
+
+/**
+ * ModbusMaster contra esclavos simulados en el mismo proceso, con el reloj manual y
+ * la línea a la velocidad del bus (BenchWire). Las unidades 2 y 3 responden desde un
+ * objeto Modbus; la unidad 4 no existe y agota su tiempo de espera. Cada escenario
+ * recorre la lista de sondeo durante un tiempo simulado y comprueba cada valor leído,
+ * las transacciones ahorradas al unir rangos y el mayor intervalo entre lecturas
+ * de una entrada frente a su periodo. Termina con error si algún valor leído no es
+ * correcto o, en una línea sin ruido, si una unidad presente falla.
+ */
+
+#define BENCH_MISSING_UNIT 4
+#define BENCH_STEP 10
+
+static MockStream masterStream(MODBUS_MAX_BUFFER);
+static MockStream slaveStream(MODBUS_MAX_BUFFER);
+static ModbusSlave slaves[] = {ModbusSlave(2), ModbusSlave(3)};
+static Modbus slave(slaveStream, slaves, 2);
+
+static ModbusScanEntry scanList[] = {
+    {2, FC_READ_HOLDING_REGISTERS, 0, 10, 100000},
+    {2, FC_READ_HOLDING_REGISTERS, 10, 10, 100000},
+    {2, FC_READ_HOLDING_REGISTERS, 15, 15, 200000},
+    {2, FC_READ_INPUT_REGISTERS, 0, 10, 50000},
+    {2, FC_READ_COILS, 0, 16, 100000},
+    {3, FC_READ_HOLDING_REGISTERS, 100, 10, 100000},
+    {3, FC_READ_HOLDING_REGISTERS, 110, 15, 100000},
+    {3, FC_READ_HOLDING_REGISTERS, 200, 10, 500000},
+    {3, FC_READ_DISCRETE_INPUT, 0, 32, 100000},
+    {3, FC_READ_DISCRETE_INPUT, 32, 32, 100000},
+    {BENCH_MISSING_UNIT, FC_READ_HOLDING_REGISTERS, 0, 10, 1000000},
+};
+#define BENCH_ENTRIES (sizeof(scanList) / sizeof(scanList[0]))
+
+static ModbusMaster *master;
+static unsigned long lastRead[BENCH_ENTRIES];
+static unsigned long maxInterval[BENCH_ENTRIES];
+static long mismatches;
+static long failures;
+static unsigned long startTime;
+
+static uint16_t registerValue(uint8_t unitAddress, uint8_t functionCode, uint16_t address)
+{
+    return (unitAddress << 12) ^ (functionCode << 10) ^ (address * 7);
+}
+
+static bool coilValue(uint8_t unitAddress, uint16_t address)
+{
+    return ((address * unitAddress) >> 1) & 1;
+}
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registerValue(slave.readUnitAddress(), fc, address + i));
+    }
+    return STATUS_OK;
+}
+
+static uint8_t readCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeCoilToBuffer(i, coilValue(slave.readUnitAddress(), address + i));
+    }
+    return STATUS_OK;
+}
+
+static void entryRead(ModbusScanEntry &entry, uint8_t status)
+{
+    size_t index = &entry - scanList;
+    if (status != STATUS_OK)
+    {
+        failures += entry.unitAddress != BENCH_MISSING_UNIT;
+        return;
+    }
+
+    for (uint16_t i = 0; i < entry.length; i++)
+    {
+        bool isValid = entry.functionCode <= FC_READ_DISCRETE_INPUT
+                           ? master->readCoilFromResponse(i) == coilValue(entry.unitAddress, entry.address + i)
+                           : master->readRegisterFromResponse(i) == registerValue(entry.unitAddress, entry.functionCode, entry.address + i);
+        mismatches += !isValid;
+    }
+
+    // El primer segundo incluye los reintentos iniciales con la unidad ausente.
+    unsigned long now = micros();
+    if (lastRead[index] != 0 && now - startTime > 1000000 && now - lastRead[index] > maxInterval[index])
+    {
+        maxInterval[index] = now - lastRead[index];
+    }
+    lastRead[index] = now;
+}
+
+static ModbusScanEntry rogueList[] = {{5, FC_READ_HOLDING_REGISTERS, 0, 10, 100000}};
+static int rogueStatus;
+
+static void rogueRead(ModbusScanEntry &entry, uint8_t status)
+{
+    rogueStatus = status;
+}
+
+/**
+ * Espera la siguiente solicitud del maestro, le responde con response de golpe y
+ * devuelve el estado entregado a la devolución de llamada (o -1 si no llega).
+ */
+static int rogueTransaction(ModbusMaster &rogue, MockStream &stream, const Frame &response)
+{
+    rogueStatus = -1;
+    stream.clearOutput();
+    for (unsigned long elapsed = 0; elapsed < 1000000 && rogueStatus < 0; elapsed += BENCH_STEP)
+    {
+        rogue.poll();
+        if (stream.output().size() == 8)
+        {
+            stream.clearOutput();
+            stream.inject(response.data(), response.size());
+        }
+        hostAdvanceMicros(BENCH_STEP);
+    }
+    return rogueStatus;
+}
+
+/**
+ * Respuestas malformadas de una unidad: una respuesta válida, la misma cortada antes
+ * del CRC (el búfer aún guarda la anterior, con el mismo CRC) y una cabecera que
+ * anuncia 252 bytes, más de los que caben en el búfer. Sólo la primera es válida.
+ */
+static long checkMalformedResponses()
+{
+    MockStream stream(MODBUS_MAX_BUFFER);
+    ModbusMaster rogue(stream, rogueList, 1);
+    rogue.setCallback(rogueRead);
+    rogue.setRetries(0);
+    rogue.begin(19200);
+
+    Frame valid;
+    valid.push_back(5);
+    valid.push_back(FC_READ_HOLDING_REGISTERS);
+    valid.push_back(20);
+    for (int i = 0; i < 20; i++)
+    {
+        valid.push_back(i);
+    }
+    benchAppendCRC(valid);
+    Frame truncated(valid.begin(), valid.end() - 3);
+    Frame oversized(valid.begin(), valid.begin() + 2);
+    oversized.push_back(252);
+    oversized.resize(MODBUS_MAX_BUFFER + 8, 0x55);
+
+    long failures = 0;
+    failures += rogueTransaction(rogue, stream, valid) != STATUS_OK;
+    failures += rogueTransaction(rogue, stream, truncated) != STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+    failures += rogueTransaction(rogue, stream, valid) != STATUS_OK;
+    failures += rogueTransaction(rogue, stream, oversized) != STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+    failures += rogueTransaction(rogue, stream, valid) != STATUS_OK;
+    return failures;
+}
+
+struct MasterScenario
+{
+    const char *name;
+    unsigned long baudRate;
+    long corruptionRate;
+};
+
+int runMasterBenchmark(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 10.0;
+
+    hostUseManualClock(true);
+    for (int i = 0; i < 2; i++)
+    {
+        slaves[i].cbVector[CB_READ_COILS] = readCoils;
+        slaves[i].cbVector[CB_READ_DISCRETE_INPUTS] = readCoils;
+        slaves[i].cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+        slaves[i].cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+    }
+
+    MasterScenario scenarios[] = {
+        {"19200", 19200, 0},
+        {"115200", 115200, 0},
+        {"noisy", 19200, 500},
+    };
+
+    // Lecturas que pide la lista si el bus diera abasto.
+    double wanted = 0;
+    for (size_t i = 0; i < BENCH_ENTRIES; i++)
+    {
+        wanted += seconds * 1e6 / scanList[i].period;
+    }
+
+    long totalFailures = 0;
+    printf("%-8s %8s %8s %8s %10s %8s %8s %8s %9s %9s %8s\n",
+           "scenario", "bus", "wanted", "reads", "reads/bus", "timeouts", "retries", "errors", "max late", "mismatch", "failures");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        MasterScenario &scenario = scenarios[s];
+        hostSetMicros(1000000);
+        startTime = micros();
+        mismatches = 0;
+        failures = 0;
+        for (size_t i = 0; i < BENCH_ENTRIES; i++)
+        {
+            lastRead[i] = 0;
+            maxInterval[i] = 0;
+        }
+
+        ModbusMaster bench(masterStream, scanList, BENCH_ENTRIES);
+        master = &bench;
+        bench.setCallback(entryRead);
+        bench.setUnitTimeout(BENCH_MISSING_UNIT, 50000);
+        if (!bench.begin(scenario.baudRate))
+        {
+            printf("invalid scan list\n");
+            return 1;
+        }
+        slave.begin(scenario.baudRate);
+
+        BenchWire request(masterStream, slaveStream, scenario.baudRate);
+        BenchWire response(slaveStream, masterStream, scenario.baudRate);
+        request.setCorruptionRate(scenario.corruptionRate);
+        response.setCorruptionRate(scenario.corruptionRate);
+
+        unsigned long duration = seconds * 1e6;
+        for (unsigned long elapsed = 0; elapsed < duration; elapsed += BENCH_STEP)
+        {
+            bench.poll();
+            request.transfer();
+            slave.poll();
+            response.transfer();
+            hostAdvanceMicros(BENCH_STEP);
+        }
+
+        // El mayor intervalo entre lecturas de una entrada, en periodos.
+        double maxLate = 0;
+        for (size_t i = 0; i < BENCH_ENTRIES; i++)
+        {
+            if (scanList[i].unitAddress != BENCH_MISSING_UNIT && maxInterval[i] > 0)
+            {
+                double late = (double)maxInterval[i] / scanList[i].period;
+                maxLate = late > maxLate ? late : maxLate;
+            }
+        }
+
+        uint32_t timeouts = 0, retries = 0, errors = 0;
+        for (uint8_t unitAddress = 2; unitAddress <= BENCH_MISSING_UNIT; unitAddress++)
+        {
+            ModbusMasterUnit *unit = bench.getUnit(unitAddress);
+            timeouts += unit->timeouts;
+            retries += unit->retransmissions;
+            errors += unit->errors;
+        }
+
+        printf("%-8s %8lu %8.0f %8lu %10.2f %8lu %8lu %8lu %9.2f %9ld %8ld\n",
+               scenario.name, (unsigned long)bench.getTotalTransactions(), wanted, (unsigned long)bench.getTotalEntryReads(),
+               (double)bench.getTotalEntryReads() / bench.getTotalTransactions(),
+               (unsigned long)timeouts, (unsigned long)retries, (unsigned long)errors, maxLate, mismatches, failures);
+
+        // Con ruido, una entrada puede agotar sus reintentos; un valor erróneo nunca es aceptable.
+        totalFailures += mismatches + (scenario.corruptionRate == 0 ? failures + errors : 0);
+    }
+
+    long malformed = checkMalformedResponses();
+    printf("malformed responses: %ld failures (truncated frame, byte count past the buffer)\n", malformed);
+    return totalFailures == 0 && malformed == 0 ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Rendimiento de ModbusMultiPort con el reloj manual: la misma solicitud llega a la
+ * vez por tres MockStream (uno con búfer completo y dos con búfer de 64 bytes) y
+ * ModbusMultiPort::poll() las atiende con un único motor Modbus. Compara también la
+ * memoria con tres objetos Modbus independientes.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_BAUDRATE 115200
+#define BENCH_REGISTERS 1024
+#define BENCH_PORTS 3
+#define BENCH_SMALL_BUFFER 64
+
+static MockStream streams[BENCH_PORTS] = {MockStream(MODBUS_MAX_BUFFER), MockStream(MODBUS_MAX_BUFFER), MockStream(MODBUS_MAX_BUFFER)};
+static uint8_t largeBuffer[MODBUS_MAX_BUFFER];
+static uint8_t smallBuffers[BENCH_PORTS - 1][BENCH_SMALL_BUFFER];
+static ModbusPort ports[BENCH_PORTS] = {
+    ModbusPort(streams[0], largeBuffer, sizeof(largeBuffer)),
+    ModbusPort(streams[1], smallBuffers[0], BENCH_SMALL_BUFFER),
+    ModbusPort(streams[2], smallBuffers[1], BENCH_SMALL_BUFFER),
+};
+static MockStream engineStream(MODBUS_MAX_BUFFER);
+static Modbus slave(engineStream, BENCH_UNIT_ADDRESS);
+static ModbusMultiPort multiPort(slave, ports, BENCH_PORTS);
+static uint16_t registers[BENCH_REGISTERS];
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS]);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+struct MultiPortScenario
+{
+    const char *name;
+    Frame request;
+    bool isSmallBufferException;
+};
+
+/**
+ * Entrega la solicitud a todos los puertos a la vez y atiende hasta que todos han respondido.
+ *
+ * @return El número de llamadas a poll() realizadas.
+ */
+static int transact(const Frame &request, unsigned long silence)
+{
+    int polls = 0;
+    for (int i = 0; i < BENCH_PORTS; i++)
+    {
+        streams[i].clearOutput();
+        streams[i].inject(request.data(), request.size());
+    }
+    multiPort.poll();
+    polls++;
+
+    for (int i = 0; i < 8; i++)
+    {
+        hostAdvanceMicros(silence);
+        multiPort.poll();
+        polls++;
+
+        bool isDone = true;
+        for (int j = 0; j < BENCH_PORTS; j++)
+        {
+            isDone = isDone && ports[j].isIdle() && !streams[j].output().empty();
+        }
+        if (isDone)
+        {
+            break;
+        }
+    }
+    return polls;
+}
+
+int runMultiPortBenchmark(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    multiPort.begin(BENCH_BAUDRATE);
+
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    printf("memory: 3 x Modbus %zu bytes, Modbus + 3 x ModbusPort + buffers %zu bytes\n",
+           3 * sizeof(Modbus),
+           sizeof(Modbus) + sizeof(ModbusMultiPort) + BENCH_PORTS * sizeof(ModbusPort) +
+               sizeof(largeBuffer) + sizeof(smallBuffers));
+
+    MultiPortScenario scenarios[] = {
+        {"FC03 x10", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 10), false},
+        {"FC16 x10", benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, 10), false},
+        {"FC03 x60", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 60), true},
+    };
+
+    printf("%-10s %12s %10s %6s %8s\n", "scenario", "trans/s", "ns/trans", "polls", "valid");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        MultiPortScenario &scenario = scenarios[s];
+
+        // Una transacción de comprobación en cada puerto.
+        transact(scenario.request, silence);
+        int valid = 0;
+        for (int i = 0; i < BENCH_PORTS; i++)
+        {
+            const Frame &response = streams[i].output();
+            bool isException = i > 0 && scenario.isSmallBufferException;
+            valid += benchCheckCRC(response) && response[0] == BENCH_UNIT_ADDRESS &&
+                     (isException ? response[1] == (scenario.request[1] | 0x80) && response[2] == STATUS_ILLEGAL_DATA_VALUE
+                                  : response[1] == scenario.request[1]);
+        }
+
+        uint64_t polls = 0;
+        uint64_t start = hostCpuNanos();
+        for (long i = 0; i < iterations; i++)
+        {
+            polls += transact(scenario.request, silence);
+        }
+        uint64_t elapsed = hostCpuNanos() - start;
+
+        double perTransaction = (double)elapsed / (iterations * BENCH_PORTS);
+        printf("%-10s %12.0f %10.0f %6.1f %6d/%d\n",
+               scenario.name, 1e9 / perTransaction, perTransaction,
+               (double)polls / iterations, valid, BENCH_PORTS);
+    }
+
+    // Una trama corrupta y una solicitud más larga que el búfer pequeño.
+    Frame corrupted = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 10);
+    corrupted[3] ^= 0xFF;
+    streams[0].inject(corrupted.data(), corrupted.size());
+    multiPort.poll();
+    hostAdvanceMicros(silence);
+    multiPort.poll();
+    Frame longRequest = benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, 40);
+    streams[1].inject(longRequest.data(), longRequest.size());
+    multiPort.poll();
+    hostAdvanceMicros(silence);
+    multiPort.poll();
+
+    printf("\n%-5s %10s %10s %10s %10s %12s %12s\n", "port", "requests", "responses", "crc", "overruns", "rx bytes", "tx bytes");
+    for (int i = 0; i < BENCH_PORTS; i++)
+    {
+        ModbusPortStatistics &statistics = ports[i].getStatistics();
+        printf("%-5d %10lu %10lu %10lu %10lu %12lu %12lu\n", i,
+               (unsigned long)statistics.requests, (unsigned long)statistics.responses,
+               (unsigned long)statistics.crcErrors, (unsigned long)statistics.overruns,
+               (unsigned long)statistics.bytesReceived, (unsigned long)statistics.bytesSent);
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * ModbusPersistentRegisters contra una EEPROM simulada que cuenta las escrituras de
+ * cada celda. Un maestro envía ráfagas de FC16 sobre 10 registros; se compara guardar
+ * cada registro en el manejador (una celda fija por registro) con la escritura diferida
+ * de flush() y 2, 4 u 8 ranuras. Comprueba que las escrituras repetidas se agrupan,
+ * el reparto de escrituras entre ranuras, la recarga tras begin() y un corte de energía
+ * entre el valor y su byte de estado.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_FIRST_ADDRESS 100
+#define BENCH_REGISTERS 10
+#define BENCH_EEPROM_ADDRESS 16
+#define BENCH_EEPROM_SIZE 1024
+#define BENCH_BURST 5
+#define BENCH_WRITE_MILLISECONDS 3.3
+
+/**
+ * EEPROM en RAM, borrada a 0xFF, que cuenta las escrituras de cada celda. Tras
+ * cutPowerAfter(n) sólo llegan n escrituras más, como si la alimentación cayera.
+ */
+class CountingEeprom : public ModbusEeprom
+{
+public:
+    CountingEeprom() { erase(); }
+
+    uint8_t read(uint16_t address) { return _cells[address % BENCH_EEPROM_SIZE]; }
+
+    void write(uint16_t address, uint8_t value)
+    {
+        if (_writesLeft == 0)
+        {
+            return;
+        }
+        _writesLeft -= _writesLeft > 0;
+        _cells[address % BENCH_EEPROM_SIZE] = value;
+        _writes[address % BENCH_EEPROM_SIZE]++;
+    }
+
+    void erase()
+    {
+        memset(_cells, 0xFF, sizeof(_cells));
+        memset(_writes, 0, sizeof(_writes));
+        _writesLeft = -1;
+    }
+
+    void cutPowerAfter(long writes) { _writesLeft = writes; }
+    void restorePower() { _writesLeft = -1; }
+    uint32_t writes(uint16_t address) { return _writes[address % BENCH_EEPROM_SIZE]; }
+
+    uint64_t totalWrites()
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < BENCH_EEPROM_SIZE; i++)
+        {
+            total += _writes[i];
+        }
+        return total;
+    }
+
+    uint32_t hottestCell()
+    {
+        uint32_t hottest = 0;
+        for (int i = 0; i < BENCH_EEPROM_SIZE; i++)
+        {
+            hottest = _writes[i] > hottest ? _writes[i] : hottest;
+        }
+        return hottest;
+    }
+
+private:
+    uint8_t _cells[BENCH_EEPROM_SIZE];
+    uint32_t _writes[BENCH_EEPROM_SIZE];
+    long _writesLeft;
+};
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static CountingEeprom eeprom;
+static uint16_t values[BENCH_REGISTERS];
+static uint8_t dirty[MODBUS_DIRTY_BITMAP_SIZE(BENCH_REGISTERS)];
+static ModbusPersistentRegisters *persistent;
+static uint32_t handlerWrites;
+static uint32_t maxHandlerWrites;
+
+/**
+ * Referencia: el manejador guarda cada registro en su celda fija, sólo los bytes que cambian.
+ */
+static uint8_t writeThrough(uint8_t fc, uint16_t address, uint16_t length)
+{
+    uint64_t before = eeprom.totalWrites();
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t cell = BENCH_EEPROM_ADDRESS + (address - BENCH_FIRST_ADDRESS + i) * 2;
+        uint16_t value = slave.readRegisterFromBuffer(i);
+        if (eeprom.read(cell) != highByte(value))
+        {
+            eeprom.write(cell, highByte(value));
+        }
+        if (eeprom.read(cell + 1) != lowByte(value))
+        {
+            eeprom.write(cell + 1, lowByte(value));
+        }
+    }
+    handlerWrites = eeprom.totalWrites() - before;
+    return STATUS_OK;
+}
+
+static uint8_t writeBehind(uint8_t fc, uint16_t address, uint16_t length)
+{
+    uint64_t before = eeprom.totalWrites();
+    uint8_t status = persistent->writeFromBuffer(slave, address, length);
+    handlerWrites = eeprom.totalWrites() - before;
+    return status;
+}
+
+static Frame updateRequest(long update)
+{
+    Frame request = benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, BENCH_FIRST_ADDRESS, BENCH_REGISTERS);
+    for (int i = 0; i < BENCH_REGISTERS; i++)
+    {
+        uint16_t value = update * 31 + i;
+        request[7 + i * 2] = highByte(value);
+        request[8 + i * 2] = lowByte(value);
+    }
+    request.resize(request.size() - 2);
+    benchAppendCRC(request);
+    return request;
+}
+
+/**
+ * Aplica un valor a un registro y lo guarda con flush().
+ */
+static void store(ModbusPersistentRegisters &registers, uint16_t address, uint16_t value)
+{
+    registers.set(address, value);
+    while (registers.flush())
+    {
+    }
+}
+
+/**
+ * Vuelve a cargar la EEPROM en una copia nueva, como tras un reinicio, y lee un registro.
+ */
+static uint16_t reload(uint8_t numberOfSlots, uint16_t address)
+{
+    uint16_t reloaded[BENCH_REGISTERS];
+    uint8_t reloadedDirty[MODBUS_DIRTY_BITMAP_SIZE(BENCH_REGISTERS)];
+    ModbusPersistentRegisters registers(eeprom, BENCH_EEPROM_ADDRESS, numberOfSlots, reloaded, reloadedDirty,
+                                        BENCH_FIRST_ADDRESS, BENCH_REGISTERS);
+    registers.begin();
+    return registers.get(address);
+}
+
+static long checkPersistence(unsigned long silence)
+{
+    long failures = 0;
+    const uint8_t slots = 4;
+    ModbusPersistentRegisters registers(eeprom, BENCH_EEPROM_ADDRESS, slots, values, dirty, BENCH_FIRST_ADDRESS, BENCH_REGISTERS);
+    persistent = &registers;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeBehind;
+
+    // Cinco escrituras FC06 del mismo registro sin flush() intermedio: un solo guardado de 3 bytes como máximo.
+    eeprom.erase();
+    registers.begin();
+    for (uint16_t value = 1; value <= 5; value++)
+    {
+        stream.clearOutput();
+        benchTransact(slave, stream, benchWriteSingleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_REGISTER, BENCH_FIRST_ADDRESS, value), silence);
+        failures += stream.output().size() != 8 || handlerWrites != 0;
+    }
+    failures += !registers.isDirty() || eeprom.totalWrites() != 0;
+    while (registers.flush())
+    {
+    }
+    failures += registers.isDirty() || eeprom.totalWrites() == 0 || eeprom.totalWrites() > 3;
+    failures += reload(slots, BENCH_FIRST_ADDRESS) != 5;
+
+    // Volver a escribir el valor guardado no gasta escrituras.
+    uint64_t before = eeprom.totalWrites();
+    registers.set(BENCH_FIRST_ADDRESS, 6);
+    registers.set(BENCH_FIRST_ADDRESS, 5);
+    registers.flush();
+    failures += eeprom.totalWrites() != before;
+
+    // 1000 valores guardados uno a uno: cada byte de estado recibe 1000 / slots escrituras, y ninguna celda más.
+    eeprom.erase();
+    registers.begin();
+    const long updates = 1000;
+    for (long update = 0; update < updates; update++)
+    {
+        store(registers, BENCH_FIRST_ADDRESS + 3, update * 257 + 1);
+    }
+    for (uint8_t slot = 0; slot < slots; slot++)
+    {
+        uint16_t statusCell = BENCH_EEPROM_ADDRESS + 3 * slots * 3 + slots * 2 + slot;
+        failures += eeprom.writes(statusCell) != updates / slots;
+    }
+    failures += eeprom.hottestCell() > updates / slots;
+    failures += reload(slots, BENCH_FIRST_ADDRESS + 3) != (uint16_t)((updates - 1) * 257 + 1);
+
+    // Corte de energía tras 0, 1 o 2 escrituras: el valor (o parte) llega, su byte de estado no.
+    for (long cut = 0; cut <= 2; cut++)
+    {
+        uint16_t previous = reload(slots, BENCH_FIRST_ADDRESS + 3);
+        eeprom.cutPowerAfter(cut);
+        store(registers, BENCH_FIRST_ADDRESS + 3, previous ^ 0xA5A5);
+        eeprom.restorePower();
+        failures += reload(slots, BENCH_FIRST_ADDRESS + 3) != previous;
+
+        // Tras reiniciar, el siguiente guardado ocupa la misma ranura y se recupera bien.
+        registers.begin();
+        store(registers, BENCH_FIRST_ADDRESS + 3, previous + 1);
+        failures += reload(slots, BENCH_FIRST_ADDRESS + 3) != (uint16_t)(previous + 1);
+    }
+    return failures;
+}
+
+struct PersistMode
+{
+    const char *name;
+    bool isWriteBehind;
+    uint8_t numberOfSlots;
+};
+
+int runPersistBenchmark(int argc, char **argv)
+{
+    long bursts = argc > 1 ? atol(argv[1]) : 200;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.begin(115200);
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    long failures = checkPersistence(silence);
+    printf("persistence check: %ld failures (coalescing, slot rotation, reload, power loss)\n", failures);
+
+    PersistMode modes[] = {
+        {"through", false, 1},
+        {"behind", true, 2},
+        {"behind", true, 4},
+        {"behind", true, 8},
+    };
+
+    printf("%ld bursts of %d FC16 updates of %d registers, flush() in the idle time after each burst\n",
+           bursts, BENCH_BURST, BENCH_REGISTERS);
+    printf("%-8s %6s %12s %12s %12s %14s\n", "mode", "slots", "byte writes", "per update", "hottest cell", "handler ms max");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        eeprom.erase();
+        ModbusPersistentRegisters registers(eeprom, BENCH_EEPROM_ADDRESS, modes[m].numberOfSlots, values, dirty,
+                                            BENCH_FIRST_ADDRESS, BENCH_REGISTERS);
+        registers.begin();
+        persistent = &registers;
+        slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = modes[m].isWriteBehind ? writeBehind : writeThrough;
+        maxHandlerWrites = 0;
+
+        long update = 0;
+        for (long burst = 0; burst < bursts; burst++)
+        {
+            for (int i = 0; i < BENCH_BURST; i++)
+            {
+                stream.clearOutput();
+                benchTransact(slave, stream, updateRequest(update++), silence);
+                failures += stream.output().size() != 8;
+                maxHandlerWrites = handlerWrites > maxHandlerWrites ? handlerWrites : maxHandlerWrites;
+            }
+            while (registers.flush())
+            {
+            }
+        }
+
+        // Todos los modos deben recargar la última ráfaga.
+        if (modes[m].isWriteBehind)
+        {
+            for (int i = 0; i < BENCH_REGISTERS; i++)
+            {
+                failures += reload(modes[m].numberOfSlots, BENCH_FIRST_ADDRESS + i) != (uint16_t)((update - 1) * 31 + i);
+            }
+        }
+
+        uint64_t writes = eeprom.totalWrites();
+        printf("%-8s %6u %12llu %12.1f %12lu %14.1f\n", modes[m].name, modes[m].numberOfSlots,
+               (unsigned long long)writes, (double)writes / update, (unsigned long)eeprom.hottestCell(),
+               maxHandlerWrites * BENCH_WRITE_MILLISECONDS);
+    }
+    return failures == 0 ? 0 : 1;
+}
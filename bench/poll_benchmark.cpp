@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Rendimiento de Modbus::poll() con el reloj manual: cada trama se inyecta en un
+ * MockStream, se deja pasar el silencio de fin de trama y se espera la respuesta.
+ * El tiempo medido es tiempo de CPU del host; las fases salen de MODBUS_PROFILING.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_CONTROL_PIN 8
+#define BENCH_BAUDRATE 115200
+#define BENCH_REGISTERS 2048
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS, BENCH_CONTROL_PIN);
+static uint16_t registers[BENCH_REGISTERS];
+
+static uint8_t readCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeCoilToBuffer(i, registers[(address + i) % BENCH_REGISTERS] & 1);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS]);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = slave.readCoilFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+struct PollScenario
+{
+    const char *name;
+    Frame request;
+};
+
+int runPollBenchmark(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+
+    slave.cbVector[CB_READ_COILS] = readCoils;
+    slave.cbVector[CB_READ_DISCRETE_INPUTS] = readCoils;
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_COILS] = writeCoils;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.begin(BENCH_BAUDRATE);
+
+    // 1.5T a más de 19200 baudios es fijo (750 us); se avanza un poco más.
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    PollScenario scenarios[] = {
+        {"FC01 x8", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_COILS, 0, 8)},
+        {"FC01 x2000", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_COILS, 0, 2000)},
+        {"FC02 x64", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_DISCRETE_INPUT, 0, 64)},
+        {"FC03 x1", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 1)},
+        {"FC03 x10", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 10)},
+        {"FC03 x125", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 125)},
+        {"FC04 x10", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_INPUT_REGISTERS, 100, 10)},
+        {"FC04 x125", benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_INPUT_REGISTERS, 100, 125)},
+        {"FC05", benchWriteSingleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_COIL, 3, COIL_ON)},
+        {"FC06", benchWriteSingleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_REGISTER, 3, 0x1234)},
+        {"FC15 x64", benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_COILS, 0, 64)},
+        {"FC15 x1968", benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_COILS, 0, 1968)},
+        {"FC16 x10", benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, 10)},
+        {"FC16 x123", benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, 123)},
+    };
+
+    long failures = 0;
+    printf("%-12s %5s %5s %12s %10s %10s %10s %10s %10s %6s\n",
+           "scenario", "req", "resp", "frames/s", "ns/frame", "crc", "validate", "create", "write", "polls");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        PollScenario &scenario = scenarios[s];
+
+        // Una transacción de comprobación: la respuesta debe ser válida y no una excepción.
+        stream.clearOutput();
+        benchTransact(slave, stream, scenario.request, silence);
+        Frame response = stream.output();
+        bool valid = benchCheckCRC(response) && (response[1] & 0x80) == 0;
+        failures += !valid;
+
+        slave.resetProfile();
+        uint64_t polls = 0;
+        uint64_t start = hostCpuNanos();
+        for (long i = 0; i < iterations; i++)
+        {
+            stream.clearOutput();
+            polls += benchTransact(slave, stream, scenario.request, silence);
+        }
+        uint64_t elapsed = hostCpuNanos() - start;
+
+        ModbusProfile &profile = slave.getProfile();
+        double perFrame = (double)elapsed / iterations;
+        printf("%-12s %5zu %5zu %12.0f %10.0f %10.0f %10.0f %10.0f %10.0f %6.1f%s\n",
+               scenario.name, scenario.request.size(), response.size(),
+               1e9 / perFrame, perFrame,
+               (double)profile.validateCRCTime / iterations,
+               (double)profile.validateRequestTime / iterations,
+               (double)profile.createResponseTime / iterations,
+               (double)profile.writeResponseTime / iterations,
+               (double)polls / iterations,
+               valid ? "" : "  INVALID RESPONSE");
+    }
+
+    // Una cantidad fuera de 1..2000 (bobinas) o 1..125 (registros) se rechaza con la excepción 3.
+    Frame limits[] = {
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_COILS, 0, 0),
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_COILS, 0, 2001),
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_DISCRETE_INPUT, 0, 2048),
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 0),
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 126),
+        benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_INPUT_REGISTERS, 0, 128),
+    };
+    long limitFailures = 0;
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+    {
+        stream.clearOutput();
+        benchTransact(slave, stream, limits[i], silence);
+        Frame response = stream.output();
+        limitFailures += response.size() != 5 || !benchCheckCRC(response) || response[1] != (limits[i][1] | 0x80) ||
+                         response[2] != STATUS_ILLEGAL_DATA_VALUE;
+    }
+    printf("quantity limits: %ld failures (FC01..FC04 outside 1..2000 / 1..125)\n", limitFailures);
+    return failures == 0 && limitFailures == 0 ? 0 : 1;
+}
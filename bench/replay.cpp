@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include "bench.h"
+
+#define BENCH_REPLAY_HEADER_SIZE 9
+#define BENCH_REPLAY_RECORD_HEADER_SIZE 5
+#define BENCH_REPLAY_TRANSMIT 0x80
+#define BENCH_REPLAY_MAX_DATA 0x7F
+#define BENCH_REPLAY_TAIL 100000
+
+/**
+ * Carga una captura exportada con ModbusCapture::exportTo().
+ *
+ * @return Falso si el archivo no tiene el formato de captura.
+ */
+bool BenchReplay::load(const Frame &file)
+{
+    _records.clear();
+    if (file.size() < BENCH_REPLAY_HEADER_SIZE || file[0] != 'M' || file[1] != 'B' || file[2] != 'C' || file[3] != 'P' || file[4] != 1)
+    {
+        return false;
+    }
+    _baudRate = file[5] | (file[6] << 8) | (file[7] << 16) | ((uint32_t)file[8] << 24);
+
+    size_t index = BENCH_REPLAY_HEADER_SIZE;
+    while (index + BENCH_REPLAY_RECORD_HEADER_SIZE <= file.size())
+    {
+        BenchReplayRecord record;
+        record.time = file[index] | (file[index + 1] << 8) | (file[index + 2] << 16) | ((uint32_t)file[index + 3] << 24);
+        record.isTransmit = file[index + 4] & BENCH_REPLAY_TRANSMIT;
+        size_t length = file[index + 4] & BENCH_REPLAY_MAX_DATA;
+        index += BENCH_REPLAY_RECORD_HEADER_SIZE;
+        if (index + length > file.size())
+        {
+            return false;
+        }
+        record.data.assign(file.begin() + index, file.begin() + index + length);
+        index += length;
+        _records.push_back(record);
+    }
+    return !_records.empty();
+}
+
+bool BenchReplay::loadFile(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    Frame content;
+    uint8_t chunk[4096];
+    size_t length;
+    while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        content.insert(content.end(), chunk, chunk + length);
+    }
+    fclose(file);
+    return load(content);
+}
+
+/**
+ * Devuelve las direcciones de unidad que respondieron en la captura (primer byte de cada respuesta).
+ */
+std::vector<uint8_t> BenchReplay::respondingUnits()
+{
+    std::vector<uint8_t> units;
+    bool isFrameStart = true;
+    for (size_t i = 0; i < _records.size(); i++)
+    {
+        if (_records[i].isTransmit && isFrameStart)
+        {
+            uint8_t unit = _records[i].data[0];
+            bool isKnown = false;
+            for (size_t j = 0; j < units.size(); j++)
+            {
+                isKnown = isKnown || units[j] == unit;
+            }
+            if (!isKnown)
+            {
+                units.push_back(unit);
+            }
+        }
+        isFrameStart = !_records[i].isTransmit;
+    }
+    return units;
+}
+
+/**
+ * Entrega los bytes recibidos de la captura con los intervalos originales divididos por speed
+ * (sin bajar de 3.5T), llamando a poll() cada step microsegundos entre medias, y compara los
+ * bytes enviados con los capturados.
+ * El esclavo tiene que estar configurado (begin(), devoluciones de llamada) y en el mismo estado
+ * que el dispositivo al empezar la captura para que las respuestas coincidan.
+ */
+BenchReplayResult BenchReplay::run(Modbus &slave, MockStream &stream, double speed, unsigned long step)
+{
+    BenchReplayResult result = BenchReplayResult();
+    Frame expected;
+    stream.clearOutput();
+
+    // Los silencios de hasta 3.5T se conservan para no unir tramas; sólo se acortan las pausas.
+    unsigned long frameSilence = 7 * (_baudRate > 19200 ? 250 : 5000000UL / _baudRate);
+    unsigned long start = micros();
+    unsigned long target = start;
+    uint64_t cpuStart = hostCpuNanos();
+
+    for (size_t i = 0; i <= _records.size(); i++)
+    {
+        // Tras el último registro, deja tiempo para la última respuesta.
+        if (i == _records.size())
+        {
+            target = micros() + BENCH_REPLAY_TAIL;
+        }
+        else if (i > 0)
+        {
+            unsigned long gap = _records[i].time - _records[i - 1].time;
+            target += max((unsigned long)(gap / speed), min(gap, frameSilence));
+        }
+        while ((long)(target - micros()) > 0)
+        {
+            slave.poll();
+            result.polls++;
+            hostAdvanceMicros(min(step, target - micros()));
+        }
+        slave.poll();
+        result.polls++;
+
+        if (i == _records.size())
+        {
+            break;
+        }
+        const BenchReplayRecord &record = _records[i];
+        if (record.isTransmit)
+        {
+            expected.insert(expected.end(), record.data.begin(), record.data.end());
+        }
+        else
+        {
+            stream.inject(record.data.data(), record.data.size());
+            result.receivedBytes += record.data.size();
+        }
+    }
+
+    result.cpuNanos = hostCpuNanos() - cpuStart;
+    result.duration = micros() - start;
+
+    const Frame &output = stream.output();
+    result.expectedBytes = expected.size();
+    result.transmittedBytes = output.size();
+    for (size_t i = 0; i < max(expected.size(), output.size()); i++)
+    {
+        result.mismatches += i >= expected.size() || i >= output.size() || expected[i] != output[i];
+    }
+    return result;
+}
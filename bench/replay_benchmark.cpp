@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * Captura y reproducción con el reloj manual. Sin argumentos, un esclavo con dos unidades
+ * atiende tráfico variado a 19200 baudios (lecturas, escrituras, tramas de otra unidad y
+ * con CRC erróneo, pausas aleatorias) con ModbusCapture activo; la captura se exporta y
+ * BenchReplay la reproduce contra un esclavo nuevo a varias velocidades, comparando cada
+ * byte enviado. Con "save <archivo>" guarda esa captura; con "<archivo> [velocidad]"
+ * reproduce una captura de campo.
+ */
+
+#define BENCH_UNITS 2
+#define BENCH_BAUDRATE 19200
+#define BENCH_REGISTERS 256
+#define BENCH_CAPTURE_SIZE 60000
+#define BENCH_TRANSACTIONS 600
+#define BENCH_REPLAY_STEP 20
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static ModbusSlave slaves[BENCH_UNITS] = {ModbusSlave(0x11), ModbusSlave(0x12)};
+static Modbus slave(stream, slaves, BENCH_UNITS);
+static uint16_t registers[BENCH_REGISTERS];
+static uint8_t captureBuffer[BENCH_CAPTURE_SIZE];
+static ModbusCapture capture(captureBuffer, BENCH_CAPTURE_SIZE);
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS] ^ slave.readUnitAddress());
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[(address + i) % BENCH_REGISTERS] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t readCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeCoilToBuffer(i, registers[(address + i) % BENCH_REGISTERS] & 1);
+    }
+    return STATUS_OK;
+}
+
+static void setup(const std::vector<uint8_t> &units, uint32_t baudRate)
+{
+    for (int i = 0; i < BENCH_UNITS; i++)
+    {
+        slaves[i].setUnitAddress(i < (int)units.size() ? units[i] : 0x11 + i);
+        slaves[i].cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+        slaves[i].cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+        slaves[i].cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+        slaves[i].cbVector[CB_READ_COILS] = readCoils;
+    }
+    for (int i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 3;
+    }
+    hostSetMicros(1000000);
+    slave.begin(baudRate);
+    hostAdvanceMicros(100000);
+}
+
+/**
+ * Genera tráfico con la captura activa y devuelve el archivo de captura exportado.
+ */
+static Frame record()
+{
+    std::vector<uint8_t> units;
+    setup(units, BENCH_BAUDRATE);
+    capture.clear();
+    slave.enableCapture(&capture);
+
+    unsigned long silence = 7 * 5000000UL / BENCH_BAUDRATE + 100;
+    srand(7);
+    for (int i = 0; i < BENCH_TRANSACTIONS; i++)
+    {
+        uint8_t unit = 0x11 + (rand() % BENCH_UNITS);
+        Frame request;
+        switch (rand() % 7)
+        {
+        case 0:
+            request = benchReadRequest(unit, FC_READ_HOLDING_REGISTERS, rand() % 200, 10);
+            break;
+        case 1:
+            request = benchReadRequest(unit, FC_READ_INPUT_REGISTERS, rand() % 100, 60);
+            break;
+        case 2:
+            request = benchWriteMultipleRequest(unit, FC_WRITE_MULTIPLE_REGISTERS, rand() % 200, 5);
+            break;
+        case 3:
+            request = benchReadRequest(unit, FC_READ_COILS, rand() % 100, 16);
+            break;
+        case 4:
+            // Una trama para otra unidad del bus.
+            request = benchReadRequest(0x20, FC_READ_HOLDING_REGISTERS, 0, 10);
+            break;
+        case 5:
+            // Una trama dañada.
+            request = benchReadRequest(unit, FC_READ_HOLDING_REGISTERS, 0, 10);
+            request[3] ^= 0x04;
+            break;
+        default:
+            request = benchReadRequest(unit, FC_READ_HOLDING_REGISTERS, rand() % 250, 2);
+            break;
+        }
+        benchTransact(slave, stream, request, silence);
+        hostAdvanceMicros(rand() % 5000);
+    }
+    slave.enableCapture(NULL);
+
+    MockStream file(0);
+    capture.exportTo(file, BENCH_BAUDRATE);
+    printf("captured %d transactions: %u bytes in the ring, %lu records overwritten\n",
+           BENCH_TRANSACTIONS, capture.getLength(), (unsigned long)capture.getOverwrittenRecords());
+    return file.output();
+}
+
+static void replay(BenchReplay &replay, double speed)
+{
+    setup(replay.respondingUnits(), replay.baudRate());
+    BenchReplayResult result = replay.run(slave, stream, speed, BENCH_REPLAY_STEP);
+    printf("%-6.1f %10.2f %10lu %10lu %10lu %10lu %10lu %10.0f\n",
+           speed, result.duration / 1e6, (unsigned long)result.receivedBytes,
+           (unsigned long)result.expectedBytes, (unsigned long)result.transmittedBytes,
+           (unsigned long)result.mismatches, (unsigned long)result.polls,
+           (double)result.cpuNanos / result.polls);
+}
+
+int runReplayBenchmark(int argc, char **argv)
+{
+    hostUseManualClock(true);
+
+    BenchReplay benchReplay;
+    bool isFieldCapture = argc > 1 && strcmp(argv[1], "save") != 0;
+    if (isFieldCapture)
+    {
+        if (!benchReplay.loadFile(argv[1]))
+        {
+            printf("cannot read capture %s\n", argv[1]);
+            return 1;
+        }
+    }
+    else
+    {
+        Frame file = record();
+        if (argc > 2)
+        {
+            FILE *output = fopen(argv[2], "wb");
+            if (output == NULL || fwrite(file.data(), 1, file.size(), output) != file.size())
+            {
+                printf("cannot write %s\n", argv[2]);
+                return 1;
+            }
+            fclose(output);
+            printf("saved %zu bytes to %s\n", file.size(), argv[2]);
+        }
+        benchReplay.load(file);
+    }
+    printf("%zu records at %lu baud\n", benchReplay.numberOfRecords(), (unsigned long)benchReplay.baudRate());
+
+    printf("%-6s %10s %10s %10s %10s %10s %10s %10s\n",
+           "speed", "seconds", "rx bytes", "tx capture", "tx replay", "mismatch", "polls", "ns/poll");
+    if (isFieldCapture)
+    {
+        replay(benchReplay, argc > 2 ? atof(argv[2]) : 1.0);
+        return 0;
+    }
+
+    double speeds[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        replay(benchReplay, speeds[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Resincronización de tramas con el reloj manual: un maestro mínimo envía FC03/FC16 a
+ * 38400 baudios por un enlace que deforma los silencios como un adaptador USB-RS485 o
+ * un radiomódem: huecos de varios caracteres dentro de la solicitud, solicitudes pegadas
+ * a la trama anterior de otra unidad y ruido justo antes de la solicitud. Compara el
+ * encuadre por silencios con enableResync(): transacciones respondidas, plazos vencidos
+ * (reintentos del maestro) y transacciones por segundo.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_OTHER_ADDRESS 0x20
+#define BENCH_BAUDRATE 38400
+#define BENCH_REGISTERS 64
+#define BENCH_TIMEOUT 20000
+#define BENCH_STEP 10
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+enum LinkProfile
+{
+    LINK_CLEAN,
+    LINK_STRETCHED,
+    LINK_BUNCHED,
+    LINK_NOISE,
+};
+
+static const char *profileNames[] = {"clean", "stretched", "bunched", "noise"};
+
+struct ResyncResult
+{
+    long answered;
+    long timeouts;
+    unsigned long duration;
+};
+
+/**
+ * Envía los bytes al esclavo a la velocidad del bus; gapIndex es el byte antes del que el
+ * enlace retiene la trama gap microsegundos.
+ */
+static void deliver(const Frame &bytes, size_t gapIndex, unsigned long gap, unsigned long charTime)
+{
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        unsigned long wait = charTime + (i == gapIndex ? gap : 0);
+        for (unsigned long elapsed = 0; elapsed < wait; elapsed += BENCH_STEP)
+        {
+            slave.poll();
+            hostAdvanceMicros(BENCH_STEP);
+        }
+        stream.inject(&bytes[i], 1);
+    }
+}
+
+static ResyncResult run(LinkProfile profile, bool isResyncEnabled, int transactions)
+{
+    slave.enableResync(isResyncEnabled);
+    slave.begin(BENCH_BAUDRATE);
+    hostAdvanceMicros(100000);
+    stream.clearOutput();
+
+    unsigned long charTime = 11000000UL / BENCH_BAUDRATE;
+    unsigned long silence = 7 * 5000000UL / BENCH_BAUDRATE + BENCH_STEP;
+    ResyncResult result = ResyncResult();
+    unsigned long start = micros();
+    srand(3);
+
+    for (int t = 0; t < transactions; t++)
+    {
+        bool isWrite = t % 3 == 2;
+        uint16_t address = rand() % (BENCH_REGISTERS - 10);
+        Frame request = isWrite ? benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, address, 5)
+                                : benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, 10);
+        size_t expected = isWrite ? 8 : 25;
+
+        // La mitad de las solicitudes sufre la deformación del enlace.
+        Frame bytes;
+        size_t gapIndex = request.size();
+        unsigned long gap = 0;
+        bool isDistorted = rand() % 2 == 0;
+        if (isDistorted && profile == LINK_STRETCHED)
+        {
+            gapIndex = 1 + rand() % (request.size() - 1);
+            gap = (2 + rand() % 5) * charTime;
+        }
+        else if (isDistorted && profile == LINK_BUNCHED)
+        {
+            bytes = benchReadRequest(BENCH_OTHER_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, 4);
+        }
+        else if (isDistorted && profile == LINK_NOISE)
+        {
+            for (int i = 0, n = 1 + rand() % 3; i < n; i++)
+            {
+                bytes.push_back(rand());
+            }
+        }
+        gapIndex += bytes.size();
+        bytes.insert(bytes.end(), request.begin(), request.end());
+        deliver(bytes, gapIndex, gap, charTime);
+
+        // Espera la respuesta completa o el plazo del maestro, y el silencio de 3.5T.
+        unsigned long sent = micros();
+        while (stream.output().size() < expected && micros() - sent < BENCH_TIMEOUT)
+        {
+            slave.poll();
+            hostAdvanceMicros(BENCH_STEP);
+        }
+        Frame response = stream.output();
+        stream.clearOutput();
+        if (response.size() == expected && benchCheckCRC(response) && response[1] == request[1])
+        {
+            result.answered++;
+        }
+        else
+        {
+            result.timeouts++;
+        }
+        for (unsigned long elapsed = 0; elapsed < silence; elapsed += BENCH_STEP)
+        {
+            slave.poll();
+            hostAdvanceMicros(BENCH_STEP);
+        }
+    }
+    result.duration = micros() - start;
+    return result;
+}
+
+int runResyncBenchmark(int argc, char **argv)
+{
+    int transactions = argc > 1 ? atoi(argv[1]) : 2000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+
+    printf("%d transactions at %d baud, half of them distorted\n", transactions, BENCH_BAUDRATE);
+    printf("%-10s %-8s %10s %10s %12s %10s %10s\n", "link", "framing", "answered", "timeouts", "trans/s", "recovered", "discarded");
+    for (int profile = LINK_CLEAN; profile <= LINK_NOISE; profile++)
+    {
+        for (int mode = 0; mode < 2; mode++)
+        {
+            uint32_t recovered = slave.getResyncRecoveredFrames();
+            uint32_t discarded = slave.getResyncDiscardedBytes();
+            ResyncResult result = run((LinkProfile)profile, mode == 1, transactions);
+            printf("%-10s %-8s %10ld %10ld %12.1f %10lu %10lu\n", profileNames[profile], mode == 1 ? "resync" : "silence",
+                   result.answered, result.timeouts, result.answered * 1e6 / result.duration,
+                   (unsigned long)(slave.getResyncRecoveredFrames() - recovered),
+                   (unsigned long)(slave.getResyncDiscardedBytes() - discarded));
+        }
+    }
+    return 0;
+}
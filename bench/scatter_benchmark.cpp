@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Lectura dispersa a 19200 baudios: una pantalla de HMI lee BENCH_BLOCKS bloques pequeños
+ * repartidos por el mapa, con una trama FC01..FC04 por bloque o con una sola FC_READ_SCATTER.
+ * Compara los bytes, el tiempo de línea y la CPU del esclavo por pantalla, comprueba cada
+ * valor y que una lectura que no cabe en MODBUS_MAX_BUFFER responde con una excepción.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_BAUDRATE 19200
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+
+struct ScatterBlock
+{
+    uint8_t table;
+    uint16_t address;
+    uint16_t length;
+};
+
+static const ScatterBlock blocks[] = {
+    {FC_READ_HOLDING_REGISTERS, 0, 4},
+    {FC_READ_HOLDING_REGISTERS, 100, 6},
+    {FC_READ_HOLDING_REGISTERS, 250, 2},
+    {FC_READ_INPUT_REGISTERS, 10, 8},
+    {FC_READ_HOLDING_REGISTERS, 400, 12},
+    {FC_READ_COILS, 0, 16},
+    {FC_READ_HOLDING_REGISTERS, 1000, 3},
+    {FC_READ_INPUT_REGISTERS, 200, 5},
+    {FC_READ_DISCRETE_INPUT, 0, 10},
+    {FC_READ_HOLDING_REGISTERS, 2000, 20},
+};
+#define BENCH_BLOCKS (sizeof(blocks) / sizeof(blocks[0]))
+
+static uint16_t registerValue(uint8_t fc, uint16_t address)
+{
+    return (fc << 12) ^ (address * 13);
+}
+
+static bool coilValue(uint8_t fc, uint16_t address)
+{
+    return ((address * fc) >> 2) & 1;
+}
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registerValue(fc, address + i));
+    }
+    return STATUS_OK;
+}
+
+static uint8_t readCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeCoilToBuffer(i, coilValue(fc, address + i));
+    }
+    return STATUS_OK;
+}
+
+static Frame scatterRequest(const ScatterBlock *request, size_t count)
+{
+    Frame frame = {BENCH_UNIT_ADDRESS, FC_READ_SCATTER, (uint8_t)(count * 5)};
+    for (size_t i = 0; i < count; i++)
+    {
+        frame.push_back(request[i].table);
+        frame.push_back(request[i].address >> 8);
+        frame.push_back(request[i].address & 0xFF);
+        frame.push_back(request[i].length >> 8);
+        frame.push_back(request[i].length & 0xFF);
+    }
+    benchAppendCRC(frame);
+    return frame;
+}
+
+/**
+ * Comprueba los datos de un bloque en una respuesta a partir del índice dado.
+ *
+ * @return El índice del byte que sigue al bloque.
+ */
+static size_t checkBlock(const Frame &response, size_t index, const ScatterBlock &block, long &mismatches)
+{
+    bool isCoil = block.table <= FC_READ_DISCRETE_INPUT;
+    for (uint16_t i = 0; i < block.length; i++)
+    {
+        bool isValid = isCoil ? ((response[index + i / 8] >> (i % 8)) & 1) == coilValue(block.table, block.address + i)
+                              : ((response[index + i * 2] << 8) | response[index + i * 2 + 1]) == registerValue(block.table, block.address + i);
+        mismatches += !isValid;
+    }
+    return index + (isCoil ? (block.length + 7) / 8 : block.length * 2);
+}
+
+/**
+ * Envía una solicitud y devuelve la respuesta; suma los bytes y el tiempo de CPU del esclavo.
+ */
+static Frame transact(const Frame &request, unsigned long silence, uint64_t &bytes, uint64_t &nanos)
+{
+    stream.clearOutput();
+    uint64_t start = hostCpuNanos();
+    benchTransact(slave, stream, request, silence);
+    nanos += hostCpuNanos() - start;
+    bytes += request.size() + stream.output().size();
+    return stream.output();
+}
+
+int runScatterBenchmark(int argc, char **argv)
+{
+    long screens = argc > 1 ? atol(argv[1]) : 20000;
+
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_COILS] = readCoils;
+    slave.cbVector[CB_READ_DISCRETE_INPUTS] = readCoils;
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+    slave.begin(BENCH_BAUDRATE);
+
+    unsigned long silence = 7 * 5000000UL / BENCH_BAUDRATE + 100;
+    hostAdvanceMicros(silence * 4);
+
+    Frame singleRequests[BENCH_BLOCKS];
+    for (size_t i = 0; i < BENCH_BLOCKS; i++)
+    {
+        singleRequests[i] = benchReadRequest(BENCH_UNIT_ADDRESS, blocks[i].table, blocks[i].address, blocks[i].length);
+    }
+    Frame scatter = scatterRequest(blocks, BENCH_BLOCKS);
+
+    uint64_t singleBytes = 0, singleNanos = 0, scatterBytes = 0, scatterNanos = 0;
+    long mismatches = 0;
+    for (long screen = 0; screen < screens; screen++)
+    {
+        for (size_t i = 0; i < BENCH_BLOCKS; i++)
+        {
+            Frame response = transact(singleRequests[i], silence, singleBytes, singleNanos);
+            mismatches += !benchCheckCRC(response) || response[1] != blocks[i].table;
+            checkBlock(response, 3, blocks[i], mismatches);
+        }
+
+        Frame response = transact(scatter, silence, scatterBytes, scatterNanos);
+        mismatches += !benchCheckCRC(response) || response[1] != FC_READ_SCATTER;
+        size_t index = 3;
+        for (size_t i = 0; i < BENCH_BLOCKS; i++)
+        {
+            index = checkBlock(response, index, blocks[i], mismatches);
+        }
+        mismatches += index != (size_t)response[2] + 3;
+    }
+
+    // Tiempo de línea por pantalla: 10 bits por carácter y 3,5 caracteres de silencio por trama.
+    double charTime = 10.0 / BENCH_BAUDRATE * 1e3;
+    double singleTime = ((double)singleBytes / screens + BENCH_BLOCKS * 2 * 3.5) * charTime;
+    double scatterTime = ((double)scatterBytes / screens + 2 * 3.5) * charTime;
+
+    printf("%-8s %8s %8s %10s %12s\n", "mode", "frames", "bytes", "line ms", "slave ns");
+    printf("%-8s %8d %8.0f %10.2f %12.0f\n", "FC0x", (int)BENCH_BLOCKS * 2, (double)singleBytes / screens, singleTime, (double)singleNanos / screens);
+    printf("%-8s %8d %8.0f %10.2f %12.0f\n", "FC66", 2, (double)scatterBytes / screens, scatterTime, (double)scatterNanos / screens);
+    printf("line time saved %.1f%%, mismatches %ld\n", 100.0 * (1 - scatterTime / singleTime), mismatches);
+
+    // Respuestas que no caben en MODBUS_MAX_BUFFER, una tabla desconocida y el máximo que cabe.
+    ScatterBlock tooLarge[] = {{FC_READ_HOLDING_REGISTERS, 0, 100}, {FC_READ_INPUT_REGISTERS, 0, 26}};
+    ScatterBlock badTable[] = {{FC_READ_HOLDING_REGISTERS, 0, 1}, {FC_WRITE_REGISTER, 0, 1}};
+    ScatterBlock largest[] = {{FC_READ_HOLDING_REGISTERS, 0, 100}, {FC_READ_INPUT_REGISTERS, 0, 25}, {FC_READ_COILS, 0, 8}};
+    struct
+    {
+        const char *name;
+        Frame request;
+        bool isException;
+    } limits[] = {
+        {"252 data bytes", scatterRequest(tooLarge, 2), true},
+        {"unknown table", scatterRequest(badTable, 2), true},
+        {"251 data bytes", scatterRequest(largest, 3), false},
+    };
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++)
+    {
+        uint64_t bytes = 0, nanos = 0;
+        Frame response = transact(limits[i].request, silence, bytes, nanos);
+        bool isValid = benchCheckCRC(response) &&
+                       (limits[i].isException ? response[1] == (FC_READ_SCATTER | 0x80) && response[2] == STATUS_ILLEGAL_DATA_VALUE
+                                              : response[1] == FC_READ_SCATTER && response.size() == MODBUS_MAX_BUFFER);
+        printf("%-16s %4zu bytes %s\n", limits[i].name, response.size(), isValid ? "ok" : "FAILED");
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <algorithm>
+#include <LinuxSerialStream.h>
+#include "bench.h"
+
+/**
+ * Prueba de extremo a extremo de LinuxSerialStream sobre un pseudoterminal: un
+ * esclavo en otro hilo atiende el bus con el mismo bucle que tools/modbusd
+ * (service() + waitForData()) y el maestro mide el tiempo de ida y vuelta de
+ * cada transacción. Comprueba cada respuesta: los valores leídos con FC03 y, tras
+ * cada FC16, los registros escritos. Termina con error si alguna no es correcta.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 1024
+#define BENCH_LENGTH 10
+
+static LinuxSerialStream slaveStream;
+static Modbus slave(slaveStream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+static volatile bool isSlaveRunning;
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[address + i] = slave.readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static void *runSlave(void *argument)
+{
+    while (isSlaveRunning)
+    {
+        long wait = (long)(slave.service(1000) - micros());
+        slaveStream.waitForData(wait > 0 ? (wait + 999) / 1000 : 0);
+    }
+    return NULL;
+}
+
+/**
+ * Lee una respuesta completa: la cabecera indica su longitud (lecturas, escrituras o excepción).
+ */
+static bool readResponse(LinuxSerialStream &stream, Frame &response)
+{
+    response.clear();
+    unsigned long start = micros();
+    while ((micros() - start) < 100000)
+    {
+        while (stream.available() > 0)
+        {
+            response.push_back(stream.read());
+        }
+
+        size_t expected = 0;
+        if (response.size() >= 3)
+        {
+            expected = (response[1] & 0x80) ? 5 : response[1] <= FC_READ_INPUT_REGISTERS ? 5 + response[2] : 8;
+        }
+        if (expected > 0 && response.size() >= expected)
+        {
+            return response.size() == expected;
+        }
+        stream.waitForData(10);
+    }
+    return false;
+}
+
+int runSerialBenchmark(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 2000;
+    unsigned long baudRate = argc > 2 ? strtoul(argv[2], NULL, 10) : 115200;
+
+    hostUseManualClock(false);
+
+    LinuxSerialStream master;
+    char slaveName[64];
+    if (!master.beginPty(slaveName, sizeof(slaveName)) || !slaveStream.begin(slaveName, baudRate))
+    {
+        perror("pty");
+        return 1;
+    }
+
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 3 + 1;
+    }
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.begin(baudRate);
+    isSlaveRunning = true;
+    pthread_t slaveThread;
+    pthread_create(&slaveThread, NULL, runSlave, NULL);
+
+    printf("pty %s at %lu baud\n", slaveName, baudRate);
+    printf("%-10s %8s %10s %10s %10s %10s %8s\n", "scenario", "frames", "frames/s", "p50 us", "p99 us", "max us", "errors");
+
+    const char *names[] = {"FC03 x10", "FC16 x10"};
+    long totalErrors = 0;
+    for (int scenario = 0; scenario < 2; scenario++)
+    {
+        std::vector<uint64_t> latencies;
+        long errors = 0;
+        Frame response;
+        uint64_t start = hostNanos();
+
+        for (long i = 0; i < iterations; i++)
+        {
+            uint16_t address = (i * 13) % (BENCH_REGISTERS - BENCH_LENGTH);
+            Frame request = scenario == 0
+                                ? benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, BENCH_LENGTH)
+                                : benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, address, BENCH_LENGTH);
+            if (scenario == 1)
+            {
+                // Valores distintos en cada escritura, para que una escritura perdida no pase por buena.
+                for (uint16_t r = 0; r < BENCH_LENGTH; r++)
+                {
+                    uint16_t value = i * BENCH_LENGTH + r;
+                    request[7 + r * 2] = highByte(value);
+                    request[8 + r * 2] = lowByte(value);
+                }
+                request.resize(request.size() - 2);
+                benchAppendCRC(request);
+            }
+
+            uint64_t sent = hostNanos();
+            master.write(request.data(), request.size());
+            bool valid = readResponse(master, response) && benchCheckCRC(response) &&
+                         response[0] == BENCH_UNIT_ADDRESS && response[1] == request[1];
+            latencies.push_back(hostNanos() - sent);
+
+            // El esclavo ya respondió, así que los registros reflejan la escritura.
+            for (uint16_t r = 0; valid && r < BENCH_LENGTH; r++)
+            {
+                valid = scenario == 0 ? word(response[3 + r * 2], response[4 + r * 2]) == registers[address + r]
+                                      : registers[address + r] == word(request[7 + r * 2], request[8 + r * 2]);
+            }
+            errors += !valid;
+
+            // El maestro también respeta el silencio de 3.5T entre tramas.
+            delayMicroseconds(baudRate > 19200 ? 1750 : 38500000 / baudRate);
+        }
+
+        double elapsed = (hostNanos() - start) / 1e9;
+        std::sort(latencies.begin(), latencies.end());
+        printf("%-10s %8ld %10.0f %10.0f %10.0f %10.0f %8ld\n",
+               names[scenario], iterations, iterations / elapsed,
+               latencies[latencies.size() / 2] / 1e3,
+               latencies[latencies.size() * 99 / 100] / 1e3,
+               latencies.back() / 1e3, errors);
+        totalErrors += errors;
+    }
+
+    isSlaveRunning = false;
+    pthread_join(slaveThread, NULL);
+    return totalErrors == 0 ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+
+/**
+ * Modbus::service() y su plazo (nextDeadline()) con el reloj manual a 115200 baudios (0.5T fijo de
+ * 250 us). Comprueba el plazo que devuelve service() en cada estado: reposo, trama de
+ * solicitud a medias, espera de 1.5T antes de transmitir (con la resincronización, que
+ * procesa la trama sin esperar al silencio), transmisión mientras la UART se vacía y
+ * liberación del pin DE. Después inunda el bus con ruido y comprueba que service()
+ * devuelve el control al agotar su presupuesto de tiempo, y mide cuántas llamadas a
+ * service() necesita cada transacción frente a un bucle que llama a poll() cada 100 us.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_CONTROL_PIN 8
+#define BENCH_BAUDRATE 115200
+#define BENCH_REGISTERS 100
+#define BENCH_LENGTH 10
+#define BENCH_UART_BUFFER 64
+#define BENCH_HALF_CHAR_TIME 250
+#define BENCH_SILENCE (BENCH_HALF_CHAR_TIME * 3)
+#define BENCH_SILENCE_END (BENCH_SILENCE + 1)
+#define BENCH_IDLE_TIME (BENCH_HALF_CHAR_TIME * 2 * MODBUS_SERVICE_IDLE_CHARS)
+#define BENCH_POLL_COST 20
+#define BENCH_BUDGET 1000
+#define BENCH_NOISE 2000
+#define BENCH_LOOP_PERIOD 100
+
+/**
+ * MockStream cuyo búfer de transmisión se vacía a la velocidad de la línea, como una UART.
+ * Cada llamada a available() puede costar tiempo de reloj, como el trabajo de una CPU lenta.
+ */
+class ServiceUartStream : public MockStream
+{
+public:
+    ServiceUartStream() : MockStream(BENCH_UART_BUFFER) {}
+    void attach(BenchWire *wire) { _wire = wire; }
+    void setAvailableCost(unsigned long cost) { _cost = cost; }
+    int available()
+    {
+        hostAdvanceMicros(_cost);
+        return MockStream::available();
+    }
+    int availableForWrite() { return _wire != NULL ? max(0, BENCH_UART_BUFFER - (int)_wire->pending()) : BENCH_UART_BUFFER; }
+
+private:
+    BenchWire *_wire = NULL;
+    unsigned long _cost = 0;
+};
+
+static ServiceUartStream slaveStream;
+static MockStream masterStream(MODBUS_MAX_BUFFER);
+static BenchWire responseWire(slaveStream, masterStream, BENCH_BAUDRATE);
+static Modbus slave(slaveStream, BENCH_UNIT_ADDRESS, BENCH_CONTROL_PIN);
+static uint16_t registers[BENCH_REGISTERS];
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+/**
+ * Recoge los bytes que llegaron al maestro.
+ */
+static Frame receive()
+{
+    Frame response;
+    while (masterStream.available() > 0)
+    {
+        response.push_back(masterStream.read());
+    }
+    return response;
+}
+
+static bool isAnswer(const Frame &response, uint16_t address)
+{
+    if (response.size() != 5 + BENCH_LENGTH * 2 || !benchCheckCRC(response) || response[1] != FC_READ_HOLDING_REGISTERS)
+    {
+        return false;
+    }
+    for (uint16_t i = 0; i < BENCH_LENGTH; i++)
+    {
+        if (word(response[3 + i * 2], response[4 + i * 2]) != registers[address + i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Comprueba los plazos desde el inicio de la transmisión hasta el reposo: un carácter
+ * mientras la UART tiene bytes, 1.5T tras el último byte para liberar el pin DE, y el
+ * plazo de reposo una vez liberado. Cada llamada se hace justo en el plazo devuelto.
+ */
+static long checkTransmission(unsigned long start, uint16_t address)
+{
+    long failures = 0;
+    hostSetMicros(start);
+    unsigned long deadline = slave.service(BENCH_BUDGET);
+    failures += deadline != micros() + BENCH_HALF_CHAR_TIME * 2 || digitalRead(BENCH_CONTROL_PIN) != HIGH;
+
+    // Cada llamada mientras la UART se vacía pide volver en un carácter.
+    unsigned long lastBusy = micros();
+    for (int i = 0; i < 100 && responseWire.pending() > 0; i++)
+    {
+        hostSetMicros(deadline);
+        responseWire.transfer();
+        bool isBusy = responseWire.pending() > 0;
+        deadline = slave.service(BENCH_BUDGET);
+        if (isBusy)
+        {
+            lastBusy = micros();
+            failures += deadline != micros() + BENCH_HALF_CHAR_TIME * 2;
+        }
+    }
+
+    // Vacía: la liberación del pin DE llega 1.5T después de la última vez que la UART estaba ocupada.
+    failures += deadline != lastBusy + BENCH_SILENCE_END || digitalRead(BENCH_CONTROL_PIN) != HIGH || slave.isIdle();
+    hostSetMicros(deadline);
+    deadline = slave.service(BENCH_BUDGET);
+    failures += digitalRead(BENCH_CONTROL_PIN) != LOW || !slave.isIdle() || deadline != micros() + BENCH_IDLE_TIME;
+    failures += !isAnswer(receive(), address);
+    return failures;
+}
+
+static long checkDeadlines()
+{
+    long failures = 0;
+    Frame request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 20, BENCH_LENGTH);
+
+    // Reposo: se vuelve cuando podrían haber llegado MODBUS_SERVICE_IDLE_CHARS caracteres.
+    hostAdvanceMicros(BENCH_IDLE_TIME);
+    failures += slave.service(BENCH_BUDGET) != micros() + BENCH_IDLE_TIME;
+
+    // Trama a medias: el plazo es el fin de trama, 1.5T tras el último byte recibido.
+    slaveStream.inject(request.data(), 4);
+    unsigned long firstBytes = micros();
+    failures += slave.service(BENCH_BUDGET) != firstBytes + BENCH_SILENCE_END;
+    hostAdvanceMicros(300);
+    failures += slave.service(BENCH_BUDGET) != firstBytes + BENCH_SILENCE_END;
+    slaveStream.inject(request.data() + 4, request.size() - 4);
+    unsigned long lastBytes = micros();
+    unsigned long deadline = slave.service(BENCH_BUDGET);
+    failures += deadline != lastBytes + BENCH_SILENCE_END || receive().size() != 0;
+
+    // En el fin de trama, service() procesa la solicitud y empieza a transmitir en la misma llamada.
+    failures += checkTransmission(deadline, 20);
+
+    // Con la resincronización la trama se procesa en cuanto está completa y la respuesta espera 1.5T.
+    slave.enableResync(true);
+    hostAdvanceMicros(BENCH_IDLE_TIME);
+    slaveStream.inject(request.data(), request.size());
+    lastBytes = micros();
+    deadline = slave.service(BENCH_BUDGET);
+    failures += deadline != lastBytes + BENCH_SILENCE_END || slaveStream.output().size() != 0 || digitalRead(BENCH_CONTROL_PIN) != LOW;
+    failures += checkTransmission(deadline, 20);
+    slave.enableResync(false);
+    return failures;
+}
+
+static long checkBudget()
+{
+    long failures = 0;
+
+    // Un nodo que balbucea: más bytes de los que caben en el búfer y cada available() cuesta 20 us.
+    Frame noise(BENCH_NOISE);
+    for (size_t i = 0; i < noise.size(); i++)
+    {
+        noise[i] = 0x5A + i * 7;
+    }
+    slaveStream.attach(NULL);
+    hostAdvanceMicros(BENCH_IDLE_TIME);
+    slaveStream.inject(noise.data(), noise.size());
+    int calls = 0;
+    while (calls < BENCH_NOISE && slaveStream.available() > 0)
+    {
+        unsigned long start = micros();
+        slaveStream.setAvailableCost(BENCH_POLL_COST);
+        slave.service(BENCH_BUDGET);
+        slaveStream.setAvailableCost(0);
+        unsigned long elapsed = micros() - start;
+        calls++;
+
+        // Con bytes por leer service() sólo vuelve al agotar el presupuesto, y como mucho tras un poll() más,
+        // que lee a lo sumo un búfer completo.
+        if (slaveStream.available() > 0)
+        {
+            failures += elapsed < BENCH_BUDGET || elapsed > BENCH_BUDGET + (MODBUS_MAX_BUFFER + 2) * BENCH_POLL_COST;
+        }
+    }
+    failures += calls < 2 || calls == BENCH_NOISE || slaveStream.output().size() != 0;
+    slaveStream.attach(&responseWire);
+
+    // Tras el ruido el esclavo vuelve a responder.
+    Frame request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 40, BENCH_LENGTH);
+    hostAdvanceMicros(BENCH_SILENCE + 1);
+    slave.service(BENCH_BUDGET);
+    slaveStream.inject(request.data(), request.size());
+    unsigned long deadline = slave.service(BENCH_BUDGET);
+    failures += checkTransmission(deadline, 40);
+    return failures;
+}
+
+/**
+ * Atiende transacciones hasta que el maestro recibe cada respuesta, llamando a service()
+ * en sus plazos o a poll() cada 100 us.
+ *
+ * @return El número medio de llamadas por transacción, o cero si alguna respuesta es incorrecta.
+ */
+static double measureCalls(long transactions, bool isService)
+{
+    uint64_t calls = 0;
+    for (long t = 0; t < transactions; t++)
+    {
+        uint16_t address = (t * 7) % (BENCH_REGISTERS - BENCH_LENGTH);
+        Frame request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, BENCH_LENGTH);
+        hostAdvanceMicros(BENCH_IDLE_TIME);
+        slaveStream.inject(request.data(), request.size());
+
+        unsigned long deadline = micros();
+        Frame response;
+        for (int i = 0; i < 10000 && (!slave.isIdle() || responseWire.pending() > 0); i++)
+        {
+            hostSetMicros(isService ? deadline : micros() + BENCH_LOOP_PERIOD);
+            responseWire.transfer();
+            if (isService)
+            {
+                deadline = slave.service(BENCH_BUDGET);
+            }
+            else
+            {
+                slave.poll();
+            }
+            calls++;
+        }
+        response = receive();
+        if (!isAnswer(response, address))
+        {
+            return 0;
+        }
+    }
+    return (double)calls / transactions;
+}
+
+int runServiceBenchmark(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 1000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 5 + 1;
+    }
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.begin(BENCH_BAUDRATE);
+    slaveStream.attach(&responseWire);
+
+    long failures = checkDeadlines();
+    printf("deadline check: %ld failures (idle, mid-frame, pre-transmit, draining, DE release)\n", failures);
+
+    long budgetFailures = checkBudget();
+    printf("budget check: %ld failures (service(%u) under a noise flood, recovery)\n", budgetFailures, BENCH_BUDGET);
+
+    double serviceCalls = measureCalls(transactions, true);
+    double pollCalls = measureCalls(transactions, false);
+    printf("%ld FC03 x%d transactions at %d baud\n", transactions, BENCH_LENGTH, BENCH_BAUDRATE);
+    printf("%-22s %14s\n", "loop", "calls per req");
+    printf("%-22s %14.1f\n", "service() deadlines", serviceCalls);
+    printf("%-22s %14.1f\n", "poll() every 100 us", pollCalls);
+    failures += budgetFailures + (serviceCalls == 0) + (pollCalls == 0);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <ModbusTcp.h>
+#include "bench.h"
+
+/**
+ * Rendimiento de ModbusTcpServer en loopback: varios clientes encadenan solicitudes
+ * FC03 (hasta "depth" sin esperar respuesta) contra un servidor en el hilo principal.
+ * Mide transacciones por segundo en tiempo real y comprueba cada respuesta.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 2048
+#define BENCH_READ_LENGTH 10
+
+static Modbus slave(BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+
+struct TcpClient
+{
+    pthread_t thread;
+    uint16_t port;
+    long transactions;
+    int depth;
+    long errors;
+};
+
+static volatile int runningClients = 0;
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave.writeRegisterToBuffer(i, registers[(address + i) % BENCH_REGISTERS]);
+    }
+    return STATUS_OK;
+}
+
+static bool readAll(int fd, uint8_t *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t received = recv(fd, buffer, length, 0);
+        if (received <= 0)
+        {
+            return false;
+        }
+        buffer += received;
+        length -= received;
+    }
+    return true;
+}
+
+static void *runClient(void *argument)
+{
+    TcpClient *client = (TcpClient *)argument;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(client->port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    if (connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0)
+    {
+        client->errors = client->transactions;
+        close(fd);
+        __sync_fetch_and_sub(&runningClients, 1);
+        return NULL;
+    }
+
+    // (MBAP: 2 x Transaction, 2 x Protocol, 2 x Length, 1 x Unit) + FC03 (1 x FC, 2 x Address, 2 x Length).
+    const size_t requestSize = MODBUS_TCP_MBAP_SIZE + 5;
+    const size_t responseSize = MODBUS_TCP_MBAP_SIZE + 2 + BENCH_READ_LENGTH * 2;
+    std::vector<uint8_t> requests(requestSize * client->depth);
+    std::vector<uint8_t> responses(responseSize * client->depth);
+    uint16_t transactionId = 0;
+
+    for (long done = 0; done < client->transactions;)
+    {
+        int batch = client->depth;
+        if (client->transactions - done < batch)
+        {
+            batch = client->transactions - done;
+        }
+
+        for (int i = 0; i < batch; i++)
+        {
+            uint8_t *request = &requests[i * requestSize];
+            uint16_t id = transactionId + i;
+            uint16_t address = (id * 7) % (BENCH_REGISTERS - BENCH_READ_LENGTH);
+            uint8_t adu[] = {(uint8_t)(id >> 8), (uint8_t)id, 0, 0, 0, 6, BENCH_UNIT_ADDRESS,
+                             FC_READ_HOLDING_REGISTERS, (uint8_t)(address >> 8), (uint8_t)address, 0, BENCH_READ_LENGTH};
+            memcpy(request, adu, requestSize);
+        }
+        if (send(fd, &requests[0], requestSize * batch, MSG_NOSIGNAL) != (ssize_t)(requestSize * batch) ||
+            !readAll(fd, &responses[0], responseSize * batch))
+        {
+            client->errors += client->transactions - done;
+            break;
+        }
+
+        // Las respuestas llegan en orden, con el mismo identificador de transacción.
+        for (int i = 0; i < batch; i++)
+        {
+            const uint8_t *response = &responses[i * responseSize];
+            uint16_t id = transactionId + i;
+            uint16_t address = (id * 7) % (BENCH_REGISTERS - BENCH_READ_LENGTH);
+            if (word(response[0], response[1]) != id ||
+                response[7] != FC_READ_HOLDING_REGISTERS ||
+                word(response[9], response[10]) != registers[address])
+            {
+                client->errors++;
+            }
+        }
+        transactionId += batch;
+        done += batch;
+    }
+
+    close(fd);
+    __sync_fetch_and_sub(&runningClients, 1);
+    return NULL;
+}
+
+int runTcpBenchmark(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 200000;
+    int configurations[][2] = {{1, 1}, {1, 16}, {8, 1}, {8, 16}, {64, 4}};
+
+    for (uint16_t i = 0; i < BENCH_REGISTERS; i++)
+    {
+        registers[i] = i * 3;
+    }
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+
+    ModbusTcpServer server(slave);
+    if (!server.begin(0, "127.0.0.1"))
+    {
+        perror("begin");
+        return 1;
+    }
+
+    printf("%8s %6s %12s %12s %10s %8s\n", "clients", "depth", "transactions", "trans/s", "ns/trans", "errors");
+
+    for (size_t c = 0; c < sizeof(configurations) / sizeof(configurations[0]); c++)
+    {
+        int numberOfClients = configurations[c][0];
+        std::vector<TcpClient> clients(numberOfClients);
+        runningClients = numberOfClients;
+
+        uint64_t start = hostNanos();
+        for (int i = 0; i < numberOfClients; i++)
+        {
+            clients[i].port = server.getPort();
+            clients[i].transactions = transactions / numberOfClients;
+            clients[i].depth = configurations[c][1];
+            clients[i].errors = 0;
+            pthread_create(&clients[i].thread, NULL, runClient, &clients[i]);
+        }
+
+        uint64_t served = server.getTotalTransactions();
+        while (runningClients > 0)
+        {
+            server.poll(10);
+        }
+        uint64_t elapsed = hostNanos() - start;
+        served = server.getTotalTransactions() - served;
+
+        long errors = 0;
+        for (int i = 0; i < numberOfClients; i++)
+        {
+            pthread_join(clients[i].thread, NULL);
+            errors += clients[i].errors;
+        }
+
+        printf("%8d %6d %12llu %12.0f %10.0f %8ld\n",
+               numberOfClients, configurations[c][1], (unsigned long long)served,
+               served * 1e9 / elapsed, (double)elapsed / served, errors);
+    }
+
+    server.end();
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "bench.h"
+
+/**
+ * Prueba de carga con dos hilos: el hilo principal hace de maestro y de hilo de
+ * comunicaciones (poll() con el reloj manual) y un hilo de control actualiza sin
+ * pausa pares de registros (v, ~v) y aplica las escrituras del maestro. Las lecturas
+ * FC03 se sirven de una ModbusRegisterImage y las escrituras FC16 llegan a la
+ * aplicación por una ModbusWriteQueue. Se cuentan los pares leídos a medias, las
+ * escrituras perdidas o desordenadas y las respuestas STATUS_SLAVE_DEVICE_BUSY; como
+ * referencia, el mismo mapa leído sin sincronización con writeArrayToBuffer(). Termina
+ * con error si la imagen da alguna lectura a medias, alguna escritura se pierde o una
+ * escritura mayor que la cola no se rechaza con STATUS_ILLEGAL_DATA_VALUE.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_PAIRS 16
+#define BENCH_REGISTERS (BENCH_PAIRS * 2)
+#define BENCH_WRITE_ADDRESS 100
+#define BENCH_WRITE_SLOTS 8
+#define BENCH_QUEUE_SIZE 64
+#define BENCH_SILENCE 200
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+static uint16_t registers[BENCH_REGISTERS];
+static ModbusRegisterImage image(registers, 0, BENCH_REGISTERS);
+static ModbusWrite entries[BENCH_QUEUE_SIZE];
+static ModbusWriteQueue queue(entries, BENCH_QUEUE_SIZE);
+
+static bool isImageEnabled;
+static unsigned long updatePeriod;
+static volatile bool isRunning;
+
+struct ControlResult
+{
+    uint64_t updates;
+    uint64_t writes;
+    uint64_t badWrites;
+    uint16_t lastSequence;
+};
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    if (isImageEnabled)
+    {
+        return slave.writeImageToBuffer(0, image, address, length);
+    }
+    return slave.writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return slave.queueWritesFromBuffer(queue, address, length);
+}
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Aplica las escrituras de la cola, que deben llegar en pares (secuencia, ~secuencia)
+ * con la secuencia consecutiva.
+ */
+static void applyWrites(ControlResult *result)
+{
+    ModbusWrite high;
+    ModbusWrite low;
+    while (queue.pop(high))
+    {
+        bool isPair = queue.pop(low) && low.address == high.address + 1 && low.value == (uint16_t)~high.value;
+        result->badWrites += !isPair || high.value != (uint16_t)(result->lastSequence + 1);
+        result->lastSequence = high.value;
+        result->writes++;
+    }
+}
+
+/**
+ * Hilo de control: publica un lote con todos los pares cada updatePeriod nanosegundos
+ * (sin pausa si es cero) y aplica las escrituras de la cola. Al parar, vacía la cola.
+ */
+static void *runControl(void *argument)
+{
+    ControlResult *result = (ControlResult *)argument;
+    uint16_t counter = 0;
+    uint64_t nextUpdate = nowNanos();
+    while (isRunning)
+    {
+        if (updatePeriod == 0 || nowNanos() >= nextUpdate)
+        {
+            counter++;
+            image.beginUpdate();
+            for (uint16_t i = 0; i < BENCH_PAIRS; i++)
+            {
+                image.set(i * 2, counter + i);
+                image.set(i * 2 + 1, ~(counter + i));
+            }
+            image.commit();
+            result->updates++;
+            nextUpdate += updatePeriod;
+        }
+        applyWrites(result);
+    }
+    applyWrites(result);
+    return NULL;
+}
+
+struct ThreadsMode
+{
+    const char *name;
+    bool isImageEnabled;
+    unsigned long updatePeriod;
+};
+
+/**
+ * Una escritura que no cabe ni con la cola vacía se rechaza con STATUS_ILLEGAL_DATA_VALUE, sin
+ * contarla como congestión; la más larga que cabe se acepta.
+ */
+static long checkOversizedWrite()
+{
+    long failures = 0;
+    ModbusWrite write;
+    while (queue.pop(write))
+    {
+    }
+    uint32_t rejected = queue.getRejectedRequests();
+
+    stream.clearOutput();
+    benchTransact(slave, stream, benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, BENCH_QUEUE_SIZE), BENCH_SILENCE);
+    Frame response = stream.output();
+    failures += response.size() != 5 || !benchCheckCRC(response) || response[1] != (FC_WRITE_MULTIPLE_REGISTERS | 0x80) ||
+                response[2] != STATUS_ILLEGAL_DATA_VALUE || queue.available() != 0 || queue.getRejectedRequests() != rejected;
+
+    stream.clearOutput();
+    benchTransact(slave, stream, benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, 0, BENCH_QUEUE_SIZE - 1), BENCH_SILENCE);
+    response = stream.output();
+    failures += response.size() != 8 || !benchCheckCRC(response) || queue.available() != BENCH_QUEUE_SIZE - 1;
+    while (queue.pop(write))
+    {
+    }
+
+    printf("oversized write check: %ld failures (FC16 of %d registers on a %d-entry queue)\n", failures, BENCH_QUEUE_SIZE, BENCH_QUEUE_SIZE);
+    return failures;
+}
+
+int runThreadsBenchmark(int argc, char **argv)
+{
+    long transactions = argc > 1 ? atol(argv[1]) : 20000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.begin(115200);
+    hostAdvanceMicros(100000);
+
+    ThreadsMode modes[] = {
+        {"array", false, 0},
+        {"image", true, 0},
+        {"image", true, 1000},
+        {"image", true, 10000},
+    };
+
+    printf("%ld transactions (FC03 of %d register pairs, FC16 of one pair) against a control thread\n", transactions, BENCH_PAIRS);
+    printf("%-6s %10s %12s %10s %10s %10s %10s %10s %10s\n",
+           "reads", "update ns", "updates/s", "torn", "read busy", "writes", "bad writes", "write busy", "trans/s");
+
+    uint64_t failures = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    {
+        isImageEnabled = modes[m].isImageEnabled;
+        updatePeriod = modes[m].updatePeriod;
+        ControlResult control = ControlResult();
+
+        isRunning = true;
+        pthread_t thread;
+        pthread_create(&thread, NULL, runControl, &control);
+
+        uint64_t torn = 0;
+        uint64_t readBusy = 0;
+        uint64_t writeBusy = 0;
+        uint16_t sequence = control.lastSequence;
+        uint64_t start = nowNanos();
+        for (long t = 0; t < transactions; t++)
+        {
+            bool isWrite = t % 2 == 1;
+            Frame request;
+            if (isWrite)
+            {
+                // La misma secuencia se repite hasta que la cola la acepta.
+                uint16_t next = sequence + 1;
+                uint16_t address = BENCH_WRITE_ADDRESS + (next % BENCH_WRITE_SLOTS) * 2;
+                request = {BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, (uint8_t)(address >> 8), (uint8_t)(address & 0xFF),
+                           0, 2, 4, (uint8_t)(next >> 8), (uint8_t)(next & 0xFF), (uint8_t)(~next >> 8), (uint8_t)(~next & 0xFF)};
+                benchAppendCRC(request);
+            }
+            else
+            {
+                request = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 0, BENCH_REGISTERS);
+            }
+
+            stream.clearOutput();
+            benchTransact(slave, stream, request, BENCH_SILENCE);
+            const Frame &response = stream.output();
+            bool isBusy = response.size() > 2 && response[1] == (request[1] | 0x80) && response[2] == STATUS_SLAVE_DEVICE_BUSY;
+
+            // Un maestro real reintenta tras una pausa; aquí basta ceder la CPU al hilo de control.
+            if (isBusy)
+            {
+                sched_yield();
+            }
+
+            if (isWrite)
+            {
+                writeBusy += isBusy;
+                sequence += !isBusy;
+                continue;
+            }
+            if (isBusy)
+            {
+                readBusy++;
+                continue;
+            }
+            // Todos los pares de una respuesta vienen del mismo lote: (counter + i, ~(counter + i)).
+            uint16_t counter = (response[3] << 8) | response[4];
+            bool isTorn = false;
+            for (int i = 0; i < BENCH_PAIRS; i++)
+            {
+                uint16_t high = (response[3 + i * 4] << 8) | response[4 + i * 4];
+                uint16_t low = (response[5 + i * 4] << 8) | response[6 + i * 4];
+                isTorn = isTorn || high != (uint16_t)(counter + i) || low != (uint16_t)~high;
+            }
+            torn += isTorn;
+        }
+        double seconds = (nowNanos() - start) / 1e9;
+
+        isRunning = false;
+        pthread_join(thread, NULL);
+
+        control.badWrites += control.lastSequence != sequence;
+        printf("%-6s %10lu %12.0f %10llu %10llu %10llu %10llu %10llu %10.0f\n",
+               modes[m].name, updatePeriod, control.updates / seconds, (unsigned long long)torn,
+               (unsigned long long)readBusy, (unsigned long long)control.writes, (unsigned long long)control.badWrites,
+               (unsigned long long)writeBusy, transactions / seconds);
+
+        // Las lecturas sin sincronización son sólo la referencia: ahí se esperan pares a medias.
+        failures += (modes[m].isImageEnabled ? torn : 0) + control.badWrites;
+    }
+
+    failures += checkOversizedWrite();
+    return failures == 0 ? 0 : 1;
+}
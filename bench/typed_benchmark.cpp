@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/**
+ * Valores de 32 y 64 bits con el reloj manual: tablas int32, uint32, float, double e
+ * int64 de 60 registros cada una, servidas por FC03 y escritas por FC16. Compara la
+ * conversión escrita a mano en la devolución de llamada, registro a registro con
+ * writeRegisterToBuffer()/readRegisterFromBuffer(), con ModbusTypedMap. Comprueba que
+ * ambas dan los mismos bytes en los cuatro órdenes de palabras, el vector conocido de
+ * 1.0f, y mide el tiempo de createResponse() por solicitud.
+ */
+
+#define BENCH_UNIT_ADDRESS 0x11
+#define BENCH_REGISTERS 60
+#define BENCH_TABLE_STRIDE 100
+
+static MockStream stream(MODBUS_MAX_BUFFER);
+static Modbus slave(stream, BENCH_UNIT_ADDRESS);
+
+static int32_t int32Values[BENCH_REGISTERS / 2];
+static uint32_t uint32Values[BENCH_REGISTERS / 2];
+static float floatValues[BENCH_REGISTERS / 2];
+static double doubleValues[BENCH_REGISTERS / 4];
+static int64_t int64Values[BENCH_REGISTERS / 4];
+
+static ModbusTypedMap maps[] = {
+    ModbusTypedMap(int32Values, 0 * BENCH_TABLE_STRIDE, BENCH_REGISTERS / 2),
+    ModbusTypedMap(uint32Values, 1 * BENCH_TABLE_STRIDE, BENCH_REGISTERS / 2),
+    ModbusTypedMap(floatValues, 2 * BENCH_TABLE_STRIDE, BENCH_REGISTERS / 2),
+    ModbusTypedMap(doubleValues, 3 * BENCH_TABLE_STRIDE, BENCH_REGISTERS / 4),
+    ModbusTypedMap(int64Values, 4 * BENCH_TABLE_STRIDE, BENCH_REGISTERS / 4),
+};
+
+static uint8_t *tables[] = {
+    (uint8_t *)int32Values, (uint8_t *)uint32Values, (uint8_t *)floatValues, (uint8_t *)doubleValues, (uint8_t *)int64Values};
+static const uint8_t valueSizes[] = {4, 4, 4, 8, 8};
+static const char *typeNames[] = {"int32", "uint32", "float", "double", "int64"};
+static const char *orderNames[] = {"ABCD", "CDAB", "BADC", "DCBA"};
+
+#define BENCH_NUMBER_OF_TABLES (sizeof(maps) / sizeof(maps[0]))
+
+static bool isTyped;
+
+/**
+ * Palabra w (en el orden de la trama) de un valor, como la calcula a mano una devolución de llamada.
+ */
+static uint16_t handWord(const uint8_t *value, uint8_t valueSize, uint8_t wordOrder, uint8_t w)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, value, valueSize);
+    uint8_t words = valueSize / 2;
+    bool isLowWordFirst = wordOrder == WORD_ORDER_CDAB || wordOrder == WORD_ORDER_DCBA;
+    uint16_t word = bits >> (16 * (isLowWordFirst ? w : words - 1 - w));
+    if (wordOrder == WORD_ORDER_BADC || wordOrder == WORD_ORDER_DCBA)
+    {
+        word = (word << 8) | (word >> 8);
+    }
+    return word;
+}
+
+static void handSetWord(uint8_t *value, uint8_t valueSize, uint8_t wordOrder, uint8_t w, uint16_t word)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, value, valueSize);
+    uint8_t words = valueSize / 2;
+    bool isLowWordFirst = wordOrder == WORD_ORDER_CDAB || wordOrder == WORD_ORDER_DCBA;
+    if (wordOrder == WORD_ORDER_BADC || wordOrder == WORD_ORDER_DCBA)
+    {
+        word = (word << 8) | (word >> 8);
+    }
+    uint8_t shift = 16 * (isLowWordFirst ? w : words - 1 - w);
+    bits = (bits & ~((uint64_t)0xFFFF << shift)) | ((uint64_t)word << shift);
+    memcpy(value, &bits, valueSize);
+}
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    size_t t = address / BENCH_TABLE_STRIDE;
+    if (t >= BENCH_NUMBER_OF_TABLES)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    if (isTyped)
+    {
+        return slave.writeTypedToBuffer(0, maps[t], address, length);
+    }
+
+    uint8_t words = valueSizes[t] / 2;
+    uint16_t first = address - t * BENCH_TABLE_STRIDE;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        const uint8_t *value = tables[t] + ((first + i) / words) * valueSizes[t];
+        slave.writeRegisterToBuffer(i, handWord(value, valueSizes[t], maps[t].getWordOrder(), (first + i) % words));
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    size_t t = address / BENCH_TABLE_STRIDE;
+    if (t >= BENCH_NUMBER_OF_TABLES)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    if (isTyped)
+    {
+        return slave.readTypedFromBuffer(0, maps[t], address, length);
+    }
+
+    uint8_t words = valueSizes[t] / 2;
+    uint16_t first = address - t * BENCH_TABLE_STRIDE;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint8_t *value = tables[t] + ((first + i) / words) * valueSizes[t];
+        handSetWord(value, valueSizes[t], maps[t].getWordOrder(), (first + i) % words, slave.readRegisterFromBuffer(i));
+    }
+    return STATUS_OK;
+}
+
+static void fillTables(unsigned int seed)
+{
+    srand(seed);
+    for (size_t t = 0; t < BENCH_NUMBER_OF_TABLES; t++)
+    {
+        for (size_t i = 0; i < BENCH_REGISTERS * 2; i++)
+        {
+            tables[t][i] = rand();
+        }
+    }
+}
+
+static Frame transact(const Frame &request, unsigned long silence)
+{
+    stream.clearOutput();
+    benchTransact(slave, stream, request, silence);
+    return stream.output();
+}
+
+/**
+ * Lectura completa de cada tabla en cada orden, a mano y con la vista; después la
+ * respuesta a mano se escribe de vuelta con FC16 a través de la vista sobre tablas
+ * borradas y debe reconstruir los valores.
+ */
+static long checkConversions(unsigned long silence)
+{
+    long failures = 0;
+    for (size_t t = 0; t < BENCH_NUMBER_OF_TABLES; t++)
+    {
+        for (uint8_t order = WORD_ORDER_ABCD; order <= WORD_ORDER_DCBA; order++)
+        {
+            maps[t].setWordOrder(order);
+            fillTables(t * 4 + order);
+            uint16_t address = t * BENCH_TABLE_STRIDE;
+            Frame read = benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, BENCH_REGISTERS);
+            isTyped = false;
+            Frame hand = transact(read, silence);
+            isTyped = true;
+            Frame typed = transact(read, silence);
+            failures += hand != typed || !benchCheckCRC(typed) || typed.size() != 5 + BENCH_REGISTERS * 2;
+
+            Frame original(tables[t], tables[t] + BENCH_REGISTERS * 2);
+            memset(tables[t], 0, BENCH_REGISTERS * 2);
+            Frame write = benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, address, BENCH_REGISTERS);
+            for (size_t i = 0; i < BENCH_REGISTERS * 2 && 3 + i < hand.size(); i++)
+            {
+                write[7 + i] = hand[3 + i];
+            }
+            write.resize(write.size() - 2);
+            benchAppendCRC(write);
+            Frame response = transact(write, silence);
+            failures += response.size() != 8 || memcmp(original.data(), tables[t], BENCH_REGISTERS * 2) != 0;
+        }
+        maps[t].setWordOrder(WORD_ORDER_ABCD);
+    }
+
+    // 1.0f es 3F 80 00 00 en ABCD.
+    floatValues[0] = 1.0f;
+    Frame one = transact(benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 2 * BENCH_TABLE_STRIDE, 2), silence);
+    failures += one.size() != 9 || one[3] != 0x3F || one[4] != 0x80 || one[5] != 0 || one[6] != 0;
+
+    // Media palabra de un valor, o un FC06 sobre un valor, se rechazan con la excepción 2.
+    Frame half = transact(benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, 2 * BENCH_TABLE_STRIDE + 1, 2), silence);
+    Frame single = transact(benchWriteSingleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_REGISTER, 2 * BENCH_TABLE_STRIDE, 1), silence);
+    failures += half.size() != 5 || half[2] != STATUS_ILLEGAL_DATA_ADDRESS;
+    failures += single.size() != 5 || single[2] != STATUS_ILLEGAL_DATA_ADDRESS;
+    return failures;
+}
+
+int runTypedBenchmark(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 20000;
+    hostUseManualClock(true);
+    hostSetMicros(1000000);
+    slave.cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave.begin(115200);
+    unsigned long silence = 800;
+    hostAdvanceMicros(silence * 4);
+
+    long failures = checkConversions(silence);
+    printf("conversion check: %ld failures (5 types x 4 word orders, FC03 and FC16, 1.0f, partial values)\n", failures);
+
+    printf("%d registers per request, createResponse() ns per request\n", BENCH_REGISTERS);
+    printf("%-8s %-6s %-6s %10s %10s %8s\n", "type", "order", "fc", "hand", "typed", "speedup");
+    for (size_t t = 0; t < BENCH_NUMBER_OF_TABLES; t++)
+    {
+        for (uint8_t order = WORD_ORDER_ABCD; order <= WORD_ORDER_CDAB; order++)
+        {
+            maps[t].setWordOrder(order);
+            uint16_t address = t * BENCH_TABLE_STRIDE;
+            Frame requests[] = {benchReadRequest(BENCH_UNIT_ADDRESS, FC_READ_HOLDING_REGISTERS, address, BENCH_REGISTERS),
+                                benchWriteMultipleRequest(BENCH_UNIT_ADDRESS, FC_WRITE_MULTIPLE_REGISTERS, address, BENCH_REGISTERS)};
+            for (size_t r = 0; r < 2; r++)
+            {
+                double nanos[2];
+                for (int mode = 0; mode < 2; mode++)
+                {
+                    isTyped = mode == 1;
+                    slave.resetProfile();
+                    for (long i = 0; i < iterations; i++)
+                    {
+                        stream.clearOutput();
+                        benchTransact(slave, stream, requests[r], silence);
+                    }
+                    nanos[mode] = (double)slave.getProfile().createResponseTime / iterations;
+                }
+                printf("%-8s %-6s %-6s %10.0f %10.0f %7.1fx\n", typeNames[t], orderNames[order], r == 0 ? "FC03" : "FC16",
+                       nanos[0], nanos[1], nanos[0] / nanos[1]);
+            }
+        }
+        maps[t].setWordOrder(WORD_ORDER_ABCD);
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include "bench.h"
+
+BenchWire::BenchWire(MockStream &from, MockStream &to, unsigned long baudRate)
+    : _from(from), _to(to), _charTimeInMicroSecond(11000000UL / baudRate)
+{
+}
+
+/**
+ * Pone en la línea los bytes escritos desde la última llamada y entrega los que ya llegaron.
+ */
+void BenchWire::transfer()
+{
+    unsigned long now = micros();
+    const Frame &output = _from.output();
+    for (size_t i = 0; i < output.size(); i++)
+    {
+        // Cada byte sale cuando la línea queda libre y tarda un tiempo de carácter.
+        unsigned long start = (long)(_lastArrival - now) > 0 ? _lastArrival : now;
+        _lastArrival = start + _charTimeInMicroSecond;
+
+        uint8_t value = output[i];
+        if (_corruptionRate > 0 && (rand() % _corruptionRate) == 0)
+        {
+            value ^= 0x10;
+            _totalCorrupted++;
+        }
+        _line.push_back(std::make_pair(_lastArrival, value));
+    }
+    _from.clearOutput();
+
+    while (!_line.empty() && (long)(_line.front().first - now) <= 0)
+    {
+        uint8_t value = _line.front().second;
+        _to.inject(&value, 1);
+        _line.pop_front();
+    }
+}
+
+/**
+ * Invierte un bit de uno de cada oneIn bytes (cero para no dañar ninguno).
+ */
+void BenchWire::setCorruptionRate(long oneIn)
+{
+    _corruptionRate = oneIn;
+}
+
+/**
+ * Devuelve el número de bytes escritos que aún no han llegado al otro extremo.
+ */
+size_t BenchWire::pending()
+{
+    return _from.output().size() + _line.size();
+}
@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <MockStream.h>
+#include <time.h>
+
+static bool hostManualClock = false;
+static unsigned long hostManualMicros = 0;
+static uint8_t hostPinStates[256];
+static unsigned long hostPinWriteCounts[256];
+
+/**
+ * ---------------------------------------------------
+ *                  RELOJ Y PINES
+ * ---------------------------------------------------
+ */
+
+uint64_t hostNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+uint64_t hostCpuNanos()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void hostUseManualClock(bool manual)
+{
+    hostManualClock = manual;
+}
+
+void hostSetMicros(unsigned long now)
+{
+    hostManualMicros = now;
+}
+
+void hostAdvanceMicros(unsigned long delta)
+{
+    hostManualMicros += delta;
+}
+
+unsigned long micros()
+{
+    if (hostManualClock)
+    {
+        return hostManualMicros;
+    }
+    return (unsigned long)(hostNanos() / 1000);
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+    delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (hostManualClock)
+    {
+        hostManualMicros += us;
+        return;
+    }
+    struct timespec duration = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    nanosleep(&duration, NULL);
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    hostPinStates[pin] = value;
+    hostPinWriteCounts[pin]++;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return hostPinStates[pin];
+}
+
+unsigned long hostPinWrites(uint8_t pin)
+{
+    return hostPinWriteCounts[pin];
+}
+
+void noInterrupts()
+{
+}
+
+void interrupts()
+{
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRINT Y STREAM
+ * ---------------------------------------------------
+ */
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (written < size && write(buffer[written]))
+    {
+        written++;
+    }
+    return written;
+}
+
+size_t Print::print(long value, int base)
+{
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%ld", value);
+    return write(text);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lX" : "%lu", value);
+    return write(text);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char text[40];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length)
+{
+    // Sin bloqueo: el host nunca espera el tiempo de espera del Stream.
+    size_t count = 0;
+    while (count < length && available() > 0)
+    {
+        buffer[count++] = (uint8_t)read();
+    }
+    return count;
+}
+
+MockStream::MockStream(int transmissionBufferLength, bool captureOutput)
+    : _transmissionBufferLength(transmissionBufferLength), _captureOutput(captureOutput)
+{
+}
+
+void MockStream::inject(const uint8_t *buffer, size_t length)
+{
+    // Compacta los bytes ya leídos antes de añadir nuevos.
+    if (_inputIndex == _input.size())
+    {
+        _input.clear();
+        _inputIndex = 0;
+    }
+    _input.insert(_input.end(), buffer, buffer + length);
+}
+
+int MockStream::available()
+{
+    return (int)(_input.size() - _inputIndex);
+}
+
+int MockStream::read()
+{
+    if (_inputIndex >= _input.size())
+    {
+        return -1;
+    }
+    return _input[_inputIndex++];
+}
+
+int MockStream::peek()
+{
+    if (_inputIndex >= _input.size())
+    {
+        return -1;
+    }
+    return _input[_inputIndex];
+}
+
+size_t MockStream::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t MockStream::write(const uint8_t *buffer, size_t size)
+{
+    if (_captureOutput)
+    {
+        _output.insert(_output.end(), buffer, buffer + size);
+    }
+    _totalBytesWritten += size;
+    return size;
+}
+
+// La consola del host descarta lo que se imprime en Serial (mensajes de depuración del sketch).
+static MockStream hostSerial(SERIAL_TX_BUFFER_SIZE, false);
+Stream &Serial = hostSerial;
@@ -0,0 +1,108 @@
+#ifndef ARDUINO_HOST_H
+#define ARDUINO_HOST_H
+
+/**
+ * Núcleo Arduino mínimo para compilar la biblioteca en el host (env:native).
+ * Sólo incluye lo que usan la biblioteca y las herramientas de prueba.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <type_traits>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define DEC 10
+#define HEX 16
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+#define lowByte(w) ((uint8_t)((w) & 0xFF))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define word(high, low) ((uint16_t)(((uint16_t)(high) << 8) | (uint8_t)(low)))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+template <class A, class B>
+inline typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+inline typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+void noInterrupts();
+void interrupts();
+
+/**
+ * Control del reloj y de los pines simulados.
+ *
+ * Por defecto micros()/millis() siguen el reloj monótono del host. Con
+ * hostUseManualClock(true) sólo avanzan con hostSetMicros()/hostAdvanceMicros(),
+ * lo que permite reproducir exactamente los tiempos de trama en pruebas.
+ */
+void hostUseManualClock(bool manual);
+void hostSetMicros(unsigned long now);
+void hostAdvanceMicros(unsigned long delta);
+uint64_t hostNanos();
+uint64_t hostCpuNanos();
+unsigned long hostPinWrites(uint8_t pin);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t value) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char value) { return write((uint8_t)value); }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(double value, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <class T>
+  size_t println(T value) { return print(value) + println(); }
+  template <class T>
+  size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long timeout) { _timeout = timeout; }
+  size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+  size_t readBytes(uint8_t *buffer, size_t length);
+
+protected:
+  unsigned long _timeout = 1000;
+};
+
+extern Stream &Serial;
+
+#endif
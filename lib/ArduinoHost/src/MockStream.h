@@ -0,0 +1,39 @@
+#ifndef MOCK_STREAM_H
+#define MOCK_STREAM_H
+#include <Arduino.h>
+#include <vector>
+
+/**
+ * @class MockStream
+ *
+ * Stream en memoria: la prueba inyecta los bytes que "llegan" con inject() y
+ * recoge los bytes escritos con output(). availableForWrite() simula un búfer
+ * de transmisión de tamaño fijo que siempre está vacío.
+ */
+class MockStream : public Stream
+{
+public:
+  MockStream(int transmissionBufferLength = SERIAL_TX_BUFFER_SIZE, bool captureOutput = true);
+
+  void inject(const uint8_t *buffer, size_t length);
+  const std::vector<uint8_t> &output() { return _output; }
+  void clearOutput() { _output.clear(); }
+  uint64_t totalBytesWritten() { return _totalBytesWritten; }
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *buffer, size_t size);
+  int availableForWrite() { return _transmissionBufferLength; }
+
+private:
+  std::vector<uint8_t> _input;
+  size_t _inputIndex = 0;
+  std::vector<uint8_t> _output;
+  int _transmissionBufferLength;
+  bool _captureOutput;
+  uint64_t _totalBytesWritten = 0;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "ModbusSlave.h"
+
+/**
+ * Registro de captura: 4 x time (little endian), 1 x flags, n x data.
+ * flags: bit 7 = enviado (TX), bits 0..6 = n (1..127).
+ *
+ * Archivo de captura: 4 x "MBCP", 1 x version, 4 x baudRate (little endian) y los
+ * registros, del más antiguo al más reciente.
+ */
+#define MODBUS_CAPTURE_RECORD_HEADER_SIZE 5
+#define MODBUS_CAPTURE_TRANSMIT 0x80
+#define MODBUS_CAPTURE_MAX_DATA 0x7F
+#define MODBUS_CAPTURE_VERSION 1
+
+/**
+ * Inicializa un anillo de captura vacío sobre un búfer propiedad de la aplicación.
+ *
+ * @param buffer Puntero al búfer del anillo.
+ * @param size El tamaño del búfer en bytes (al menos MODBUS_CAPTURE_RECORD_HEADER_SIZE + 1).
+ */
+ModbusCapture::ModbusCapture(uint8_t *buffer, uint16_t size)
+    : _buffer(buffer), _size(size)
+{
+}
+
+/**
+ * Descarta todos los registros.
+ */
+void ModbusCapture::clear()
+{
+    _head = 0;
+    _tail = 0;
+    _length = 0;
+    _overwrittenRecords = 0;
+}
+
+/**
+ * Detiene o reanuda la captura, p. ej. para conservar el tráfico anterior a un fallo.
+ */
+void ModbusCapture::setPaused(bool isPaused)
+{
+    _isPaused = isPaused;
+}
+
+/**
+ * Añade los bytes leídos o escritos con la marca de tiempo actual, descartando
+ * los registros más antiguos si no caben.
+ *
+ * @param isTransmit Verdadero para bytes enviados, falso para bytes recibidos.
+ * @param data Los bytes.
+ * @param length El número de bytes.
+ */
+void ModbusCapture::record(bool isTransmit, const uint8_t *data, uint16_t length)
+{
+    if (_isPaused || _size <= MODBUS_CAPTURE_RECORD_HEADER_SIZE)
+    {
+        return;
+    }
+
+    uint32_t time = micros();
+    uint16_t maxData = min(MODBUS_CAPTURE_MAX_DATA, _size - MODBUS_CAPTURE_RECORD_HEADER_SIZE);
+    while (length > 0)
+    {
+        uint8_t chunk = min(length, maxData);
+        while (_size - _length < MODBUS_CAPTURE_RECORD_HEADER_SIZE + chunk)
+        {
+            ModbusCapture::dropOldestRecord();
+        }
+
+        push(time & 0xFF);
+        push((time >> 8) & 0xFF);
+        push((time >> 16) & 0xFF);
+        push(time >> 24);
+        push((isTransmit ? MODBUS_CAPTURE_TRANSMIT : 0) | chunk);
+        for (uint8_t i = 0; i < chunk; i++)
+        {
+            push(data[i]);
+        }
+
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Escribe el contenido del anillo en el formato de archivo de captura.
+ *
+ * @param output El destino (p. ej. un archivo de SD o Serial).
+ * @param baudRate La velocidad del puerto capturado, para la reproducción.
+ * @return El número de bytes escritos.
+ */
+size_t ModbusCapture::exportTo(Print &output, uint32_t baudRate)
+{
+    uint8_t header[] = {'M', 'B', 'C', 'P', MODBUS_CAPTURE_VERSION,
+                        (uint8_t)(baudRate & 0xFF), (uint8_t)((baudRate >> 8) & 0xFF),
+                        (uint8_t)((baudRate >> 16) & 0xFF), (uint8_t)(baudRate >> 24)};
+    size_t written = output.write(header, sizeof(header));
+
+    // Los registros pueden dar la vuelta al final del búfer: dos escrituras como mucho.
+    uint16_t first = min(_length, _size - _tail);
+    written += output.write(_buffer + _tail, first);
+    if (_length > first)
+    {
+        written += output.write(_buffer, _length - first);
+    }
+    return written;
+}
+
+/**
+ * Devuelve el número de bytes ocupados en el anillo.
+ */
+uint16_t ModbusCapture::getLength()
+{
+    return _length;
+}
+
+/**
+ * Devuelve el número de registros descartados por falta de espacio desde clear().
+ */
+uint32_t ModbusCapture::getOverwrittenRecords()
+{
+    return _overwrittenRecords;
+}
+
+/**
+ * Activa la captura de los bytes recibidos en readRequest() y enviados en writeResponse().
+ *
+ * @param capture El anillo de captura o NULL para desactivarla.
+ */
+void Modbus::enableCapture(ModbusCapture *capture)
+{
+    _capture = capture;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Devuelve el byte a offset bytes del registro más antiguo.
+ */
+uint8_t ModbusCapture::peek(uint16_t offset)
+{
+    return _buffer[(_tail + offset) % _size];
+}
+
+void ModbusCapture::push(uint8_t value)
+{
+    _buffer[_head] = value;
+    _head = (_head + 1) % _size;
+    _length++;
+}
+
+void ModbusCapture::dropOldestRecord()
+{
+    uint16_t recordLength = MODBUS_CAPTURE_RECORD_HEADER_SIZE + (peek(4) & MODBUS_CAPTURE_MAX_DATA);
+    _tail = (_tail + recordLength) % _size;
+    _length -= recordLength;
+    _overwrittenRecords++;
+}
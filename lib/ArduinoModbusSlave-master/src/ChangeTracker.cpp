@@ -0,0 +1,252 @@
+#include "ModbusSlave.h"
+
+#define MODBUS_FRAME_SIZE 4
+
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+
+/**
+ * Respuesta de FC_READ_CHANGES (tras la dirección y el código de función):
+ *
+ *     1 x byteCount, 2 x epoch, 2 x generation, 2 x nextAddress, n x (2 x address, 2 x value)
+ *
+ * epoch identifica el arranque del esclavo, generation es el cursor para la próxima
+ * ronda y nextAddress la dirección desde la que continuar la ronda actual con el mismo
+ * cursor, o MODBUS_CHANGES_END si terminó.
+ */
+#define MODBUS_CHANGES_HEADER_SIZE 7
+#define MODBUS_CHANGES_PAIR_SIZE 4
+#define MODBUS_CHANGES_MAX_PAIRS ((MODBUS_MAX_BUFFER - MODBUS_FRAME_SIZE - MODBUS_CHANGES_HEADER_SIZE) / MODBUS_CHANGES_PAIR_SIZE)
+
+/**
+ * Inicializa el seguimiento de cambios sobre matrices propiedad de la aplicación.
+ *
+ * @param registers Puntero a los valores de los registros.
+ * @param generations Puntero a numberOfRegisters generaciones, una por registro.
+ * @param firstAddress La dirección Modbus del primer registro.
+ * @param numberOfRegisters El número de registros (como mucho MODBUS_CHANGES_MAX_AGE).
+ */
+ModbusChangeTracker::ModbusChangeTracker(uint16_t *registers, uint16_t *generations, uint16_t firstAddress, uint16_t numberOfRegisters)
+    : _registers(registers), _generations(generations), _firstAddress(firstAddress),
+      _numberOfRegisters(min(numberOfRegisters, (uint16_t)MODBUS_CHANGES_MAX_AGE))
+{
+}
+
+/**
+ * Marca todos los registros como cambiados en la generación actual, que vuelve a 1.
+ * Un maestro que empieza con el cursor MODBUS_CHANGES_FULL_SYNC recibe todos los registros.
+ *
+ * Tras un reinicio el cursor de un maestro puede caer dentro de las generaciones nuevas y
+ * los valores de arranque no le llegarían. Por eso cada respuesta lleva epoch: si cambia,
+ * el maestro vuelve a MODBUS_CHANGES_FULL_SYNC.
+ *
+ * @param epoch Un valor distinto en cada arranque, por ejemplo un contador de arranques en
+ *              EEPROM o random() sembrado con ruido de una entrada analógica.
+ */
+void ModbusChangeTracker::begin(uint16_t epoch)
+{
+    _epoch = epoch;
+    _generation = 1;
+    _nextAgedIndex = 0;
+    for (uint16_t i = 0; i < _numberOfRegisters; i++)
+    {
+        _generations[i] = _generation;
+    }
+}
+
+/**
+ * Devuelve el valor actual de un registro (cero si está fuera del rango).
+ *
+ * @param address La dirección Modbus del registro.
+ */
+uint16_t ModbusChangeTracker::get(uint16_t address)
+{
+    if (!contains(address, 1))
+    {
+        return 0;
+    }
+    return _registers[address - _firstAddress];
+}
+
+/**
+ * Cambia el valor de un registro. Si el valor es distinto, el cambio recibe una generación nueva.
+ *
+ * @param address La dirección Modbus del registro.
+ * @param value El nuevo valor.
+ */
+void ModbusChangeTracker::set(uint16_t address, uint16_t value)
+{
+    if (!contains(address, 1))
+    {
+        return;
+    }
+
+    uint16_t index = address - _firstAddress;
+    if (_registers[index] == value)
+    {
+        return;
+    }
+    _registers[index] = value;
+
+    // La generación cero está reservada para MODBUS_CHANGES_FULL_SYNC.
+    if (++_generation == MODBUS_CHANGES_FULL_SYNC)
+    {
+        _generation++;
+    }
+    _generations[index] = _generation;
+
+    // Envejece un registro por cambio, así ninguna generación queda a más de media
+    // vuelta del contador y la comparación circular sigue siendo válida.
+    if ((uint16_t)(_generation - _generations[_nextAgedIndex]) > MODBUS_CHANGES_MAX_AGE)
+    {
+        _generations[_nextAgedIndex] = _generation - MODBUS_CHANGES_MAX_AGE;
+    }
+    _nextAgedIndex = (_nextAgedIndex + 1) % _numberOfRegisters;
+}
+
+/**
+ * Devuelve verdadero si el rango de registros dado está completamente dentro del seguimiento.
+ *
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ */
+bool ModbusChangeTracker::contains(uint16_t address, uint16_t length)
+{
+    return address >= _firstAddress &&
+           (uint32_t)address + length <= (uint32_t)_firstAddress + _numberOfRegisters;
+}
+
+/**
+ * Devuelve el valor de arranque dado a begin().
+ */
+uint16_t ModbusChangeTracker::getEpoch()
+{
+    return _epoch;
+}
+
+/**
+ * Devuelve la generación del último cambio.
+ */
+uint16_t ModbusChangeTracker::getGeneration()
+{
+    return _generation;
+}
+
+/**
+ * Escribe en el búfer de salida los registros pedidos por una lectura FC03.
+ *
+ * @param modbus El objeto modbus que atiende la solicitud.
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t ModbusChangeTracker::readToBuffer(Modbus &modbus, uint16_t address, uint16_t length)
+{
+    if (!contains(address, length))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    return modbus.writeArrayToBuffer(0, _registers + (address - _firstAddress), length);
+}
+
+/**
+ * Aplica los valores de una escritura FC06/FC16, que cuentan como cambios.
+ *
+ * @param modbus El objeto modbus que atiende la solicitud.
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t ModbusChangeTracker::writeFromBuffer(Modbus &modbus, uint16_t address, uint16_t length)
+{
+    if (!contains(address, length))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        set(address + i, modbus.readRegisterFromBuffer(i));
+    }
+    return STATUS_OK;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Devuelve verdadero si el registro cambió después de la generación cursor (comparación circular).
+ */
+bool ModbusChangeTracker::isChanged(uint16_t index, uint16_t cursor)
+{
+    return (int16_t)(_generations[index] - cursor) > 0;
+}
+
+/**
+ * Responde a FC_READ_CHANGES con los pares (dirección, valor) de los registros que
+ * cambiaron después de cursor, desde la dirección dada, tantos como quepan en la
+ * respuesta. Un cursor MODBUS_CHANGES_FULL_SYNC, o más antiguo que MODBUS_CHANGES_MAX_AGE
+ * generaciones, devuelve todos los registros.
+ *
+ * Para una ronda completa el maestro repite la solicitud con el mismo cursor y la
+ * dirección nextAddress de cada respuesta hasta recibir MODBUS_CHANGES_END, y usa la
+ * generación de la primera respuesta de la ronda como cursor de la siguiente. Si epoch
+ * cambia, el esclavo se reinició y el maestro empieza una ronda con MODBUS_CHANGES_FULL_SYNC.
+ *
+ * @param tracker El seguimiento de cambios.
+ * @param cursor La generación que el maestro ya conoce.
+ * @param address La dirección Modbus desde la que buscar cambios.
+ * @return STATUS_OK si tiene éxito; de lo contrario STATUS_ILLEGAL_DATA_ADDRESS.
+ */
+uint8_t Modbus::writeChangesToBuffer(ModbusChangeTracker &tracker, uint16_t cursor, uint16_t address)
+{
+    // Verifique el código de la función.
+    if (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX] != FC_READ_CHANGES)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    uint16_t generation = tracker._generation;
+    bool isFullSync = cursor == MODBUS_CHANGES_FULL_SYNC || (uint16_t)(generation - cursor) > MODBUS_CHANGES_MAX_AGE;
+
+    uint16_t first = address > tracker._firstAddress ? address - tracker._firstAddress : 0;
+    uint16_t nextAddress = MODBUS_CHANGES_END;
+    uint16_t index = MODBUS_DATA_INDEX + MODBUS_CHANGES_HEADER_SIZE;
+    uint8_t pairs = 0;
+
+    for (uint16_t i = first; i < tracker._numberOfRegisters; i++)
+    {
+        if (!isFullSync && !tracker.isChanged(i, cursor))
+        {
+            continue;
+        }
+
+        // La respuesta está llena: el maestro continúa desde este registro.
+        if (pairs == MODBUS_CHANGES_MAX_PAIRS)
+        {
+            nextAddress = tracker._firstAddress + i;
+            break;
+        }
+
+        uint16_t registerAddress = tracker._firstAddress + i;
+        uint16_t value = tracker._registers[i];
+        _responseBuffer[index++] = registerAddress >> 8;
+        _responseBuffer[index++] = registerAddress & 0xFF;
+        _responseBuffer[index++] = value >> 8;
+        _responseBuffer[index++] = value & 0xFF;
+        pairs++;
+    }
+
+    _responseBuffer[MODBUS_DATA_INDEX] = MODBUS_CHANGES_HEADER_SIZE - 1 + pairs * MODBUS_CHANGES_PAIR_SIZE;
+    _responseBuffer[MODBUS_DATA_INDEX + 1] = tracker._epoch >> 8;
+    _responseBuffer[MODBUS_DATA_INDEX + 2] = tracker._epoch & 0xFF;
+    _responseBuffer[MODBUS_DATA_INDEX + 3] = generation >> 8;
+    _responseBuffer[MODBUS_DATA_INDEX + 4] = generation & 0xFF;
+    _responseBuffer[MODBUS_DATA_INDEX + 5] = nextAddress >> 8;
+    _responseBuffer[MODBUS_DATA_INDEX + 6] = nextAddress & 0xFF;
+    _responseBufferLength += 1 + _responseBuffer[MODBUS_DATA_INDEX];
+    return STATUS_OK;
+}
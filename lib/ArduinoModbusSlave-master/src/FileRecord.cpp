@@ -0,0 +1,159 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+#define MODBUS_DATA_INDEX 2
+
+/**
+ * Subsolicitud de FC20: 1 x referenceType, 2 x fileNumber, 2 x recordNumber, 2 x recordLength.
+ * Subsolicitud de FC21: la misma cabecera seguida de 2 x recordLength bytes de datos.
+ * Subrespuesta de FC20: 1 x length, 1 x referenceType, 2 x recordLength bytes de datos.
+ */
+#define MODBUS_FILE_REFERENCE_TYPE 6
+#define MODBUS_FILE_HEADER_SIZE 7
+#define MODBUS_FILE_MAX_RECORD 0x270F
+#define MODBUS_FILE_READ_MIN_BYTES 0x07
+#define MODBUS_FILE_READ_MAX_BYTES 0xF5
+#define MODBUS_FILE_WRITE_MIN_BYTES 0x09
+#define MODBUS_FILE_WRITE_MAX_BYTES 0xFB
+
+#define readUInt16(arr, index) word(arr[index], arr[index + 1])
+
+/**
+ * Establece el proveedor de los archivos de FC20/FC21. Sin proveedor, ambos códigos de
+ * función responden STATUS_ILLEGAL_FUNCTION.
+ *
+ * @param provider El proveedor de archivos o NULL.
+ */
+void Modbus::setFileProvider(ModbusFileProvider *provider)
+{
+    _fileProvider = provider;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Crea la respuesta a FC20: valida todas las subsolicitudes y después el proveedor
+ * escribe los registros de cada una directamente en el búfer de salida.
+ *
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t Modbus::readFileRecords()
+{
+    if (_fileProvider == NULL)
+    {
+        return STATUS_ILLEGAL_FUNCTION;
+    }
+
+    uint8_t byteCount = _requestBuffer[MODBUS_DATA_INDEX];
+    if (byteCount < MODBUS_FILE_READ_MIN_BYTES || byteCount > MODBUS_FILE_READ_MAX_BYTES ||
+        byteCount % MODBUS_FILE_HEADER_SIZE != 0)
+    {
+        return STATUS_ILLEGAL_DATA_VALUE;
+    }
+
+    uint16_t end = MODBUS_DATA_INDEX + 1 + byteCount;
+    uint32_t responseLength = 0;
+    for (uint16_t index = MODBUS_DATA_INDEX + 1; index < end; index += MODBUS_FILE_HEADER_SIZE)
+    {
+        if (_requestBuffer[index] != MODBUS_FILE_REFERENCE_TYPE ||
+            readUInt16(_requestBuffer, index + 3) > MODBUS_FILE_MAX_RECORD ||
+            readUInt16(_requestBuffer, index + 5) == 0)
+        {
+            return STATUS_ILLEGAL_DATA_ADDRESS;
+        }
+        responseLength += 2 + (uint32_t)readUInt16(_requestBuffer, index + 5) * 2;
+    }
+
+    // La respuesta completa tiene que caber en una trama.
+    if (responseLength > MODBUS_FILE_READ_MAX_BYTES)
+    {
+        return STATUS_ILLEGAL_DATA_VALUE;
+    }
+
+    uint16_t responseIndex = MODBUS_DATA_INDEX + 1;
+    for (uint16_t index = MODBUS_DATA_INDEX + 1; index < end; index += MODBUS_FILE_HEADER_SIZE)
+    {
+        uint16_t recordLength = readUInt16(_requestBuffer, index + 5);
+        _responseBuffer[responseIndex] = 1 + recordLength * 2;
+        _responseBuffer[responseIndex + 1] = MODBUS_FILE_REFERENCE_TYPE;
+
+        uint8_t status = _fileProvider->readRecords(readUInt16(_requestBuffer, index + 1),
+                                                    readUInt16(_requestBuffer, index + 3),
+                                                    _responseBuffer + responseIndex + 2, recordLength);
+        if (status != STATUS_OK)
+        {
+            return status;
+        }
+        responseIndex += 2 + recordLength * 2;
+    }
+
+    _responseBuffer[MODBUS_DATA_INDEX] = responseLength;
+    _responseBufferLength += 1 + responseLength;
+    return STATUS_OK;
+}
+
+/**
+ * Crea la respuesta a FC21: valida todas las subsolicitudes antes de escribir ninguna,
+ * el proveedor lee los registros directamente del búfer de entrada y la respuesta
+ * repite la solicitud.
+ *
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t Modbus::writeFileRecords()
+{
+    if (_fileProvider == NULL)
+    {
+        return STATUS_ILLEGAL_FUNCTION;
+    }
+
+    uint8_t byteCount = _requestBuffer[MODBUS_DATA_INDEX];
+    if (byteCount < MODBUS_FILE_WRITE_MIN_BYTES || byteCount > MODBUS_FILE_WRITE_MAX_BYTES)
+    {
+        return STATUS_ILLEGAL_DATA_VALUE;
+    }
+
+    uint16_t end = MODBUS_DATA_INDEX + 1 + byteCount;
+    uint16_t index = MODBUS_DATA_INDEX + 1;
+    while (index < end)
+    {
+        if (index + MODBUS_FILE_HEADER_SIZE > end)
+        {
+            return STATUS_ILLEGAL_DATA_VALUE;
+        }
+        if (_requestBuffer[index] != MODBUS_FILE_REFERENCE_TYPE ||
+            readUInt16(_requestBuffer, index + 3) > MODBUS_FILE_MAX_RECORD)
+        {
+            return STATUS_ILLEGAL_DATA_ADDRESS;
+        }
+
+        // Los datos de la subsolicitud tienen que terminar dentro de la solicitud.
+        uint32_t recordBytes = (uint32_t)readUInt16(_requestBuffer, index + 5) * 2;
+        if (recordBytes == 0 || index + MODBUS_FILE_HEADER_SIZE + recordBytes > end)
+        {
+            return STATUS_ILLEGAL_DATA_VALUE;
+        }
+        index += MODBUS_FILE_HEADER_SIZE + recordBytes;
+    }
+
+    for (index = MODBUS_DATA_INDEX + 1; index < end;)
+    {
+        uint16_t recordLength = readUInt16(_requestBuffer, index + 5);
+        uint8_t status = _fileProvider->writeRecords(readUInt16(_requestBuffer, index + 1),
+                                                     readUInt16(_requestBuffer, index + 3),
+                                                     _requestBuffer + index + MODBUS_FILE_HEADER_SIZE, recordLength);
+        if (status != STATUS_OK)
+        {
+            return status;
+        }
+        index += MODBUS_FILE_HEADER_SIZE + recordLength * 2;
+    }
+
+    // La respuesta es un eco de la solicitud (1 x Bytes, n x Subsolicitudes).
+    memcpy(_responseBuffer + MODBUS_DATA_INDEX, _requestBuffer + MODBUS_DATA_INDEX, 1 + byteCount);
+    _responseBufferLength += 1 + byteCount;
+    return STATUS_OK;
+}
@@ -0,0 +1,226 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+#define MODBUS_FRAME_SIZE 4
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_FULL_DUPLEX_HEADER_SIZE 2
+
+#define MODBUS_FULL_SILENCE_MULTIPLIER 7
+
+/**
+ * Activa el modo dúplex completo para enlaces de 4 hilos (RS422) o transportes con
+ * búfer, en los que el maestro puede enviar la siguiente solicitud mientras recibe la
+ * respuesta anterior. Las respuestas pasan a una cola circular que poll() transmite
+ * poco a poco, con tramas separadas por 3.5T, mientras sigue recibiendo y procesando
+ * solicitudes; la recepción sólo se detiene si una respuesta no cabe en la cola.
+ *
+ * @param queue Puntero a la cola, propiedad de la aplicación, o NULL para volver a semidúplex.
+ * @param queueSize El tamaño de la cola en bytes; cada respuesta ocupa su longitud más dos,
+ *                  así que debe ser al menos MODBUS_MAX_BUFFER + 2.
+ * @return Verdadero si tiene éxito; falso si la cola es demasiado pequeña, y el modo no cambia.
+ */
+bool Modbus::enableFullDuplex(uint8_t *queue, uint16_t queueSize)
+{
+    // En una cola menor una respuesta larga no cabría nunca y se perdería sin dejar rastro.
+    if (queue != NULL && queueSize < MODBUS_MAX_BUFFER + MODBUS_FULL_DUPLEX_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    _fullDuplexQueue = queue;
+    _fullDuplexQueueSize = queue != NULL ? queueSize : 0;
+    _fullDuplexQueueHead = 0;
+    _fullDuplexQueueLength = 0;
+    _fullDuplexFrameRemaining = 0;
+    _isFullDuplexTransmitting = false;
+    _isResponseBufferWriting = false;
+    _responseBufferWriteIndex = 0;
+    return true;
+}
+
+/**
+ * Devuelve el número de bytes de la cola de respuestas que aún no se han escrito en el puerto.
+ */
+uint16_t Modbus::getQueuedBytes()
+{
+    return _fullDuplexQueueLength;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Pasa la respuesta del búfer de salida a la cola y transmite lo que permita el puerto.
+ * Mientras la respuesta no cabe, _isResponseBufferWriting sigue activo y poll() no lee
+ * nuevas solicitudes. Las líneas de recepción y de transmisión son distintas, así que
+ * la respuesta no espera el silencio de 1.5T tras la solicitud.
+ *
+ * @return El número de bytes escritos.
+ */
+uint16_t Modbus::writeFullDuplexResponse()
+{
+    MODBUS_PROFILE_SCOPE(writeResponse);
+
+    if (!_isResponsePending && _responseBufferLength >= MODBUS_FRAME_SIZE)
+    {
+        uint16_t frameLength = _responseBufferLength + MODBUS_FULL_DUPLEX_HEADER_SIZE;
+        if (!Modbus::isBroadcast())
+        {
+            if (_fullDuplexQueueSize - _fullDuplexQueueLength < frameLength)
+            {
+                _isResponseBufferWriting = true;
+                return Modbus::transmitQueuedResponses();
+            }
+
+            // Calcular y añadir el CRC, salvo que la respuesta ya lo incluya (p. ej. copiada de la caché).
+            if (!_isResponseCRCReady)
+            {
+                uint16_t crc = Modbus::calculateCRC(_responseBuffer, _responseBufferLength - MODBUS_CRC_LENGTH);
+                _responseBuffer[_responseBufferLength - MODBUS_CRC_LENGTH] = crc & 0xFF;
+                _responseBuffer[(_responseBufferLength - MODBUS_CRC_LENGTH) + 1] = crc >> 8;
+            }
+
+            uint8_t header[MODBUS_FULL_DUPLEX_HEADER_SIZE] = {lowByte(_responseBufferLength), highByte(_responseBufferLength)};
+            Modbus::pushFullDuplexQueue(header, MODBUS_FULL_DUPLEX_HEADER_SIZE);
+            Modbus::pushFullDuplexQueue(_responseBuffer, _responseBufferLength);
+        }
+
+        // La respuesta está en la cola (o no se envía): el búfer de salida queda libre.
+        _isResponseBufferWriting = false;
+        _responseBufferWriteIndex = 0;
+        _responseBufferLength = 0;
+        _isResponseCRCReady = false;
+    }
+    return Modbus::transmitQueuedResponses();
+}
+
+/**
+ * Escribe en el puerto los bytes de la cola que quepan en su búfer de transmisión. Entre
+ * dos tramas espera a que la anterior salga del puerto y a 3.5T de silencio en la línea
+ * de transmisión; el pin de control sólo está en alto mientras sale una trama.
+ *
+ * @return El número de bytes escritos.
+ */
+uint16_t Modbus::transmitQueuedResponses()
+{
+    if (_fullDuplexFrameRemaining == 0)
+    {
+        if (_isFullDuplexTransmitting)
+        {
+            // Comprueba si se han enviado todos los datos.
+            if (_serialTransmissionBufferLength > 0 && _serialStream.availableForWrite() < _serialTransmissionBufferLength)
+            {
+                return 0;
+            }
+            _serialStream.flush();
+            if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+            {
+                digitalWrite(_transmissionControlPin, LOW);
+            }
+            _isFullDuplexTransmitting = false;
+            _fullDuplexIdleTime = micros();
+        }
+
+        if (_fullDuplexQueueLength == 0 ||
+            (micros() - _fullDuplexIdleTime) <= (unsigned long)(_halfCharTimeInMicroSecond * MODBUS_FULL_SILENCE_MULTIPLIER))
+        {
+            return 0;
+        }
+
+        uint8_t header[MODBUS_FULL_DUPLEX_HEADER_SIZE];
+        Modbus::popFullDuplexQueue(header, MODBUS_FULL_DUPLEX_HEADER_SIZE);
+        _fullDuplexFrameRemaining = word(header[1], header[0]);
+        _isFullDuplexTransmitting = true;
+
+        // Inicie el modo de transmisión para RS485/RS422.
+        if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+        {
+            _serialStream.flush();
+            digitalWrite(_transmissionControlPin, HIGH);
+        }
+    }
+
+    // Un tramo contiguo de la cola: la trama puede dar la vuelta al final del búfer.
+    uint16_t length = min(_fullDuplexFrameRemaining, _fullDuplexQueueSize - _fullDuplexQueueHead);
+    if (_serialTransmissionBufferLength > 0)
+    {
+        length = min(length, _serialStream.availableForWrite());
+    }
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    uint8_t *data = _fullDuplexQueue + _fullDuplexQueueHead;
+    length = _serialStream.write(data, length);
+    if (_capture != NULL)
+    {
+        _capture->record(true, data, length);
+    }
+    _fullDuplexQueueHead = (_fullDuplexQueueHead + length) % _fullDuplexQueueSize;
+    _fullDuplexQueueLength -= length;
+    _fullDuplexFrameRemaining -= length;
+    _totalBytesSent += length;
+
+    // Modo de compatibilidad para series de software mal escritas; aka AltSoftSerial.
+    if (_serialTransmissionBufferLength == 0)
+    {
+        _serialStream.flush();
+    }
+    return length;
+}
+
+/**
+ * Combina el plazo de la recepción con el de la transmisión de la cola.
+ *
+ * @param receiveDeadline El siguiente plazo de la recepción.
+ * @return El más próximo de los dos.
+ */
+unsigned long Modbus::nextFullDuplexDeadline(unsigned long receiveDeadline)
+{
+    unsigned long deadline;
+    if (_fullDuplexFrameRemaining > 0 || _isFullDuplexTransmitting || _isResponseBufferWriting)
+    {
+        // Aún quedan bytes por enviar o por vaciar del búfer de transmisión.
+        deadline = micros() + _halfCharTimeInMicroSecond * 2;
+    }
+    else if (_fullDuplexQueueLength > 0)
+    {
+        // Silencio de 3.5T antes de la siguiente trama.
+        deadline = _fullDuplexIdleTime + _halfCharTimeInMicroSecond * MODBUS_FULL_SILENCE_MULTIPLIER + 1;
+    }
+    else
+    {
+        return receiveDeadline;
+    }
+    return (long)(deadline - receiveDeadline) < 0 ? deadline : receiveDeadline;
+}
+
+/**
+ * Añade length bytes al final de la cola; el que llama ya comprobó que caben.
+ */
+void Modbus::pushFullDuplexQueue(const uint8_t *data, uint16_t length)
+{
+    uint16_t tail = (_fullDuplexQueueHead + _fullDuplexQueueLength) % _fullDuplexQueueSize;
+    uint16_t first = min(length, _fullDuplexQueueSize - tail);
+    memcpy(_fullDuplexQueue + tail, data, first);
+    memcpy(_fullDuplexQueue, data + first, length - first);
+    _fullDuplexQueueLength += length;
+}
+
+/**
+ * Saca length bytes del principio de la cola.
+ */
+void Modbus::popFullDuplexQueue(uint8_t *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        data[i] = _fullDuplexQueue[_fullDuplexQueueHead];
+        _fullDuplexQueueHead = (_fullDuplexQueueHead + 1) % _fullDuplexQueueSize;
+    }
+    _fullDuplexQueueLength -= length;
+}
@@ -0,0 +1,351 @@
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#include "LinuxSerialStream.h"
+
+/**
+ * Velocidades estándar de termios.
+ */
+static const struct
+{
+    unsigned long baudRate;
+    speed_t speed;
+} speeds[] = {
+    {1200, B1200},
+    {2400, B2400},
+    {4800, B4800},
+    {9600, B9600},
+    {19200, B19200},
+    {38400, B38400},
+    {57600, B57600},
+    {115200, B115200},
+    {230400, B230400},
+    {460800, B460800},
+    {500000, B500000},
+    {576000, B576000},
+    {921600, B921600},
+    {1000000, B1000000},
+    {1152000, B1152000},
+    {1500000, B1500000},
+    {2000000, B2000000},
+    {2500000, B2500000},
+    {3000000, B3000000},
+    {3500000, B3500000},
+    {4000000, B4000000},
+};
+
+LinuxSerialStream::LinuxSerialStream()
+{
+}
+
+LinuxSerialStream::~LinuxSerialStream()
+{
+    end();
+}
+
+/**
+ * Abre y configura un puerto serie en modo crudo.
+ *
+ * @param device La ruta del dispositivo, por ejemplo /dev/ttyUSB0.
+ * @param baudRate La velocidad en baudios (una de las velocidades estándar de termios).
+ * @param parity 'N' (ninguna), 'E' (par) u 'O' (impar).
+ * @param stopBits 1 o 2.
+ * @return True si tiene éxito; de lo contrario falso.
+ */
+bool LinuxSerialStream::begin(const char *device, unsigned long baudRate, char parity, uint8_t stopBits)
+{
+    end();
+    if (!LinuxSerialStream::open(::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC)) ||
+        !LinuxSerialStream::configure(baudRate, parity, stopBits))
+    {
+        end();
+        return false;
+    }
+
+    // Pide al controlador que entregue cada byte en cuanto llega, si lo admite.
+    struct serial_struct serial;
+    if (ioctl(_fd, TIOCGSERIAL, &serial) == 0)
+    {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(_fd, TIOCSSERIAL, &serial);
+    }
+
+    tcflush(_fd, TCIOFLUSH);
+    return true;
+}
+
+/**
+ * Abre el lado maestro de un pseudoterminal nuevo, para pruebas sin hardware.
+ * El otro extremo se abre con begin(slaveName, ...).
+ *
+ * @param slaveName Recibe la ruta del lado esclavo, por ejemplo /dev/pts/3.
+ * @param slaveNameLength El tamaño de slaveName.
+ * @return True si tiene éxito; de lo contrario falso.
+ */
+bool LinuxSerialStream::beginPty(char *slaveName, size_t slaveNameLength)
+{
+    end();
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 ||
+        ptsname_r(fd, slaveName, slaveNameLength) != 0 ||
+        !LinuxSerialStream::open(fd) ||
+        !LinuxSerialStream::configure(115200, 'N', 1))
+    {
+        if (fd >= 0 && _fd < 0)
+        {
+            close(fd);
+        }
+        end();
+        return false;
+    }
+    _isPty = true;
+    return true;
+}
+
+/**
+ * Cierra el puerto.
+ */
+void LinuxSerialStream::end()
+{
+    if (_epollFd >= 0)
+    {
+        close(_epollFd);
+        _epollFd = -1;
+    }
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+    }
+    _isPty = false;
+    _bufferIndex = 0;
+    _bufferLength = 0;
+}
+
+int LinuxSerialStream::available()
+{
+    LinuxSerialStream::fill();
+    return _bufferLength - _bufferIndex;
+}
+
+int LinuxSerialStream::read()
+{
+    if (!LinuxSerialStream::fill())
+    {
+        return -1;
+    }
+    return _buffer[_bufferIndex++];
+}
+
+int LinuxSerialStream::peek()
+{
+    if (!LinuxSerialStream::fill())
+    {
+        return -1;
+    }
+    return _buffer[_bufferIndex];
+}
+
+size_t LinuxSerialStream::write(uint8_t value)
+{
+    return LinuxSerialStream::write(&value, 1);
+}
+
+/**
+ * Escribe todos los bytes; si el búfer del controlador está lleno espera a que haya sitio.
+ */
+size_t LinuxSerialStream::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (_fd >= 0 && written < size)
+    {
+        ssize_t length = ::write(_fd, buffer + written, size - written);
+        if (length > 0)
+        {
+            written += length;
+            continue;
+        }
+        if (length < 0 && errno == EAGAIN)
+        {
+            struct pollfd descriptor = {_fd, POLLOUT, 0};
+            ::poll(&descriptor, 1, 100);
+            continue;
+        }
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        break;
+    }
+    return written;
+}
+
+/**
+ * write() nunca deja bytes a medias, así que siempre admite una trama completa.
+ */
+int LinuxSerialStream::availableForWrite()
+{
+    return LINUX_SERIAL_BUFFER_SIZE;
+}
+
+/**
+ * Espera a que el controlador haya enviado todos los bytes (necesario antes de soltar el pin DE).
+ */
+void LinuxSerialStream::flush()
+{
+    // Un pseudoterminal no tiene línea que vaciar.
+    if (_fd >= 0 && !_isPty)
+    {
+        tcdrain(_fd);
+    }
+}
+
+/**
+ * Duerme hasta que haya bytes por leer o venza el plazo.
+ *
+ * @param timeoutInMilliSecond El tiempo máximo de espera (-1 para esperar indefinidamente).
+ * @return True si hay bytes por leer; de lo contrario falso.
+ */
+bool LinuxSerialStream::waitForData(int timeoutInMilliSecond)
+{
+    if (_bufferIndex < _bufferLength)
+    {
+        return true;
+    }
+
+    struct epoll_event event;
+    int count = epoll_wait(_epollFd, &event, 1, timeoutInMilliSecond);
+    return count > 0 && LinuxSerialStream::fill();
+}
+
+/**
+ * Activa el modo RS485 del controlador, que maneja el pin DE por sí mismo, si lo admite.
+ *
+ * @return True si el controlador aceptó la configuración; de lo contrario falso.
+ */
+bool LinuxSerialStream::setRs485(bool enable)
+{
+    struct serial_rs485 rs485;
+    memset(&rs485, 0, sizeof(rs485));
+    if (enable)
+    {
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+    }
+    return _fd >= 0 && ioctl(_fd, TIOCSRS485, &rs485) == 0;
+}
+
+/**
+ * Obtiene el descriptor del puerto, para añadirlo a otro bucle epoll.
+ */
+int LinuxSerialStream::getFd()
+{
+    return _fd;
+}
+
+/**
+ * Obtiene el instante (en micros()) en que se leyeron del controlador los últimos bytes.
+ */
+unsigned long LinuxSerialStream::getLastReceiveTime()
+{
+    return _lastReceiveTime;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Configura el modo crudo, la velocidad y el formato de carácter.
+ */
+bool LinuxSerialStream::configure(unsigned long baudRate, char parity, uint8_t stopBits)
+{
+    speed_t speed = 0;
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+    {
+        if (speeds[i].baudRate == baudRate)
+        {
+            speed = speeds[i].speed;
+        }
+    }
+
+    struct termios settings;
+    if (speed == 0 || tcgetattr(_fd, &settings) < 0)
+    {
+        return false;
+    }
+
+    cfmakeraw(&settings);
+    settings.c_cflag |= CLOCAL | CREAD;
+    settings.c_cflag &= ~(PARENB | PARODD | CSTOPB | CRTSCTS);
+    if (parity == 'E' || parity == 'O')
+    {
+        settings.c_cflag |= PARENB | (parity == 'O' ? PARODD : 0);
+    }
+    if (stopBits == 2)
+    {
+        settings.c_cflag |= CSTOPB;
+    }
+
+    // Lectura no bloqueante: read() devuelve lo que haya.
+    settings.c_cc[VMIN] = 0;
+    settings.c_cc[VTIME] = 0;
+
+    cfsetispeed(&settings, speed);
+    cfsetospeed(&settings, speed);
+    return tcsetattr(_fd, TCSANOW, &settings) == 0;
+}
+
+/**
+ * Adopta un descriptor ya abierto y lo registra en su bucle epoll.
+ */
+bool LinuxSerialStream::open(int fd)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    _fd = fd;
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = _fd;
+    return _epollFd >= 0 && epoll_ctl(_epollFd, EPOLL_CTL_ADD, _fd, &event) == 0;
+}
+
+/**
+ * Rellena el búfer con lo que el controlador tenga disponible, sin esperar.
+ *
+ * @return True si hay bytes en el búfer; de lo contrario falso.
+ */
+bool LinuxSerialStream::fill()
+{
+    if (_bufferIndex < _bufferLength)
+    {
+        return true;
+    }
+    if (_fd < 0)
+    {
+        return false;
+    }
+
+    ssize_t length = ::read(_fd, _buffer, sizeof(_buffer));
+    _bufferIndex = 0;
+    _bufferLength = length > 0 ? length : 0;
+    if (length > 0)
+    {
+        _lastReceiveTime = micros();
+    }
+    return _bufferLength > 0;
+}
+#endif
@@ -0,0 +1,55 @@
+#ifndef LINUXSERIALSTREAM_H
+#define LINUXSERIALSTREAM_H
+#include <Arduino.h>
+
+#if defined(__linux__)
+
+#define LINUX_SERIAL_BUFFER_SIZE 256
+
+/**
+ * @class LinuxSerialStream
+ *
+ * Stream sobre un puerto serie de Linux (/dev/ttyS*, /dev/ttyUSB*) o un pseudoterminal,
+ * para usar Modbus en pasarelas Linux. El descriptor es no bloqueante: available()
+ * nunca espera y waitForData() duerme en epoll hasta que llegan bytes o vence el plazo.
+ * Cada lectura del descriptor guarda el instante de llegada (getLastReceiveTime()).
+ */
+class LinuxSerialStream : public Stream
+{
+public:
+  LinuxSerialStream();
+  ~LinuxSerialStream();
+
+  bool begin(const char *device, unsigned long baudRate, char parity = 'N', uint8_t stopBits = 1);
+  bool beginPty(char *slaveName, size_t slaveNameLength);
+  void end();
+
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *buffer, size_t size);
+  int availableForWrite();
+  void flush();
+
+  bool waitForData(int timeoutInMilliSecond);
+  bool setRs485(bool enable);
+  int getFd();
+  unsigned long getLastReceiveTime();
+
+private:
+  int _fd = -1;
+  int _epollFd = -1;
+  bool _isPty = false;
+  uint8_t _buffer[LINUX_SERIAL_BUFFER_SIZE];
+  uint16_t _bufferIndex = 0;
+  uint16_t _bufferLength = 0;
+  unsigned long _lastReceiveTime = 0;
+
+  bool configure(unsigned long baudRate, char parity, uint8_t stopBits);
+  bool open(int fd);
+  bool fill();
+};
+
+#endif
+#endif
@@ -0,0 +1,606 @@
+#include <string.h>
+#include "ModbusMaster.h"
+
+/**
+ * ---------------------------------------------------
+ *                CONSTANTS AND MACROS
+ * ---------------------------------------------------
+ */
+
+#define MODBUS_ADDRESS_INDEX 0
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_FULL_SILENCE_CHARS 3.5
+#define MODBUS_FIXED_SILENCE 1750
+
+#define MODBUS_MASTER_DEFAULT_UNIT_RETRIES 0xFF
+
+/**
+ * Estados del bus: libre, trama de solicitud preparada a la espera del silencio
+ * de 3.5T, solicitud saliendo por el flujo serial y esperando la respuesta.
+ */
+#define MODBUS_MASTER_IDLE 0
+#define MODBUS_MASTER_READY 1
+#define MODBUS_MASTER_SENDING 2
+#define MODBUS_MASTER_RECEIVING 3
+
+/**
+ * ---------------------------------------------------
+ *                  PUBLIC METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Inicializa el maestro.
+ *
+ * @param serialStream El flujo serial del bus RTU.
+ * @param entries Puntero a la lista de sondeo.
+ * @param numberOfEntries El número de entradas de la lista.
+ * @param transmissionControlPin El pin de salida digital que se utilizará para el control de transmisión RS485.
+ */
+ModbusMaster::ModbusMaster(Stream &serialStream, ModbusScanEntry *entries, uint8_t numberOfEntries, int transmissionControlPin)
+    : _serialStream(serialStream), _entries(entries), _numberOfEntries(numberOfEntries), _transmissionControlPin(transmissionControlPin)
+{
+    memset(_units, 0, sizeof(_units));
+}
+
+/**
+ * Valida la lista de sondeo, registra sus unidades y programa todas las entradas para ya.
+ * El flujo serial ya debe estar iniciado.
+ *
+ * @param baudrate La velocidad en baudios del bus, para los tiempos de trama.
+ * @return True si la lista es válida; falso si una entrada tiene un código de función
+ *         o una longitud no admitidos, o si hay más de MODBUS_MASTER_MAX_UNITS unidades.
+ */
+bool ModbusMaster::begin(uint64_t baudrate)
+{
+    if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+    {
+        pinMode(_transmissionControlPin, OUTPUT);
+        digitalWrite(_transmissionControlPin, LOW);
+    }
+
+    _serialStream.setTimeout(0);
+    _serialStream.flush();
+    _serialTransmissionBufferLength = _serialStream.availableForWrite();
+
+    // Un carácter son 11 bits; a más de 19200 baudios el silencio de 3.5T es fijo.
+    _charTimeInMicroSecond = 11000000UL / baudrate;
+    _silenceInMicroSecond = baudrate > 19200 ? MODBUS_FIXED_SILENCE : _charTimeInMicroSecond * MODBUS_FULL_SILENCE_CHARS;
+
+    unsigned long now = micros();
+    for (uint8_t i = 0; i < _numberOfEntries; i++)
+    {
+        ModbusScanEntry &entry = _entries[i];
+        uint16_t maxLength = entry.functionCode <= FC_READ_DISCRETE_INPUT ? MODBUS_MASTER_MAX_COILS : MODBUS_MASTER_MAX_REGISTERS;
+        if (entry.functionCode < FC_READ_COILS || entry.functionCode > FC_READ_INPUT_REGISTERS ||
+            entry.length == 0 || entry.length > maxLength || (uint32_t)entry.address + entry.length > 0x10000UL ||
+            !ModbusMaster::findUnit(entry.unitAddress, true))
+        {
+            return false;
+        }
+        entry.deadline = now;
+        entry.status = STATUS_OK;
+        entry.isInTransaction = false;
+    }
+
+    _state = MODBUS_MASTER_IDLE;
+    _lastBusTime = now;
+    return true;
+}
+
+/**
+ * Avanza la transacción en curso o, con el bus libre, empieza la siguiente.
+ * Las entradas leídas (o fallidas) se entregan a la devolución de llamada.
+ *
+ * @return El número de entradas entregadas en esta llamada.
+ */
+uint8_t ModbusMaster::poll()
+{
+    if (_state == MODBUS_MASTER_IDLE && !ModbusMaster::startTransaction())
+    {
+        return 0;
+    }
+
+    if (_state == MODBUS_MASTER_READY)
+    {
+        // Respete el silencio de 3.5T desde la última actividad del bus.
+        if ((micros() - _lastBusTime) < _silenceInMicroSecond)
+        {
+            return 0;
+        }
+        ModbusMaster::sendRequest();
+    }
+
+    if (_state == MODBUS_MASTER_SENDING)
+    {
+        // Espere a que el búfer de transmisión se vacíe antes de soltar el pin DE.
+        if (_serialTransmissionBufferLength > 0 && _serialStream.availableForWrite() < _serialTransmissionBufferLength)
+        {
+            return 0;
+        }
+        _serialStream.flush();
+        if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+        {
+            digitalWrite(_transmissionControlPin, LOW);
+        }
+
+        // El tiempo de espera cuenta desde el final de la solicitud.
+        _startTime = micros();
+        _lastBusTime = _startTime;
+        _responseLength = 0;
+        _state = MODBUS_MASTER_RECEIVING;
+    }
+
+    uint8_t status = ModbusMaster::receiveResponse();
+    if (status == STATUS_PENDING)
+    {
+        return 0;
+    }
+
+    // Sin respuesta válida: reintente si la unidad respondía hasta ahora.
+    if (status == STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND && _attempt < ModbusMaster::unitRetries(_unit))
+    {
+        _attempt++;
+        _unit->retransmissions++;
+        _state = MODBUS_MASTER_READY;
+        return 0;
+    }
+    return ModbusMaster::completeTransaction(status);
+}
+
+/**
+ * Calcula el siguiente momento en el que poll() tiene trabajo que hacer.
+ *
+ * @return El tiempo absoluto (en micros()) del siguiente plazo.
+ */
+unsigned long ModbusMaster::nextDeadline()
+{
+    unsigned long now = micros();
+    switch (_state)
+    {
+    case MODBUS_MASTER_READY:
+        return _lastBusTime + _silenceInMicroSecond;
+    case MODBUS_MASTER_SENDING:
+        return now + _charTimeInMicroSecond;
+    case MODBUS_MASTER_RECEIVING:
+        return _responseLength > 0 ? _lastBusTime + _silenceInMicroSecond : _startTime + ModbusMaster::unitTimeout(_unit);
+    }
+
+    // El bus está libre: el plazo de la próxima entrada.
+    unsigned long deadline = now + _silenceInMicroSecond * 16;
+    for (uint8_t i = 0; i < _numberOfEntries; i++)
+    {
+        if ((long)(_entries[i].deadline - deadline) < 0)
+        {
+            deadline = _entries[i].deadline;
+        }
+    }
+    return deadline;
+}
+
+/**
+ * Devuelve verdadero si no hay ninguna transacción en curso.
+ */
+bool ModbusMaster::isIdle()
+{
+    return _state == MODBUS_MASTER_IDLE;
+}
+
+/**
+ * Establece la función que recibe las entradas leídas.
+ */
+void ModbusMaster::setCallback(ModbusMasterCallback callback)
+{
+    _callback = callback;
+}
+
+/**
+ * Establece el tiempo de espera de respuesta de las unidades sin uno propio.
+ *
+ * @param timeoutInMicroSecond Microsegundos desde el final de la solicitud.
+ */
+void ModbusMaster::setTimeout(unsigned long timeoutInMicroSecond)
+{
+    _timeout = timeoutInMicroSecond;
+}
+
+/**
+ * Establece el número de reintentos de las unidades sin uno propio.
+ */
+void ModbusMaster::setRetries(uint8_t retries)
+{
+    _retries = retries;
+}
+
+/**
+ * Establece el tiempo de espera de respuesta de una unidad.
+ *
+ * @param unitAddress La dirección de la unidad.
+ * @param timeoutInMicroSecond Microsegundos desde el final de la solicitud (cero para el general).
+ * @return False si ya hay MODBUS_MASTER_MAX_UNITS unidades.
+ */
+bool ModbusMaster::setUnitTimeout(uint8_t unitAddress, unsigned long timeoutInMicroSecond)
+{
+    ModbusMasterUnit *unit = ModbusMaster::findUnit(unitAddress, true);
+    if (!unit)
+    {
+        return false;
+    }
+    unit->timeout = timeoutInMicroSecond;
+    return true;
+}
+
+/**
+ * Establece el número de reintentos de una unidad.
+ *
+ * @param unitAddress La dirección de la unidad.
+ * @param retries El número de reintentos tras una respuesta perdida o dañada.
+ * @return False si ya hay MODBUS_MASTER_MAX_UNITS unidades.
+ */
+bool ModbusMaster::setUnitRetries(uint8_t unitAddress, uint8_t retries)
+{
+    ModbusMasterUnit *unit = ModbusMaster::findUnit(unitAddress, true);
+    if (!unit)
+    {
+        return false;
+    }
+    unit->retries = retries;
+    return true;
+}
+
+/**
+ * Establece cuántos registros (o bobinas) sin usar puede leer de más una transacción
+ * para unir dos rangos separados. Por defecto cero: sólo se unen rangos contiguos o
+ * solapados, ya que leer direcciones que la unidad no tiene produce una excepción.
+ */
+void ModbusMaster::setMaxGap(uint16_t maxGap)
+{
+    _maxGap = maxGap;
+}
+
+/**
+ * Lee una bobina o entrada discreta de la respuesta, desde la devolución de llamada.
+ *
+ * @param offset El offset desde la primera dirección de la entrada.
+ */
+bool ModbusMaster::readCoilFromResponse(int offset)
+{
+    int bit = _responseOffset + offset;
+    uint16_t index = MODBUS_DATA_INDEX + 1 + bit / 8;
+    if (offset < 0 || index >= _responseLength - MODBUS_CRC_LENGTH)
+    {
+        return false;
+    }
+    return bitRead(_responseBuffer[index], bit % 8);
+}
+
+/**
+ * Lee un registro de la respuesta, desde la devolución de llamada.
+ *
+ * @param offset El offset desde la primera dirección de la entrada.
+ */
+uint16_t ModbusMaster::readRegisterFromResponse(int offset)
+{
+    uint16_t index = MODBUS_DATA_INDEX + 1 + (_responseOffset + offset) * 2;
+    if (offset < 0 || index + 1 >= _responseLength - MODBUS_CRC_LENGTH)
+    {
+        return 0;
+    }
+    return word(_responseBuffer[index], _responseBuffer[index + 1]);
+}
+
+/**
+ * Obtiene la configuración y las estadísticas de una unidad, o NULL si no está registrada.
+ */
+ModbusMasterUnit *ModbusMaster::getUnit(uint8_t unitAddress)
+{
+    return ModbusMaster::findUnit(unitAddress, false);
+}
+
+/**
+ * Obtiene el número de transacciones enviadas por el bus, reintentos incluidos.
+ */
+uint32_t ModbusMaster::getTotalTransactions()
+{
+    return _totalTransactions;
+}
+
+/**
+ * Obtiene el número de entradas leídas con éxito.
+ */
+uint32_t ModbusMaster::getTotalEntryReads()
+{
+    return _totalEntryReads;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Busca una unidad y, si se pide, la registra.
+ */
+ModbusMasterUnit *ModbusMaster::findUnit(uint8_t unitAddress, bool isCreating)
+{
+    for (uint8_t i = 0; i < _numberOfUnits; i++)
+    {
+        if (_units[i].unitAddress == unitAddress)
+        {
+            return &_units[i];
+        }
+    }
+    if (!isCreating || _numberOfUnits == MODBUS_MASTER_MAX_UNITS)
+    {
+        return NULL;
+    }
+
+    ModbusMasterUnit &unit = _units[_numberOfUnits++];
+    memset(&unit, 0, sizeof(unit));
+    unit.unitAddress = unitAddress;
+    unit.retries = MODBUS_MASTER_DEFAULT_UNIT_RETRIES;
+    unit.isOnline = true;
+    return &unit;
+}
+
+/**
+ * Devuelve el tiempo de espera de respuesta de una unidad.
+ */
+unsigned long ModbusMaster::unitTimeout(ModbusMasterUnit *unit)
+{
+    return unit->timeout ? unit->timeout : _timeout;
+}
+
+/**
+ * Devuelve el número de reintentos de una unidad: ninguno desde que agota los
+ * reintentos hasta que vuelve a responder.
+ */
+uint8_t ModbusMaster::unitRetries(ModbusMasterUnit *unit)
+{
+    if (!unit->isOnline)
+    {
+        return 0;
+    }
+    return unit->retries != MODBUS_MASTER_DEFAULT_UNIT_RETRIES ? unit->retries : _retries;
+}
+
+/**
+ * Elige la entrada vencida con el plazo más antiguo y le une las entradas de la
+ * misma unidad y tabla cuyo rango es contiguo o solapado (o a menos de _maxGap)
+ * y que vencen antes de medio periodo, hasta el máximo legal de la función.
+ *
+ * @return True si hay una transacción preparada; de lo contrario falso.
+ */
+bool ModbusMaster::startTransaction()
+{
+    unsigned long now = micros();
+    ModbusScanEntry *first = NULL;
+    for (uint8_t i = 0; i < _numberOfEntries; i++)
+    {
+        ModbusScanEntry &entry = _entries[i];
+        if ((long)(entry.deadline - now) <= 0 && (!first || (long)(entry.deadline - first->deadline) < 0))
+        {
+            first = &entry;
+        }
+    }
+    if (!first)
+    {
+        return false;
+    }
+
+    uint32_t start = first->address;
+    uint32_t end = start + first->length;
+    uint16_t maxLength = first->functionCode <= FC_READ_DISCRETE_INPUT ? MODBUS_MASTER_MAX_COILS : MODBUS_MASTER_MAX_REGISTERS;
+    first->isInTransaction = true;
+
+    // Cada entrada unida puede hacer contiguas otras que antes no lo eran.
+    bool isMerged;
+    do
+    {
+        isMerged = false;
+        for (uint8_t i = 0; i < _numberOfEntries; i++)
+        {
+            ModbusScanEntry &entry = _entries[i];
+            if (entry.isInTransaction || entry.unitAddress != first->unitAddress || entry.functionCode != first->functionCode ||
+                (long)(entry.deadline - now) > (long)(entry.period / 2))
+            {
+                continue;
+            }
+
+            uint32_t entryEnd = (uint32_t)entry.address + entry.length;
+            if (entry.address > end + _maxGap || entryEnd + _maxGap < start ||
+                max(end, entryEnd) - min(start, (uint32_t)entry.address) > maxLength)
+            {
+                continue;
+            }
+            start = min(start, (uint32_t)entry.address);
+            end = max(end, entryEnd);
+            entry.isInTransaction = true;
+            isMerged = true;
+        }
+    } while (isMerged);
+
+    // Las entradas vencidas conservan su cadencia; las adelantadas o muy retrasadas cuentan desde ahora.
+    for (uint8_t i = 0; i < _numberOfEntries; i++)
+    {
+        ModbusScanEntry &entry = _entries[i];
+        if (entry.isInTransaction)
+        {
+            entry.deadline += entry.period;
+            if ((long)(entry.deadline - now) <= 0 || (entry.deadline - now) > entry.period)
+            {
+                entry.deadline = now + entry.period;
+            }
+        }
+    }
+
+    // (1 x Address, 1 x FC, 2 x Address, 2 x Quantity, 2 x CRC).
+    uint16_t length = end - start;
+    _requestBuffer[MODBUS_ADDRESS_INDEX] = first->unitAddress;
+    _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] = first->functionCode;
+    _requestBuffer[MODBUS_DATA_INDEX] = highByte((uint16_t)start);
+    _requestBuffer[MODBUS_DATA_INDEX + 1] = lowByte((uint16_t)start);
+    _requestBuffer[MODBUS_DATA_INDEX + 2] = highByte(length);
+    _requestBuffer[MODBUS_DATA_INDEX + 3] = lowByte(length);
+    uint16_t crc = Modbus::calculateCRC(_requestBuffer, MODBUS_MASTER_REQUEST_SIZE - MODBUS_CRC_LENGTH);
+    _requestBuffer[MODBUS_MASTER_REQUEST_SIZE - MODBUS_CRC_LENGTH] = crc & 0xFF;
+    _requestBuffer[MODBUS_MASTER_REQUEST_SIZE - MODBUS_CRC_LENGTH + 1] = crc >> 8;
+
+    _unit = ModbusMaster::findUnit(first->unitAddress, false);
+    _attempt = 0;
+    _state = MODBUS_MASTER_READY;
+    return true;
+}
+
+/**
+ * Envía la trama de solicitud preparada.
+ */
+void ModbusMaster::sendRequest()
+{
+    // Descarte los bytes sueltos de una respuesta tardía anterior.
+    while (_serialStream.available() > 0 && _serialStream.read() >= 0)
+    {
+    }
+
+    if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+    {
+        digitalWrite(_transmissionControlPin, HIGH);
+    }
+    _serialStream.write(_requestBuffer, MODBUS_MASTER_REQUEST_SIZE);
+
+    _unit->transactions++;
+    _totalTransactions++;
+    _state = MODBUS_MASTER_SENDING;
+}
+
+/**
+ * Recibe la respuesta en curso. Termina al llegar la longitud que anuncia su
+ * cabecera o, si no se puede saber, tras 3.5T de silencio.
+ *
+ * @return STATUS_PENDING mientras la respuesta no está completa; STATUS_OK, el
+ *         código de excepción de la unidad, o STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND
+ *         si no hubo respuesta o llegó dañada.
+ */
+uint8_t ModbusMaster::receiveResponse()
+{
+    while (_serialStream.available() > 0)
+    {
+        int value = _serialStream.read();
+        if (value < 0)
+        {
+            break;
+        }
+        if (_responseLength < MODBUS_MAX_BUFFER)
+        {
+            _responseBuffer[_responseLength++] = value;
+        }
+        _lastBusTime = micros();
+    }
+
+    unsigned long now = micros();
+    uint16_t expectedLength = ModbusMaster::expectedResponseLength();
+    bool isComplete = (expectedLength > 0 && _responseLength >= expectedLength) ||
+                      (_responseLength > 0 && (now - _lastBusTime) >= _silenceInMicroSecond);
+    if (!isComplete)
+    {
+        if (_responseLength == 0 && (now - _startTime) >= ModbusMaster::unitTimeout(_unit))
+        {
+            _unit->timeouts++;
+            return STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+        }
+        return STATUS_PENDING;
+    }
+
+    // Una respuesta dañada, de otra unidad o con otra longitud cuenta como falta de respuesta. Una
+    // cabecera que anuncia más bytes de los que caben, o una trama cortada por el silencio, no se
+    // comprueba: su CRC quedaría fuera del búfer o sobre los bytes de la respuesta anterior.
+    uint16_t length = expectedLength > 0 ? expectedLength : _responseLength;
+    if (length > MODBUS_MAX_BUFFER || _responseLength < length || length < 5 ||
+        word(_responseBuffer[length - 1], _responseBuffer[length - 2]) != Modbus::calculateCRC(_responseBuffer, length - MODBUS_CRC_LENGTH) ||
+        _responseBuffer[MODBUS_ADDRESS_INDEX] != _requestBuffer[MODBUS_ADDRESS_INDEX] ||
+        (_responseBuffer[MODBUS_FUNCTION_CODE_INDEX] & 0x7F) != _requestBuffer[MODBUS_FUNCTION_CODE_INDEX])
+    {
+        _unit->errors++;
+        return STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+    }
+
+    if (_responseBuffer[MODBUS_FUNCTION_CODE_INDEX] & 0x80)
+    {
+        _unit->exceptions++;
+        return _responseBuffer[MODBUS_DATA_INDEX];
+    }
+
+    uint16_t quantity = word(_requestBuffer[MODBUS_DATA_INDEX + 2], _requestBuffer[MODBUS_DATA_INDEX + 3]);
+    uint16_t byteCount = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] <= FC_READ_DISCRETE_INPUT ? (quantity + 7) / 8 : quantity * 2;
+    if (_responseBuffer[MODBUS_DATA_INDEX] != byteCount)
+    {
+        _unit->errors++;
+        return STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+    }
+    _responseLength = length;
+    return STATUS_OK;
+}
+
+/**
+ * Devuelve la longitud de la respuesta en curso según su cabecera, o cero si aún no se puede saber.
+ */
+uint16_t ModbusMaster::expectedResponseLength()
+{
+    if (_responseLength < 3)
+    {
+        return 0;
+    }
+    if (_responseBuffer[MODBUS_FUNCTION_CODE_INDEX] & 0x80)
+    {
+        return 5; // (1 x Address, 1 x FC, 1 x Exception, 2 x CRC).
+    }
+    return 5 + _responseBuffer[MODBUS_DATA_INDEX]; // (1 x Address, 1 x FC, 1 x Count, n x Data, 2 x CRC).
+}
+
+/**
+ * Entrega el resultado de la transacción a cada entrada que incluía y libera el bus.
+ *
+ * @return El número de entradas entregadas.
+ */
+uint8_t ModbusMaster::completeTransaction(uint8_t status)
+{
+    if (status == STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND)
+    {
+        _unit->isOnline = false;
+        _unit->consecutiveFailures += _unit->consecutiveFailures < 0xFF;
+    }
+    else
+    {
+        _unit->isOnline = true;
+        _unit->consecutiveFailures = 0;
+    }
+
+    uint16_t start = word(_requestBuffer[MODBUS_DATA_INDEX], _requestBuffer[MODBUS_DATA_INDEX + 1]);
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < _numberOfEntries; i++)
+    {
+        ModbusScanEntry &entry = _entries[i];
+        if (!entry.isInTransaction)
+        {
+            continue;
+        }
+        entry.isInTransaction = false;
+        entry.status = status;
+        _totalEntryReads += status == STATUS_OK;
+        count++;
+
+        if (_callback)
+        {
+            _responseOffset = entry.address - start;
+            _callback(entry, status);
+        }
+    }
+
+    _state = MODBUS_MASTER_IDLE;
+    _lastBusTime = micros();
+    return count;
+}
@@ -0,0 +1,131 @@
+#ifndef MODBUSMASTER_H
+#define MODBUSMASTER_H
+#include "ModbusSlave.h"
+
+#define MODBUS_MASTER_MAX_UNITS 8
+#define MODBUS_MASTER_DEFAULT_TIMEOUT 100000
+#define MODBUS_MASTER_DEFAULT_RETRIES 2
+#define MODBUS_MASTER_MAX_REGISTERS 125
+#define MODBUS_MASTER_MAX_COILS 2000
+#define MODBUS_MASTER_REQUEST_SIZE 8
+
+/**
+ * Entrada de la lista de sondeo: un rango de una tabla de una unidad que se lee
+ * cada period microsegundos. Los campos a partir de deadline los mantiene ModbusMaster.
+ *
+ *     ModbusScanEntry scanList[] = {{2, FC_READ_HOLDING_REGISTERS, 0, 10, 100000}};
+ */
+struct ModbusScanEntry
+{
+  uint8_t unitAddress;
+  uint8_t functionCode;
+  uint16_t address;
+  uint16_t length;
+  unsigned long period;
+
+  unsigned long deadline;
+  uint8_t status;
+  bool isInTransaction;
+};
+
+/**
+ * Configuración y estadísticas de una unidad sondeada por ModbusMaster.
+ */
+struct ModbusMasterUnit
+{
+  uint8_t unitAddress;
+  uint8_t retries;
+  unsigned long timeout;
+  bool isOnline;
+  uint8_t consecutiveFailures;
+  uint32_t transactions;
+  uint32_t timeouts;
+  uint32_t retransmissions;
+  uint32_t errors;
+  uint32_t exceptions;
+};
+
+/**
+ * Se llama una vez por cada entrada de la lista de sondeo leída o fallida. Con
+ * STATUS_OK los valores se leen con readRegisterFromResponse() / readCoilFromResponse().
+ * Tras agotar los reintentos status es STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND;
+ * si la unidad respondió con una excepción, es su código de excepción.
+ */
+typedef void (*ModbusMasterCallback)(ModbusScanEntry &entry, uint8_t status);
+
+/**
+ * @class ModbusMaster
+ *
+ * Maestro RTU que sondea una lista de rangos. En cada transacción lee el rango
+ * con el plazo más antiguo y le une los rangos contiguos o solapados de la misma
+ * unidad y tabla que vencen pronto, sin pasar del máximo legal de FC01..FC04.
+ * El bus es half-duplex: una transacción a la vez, pero en cuanto termina (o
+ * vence el tiempo de espera de su unidad) se envía la siguiente, sea de la unidad
+ * que sea. Sólo se reintenta con una unidad que está respondiendo, así una unidad
+ * caída o ausente ocupa el bus una sola vez por plazo.
+ */
+class ModbusMaster
+{
+public:
+  ModbusMaster(Stream &serialStream, ModbusScanEntry *entries, uint8_t numberOfEntries, int transmissionControlPin = MODBUS_CONTROL_PIN_NONE);
+
+  bool begin(uint64_t boudRate);
+  uint8_t poll();
+  unsigned long nextDeadline();
+  bool isIdle();
+
+  void setCallback(ModbusMasterCallback callback);
+  void setTimeout(unsigned long timeoutInMicroSecond);
+  void setRetries(uint8_t retries);
+  bool setUnitTimeout(uint8_t unitAddress, unsigned long timeoutInMicroSecond);
+  bool setUnitRetries(uint8_t unitAddress, uint8_t retries);
+  void setMaxGap(uint16_t maxGap);
+
+  bool readCoilFromResponse(int offset);
+  uint16_t readRegisterFromResponse(int offset);
+
+  ModbusMasterUnit *getUnit(uint8_t unitAddress);
+  uint32_t getTotalTransactions();
+  uint32_t getTotalEntryReads();
+
+private:
+  Stream &_serialStream;
+  ModbusScanEntry *_entries;
+  uint8_t _numberOfEntries;
+  int _transmissionControlPin;
+  int _serialTransmissionBufferLength = 0;
+  ModbusMasterCallback _callback = NULL;
+
+  unsigned long _charTimeInMicroSecond = 0;
+  unsigned long _silenceInMicroSecond = 0;
+  unsigned long _timeout = MODBUS_MASTER_DEFAULT_TIMEOUT;
+  uint8_t _retries = MODBUS_MASTER_DEFAULT_RETRIES;
+  uint16_t _maxGap = 0;
+
+  ModbusMasterUnit _units[MODBUS_MASTER_MAX_UNITS];
+  uint8_t _numberOfUnits = 0;
+
+  uint8_t _state = 0;
+  ModbusMasterUnit *_unit = NULL;
+  uint8_t _attempt = 0;
+  unsigned long _startTime = 0;
+  unsigned long _lastBusTime = 0;
+  uint8_t _requestBuffer[MODBUS_MASTER_REQUEST_SIZE];
+  uint8_t _responseBuffer[MODBUS_MAX_BUFFER];
+  uint16_t _responseLength = 0;
+  int _responseOffset = 0;
+
+  uint32_t _totalTransactions = 0;
+  uint32_t _totalEntryReads = 0;
+
+  ModbusMasterUnit *findUnit(uint8_t unitAddress, bool isCreating);
+  unsigned long unitTimeout(ModbusMasterUnit *unit);
+  uint8_t unitRetries(ModbusMasterUnit *unit);
+  bool startTransaction();
+  void sendRequest();
+  uint8_t receiveResponse();
+  uint16_t expectedResponseLength();
+  uint8_t completeTransaction(uint8_t status);
+};
+
+#endif
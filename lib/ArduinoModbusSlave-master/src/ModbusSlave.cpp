@@ -14,7 +14,7 @@
 #define MODBUS_FUNCTION_CODE_INDEX 1
 #define MODBUS_DATA_INDEX 2
 
-#define MODBUS_BROADCAST_ADDRESS 00
+#define MODBUS_BROADCAST_ADDRESS 0
 #define MODBUS_ADDRESS_MIN 1
 #define MODBUS_ADDRESS_MAX 247
 
@@ -123,6 +123,19 @@ Modbus::Modbus(Stream &serialStream, ModbusSlave *slaves, uint8_t numberOfSlaves
     _transmissionControlPin = transmissionControlPin;
 }
 
+/**
+ * Obtiene la dirección de la unidad atendida dentro de una devolución de llamada (también
+ * en una difusión, que llama a cada unidad); fuera de ellas, la del primer esclavo modbus.
+ */
+uint8_t Modbus::getUnitAddress()
+{
+    if (_servedUnitAddress != MODBUS_INVALID_UNIT_ADDRESS)
+    {
+        return _servedUnitAddress;
+    }
+    return _slaves[0].getUnitAddress();
+}
+
 /**
  * Establece la dirección de la unidad esclavo modbus.
  *
@@ -153,6 +166,45 @@ uint64_t Modbus::getTotalBytesReceived()
     return _totalBytesReceived;
 }
 
+#if defined(MODBUS_PROFILING)
+/**
+ * Obtiene el tiempo acumulado en cada fase de poll().
+ *
+ * @return Los contadores de perfilado.
+ */
+ModbusProfile &Modbus::getProfile()
+{
+    return _profile;
+}
+
+/**
+ * Pone a cero los contadores de perfilado.
+ */
+void Modbus::resetProfile()
+{
+    _profile = ModbusProfile();
+}
+#endif
+
+/**
+ * Establece cuánto tiempo se conserva una respuesta diferida antes de descartarla.
+ * Debe ser menor que el tiempo de espera de respuesta del maestro.
+ *
+ * @param timeoutInMicroSecond El tiempo máximo en microsegundos.
+ */
+void Modbus::setDeferredTimeout(unsigned long timeoutInMicroSecond)
+{
+    _deferredTimeout = timeoutInMicroSecond;
+}
+
+/**
+ * Devuelve verdadero si hay una respuesta diferida esperando completeResponse().
+ */
+bool Modbus::isResponsePending()
+{
+    return _isResponsePending;
+}
+
 /**
  * Comienza a inicializar el flujo en serie y se prepara para leer los mensajes de solicitud.
  *
@@ -187,6 +239,9 @@ void Modbus::begin(uint64_t baudrate)
 
     // Establece la longitud del búfer de solicitud en cero.
     _requestBufferLength = 0;
+    _resyncLength = 0;
+    _resyncFrameLength = 0;
+    _resyncScannedLength = 0;
 }
 
 /**
@@ -198,7 +253,7 @@ uint8_t Modbus::readFunctionCode()
 {
     if (_requestBufferLength >= MODBUS_FRAME_SIZE && !_isRequestBufferReading)
     {
-        return _requestBuffer[MODBUS_FUNCTION_CODE_INDEX];
+        return Modbus::currentFunctionCode();
     }
     return FC_INVALID;
 }
@@ -217,6 +272,16 @@ uint8_t Modbus::readUnitAddress()
     return MODBUS_INVALID_UNIT_ADDRESS;
 }
 
+/**
+ * Devuelve verdadero si no hay ninguna solicitud ni respuesta en curso, es decir,
+ * si es un buen momento para trabajo lento como escribir en la EEPROM.
+ */
+bool Modbus::isIdle()
+{
+    return !_isRequestBufferReading && !_isResponseBufferWriting && !_isResponsePending &&
+           _fullDuplexQueueLength == 0 && !_isFullDuplexTransmitting && _serialStream.available() == 0;
+}
+
 /**
  * Lee un estado de bobina del búfer de entrada.
  *
@@ -324,14 +389,14 @@ uint8_t Modbus::writeExceptionStatusToBuffer(int offset, bool status)
 uint8_t Modbus::writeCoilToBuffer(int offset, bool state)
 {  
     // Verifique el código de la función.
-    if (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX] != FC_READ_DISCRETE_INPUT &&
-        _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] != FC_READ_COILS)
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    if (functionCode != FC_READ_DISCRETE_INPUT && functionCode != FC_READ_COILS)
     {
         return STATUS_ILLEGAL_DATA_ADDRESS;
     }
 
     // (1 x valueBytes, n x values).
-    uint16_t index = MODBUS_DATA_INDEX + 1 + (offset / 8);
+    uint16_t index = MODBUS_DATA_INDEX + 1 + _scatterDataOffset + (offset / 8);
     uint8_t bitIndex = offset % 8;
 
     // Check the offset.
@@ -372,14 +437,14 @@ uint8_t Modbus::writeDiscreteInputToBuffer(int offset, bool state)
 uint8_t Modbus::writeRegisterToBuffer(int offset, uint16_t value)
 {
     // Verifique el código de la función.
-    if (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX] != FC_READ_HOLDING_REGISTERS &&
-        _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] != FC_READ_INPUT_REGISTERS)
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    if (functionCode != FC_READ_HOLDING_REGISTERS && functionCode != FC_READ_INPUT_REGISTERS)
     {
         return STATUS_ILLEGAL_DATA_ADDRESS;
     }
 
     // (1 x valueBytes, n x values).
-    uint16_t index = MODBUS_DATA_INDEX + 1 + (offset * 2);
+    uint16_t index = MODBUS_DATA_INDEX + 1 + _scatterDataOffset + (offset * 2);
 
     // Verifica el desplazamiento.
     if ((index + 2) > (_responseBufferLength - MODBUS_CRC_LENGTH))
@@ -404,7 +469,7 @@ uint8_t Modbus::writeRegisterToBuffer(int offset, uint16_t value)
 uint8_t Modbus::writeArrayToBuffer(int offset, uint16_t *str, uint8_t length)
 {
     // Índice desde el que empezar a escribir (1 x valueBytes, n x values (offset)).
-    uint8_t index = MODBUS_DATA_INDEX + 1 + (offset * 2);
+    uint16_t index = MODBUS_DATA_INDEX + 1 + _scatterDataOffset + (offset * 2);
 
     // Verifica si la matriz cabe en el espacio restante de la respuesta.
     if ((index + (length * 2)) > _responseBufferLength - MODBUS_CRC_LENGTH)
@@ -465,34 +530,58 @@ bool Modbus::relevantAddress(uint8_t unitAddress)
  */
 uint8_t Modbus::executeCallback(uint8_t slaveAddress, uint8_t callbackIndex, uint16_t address, uint16_t length)
 {
-    // Busca el esclavo correcto para ejecutar la devolución de llamada.
-    for (uint8_t i = 0; i < _numberOfSlaves; ++i)
+    // Una difusión se aplica a todos los esclavos y sus códigos de estado se descartan, ya que no hay
+    // respuesta. Una devolución de llamada compartida por varios esclavos (p. ej. unidades emuladas
+    // sobre el mismo mapa) se ejecuta una vez por unidad; getUnitAddress() indica cuál.
+    if (slaveAddress == MODBUS_BROADCAST_ADDRESS)
     {
-        ModbusCallback callback = _slaves[i].cbVector[callbackIndex];
-        if (slaveAddress == MODBUS_BROADCAST_ADDRESS)
+        uint8_t functionCode = Modbus::readFunctionCode();
+        for (uint8_t i = 0; i < _numberOfSlaves; ++i)
         {
+            ModbusCallback callback = _slaves[i].cbVector[callbackIndex];
             if (callback)
             {
-                callback(Modbus::readFunctionCode(), address, length);
+                _servedUnitAddress = _slaves[i].getUnitAddress();
+                callback(functionCode, address, length);
             }
         }
-        else if (_slaves[i].getUnitAddress() == slaveAddress)
+        _servedUnitAddress = MODBUS_INVALID_UNIT_ADDRESS;
+        return STATUS_OK;
+    }
+
+    // Busca el esclavo correcto para ejecutar la devolución de llamada.
+    for (uint8_t i = 0; i < _numberOfSlaves; ++i)
+    {
+        if (_slaves[i].getUnitAddress() == slaveAddress)
         {
+            ModbusCallback callback = _slaves[i].cbVector[callbackIndex];
             if (callback)
             {
-                return callback(Modbus::readFunctionCode(), address, length);
-            }
-            else
-            {
-                return STATUS_ILLEGAL_FUNCTION;
+                _servedUnitAddress = slaveAddress;
+                uint8_t status = callback(Modbus::readFunctionCode(), address, length);
+                _servedUnitAddress = MODBUS_INVALID_UNIT_ADDRESS;
+                return status;
             }
+            return STATUS_ILLEGAL_FUNCTION;
         }
     }
-    // ¡No hay retorno en bucle para una transmisión, por lo tanto, regrese aquí sin error si es una transmisión!
-    return slaveAddress == MODBUS_BROADCAST_ADDRESS ? STATUS_ACKNOWLEDGE : STATUS_ILLEGAL_FUNCTION;
+    return STATUS_ILLEGAL_FUNCTION;
 }
 
 
+/**
+ * Devuelve el código de función al que responden las devoluciones de llamada: el de la
+ * solicitud o, dentro de FC_READ_SCATTER, el de la tabla del rango en curso.
+ */
+uint8_t Modbus::currentFunctionCode()
+{
+    if (_scatterFunctionCode != FC_INVALID)
+    {
+        return _scatterFunctionCode;
+    }
+    return _requestBuffer[MODBUS_FUNCTION_CODE_INDEX];
+}
+
 /**
  * Calcule el CRC de la matriz de bytes pasada desde cero hasta la longitud pasada.
  *
@@ -501,7 +590,7 @@ uint8_t Modbus::executeCallback(uint8_t slaveAddress, uint8_t callbackIndex, uin
  *
  * @return El CRC calculado como un entero de 16 bits sin signo.
  */
-uint16_t Modbus::calculateCRC(uint8_t *buffer, int length)
+uint16_t Modbus::calculateCRC(const uint8_t *buffer, int length)
 {
     int i, j;
     uint16_t crc = 0xFFFF;
@@ -3,9 +3,21 @@
 #include <Arduino.h>
 
 #define MODBUS_MAX_BUFFER 256
+#define MODBUS_MAX_PDU 253
 #define MODBUS_INVALID_UNIT_ADDRESS 255
 #define MODBUS_DEFAULT_UNIT_ADDRESS 1
 #define MODBUS_CONTROL_PIN_NONE -1
+#define MODBUS_SERVICE_IDLE_CHARS 16
+#define MODBUS_DEFAULT_DEFERRED_TIMEOUT 500000
+#define MODBUS_DEFAULT_RESYNC_TIMEOUT 50000
+#define MODBUS_CACHE_REQUEST_SIZE 8
+#define MODBUS_CACHE_RESPONSE_SIZE 64
+#define MODBUS_SNAPSHOT_RETRIES 4
+#define MODBUS_SNAPSHOT_WAITS 1000
+#define MODBUS_DIRTY_BITMAP_SIZE(numberOfRegisters) (((numberOfRegisters) + 7) / 8)
+#define MODBUS_CHANGES_FULL_SYNC 0
+#define MODBUS_CHANGES_END 0xFFFF
+#define MODBUS_CHANGES_MAX_AGE 0x4000
 
 /**
  * Modbus function codes
@@ -21,7 +33,11 @@ enum
   FC_WRITE_REGISTER = 6,
   FC_READ_EXCEPTION_STATUS = 7,
   FC_WRITE_MULTIPLE_COILS = 15,
-  FC_WRITE_MULTIPLE_REGISTERS = 16
+  FC_WRITE_MULTIPLE_REGISTERS = 16,
+  FC_READ_FILE_RECORD = 20,
+  FC_WRITE_FILE_RECORD = 21,
+  FC_READ_CHANGES = 65,
+  FC_READ_SCATTER = 66
 };
 
 enum
@@ -33,6 +49,7 @@ enum
   CB_WRITE_COILS,
   CB_WRITE_HOLDING_REGISTERS,
   CB_READ_EXCEPTION_STATUS,
+  CB_READ_CHANGES,
   CB_MAX
 };
 
@@ -55,10 +72,351 @@ enum
   STATUS_MEMORY_PARITY_ERROR,
   STATUS_GATEWAY_PATH_UNAVAILABLE,
   STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND,
+  STATUS_PENDING = 0xFF
+};
+
+/**
+ * Orden de los bytes de un valor de 32 bits (A el más significativo) en los registros;
+ * los valores de 64 bits siguen el mismo patrón por palabras (ABCD: ABCDEFGH, CDAB: GHEFCDAB).
+ */
+enum
+{
+  WORD_ORDER_ABCD = 0,
+  WORD_ORDER_CDAB,
+  WORD_ORDER_BADC,
+  WORD_ORDER_DCBA
 };
 
 typedef uint8_t (*ModbusCallback)(uint8_t, uint16_t, uint16_t);
 
+#if defined(MODBUS_PROFILING)
+#if !defined(MODBUS_PROFILE_CLOCK)
+#define MODBUS_PROFILE_CLOCK micros
+#endif
+
+/**
+ * Tiempo acumulado (en unidades de MODBUS_PROFILE_CLOCK) y número de llamadas de cada fase de poll().
+ */
+struct ModbusProfile
+{
+  uint64_t validateCRCTime;
+  uint32_t validateCRCCalls;
+  uint64_t validateRequestTime;
+  uint32_t validateRequestCalls;
+  uint64_t createResponseTime;
+  uint32_t createResponseCalls;
+  uint64_t writeResponseTime;
+  uint32_t writeResponseCalls;
+};
+
+/**
+ * Acumula en un contador de ModbusProfile el tiempo de vida del objeto.
+ */
+class ModbusProfileScope
+{
+public:
+  ModbusProfileScope(uint64_t &time, uint32_t &calls) : _time(time), _start(MODBUS_PROFILE_CLOCK())
+  {
+    calls++;
+  }
+  ~ModbusProfileScope()
+  {
+    _time += MODBUS_PROFILE_CLOCK() - _start;
+  }
+
+private:
+  uint64_t &_time;
+  uint64_t _start;
+};
+
+#define MODBUS_PROFILE_SCOPE(phase) ModbusProfileScope _profileScope(_profile.phase##Time, _profile.phase##Calls)
+#else
+#define MODBUS_PROFILE_SCOPE(phase)
+#endif
+
+/**
+ * Entrada de la caché de respuestas: la trama de solicitud FC03/FC04 completa
+ * (unidad, función, dirección, cantidad y CRC) y la respuesta codificada con su CRC.
+ */
+struct ModbusCacheEntry
+{
+  uint8_t request[MODBUS_CACHE_REQUEST_SIZE];
+  uint8_t response[MODBUS_CACHE_RESPONSE_SIZE];
+  uint8_t responseLength;
+  unsigned long storedTime;
+  unsigned long maxAge;
+};
+
+/**
+ * Ventana de validez de la caché para un rango de registros.
+ * Un maxAge de cero excluye el rango de la caché.
+ */
+struct ModbusCacheRange
+{
+  uint8_t functionCode;
+  uint16_t address;
+  uint16_t length;
+  unsigned long maxAge;
+};
+
+/**
+ * Marca de secuencia de ModbusRegisterImage. En AVR los lotes los publica el bucle
+ * principal o una ISR y 8 bits bastan; con varios núcleos un lector expulsado durante la
+ * copia no debe ver la misma marca tras 128 lotes, así que se usan 32 bits.
+ */
+#if defined(__AVR__)
+typedef uint8_t ModbusSequence;
+#else
+typedef uint32_t ModbusSequence;
+#endif
+
+/**
+ * @class ModbusRegisterImage
+ *
+ * Imagen de registros con semántica seqlock. La aplicación publica lotes de
+ * cambios entre beginUpdate() y commit(); el lado Modbus copia los registros
+ * pedidos directamente al búfer de respuesta y repite la copia si un lote se
+ * publicó mientras tanto, sin deshabilitar interrupciones ni copiar el mapa entero.
+ */
+class ModbusRegisterImage
+{
+public:
+  ModbusRegisterImage(uint16_t *registers, uint16_t firstAddress, uint16_t numberOfRegisters);
+  void beginUpdate();
+  void set(uint16_t address, uint16_t value);
+  void commit();
+  uint16_t get(uint16_t address);
+  bool contains(uint16_t address, uint16_t length);
+
+private:
+  friend class Modbus;
+
+  uint16_t *_registers;
+  uint16_t _firstAddress;
+  uint16_t _numberOfRegisters;
+#if defined(__AVR__)
+  volatile ModbusSequence _sequence = 0;
+#else
+  ModbusSequence _sequence = 0;
+#endif
+};
+
+/**
+ * Escritura de una bobina o un registro recibida del maestro.
+ */
+struct ModbusWrite
+{
+  uint8_t functionCode;
+  uint16_t address;
+  uint16_t value;
+};
+
+/**
+ * @class ModbusWriteQueue
+ *
+ * Cola sin bloqueos de un productor y un consumidor que lleva las escrituras del
+ * maestro del hilo de comunicaciones (poll()) al hilo de control. Las devoluciones
+ * de llamada la llenan con Modbus::queueWritesFromBuffer(), que publica juntas todas
+ * las escrituras de una solicitud, y la aplicación la vacía con pop(). Las entradas
+ * son propiedad de la aplicación; caben size - 1.
+ */
+class ModbusWriteQueue
+{
+public:
+  ModbusWriteQueue(ModbusWrite *entries, uint16_t size);
+  bool pop(ModbusWrite &write);
+  uint16_t available();
+  uint32_t getRejectedRequests();
+
+private:
+  friend class Modbus;
+
+  ModbusWrite *_entries;
+  uint16_t _size;
+  volatile uint16_t _head = 0;
+  volatile uint16_t _tail = 0;
+  volatile uint32_t _rejectedRequests = 0;
+};
+
+/**
+ * @class ModbusTypedMap
+ *
+ * Vista de una matriz de valores de 32 o 64 bits (int32_t, uint32_t, float, double,
+ * int64_t) propiedad de la aplicación como un bloque de registros, con el orden de
+ * palabras del mapa. Modbus::writeTypedToBuffer() y Modbus::readTypedFromBuffer()
+ * convierten la matriz entera directamente desde y hacia la carga de la trama; cada
+ * solicitud debe cubrir valores enteros.
+ */
+class ModbusTypedMap
+{
+public:
+  ModbusTypedMap(int32_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder = WORD_ORDER_ABCD);
+  ModbusTypedMap(uint32_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder = WORD_ORDER_ABCD);
+  ModbusTypedMap(float *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder = WORD_ORDER_ABCD);
+  ModbusTypedMap(double *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder = WORD_ORDER_ABCD);
+  ModbusTypedMap(int64_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder = WORD_ORDER_ABCD);
+  void setWordOrder(uint8_t wordOrder);
+  uint8_t getWordOrder();
+  uint8_t registersPerValue();
+  bool contains(uint16_t address, uint16_t length);
+
+private:
+  friend class Modbus;
+
+  uint8_t *_values;
+  uint8_t _valueSize;
+  uint16_t _firstAddress;
+  uint16_t _numberOfValues;
+  uint8_t _wordOrder;
+};
+
+/**
+ * @class ModbusEeprom
+ *
+ * Interfaz de la memoria no volátil usada por ModbusPersistentRegisters.
+ * El sketch la implementa sobre EEPROM.h (o cualquier otra memoria direccionable por bytes).
+ */
+class ModbusEeprom
+{
+public:
+  virtual uint8_t read(uint16_t address) = 0;
+  virtual void write(uint16_t address, uint8_t value) = 0;
+};
+
+/**
+ * @class ModbusFileProvider
+ *
+ * Interfaz de los archivos de FC20 (Read File Record) y FC21 (Write File Record).
+ * El sketch la implementa sobre su almacenamiento (SD, flash, un registro de eventos en RAM...).
+ * buffer apunta directamente al búfer de respuesta (lectura) o de solicitud (escritura) de
+ * Modbus y tiene length registros de 2 bytes en orden de red, así que los datos no pasan por otra copia.
+ * Devuelve STATUS_OK o el código de excepción (p. ej. STATUS_ILLEGAL_DATA_ADDRESS si el
+ * archivo o los registros no existen).
+ */
+class ModbusFileProvider
+{
+public:
+  virtual uint8_t readRecords(uint16_t fileNumber, uint16_t recordNumber, uint8_t *buffer, uint16_t length) = 0;
+  virtual uint8_t writeRecords(uint16_t fileNumber, uint16_t recordNumber, const uint8_t *buffer, uint16_t length) = 0;
+};
+
+class Modbus;
+
+/**
+ * @class ModbusCapture
+ *
+ * Anillo de captura de los bytes recibidos y enviados por Modbus, con la marca de
+ * tiempo de micros() de cada lectura o escritura del flujo serie. Cuando se llena,
+ * se descartan los registros más antiguos. exportTo() vuelca el contenido en el
+ * formato de archivo de captura (ver README), que el banco de pruebas del host
+ * puede reproducir con poll().
+ */
+class ModbusCapture
+{
+public:
+  ModbusCapture(uint8_t *buffer, uint16_t size);
+
+  void clear();
+  void setPaused(bool isPaused);
+  void record(bool isTransmit, const uint8_t *data, uint16_t length);
+  size_t exportTo(Print &output, uint32_t baudRate);
+
+  uint16_t getLength();
+  uint32_t getOverwrittenRecords();
+
+private:
+  uint8_t *_buffer;
+  uint16_t _size;
+  uint16_t _head = 0;
+  uint16_t _tail = 0;
+  uint16_t _length = 0;
+  uint32_t _overwrittenRecords = 0;
+  bool _isPaused = false;
+
+  uint8_t peek(uint16_t offset);
+  void push(uint8_t value);
+  void dropOldestRecord();
+};
+
+/**
+ * @class ModbusChangeTracker
+ *
+ * Registros con seguimiento de cambios para el código de función de fabricante
+ * FC_READ_CHANGES (65). Cada cambio de valor recibe un número de generación y cada
+ * registro guarda la generación de su último cambio, así varios maestros pueden
+ * pedir, cada uno con su propio cursor, sólo los pares (dirección, valor) que
+ * cambiaron desde la generación que ya conocen.
+ */
+class ModbusChangeTracker
+{
+public:
+  ModbusChangeTracker(uint16_t *registers, uint16_t *generations, uint16_t firstAddress, uint16_t numberOfRegisters);
+
+  void begin(uint16_t epoch = 0);
+  uint16_t get(uint16_t address);
+  void set(uint16_t address, uint16_t value);
+  bool contains(uint16_t address, uint16_t length);
+  uint16_t getEpoch();
+  uint16_t getGeneration();
+
+  uint8_t readToBuffer(Modbus &modbus, uint16_t address, uint16_t length);
+  uint8_t writeFromBuffer(Modbus &modbus, uint16_t address, uint16_t length);
+
+private:
+  friend class Modbus;
+
+  uint16_t *_registers;
+  uint16_t *_generations;
+  uint16_t _firstAddress;
+  uint16_t _numberOfRegisters;
+  uint16_t _epoch = 0;
+  uint16_t _generation = 1;
+  uint16_t _nextAgedIndex = 0;
+
+  bool isChanged(uint16_t index, uint16_t cursor);
+};
+
+/**
+ * @class ModbusPersistentRegisters
+ *
+ * Registros de retención persistentes con escritura diferida. Las escrituras del
+ * maestro sólo cambian la copia en RAM y marcan el registro como sucio, así FC06/FC16
+ * se responden de inmediato y las escrituras repetidas se agrupan. flush() guarda los
+ * registros sucios en ranuras rotativas (nivelación de desgaste) cuando el bus está libre.
+ */
+class ModbusPersistentRegisters
+{
+public:
+  ModbusPersistentRegisters(ModbusEeprom &eeprom, uint16_t eepromAddress, uint8_t numberOfSlots,
+                            uint16_t *registers, uint8_t *dirtyBitmap, uint16_t firstAddress, uint16_t numberOfRegisters);
+  static uint16_t eepromSize(uint16_t numberOfRegisters, uint8_t numberOfSlots);
+
+  void begin();
+  uint16_t get(uint16_t address);
+  void set(uint16_t address, uint16_t value);
+  bool contains(uint16_t address, uint16_t length);
+  bool isDirty();
+  bool flush(uint16_t maxRegisters = 1);
+
+  uint8_t readToBuffer(Modbus &modbus, uint16_t address, uint16_t length);
+  uint8_t writeFromBuffer(Modbus &modbus, uint16_t address, uint16_t length);
+
+private:
+  ModbusEeprom &_eeprom;
+  uint16_t _eepromAddress;
+  uint8_t _numberOfSlots;
+  uint16_t *_registers;
+  uint8_t *_dirtyBitmap;
+  uint16_t _firstAddress;
+  uint16_t _numberOfRegisters;
+  uint16_t _nextDirtyIndex = 0;
+
+  uint16_t slotAddress(uint16_t index, uint8_t slot);
+  uint16_t statusAddress(uint16_t index, uint8_t slot);
+  uint8_t currentSlot(uint16_t index);
+  void persist(uint16_t index);
+};
+
 /**
  * @class ModbusSlave
  */
@@ -86,8 +444,16 @@ public:
   Modbus(Stream &serialStream, ModbusSlave *slaves, uint8_t numberOfSlaves, int transmissionControlPin = MODBUS_CONTROL_PIN_NONE);
 
   void begin(uint64_t boudRate);
+  uint8_t getUnitAddress();
   void setUnitAddress(uint8_t unitAddress);
   uint8_t poll();
+  uint16_t processPdu(uint8_t unitAddress, const uint8_t *pdu, uint16_t pduLength, uint8_t *response);
+  uint16_t processFrame(uint8_t *frame, uint16_t frameLength, uint16_t frameSize);
+  unsigned long service(unsigned long budgetInMicroSecond);
+
+  void setDeferredTimeout(unsigned long timeoutInMicroSecond);
+  bool isResponsePending();
+  uint16_t completeResponse(uint8_t status);
 
   bool readCoilFromBuffer(int offset);
   uint16_t readRegisterFromBuffer(int offset);
@@ -96,14 +462,39 @@ public:
   uint8_t writeDiscreteInputToBuffer(int offset, bool state);
   uint8_t writeRegisterToBuffer(int offset, uint16_t value);
   uint8_t writeArrayToBuffer(int offset, uint16_t *str, uint8_t length);
+  uint8_t writeImageToBuffer(int offset, ModbusRegisterImage &image, uint16_t address, uint16_t length);
+  uint8_t writeChangesToBuffer(ModbusChangeTracker &tracker, uint16_t cursor, uint16_t address);
+  uint8_t queueWritesFromBuffer(ModbusWriteQueue &queue, uint16_t address, uint16_t length);
+  uint8_t writeTypedToBuffer(int offset, ModbusTypedMap &map, uint16_t address, uint16_t length);
+  uint8_t readTypedFromBuffer(int offset, ModbusTypedMap &map, uint16_t address, uint16_t length);
 
   uint8_t readFunctionCode();
   uint8_t readUnitAddress();
   bool isBroadcast();
+  bool isIdle();
+
+  static uint16_t calculateCRC(const uint8_t *buffer, int length);
+
+  void setFileProvider(ModbusFileProvider *provider);
+  void enableCapture(ModbusCapture *capture);
+  void enableResync(bool isEnabled, unsigned long timeoutInMicroSecond = MODBUS_DEFAULT_RESYNC_TIMEOUT);
+  uint32_t getResyncDiscardedBytes();
+  uint32_t getResyncRecoveredFrames();
+  bool enableFullDuplex(uint8_t *queue, uint16_t queueSize);
+  uint16_t getQueuedBytes();
+  void enableResponseCache(ModbusCacheEntry *entries, uint8_t numberOfEntries, unsigned long maxAgeInMicroSecond);
+  void setResponseCacheRanges(ModbusCacheRange *ranges, uint8_t numberOfRanges);
+  void invalidateResponseCache();
+  void invalidateResponseCache(uint8_t functionCode, uint16_t address, uint16_t length);
 
   uint64_t getTotalBytesSent();
   uint64_t getTotalBytesReceived();
 
+#if defined(MODBUS_PROFILING)
+  ModbusProfile &getProfile();
+  void resetProfile();
+#endif
+
 // Este cbVector es un puntero a cbVector del primer esclavo, para permitir la sintaxis abreviada:
   //     Modbus slave(SLAVE_ID, CTRL_PIN);
   //     slave.cbVector[CB_WRITE_COILS] = writeDigitalOut;
@@ -114,6 +505,8 @@ public:
   ModbusCallback *cbVector;
 
 private:
+  friend class ModbusMultiPort;
+
   ModbusSlave *_slaves = new ModbusSlave();
   uint8_t _numberOfSlaves = 1;
 
@@ -139,16 +532,163 @@ private:
   bool _isResponseBufferWriting = false;
   uint16_t _responseBufferWriteIndex = 0;
 
+  bool _isResponsePending = false;
+  unsigned long _pendingStartTime = 0;
+  unsigned long _deferredTimeout = MODBUS_DEFAULT_DEFERRED_TIMEOUT;
+
+  bool _isResponseCRCReady = false;
+
+  // La unidad cuya devolución de llamada se está ejecutando, para getUnitAddress().
+  uint8_t _servedUnitAddress = MODBUS_INVALID_UNIT_ADDRESS;
+
+  // Durante FC_READ_SCATTER: la tabla del rango en curso y el desplazamiento de sus datos en la respuesta.
+  uint8_t _scatterFunctionCode = FC_INVALID;
+  uint16_t _scatterDataOffset = 0;
+
+  ModbusFileProvider *_fileProvider = NULL;
+  ModbusCapture *_capture = NULL;
+
+  // Resincronización: bytes acumulados en _requestBuffer, longitud de la trama entregada a
+  // poll() (que sigue al principio del búfer) y longitud ya examinada sin encontrar trama.
+  bool _isResyncEnabled = false;
+  unsigned long _resyncTimeout = MODBUS_DEFAULT_RESYNC_TIMEOUT;
+  uint16_t _resyncLength = 0;
+  uint16_t _resyncFrameLength = 0;
+  uint16_t _resyncScannedLength = 0;
+  bool _isResyncDistorted = false;
+  bool _isResyncSilenceChecked = false;
+  uint32_t _resyncDiscardedBytes = 0;
+  uint32_t _resyncRecoveredFrames = 0;
+
+  // Dúplex completo: cola circular de respuestas (2 x longitud, n x trama) y estado de la
+  // línea de transmisión, separado del encuadre de la recepción.
+  uint8_t *_fullDuplexQueue = NULL;
+  uint16_t _fullDuplexQueueSize = 0;
+  uint16_t _fullDuplexQueueHead = 0;
+  uint16_t _fullDuplexQueueLength = 0;
+  uint16_t _fullDuplexFrameRemaining = 0;
+  bool _isFullDuplexTransmitting = false;
+  unsigned long _fullDuplexIdleTime = 0;
+
+  ModbusCacheEntry *_cacheEntries = NULL;
+  uint8_t _numberOfCacheEntries = 0;
+  uint8_t _nextCacheEntry = 0;
+  unsigned long _cacheMaxAge = 0;
+  ModbusCacheRange *_cacheRanges = NULL;
+  uint8_t _numberOfCacheRanges = 0;
+
   uint64_t _totalBytesSent = 0;
   uint64_t _totalBytesReceived = 0;
 
+#if defined(MODBUS_PROFILING)
+  ModbusProfile _profile = ModbusProfile();
+#endif
+
   bool relevantAddress(uint8_t unitAddress);
+  unsigned long nextDeadline();
   bool readRequest();
+  bool readResyncRequest();
+  uint16_t resyncFrameLength(uint16_t offset);
+  void discardResyncBytes(uint16_t length);
+  bool validateCRC();
   bool validateRequest();
+  bool processRequest();
+  bool processExternalRequest();
   uint8_t createResponse();
+  uint8_t createScatterResponse(uint8_t unitAddress);
+  uint8_t readFileRecords();
+  uint8_t writeFileRecords();
+  uint8_t currentFunctionCode();
   uint8_t executeCallback(uint8_t slaveAddress, uint8_t callbackIndex, uint16_t address, uint16_t length);
   uint16_t writeResponse();
+  uint16_t writeFullDuplexResponse();
+  uint16_t transmitQueuedResponses();
+  unsigned long nextFullDuplexDeadline(unsigned long receiveDeadline);
+  void pushFullDuplexQueue(const uint8_t *data, uint16_t length);
+  void popFullDuplexQueue(uint8_t *data, uint16_t length);
   uint16_t reportException(uint8_t exceptionCode);
-  uint16_t calculateCRC(uint8_t *buffer, int length);
+  void setException(uint8_t exceptionCode);
+  bool readResponseCache();
+  void writeResponseCache();
+  void invalidateResponseCacheForWrite();
+  unsigned long responseCacheMaxAge(uint8_t functionCode, uint16_t address, uint16_t length);
+};
+
+/**
+ * Estadísticas de un puerto de ModbusMultiPort.
+ */
+struct ModbusPortStatistics
+{
+  uint32_t requests;
+  uint32_t responses;
+  uint32_t crcErrors;
+  uint32_t overruns;
+  uint32_t bytesReceived;
+  uint32_t bytesSent;
+};
+
+/**
+ * @class ModbusPort
+ *
+ * Estado de encuadre RTU de un puerto serie atendido por ModbusMultiPort. La trama
+ * se recibe y la respuesta se transmite en el búfer que aporta el sketch, así que
+ * cada puerto ocupa sólo ese búfer y unos pocos bytes de estado.
+ */
+class ModbusPort
+{
+public:
+  ModbusPort(Stream &serialStream, uint8_t *buffer, uint16_t bufferSize, int transmissionControlPin = MODBUS_CONTROL_PIN_NONE);
+
+  void begin(uint64_t boudRate);
+  bool isIdle();
+  ModbusPortStatistics &getStatistics();
+  void resetStatistics();
+
+private:
+  friend class ModbusMultiPort;
+
+  Stream &_serialStream;
+  uint8_t *_buffer;
+  uint16_t _bufferSize;
+  int _transmissionControlPin;
+  int _serialTransmissionBufferLength = 0;
+
+  uint16_t _halfCharTimeInMicroSecond = 0;
+  unsigned long _lastCommunicationTime = 0;
+  uint16_t _length = 0;
+  uint16_t _writeIndex = 0;
+  uint8_t _state = 0;
+
+  ModbusPortStatistics _statistics = ModbusPortStatistics();
+};
+
+/**
+ * @class ModbusMultiPort
+ *
+ * Sirve las mismas definiciones de ModbusSlave por varios puertos serie a la vez
+ * (p. ej. Serial1-3 de un Mega). Los puertos se atienden por turnos y todas las
+ * solicitudes pasan por el motor de un único objeto Modbus, con las mismas
+ * devoluciones de llamada y la misma caché de respuestas.
+ */
+class ModbusMultiPort
+{
+public:
+  ModbusMultiPort(Modbus &modbus, ModbusPort *ports, uint8_t numberOfPorts);
+
+  void begin(uint64_t boudRate);
+  uint16_t poll();
+  uint8_t getNumberOfPorts();
+  ModbusPort &getPort(uint8_t index);
+
+private:
+  Modbus &_modbus;
+  ModbusPort *_ports;
+  uint8_t _numberOfPorts;
+  uint8_t _nextPort = 0;
+
+  uint16_t pollPort(ModbusPort &port);
+  bool readFrame(ModbusPort &port);
+  void processFrame(ModbusPort &port);
+  uint16_t writeFrame(ModbusPort &port);
 };
 #endif
@@ -0,0 +1,572 @@
+#if defined(__linux__)
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "ModbusTcp.h"
+
+#define MODBUS_TCP_TRANSACTION_INDEX 0
+#define MODBUS_TCP_PROTOCOL_INDEX 2
+#define MODBUS_TCP_LENGTH_INDEX 4
+#define MODBUS_TCP_UNIT_INDEX 6
+#define MODBUS_TCP_MAX_EVENTS 32
+
+#define readUInt16(arr, index) word(arr[index], arr[index + 1])
+
+ModbusTcpTransport::ModbusTcpTransport()
+{
+    memset(_connections, 0, sizeof(_connections));
+}
+
+ModbusTcpTransport::~ModbusTcpTransport()
+{
+    end();
+}
+
+/**
+ * Abre el socket de escucha.
+ *
+ * @param port El puerto TCP (0 para que el sistema elija uno libre, ver getPort()).
+ * @param address La dirección IPv4 local, o NULL para todas.
+ * @return True si tiene éxito; de lo contrario falso.
+ */
+bool ModbusTcpTransport::begin(uint16_t port, const char *address)
+{
+    end();
+
+    _listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0)
+    {
+        return false;
+    }
+
+    int enable = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address && inet_pton(AF_INET, address, &local.sin_addr) != 1)
+    {
+        end();
+        return false;
+    }
+
+    socklen_t localLength = sizeof(local);
+    if (bind(_listenFd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+        listen(_listenFd, SOMAXCONN) < 0 ||
+        getsockname(_listenFd, (struct sockaddr *)&local, &localLength) < 0)
+    {
+        end();
+        return false;
+    }
+    _port = ntohs(local.sin_port);
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = &_listenFd;
+    if (_epollFd < 0 || epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &event) < 0)
+    {
+        end();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Cierra todas las conexiones y el socket de escucha.
+ */
+void ModbusTcpTransport::end()
+{
+    for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+    {
+        if (_connections[i])
+        {
+            closeConnection(_connections[i]);
+        }
+    }
+    if (_epollFd >= 0)
+    {
+        close(_epollFd);
+        _epollFd = -1;
+    }
+    if (_listenFd >= 0)
+    {
+        close(_listenFd);
+        _listenFd = -1;
+    }
+}
+
+/**
+ * Espera eventos de red y atiende todas las conexiones listas.
+ *
+ * @param timeoutInMilliSecond El tiempo máximo de espera (-1 para esperar indefinidamente).
+ * @return El número de transacciones atendidas, o -1 si el servidor no está abierto.
+ */
+int ModbusTcpTransport::poll(int timeoutInMilliSecond)
+{
+    if (_epollFd < 0)
+    {
+        return -1;
+    }
+
+    struct epoll_event events[MODBUS_TCP_MAX_EVENTS];
+    int count = epoll_wait(_epollFd, events, MODBUS_TCP_MAX_EVENTS, timeoutInMilliSecond);
+    if (count < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    int transactions = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (events[i].data.ptr == &_listenFd)
+        {
+            acceptClients();
+            continue;
+        }
+
+        // Un descriptor vigilado con watch(): sólo despierta a poll().
+        ModbusTcpConnection *connection = (ModbusTcpConnection *)events[i].data.ptr;
+        if (!connection)
+        {
+            continue;
+        }
+
+        bool isOpen = true;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            isOpen = receive(connection) >= 0;
+        }
+        if (!isOpen || !serviceConnection(connection, transactions))
+        {
+            closeConnection(connection);
+            continue;
+        }
+        updateEvents(connection);
+    }
+    return transactions;
+}
+
+/**
+ * Obtiene el puerto TCP local en el que escucha el servidor.
+ */
+uint16_t ModbusTcpTransport::getPort()
+{
+    return _port;
+}
+
+/**
+ * Obtiene el número de clientes conectados.
+ */
+uint8_t ModbusTcpTransport::getNumberOfClients()
+{
+    return _numberOfClients;
+}
+
+/**
+ * Obtiene el número total de transacciones atendidas.
+ */
+uint64_t ModbusTcpTransport::getTotalTransactions()
+{
+    return _totalTransactions;
+}
+
+/**
+ * Añade un descriptor (por ejemplo el puerto serie) al bucle epoll para que poll() despierte cuando tenga datos.
+ *
+ * @param fd El descriptor a vigilar.
+ * @return True si tiene éxito; de lo contrario falso.
+ */
+bool ModbusTcpTransport::watch(int fd)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    return _epollFd >= 0 && epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PROTECTED METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Se llama antes de cerrar una conexión, para que la clase derivada olvide sus solicitudes.
+ */
+void ModbusTcpTransport::connectionClosed(ModbusTcpConnection *)
+{
+}
+
+/**
+ * Envía la respuesta de una solicitud que processAdu() aceptó sin responder.
+ * processAdu() debe haber incrementado connection->outstanding, que reserva el espacio.
+ *
+ * @param connection La conexión que hizo la solicitud.
+ * @param adu La cabecera MBAP de la solicitud (identificador de transacción y unidad).
+ * @param pdu La PDU de respuesta.
+ * @param pduLength La longitud de la PDU, o cero para no responder.
+ */
+void ModbusTcpTransport::sendResponse(ModbusTcpConnection *connection, const uint8_t *adu, const uint8_t *pdu, uint16_t pduLength)
+{
+    if (connection->outstanding > 0)
+    {
+        connection->outstanding--;
+    }
+    if (pduLength == 0)
+    {
+        return;
+    }
+
+    compactTransmitBuffer(connection);
+    appendResponse(connection, adu, pdu, pduLength);
+
+    // Los errores de socket se detectan en el próximo poll(), que cierra la conexión.
+    transmit(connection);
+    updateEvents(connection);
+}
+
+/**
+ * Vuelve a procesar las ADU que esperaban en los búferes de recepción, por ejemplo
+ * cuando la clase derivada vuelve a tener sitio para nuevas solicitudes.
+ */
+void ModbusTcpTransport::resume()
+{
+    int transactions = 0;
+    for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+    {
+        ModbusTcpConnection *connection = _connections[i];
+        if (!connection || connection->receiveLength < MODBUS_TCP_MBAP_SIZE)
+        {
+            continue;
+        }
+        if (!serviceConnection(connection, transactions))
+        {
+            closeConnection(connection);
+            continue;
+        }
+        updateEvents(connection);
+    }
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Acepta todas las conexiones pendientes.
+ */
+void ModbusTcpTransport::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept4(_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        // Busque un hueco libre; si no hay, rechace la conexión.
+        uint8_t slot = 0;
+        while (slot < MODBUS_TCP_MAX_CLIENTS && _connections[slot])
+        {
+            slot++;
+        }
+        if (slot == MODBUS_TCP_MAX_CLIENTS)
+        {
+            close(fd);
+            continue;
+        }
+
+        int enable = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+        ModbusTcpConnection *connection = new ModbusTcpConnection();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+
+        struct epoll_event event;
+        event.events = connection->events;
+        event.data.ptr = connection;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close(fd);
+            delete connection;
+            continue;
+        }
+
+        _connections[slot] = connection;
+        _numberOfClients++;
+    }
+}
+
+/**
+ * Lee del socket todo lo que quepa en el búfer de recepción.
+ *
+ * @return El número de bytes leídos, o -1 si el cliente cerró la conexión o hubo un error.
+ */
+int ModbusTcpTransport::receive(ModbusTcpConnection *connection)
+{
+    int total = 0;
+    while (connection->receiveLength < MODBUS_TCP_RECEIVE_BUFFER)
+    {
+        ssize_t length = recv(connection->fd,
+                              connection->receiveBuffer + connection->receiveLength,
+                              MODBUS_TCP_RECEIVE_BUFFER - connection->receiveLength, 0);
+        if (length > 0)
+        {
+            connection->receiveLength += length;
+            total += length;
+            continue;
+        }
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return -1;
+    }
+    return total;
+}
+
+/**
+ * Envía las respuestas pendientes.
+ *
+ * @return False si hubo un error de socket; de lo contrario verdadero.
+ */
+bool ModbusTcpTransport::transmit(ModbusTcpConnection *connection)
+{
+    while (connection->transmitIndex < connection->transmitLength)
+    {
+        ssize_t length = send(connection->fd,
+                              connection->transmitBuffer + connection->transmitIndex,
+                              connection->transmitLength - connection->transmitIndex, MSG_NOSIGNAL);
+        if (length > 0)
+        {
+            connection->transmitIndex += length;
+            continue;
+        }
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return false;
+    }
+
+    connection->transmitIndex = 0;
+    connection->transmitLength = 0;
+    return true;
+}
+
+/**
+ * Ajusta los eventos epoll de la conexión: lectura mientras haya espacio, escritura mientras haya respuestas.
+ */
+void ModbusTcpTransport::updateEvents(ModbusTcpConnection *connection)
+{
+    uint32_t events = 0;
+    if (connection->receiveLength < MODBUS_TCP_RECEIVE_BUFFER)
+    {
+        events |= EPOLLIN;
+    }
+    if (connection->transmitLength > connection->transmitIndex)
+    {
+        events |= EPOLLOUT;
+    }
+    if (events == connection->events)
+    {
+        return;
+    }
+
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = connection;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+/**
+ * Cierra una conexión y libera su hueco.
+ */
+void ModbusTcpTransport::closeConnection(ModbusTcpConnection *connection)
+{
+    connectionClosed(connection);
+    for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+    {
+        if (_connections[i] == connection)
+        {
+            _connections[i] = NULL;
+            _numberOfClients--;
+        }
+    }
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    delete connection;
+}
+
+/**
+ * Mueve al principio del búfer de transmisión los bytes que quedan por enviar.
+ */
+void ModbusTcpTransport::compactTransmitBuffer(ModbusTcpConnection *connection)
+{
+    if (connection->transmitIndex > 0)
+    {
+        memmove(connection->transmitBuffer,
+                connection->transmitBuffer + connection->transmitIndex,
+                connection->transmitLength - connection->transmitIndex);
+        connection->transmitLength -= connection->transmitIndex;
+        connection->transmitIndex = 0;
+    }
+}
+
+/**
+ * Añade una respuesta con su cabecera MBAP al final del búfer de transmisión, sin enviarla.
+ */
+void ModbusTcpTransport::appendResponse(ModbusTcpConnection *connection, const uint8_t *adu, const uint8_t *pdu, uint16_t pduLength)
+{
+    uint8_t *response = connection->transmitBuffer + connection->transmitLength;
+    response[MODBUS_TCP_TRANSACTION_INDEX] = adu[MODBUS_TCP_TRANSACTION_INDEX];
+    response[MODBUS_TCP_TRANSACTION_INDEX + 1] = adu[MODBUS_TCP_TRANSACTION_INDEX + 1];
+    response[MODBUS_TCP_PROTOCOL_INDEX] = 0;
+    response[MODBUS_TCP_PROTOCOL_INDEX + 1] = 0;
+    response[MODBUS_TCP_LENGTH_INDEX] = (pduLength + 1) >> 8;
+    response[MODBUS_TCP_LENGTH_INDEX + 1] = (pduLength + 1) & 0xFF;
+    response[MODBUS_TCP_UNIT_INDEX] = adu[MODBUS_TCP_UNIT_INDEX];
+    if (pdu != response + MODBUS_TCP_MBAP_SIZE)
+    {
+        memcpy(response + MODBUS_TCP_MBAP_SIZE, pdu, pduLength);
+    }
+    connection->transmitLength += MODBUS_TCP_MBAP_SIZE + pduLength;
+}
+
+/**
+ * Procesa las ADU completas de una conexión y envía las respuestas.
+ *
+ * @param transactions Se incrementa con el número de transacciones procesadas.
+ * @return False si hay que cerrar la conexión; de lo contrario verdadero.
+ */
+bool ModbusTcpTransport::serviceConnection(ModbusTcpConnection *connection, int &transactions)
+{
+    while (true)
+    {
+        int processed = processAdus(connection);
+        if (processed < 0 || !transmit(connection))
+        {
+            return false;
+        }
+        transactions += processed;
+
+        // Siga sólo si enviar liberó espacio para ADU que esperaban en el búfer de recepción.
+        if (processed == 0 || connection->transmitLength > 0)
+        {
+            return true;
+        }
+    }
+}
+
+/**
+ * Procesa todas las ADU completas del búfer de recepción mientras quepan sus respuestas.
+ *
+ * @return El número de transacciones procesadas, o -1 si la cabecera MBAP no es válida.
+ */
+int ModbusTcpTransport::processAdus(ModbusTcpConnection *connection)
+{
+    int transactions = 0;
+    uint16_t offset = 0;
+
+    compactTransmitBuffer(connection);
+
+    while (connection->receiveLength - offset >= MODBUS_TCP_MBAP_SIZE)
+    {
+        uint8_t *adu = connection->receiveBuffer + offset;
+
+        // (2 x Transaction, 2 x Protocol = 0, 2 x Length = unit + PDU, 1 x Unit, n x PDU).
+        uint16_t length = readUInt16(adu, MODBUS_TCP_LENGTH_INDEX);
+        if (readUInt16(adu, MODBUS_TCP_PROTOCOL_INDEX) != 0 || length < 2 || length > MODBUS_MAX_PDU + 1)
+        {
+            return -1;
+        }
+        if (connection->receiveLength - offset < MODBUS_TCP_UNIT_INDEX + length)
+        {
+            break;
+        }
+
+        // Sin sitio para esta respuesta y las pendientes: espere a que el cliente lea (control de flujo).
+        if (MODBUS_TCP_TRANSMIT_BUFFER - connection->transmitLength < (connection->outstanding + 1) * MODBUS_TCP_MAX_ADU)
+        {
+            break;
+        }
+
+        uint8_t *response = connection->transmitBuffer + connection->transmitLength;
+        uint16_t responseLength = 0;
+        if (!processAdu(connection, adu, MODBUS_TCP_UNIT_INDEX + length, response + MODBUS_TCP_MBAP_SIZE, responseLength))
+        {
+            break;
+        }
+        if (responseLength > 0)
+        {
+            appendResponse(connection, adu, response + MODBUS_TCP_MBAP_SIZE, responseLength);
+        }
+
+        offset += MODBUS_TCP_UNIT_INDEX + length;
+        transactions++;
+    }
+
+    // Descarta las ADU procesadas.
+    if (offset > 0)
+    {
+        memmove(connection->receiveBuffer, connection->receiveBuffer + offset, connection->receiveLength - offset);
+        connection->receiveLength -= offset;
+    }
+    _totalTransactions += transactions;
+    return transactions;
+}
+
+/**
+ * Inicializa el servidor Modbus TCP.
+ *
+ * @param modbus El objeto modbus cuyas devoluciones de llamada atienden las solicitudes.
+ */
+ModbusTcpServer::ModbusTcpServer(Modbus &modbus)
+    : _modbus(modbus)
+{
+}
+
+ModbusTcpServer::~ModbusTcpServer()
+{
+    end();
+}
+
+/**
+ * Atiende una ADU con el motor de PDU del objeto modbus.
+ */
+bool ModbusTcpServer::processAdu(ModbusTcpConnection *, const uint8_t *adu, uint16_t aduLength,
+                                 uint8_t *response, uint16_t &responseLength)
+{
+    uint8_t unitAddress = adu[MODBUS_TCP_UNIT_INDEX];
+    if (unitAddress == MODBUS_TCP_UNIT_ADDRESS_DIRECT)
+    {
+        unitAddress = _modbus.getUnitAddress();
+    }
+
+    responseLength = _modbus.processPdu(unitAddress, adu + MODBUS_TCP_MBAP_SIZE, aduLength - MODBUS_TCP_MBAP_SIZE, response);
+    return true;
+}
+#endif
@@ -0,0 +1,103 @@
+#ifndef MODBUSTCP_H
+#define MODBUSTCP_H
+#include "ModbusSlave.h"
+
+#if defined(__linux__)
+
+#define MODBUS_TCP_DEFAULT_PORT 502
+#define MODBUS_TCP_MAX_CLIENTS 64
+#define MODBUS_TCP_MBAP_SIZE 7
+#define MODBUS_TCP_MAX_ADU (MODBUS_TCP_MBAP_SIZE + MODBUS_MAX_PDU)
+#define MODBUS_TCP_RECEIVE_BUFFER (MODBUS_TCP_MAX_ADU * 4)
+#define MODBUS_TCP_TRANSMIT_BUFFER (MODBUS_TCP_MAX_ADU * 8)
+#define MODBUS_TCP_UNIT_ADDRESS_DIRECT 0xFF
+
+/**
+ * Conexión de un cliente Modbus TCP: bytes recibidos sin procesar y respuestas pendientes de enviar.
+ * outstanding cuenta las solicitudes aceptadas cuya respuesta aún no está en el búfer de transmisión.
+ */
+struct ModbusTcpConnection
+{
+  int fd;
+  uint8_t receiveBuffer[MODBUS_TCP_RECEIVE_BUFFER];
+  uint16_t receiveLength;
+  uint8_t transmitBuffer[MODBUS_TCP_TRANSMIT_BUFFER];
+  uint16_t transmitLength;
+  uint16_t transmitIndex;
+  uint8_t outstanding;
+  uint32_t events;
+};
+
+/**
+ * @class ModbusTcpTransport
+ *
+ * Parte común de los front-end Modbus TCP (MBAP) para Linux: un bucle epoll que
+ * acepta muchos clientes, separa las ADU de cada conexión (varias transacciones
+ * encadenadas sin esperar respuesta) y devuelve las respuestas con su identificador
+ * de transacción. Las clases derivadas deciden qué hacer con cada ADU.
+ */
+class ModbusTcpTransport
+{
+public:
+  ModbusTcpTransport();
+  virtual ~ModbusTcpTransport();
+
+  bool begin(uint16_t port = MODBUS_TCP_DEFAULT_PORT, const char *address = NULL);
+  void end();
+  int poll(int timeoutInMilliSecond);
+
+  uint16_t getPort();
+  uint8_t getNumberOfClients();
+  uint64_t getTotalTransactions();
+  bool watch(int fd);
+
+protected:
+  ModbusTcpConnection *_connections[MODBUS_TCP_MAX_CLIENTS];
+
+  virtual bool processAdu(ModbusTcpConnection *connection, const uint8_t *adu, uint16_t aduLength,
+                          uint8_t *response, uint16_t &responseLength) = 0;
+  virtual void connectionClosed(ModbusTcpConnection *connection);
+
+  void sendResponse(ModbusTcpConnection *connection, const uint8_t *adu, const uint8_t *pdu, uint16_t pduLength);
+  void resume();
+
+private:
+  int _listenFd = -1;
+  int _epollFd = -1;
+  uint16_t _port = 0;
+  uint8_t _numberOfClients = 0;
+  uint64_t _totalTransactions = 0;
+
+  void acceptClients();
+  int receive(ModbusTcpConnection *connection);
+  bool transmit(ModbusTcpConnection *connection);
+  void updateEvents(ModbusTcpConnection *connection);
+  void closeConnection(ModbusTcpConnection *connection);
+  void compactTransmitBuffer(ModbusTcpConnection *connection);
+  void appendResponse(ModbusTcpConnection *connection, const uint8_t *adu, const uint8_t *pdu, uint16_t pduLength);
+  bool serviceConnection(ModbusTcpConnection *connection, int &transactions);
+  int processAdus(ModbusTcpConnection *connection);
+};
+
+/**
+ * @class ModbusTcpServer
+ *
+ * Servidor Modbus TCP sobre el mismo motor de PDU que poll(): cada ADU se atiende
+ * en el acto con las devoluciones de llamada del objeto modbus.
+ */
+class ModbusTcpServer : public ModbusTcpTransport
+{
+public:
+  ModbusTcpServer(Modbus &modbus);
+  ~ModbusTcpServer();
+
+protected:
+  bool processAdu(ModbusTcpConnection *connection, const uint8_t *adu, uint16_t aduLength,
+                  uint8_t *response, uint16_t &responseLength);
+
+private:
+  Modbus &_modbus;
+};
+
+#endif
+#endif
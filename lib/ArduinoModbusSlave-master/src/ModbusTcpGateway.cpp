@@ -0,0 +1,580 @@
+#if defined(__linux__)
+#include <string.h>
+#include "ModbusTcpGateway.h"
+
+#define MODBUS_ADDRESS_INDEX 0
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+#define MODBUS_CRC_LENGTH 2
+#define MODBUS_TCP_UNIT_INDEX 6
+
+#define MODBUS_FULL_SILENCE_CHARS 3.5
+#define MODBUS_FIXED_SILENCE 1750
+
+/**
+ * Inicializa la pasarela.
+ *
+ * @param serialStream El flujo serie del bus RTU, ya configurado.
+ * @param baudRate La velocidad del bus, para los tiempos de trama.
+ * @param serialFd El descriptor del puerto serie, si lo hay: poll() despierta en cuanto llegan datos en vez de sondear cada milisegundo.
+ */
+ModbusTcpGateway::ModbusTcpGateway(Stream &serialStream, uint64_t baudRate, int serialFd)
+    : _serialStream(serialStream), _serialFd(serialFd)
+{
+    // Un carácter son 11 bits (inicio, 8 datos, paridad o segundo bit de parada, parada).
+    _charTimeInMicroSecond = 11000000UL / baudRate;
+
+    // A más de 19200 baudios el silencio de 3.5T es fijo.
+    _silenceInMicroSecond = baudRate > 19200 ? MODBUS_FIXED_SILENCE : _charTimeInMicroSecond * MODBUS_FULL_SILENCE_CHARS;
+
+    memset(_unitTimeouts, 0, sizeof(_unitTimeouts));
+    memset(_queue, 0, sizeof(_queue));
+}
+
+ModbusTcpGateway::~ModbusTcpGateway()
+{
+    end();
+}
+
+/**
+ * Abre el socket de escucha y vigila el puerto serie.
+ *
+ * @param port El puerto TCP (0 para que el sistema elija uno libre, ver getPort()).
+ * @param address La dirección IPv4 local, o NULL para todas.
+ * @return True si tiene éxito; de lo contrario falso.
+ */
+bool ModbusTcpGateway::begin(uint16_t port, const char *address)
+{
+    if (!ModbusTcpTransport::begin(port, address))
+    {
+        return false;
+    }
+    if (_serialFd >= 0 && !watch(_serialFd))
+    {
+        end();
+        return false;
+    }
+
+    _serialStream.setTimeout(0);
+    _lastBusTime = micros();
+    return true;
+}
+
+/**
+ * Atiende los clientes TCP y avanza la transacción en curso en el bus.
+ *
+ * @param timeoutInMilliSecond El tiempo máximo de espera si el bus está libre y la cola vacía.
+ * @return El número de solicitudes TCP aceptadas, o -1 si la pasarela no está abierta.
+ */
+int ModbusTcpGateway::poll(int timeoutInMilliSecond)
+{
+    // Con trabajo en el bus, no duerma más allá del próximo plazo.
+    if (_active || getQueueLength() > 0)
+    {
+        int limit = 1;
+        if (_serialFd >= 0)
+        {
+            limit = (nextBusDeadline() + 999) / 1000;
+        }
+        if (timeoutInMilliSecond < 0 || limit < timeoutInMilliSecond)
+        {
+            timeoutInMilliSecond = limit;
+        }
+    }
+
+    int transactions = ModbusTcpTransport::poll(timeoutInMilliSecond);
+    serviceBus();
+    return transactions;
+}
+
+/**
+ * Establece el tiempo de espera de respuesta por defecto.
+ *
+ * @param timeoutInMicroSecond El tiempo desde el final de la solicitud hasta el primer byte de la respuesta.
+ */
+void ModbusTcpGateway::setTimeout(unsigned long timeoutInMicroSecond)
+{
+    _timeout = timeoutInMicroSecond;
+}
+
+/**
+ * Establece el tiempo de espera de respuesta de una unidad.
+ *
+ * @param unitAddress La dirección de la unidad.
+ * @param timeoutInMicroSecond El tiempo de espera, o cero para usar el valor por defecto.
+ */
+void ModbusTcpGateway::setUnitTimeout(uint8_t unitAddress, unsigned long timeoutInMicroSecond)
+{
+    if (unitAddress <= MODBUS_GATEWAY_MAX_UNIT_ADDRESS)
+    {
+        _unitTimeouts[unitAddress] = timeoutInMicroSecond;
+    }
+}
+
+/**
+ * Establece el tiempo que el bus queda reservado tras una difusión (unidad 0), que no tiene respuesta.
+ */
+void ModbusTcpGateway::setBroadcastDelay(unsigned long delayInMicroSecond)
+{
+    _broadcastDelay = delayInMicroSecond;
+}
+
+/**
+ * Obtiene el número de transacciones en cola, incluida la que está en curso.
+ */
+uint8_t ModbusTcpGateway::getQueueLength()
+{
+    uint8_t length = 0;
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+    {
+        length += _queue[i].isUsed;
+    }
+    return length;
+}
+
+/**
+ * Obtiene el número total de transacciones enviadas por el bus.
+ */
+uint64_t ModbusTcpGateway::getTotalBusTransactions()
+{
+    return _totalBusTransactions;
+}
+
+/**
+ * Obtiene el número total de solicitudes atendidas con la respuesta de una lectura idéntica.
+ */
+uint64_t ModbusTcpGateway::getTotalDeduplicated()
+{
+    return _totalDeduplicated;
+}
+
+/**
+ * Obtiene el número total de transacciones sin respuesta de la unidad.
+ */
+uint64_t ModbusTcpGateway::getTotalTimeouts()
+{
+    return _totalTimeouts;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PROTECTED METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Pone en cola una ADU, o la une a una lectura idéntica pendiente.
+ *
+ * @return False si la cola o el cupo del cliente están llenos (la ADU espera en el búfer de recepción).
+ */
+bool ModbusTcpGateway::processAdu(ModbusTcpConnection *connection, const uint8_t *adu, uint16_t aduLength,
+                                  uint8_t *response, uint16_t &responseLength)
+{
+    uint8_t unitAddress = adu[MODBUS_TCP_UNIT_INDEX];
+    const uint8_t *pdu = adu + MODBUS_TCP_MBAP_SIZE;
+    uint16_t pduLength = aduLength - MODBUS_TCP_MBAP_SIZE;
+
+    // No hay esclavos RTU por encima de 247 (0xFF se usa para el propio dispositivo TCP).
+    if (unitAddress > MODBUS_GATEWAY_MAX_UNIT_ADDRESS)
+    {
+        response[0] = pdu[0] | 0x80;
+        response[1] = STATUS_GATEWAY_PATH_UNAVAILABLE;
+        responseLength = 2;
+        return true;
+    }
+
+    if (connection->outstanding >= MODBUS_GATEWAY_MAX_CLIENT_REQUESTS)
+    {
+        return false;
+    }
+
+    ModbusGatewayTransaction *transaction = findDuplicate(connection, unitAddress, pdu, pduLength);
+    if (transaction)
+    {
+        _totalDeduplicated++;
+    }
+    else
+    {
+        for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE && !transaction; i++)
+        {
+            if (!_queue[i].isUsed)
+            {
+                transaction = &_queue[i];
+            }
+        }
+        if (!transaction)
+        {
+            return false;
+        }
+
+        // Construye la trama RTU (1 x Address, n x PDU, 2 x CRC).
+        transaction->frame[MODBUS_ADDRESS_INDEX] = unitAddress;
+        memcpy(transaction->frame + MODBUS_FUNCTION_CODE_INDEX, pdu, pduLength);
+        uint16_t crc = Modbus::calculateCRC(transaction->frame, pduLength + 1);
+        transaction->frame[pduLength + 1] = crc & 0xFF;
+        transaction->frame[pduLength + 2] = crc >> 8;
+        transaction->frameLength = pduLength + 1 + MODBUS_CRC_LENGTH;
+        transaction->numberOfWaiters = 0;
+        transaction->sequence = _sequence++;
+        transaction->isUsed = true;
+    }
+
+    ModbusGatewayWaiter &waiter = transaction->waiters[transaction->numberOfWaiters++];
+    waiter.connection = connection;
+    memcpy(waiter.header, adu, MODBUS_TCP_MBAP_SIZE);
+    connection->outstanding++;
+
+    responseLength = 0;
+    return true;
+}
+
+/**
+ * Olvida las solicitudes de una conexión que se cierra.
+ */
+void ModbusTcpGateway::connectionClosed(ModbusTcpConnection *connection)
+{
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+    {
+        ModbusGatewayTransaction &transaction = _queue[i];
+        if (!transaction.isUsed)
+        {
+            continue;
+        }
+
+        uint8_t count = 0;
+        for (uint8_t j = 0; j < transaction.numberOfWaiters; j++)
+        {
+            if (transaction.waiters[j].connection != connection)
+            {
+                transaction.waiters[count++] = transaction.waiters[j];
+            }
+        }
+        transaction.numberOfWaiters = count;
+
+        // La transacción en curso sigue ocupando el bus hasta que termine.
+        if (count == 0 && &transaction != _active)
+        {
+            transaction.isUsed = false;
+        }
+    }
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Elige la siguiente transacción: la más antigua del siguiente cliente en turno que tenga alguna en cola
+ * y que no deba esperar a otra (véase isBlocked()).
+ */
+ModbusGatewayTransaction *ModbusTcpGateway::nextTransaction()
+{
+    for (uint8_t offset = 0; offset < MODBUS_TCP_MAX_CLIENTS; offset++)
+    {
+        uint8_t slot = (_nextClient + offset) % MODBUS_TCP_MAX_CLIENTS;
+        ModbusTcpConnection *connection = _connections[slot];
+        if (!connection)
+        {
+            continue;
+        }
+
+        ModbusGatewayTransaction *oldest = NULL;
+        for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+        {
+            ModbusGatewayTransaction &transaction = _queue[i];
+            if (transaction.isUsed && transaction.numberOfWaiters > 0 &&
+                transaction.waiters[0].connection == connection &&
+                (!oldest || (int32_t)(transaction.sequence - oldest->sequence) < 0))
+            {
+                oldest = &transaction;
+            }
+        }
+        if (oldest && !isBlocked(*oldest))
+        {
+            _nextClient = (slot + 1) % MODBUS_TCP_MAX_CLIENTS;
+            return oldest;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Busca una lectura idéntica en cola o en curso a la que pueda unirse otra solicitud.
+ * Para que el cliente reciba sus respuestas en orden, y no lea un valor anterior a una
+ * escritura suya aún pendiente, sólo se une a una transacción más reciente que todas las
+ * que el cliente tiene pendientes, y a la que está en curso sólo si no tiene ninguna.
+ */
+ModbusGatewayTransaction *ModbusTcpGateway::findDuplicate(ModbusTcpConnection *connection, uint8_t unitAddress,
+                                                          const uint8_t *pdu, uint16_t pduLength)
+{
+    // Sólo las lecturas son idempotentes; las difusiones no tienen respuesta que compartir.
+    if (unitAddress == 0 || pdu[0] < FC_READ_COILS || pdu[0] > FC_READ_INPUT_REGISTERS)
+    {
+        return NULL;
+    }
+
+    // La transacción pendiente más reciente del cliente, como dueño o unido a ella.
+    ModbusGatewayTransaction *newest = NULL;
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+    {
+        ModbusGatewayTransaction &transaction = _queue[i];
+        if (transaction.isUsed && hasWaiter(transaction, connection) &&
+            (!newest || (int32_t)(transaction.sequence - newest->sequence) > 0))
+        {
+            newest = &transaction;
+        }
+    }
+
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+    {
+        ModbusGatewayTransaction &transaction = _queue[i];
+        if (transaction.isUsed &&
+            transaction.numberOfWaiters > 0 &&
+            (!newest || (&transaction != _active && (int32_t)(transaction.sequence - newest->sequence) > 0)) &&
+            transaction.numberOfWaiters < MODBUS_GATEWAY_MAX_WAITERS &&
+            transaction.frameLength == pduLength + 1 + MODBUS_CRC_LENGTH &&
+            transaction.frame[MODBUS_ADDRESS_INDEX] == unitAddress &&
+            memcmp(transaction.frame + MODBUS_FUNCTION_CODE_INDEX, pdu, pduLength) == 0)
+        {
+            return &transaction;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Devuelve verdadero si la conexión espera la respuesta de la transacción.
+ */
+bool ModbusTcpGateway::hasWaiter(const ModbusGatewayTransaction &transaction, ModbusTcpConnection *connection)
+{
+    for (uint8_t i = 0; i < transaction.numberOfWaiters; i++)
+    {
+        if (transaction.waiters[i].connection == connection)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Devuelve verdadero si algún cliente unido a la transacción (no su dueño) tiene pendiente
+ * otra más antigua: ésta debe pasar antes por el bus para que sus respuestas sigan en orden.
+ * La transacción pendiente más antigua nunca espera, así que la cola siempre avanza.
+ */
+bool ModbusTcpGateway::isBlocked(const ModbusGatewayTransaction &transaction)
+{
+    for (uint8_t i = 0; i < MODBUS_GATEWAY_QUEUE_SIZE; i++)
+    {
+        ModbusGatewayTransaction &other = _queue[i];
+        if (!other.isUsed || &other == &transaction || (int32_t)(other.sequence - transaction.sequence) >= 0)
+        {
+            continue;
+        }
+        for (uint8_t j = 1; j < transaction.numberOfWaiters; j++)
+        {
+            if (hasWaiter(other, transaction.waiters[j].connection))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Devuelve el tiempo de espera de respuesta de una unidad.
+ */
+unsigned long ModbusTcpGateway::unitTimeout(uint8_t unitAddress)
+{
+    return _unitTimeouts[unitAddress] ? _unitTimeouts[unitAddress] : _timeout;
+}
+
+/**
+ * Devuelve los microsegundos hasta el próximo cambio de estado del bus que no depende de recibir datos.
+ */
+unsigned long ModbusTcpGateway::nextBusDeadline()
+{
+    unsigned long now = micros();
+    unsigned long deadline;
+    if (!_active)
+    {
+        deadline = _lastBusTime + _silenceInMicroSecond;
+    }
+    else if (_active->frame[MODBUS_ADDRESS_INDEX] == 0)
+    {
+        deadline = _activeTime + _broadcastDelay;
+    }
+    else if (_responseLength > 0)
+    {
+        deadline = _lastBusTime + _silenceInMicroSecond;
+    }
+    else
+    {
+        deadline = _activeTime + unitTimeout(_active->frame[MODBUS_ADDRESS_INDEX]);
+    }
+    return (long)(deadline - now) > 0 ? deadline - now : 0;
+}
+
+/**
+ * Avanza la transacción del bus: recibe la respuesta en curso o, con el bus libre
+ * durante 3.5T, envía la siguiente transacción de la cola.
+ */
+void ModbusTcpGateway::serviceBus()
+{
+    if (!_active)
+    {
+        if ((micros() - _lastBusTime) < _silenceInMicroSecond)
+        {
+            return;
+        }
+        ModbusGatewayTransaction *transaction = nextTransaction();
+        if (transaction)
+        {
+            startTransaction(transaction);
+        }
+        return;
+    }
+
+    while (_serialStream.available() > 0)
+    {
+        int value = _serialStream.read();
+        if (value < 0)
+        {
+            break;
+        }
+        if (_responseLength < MODBUS_MAX_BUFFER)
+        {
+            _responseBuffer[_responseLength++] = value;
+        }
+        _lastBusTime = micros();
+    }
+
+    unsigned long now = micros();
+    uint8_t unitAddress = _active->frame[MODBUS_ADDRESS_INDEX];
+    if (unitAddress == 0)
+    {
+        if ((long)(now - _activeTime) >= (long)_broadcastDelay)
+        {
+            completeTransaction(NULL, 0);
+        }
+        return;
+    }
+
+    // La respuesta termina al llegar la longitud que anuncia su cabecera o, si no se puede saber, tras 3.5T de silencio.
+    uint16_t expectedLength = expectedResponseLength();
+    bool isComplete = (expectedLength > 0 && _responseLength >= expectedLength) ||
+                      (_responseLength > 0 && (now - _lastBusTime) >= _silenceInMicroSecond);
+    if (!isComplete)
+    {
+        if (_responseLength == 0 && (long)(now - _activeTime) >= (long)unitTimeout(unitAddress))
+        {
+            _totalTimeouts++;
+            failTransaction(STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND);
+        }
+        return;
+    }
+
+    // Una respuesta dañada o de otra unidad cuenta como falta de respuesta, igual que una cuya
+    // longitud no coincide con su cabecera: cortada, con bytes de más o más larga que el búfer.
+    uint16_t length = expectedLength > 0 ? expectedLength : _responseLength;
+    if (length < 5 || length > MODBUS_MAX_BUFFER || _responseLength != length ||
+        word(_responseBuffer[length - 1], _responseBuffer[length - 2]) != Modbus::calculateCRC(_responseBuffer, length - MODBUS_CRC_LENGTH) ||
+        _responseBuffer[MODBUS_ADDRESS_INDEX] != unitAddress ||
+        (_responseBuffer[MODBUS_FUNCTION_CODE_INDEX] & 0x7F) != _active->frame[MODBUS_FUNCTION_CODE_INDEX])
+    {
+        failTransaction(STATUS_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND);
+        return;
+    }
+
+    completeTransaction(_responseBuffer + MODBUS_FUNCTION_CODE_INDEX, length - 1 - MODBUS_CRC_LENGTH);
+}
+
+/**
+ * Envía una transacción por el bus. El tiempo de espera cuenta desde el final estimado de la trama.
+ */
+void ModbusTcpGateway::startTransaction(ModbusGatewayTransaction *transaction)
+{
+    // Descarte los bytes sueltos de una respuesta tardía anterior.
+    while (_serialStream.available() > 0 && _serialStream.read() >= 0)
+    {
+    }
+
+    _active = transaction;
+    _responseLength = 0;
+    _serialStream.write(transaction->frame, transaction->frameLength);
+    _activeTime = micros() + transaction->frameLength * _charTimeInMicroSecond;
+    _lastBusTime = _activeTime;
+    _totalBusTransactions++;
+}
+
+/**
+ * Devuelve la longitud de la respuesta en curso según su cabecera, o cero si aún no se puede saber.
+ */
+uint16_t ModbusTcpGateway::expectedResponseLength()
+{
+    if (_responseLength < 3)
+    {
+        return 0;
+    }
+
+    uint8_t functionCode = _responseBuffer[MODBUS_FUNCTION_CODE_INDEX];
+    if (functionCode & 0x80)
+    {
+        return 5; // (1 x Address, 1 x FC, 1 x Exception, 2 x CRC).
+    }
+    switch (functionCode)
+    {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUT:
+    case FC_READ_HOLDING_REGISTERS:
+    case FC_READ_INPUT_REGISTERS:
+    case FC_READ_FILE_RECORD:
+    case FC_WRITE_FILE_RECORD:
+    case FC_READ_CHANGES:
+    case FC_READ_SCATTER:
+        return 5 + _responseBuffer[MODBUS_DATA_INDEX]; // (1 x Address, 1 x FC, 1 x Count, n x Data, 2 x CRC).
+    case FC_READ_EXCEPTION_STATUS:
+        return 5;
+    case FC_WRITE_COIL:
+    case FC_WRITE_REGISTER:
+    case FC_WRITE_MULTIPLE_COILS:
+    case FC_WRITE_MULTIPLE_REGISTERS:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Entrega la respuesta a todos los clientes que la esperan y libera el bus.
+ */
+void ModbusTcpGateway::completeTransaction(const uint8_t *pdu, uint16_t pduLength)
+{
+    ModbusGatewayTransaction *transaction = _active;
+    _active = NULL;
+    _lastBusTime = micros();
+
+    for (uint8_t i = 0; i < transaction->numberOfWaiters; i++)
+    {
+        ModbusGatewayWaiter &waiter = transaction->waiters[i];
+        sendResponse(waiter.connection, waiter.header, pdu, pduLength);
+    }
+    transaction->numberOfWaiters = 0;
+    transaction->isUsed = false;
+
+    // Hay sitio en la cola para las ADU que esperaban en los búferes de recepción.
+    resume();
+}
+
+/**
+ * Responde a todos los clientes de la transacción en curso con una excepción.
+ */
+void ModbusTcpGateway::failTransaction(uint8_t exceptionCode)
+{
+    uint8_t pdu[] = {(uint8_t)(_active->frame[MODBUS_FUNCTION_CODE_INDEX] | 0x80), exceptionCode};
+    completeTransaction(pdu, sizeof(pdu));
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef MODBUSTCPGATEWAY_H
+#define MODBUSTCPGATEWAY_H
+#include "ModbusTcp.h"
+
+#if defined(__linux__)
+
+#define MODBUS_GATEWAY_QUEUE_SIZE 32
+#define MODBUS_GATEWAY_MAX_CLIENT_REQUESTS 4
+#define MODBUS_GATEWAY_MAX_WAITERS 8
+#define MODBUS_GATEWAY_DEFAULT_TIMEOUT 200000
+#define MODBUS_GATEWAY_DEFAULT_BROADCAST_DELAY 10000
+#define MODBUS_GATEWAY_MAX_UNIT_ADDRESS 247
+
+/**
+ * Cliente que espera la respuesta de una transacción: su conexión y la cabecera MBAP de su solicitud.
+ */
+struct ModbusGatewayWaiter
+{
+  ModbusTcpConnection *connection;
+  uint8_t header[MODBUS_TCP_MBAP_SIZE];
+};
+
+/**
+ * Transacción en cola: la trama RTU completa (unidad, PDU y CRC) y los clientes que esperan
+ * su respuesta. El primero es el dueño a efectos del reparto por turnos; los demás son
+ * lecturas idénticas que se unieron mientras la transacción estaba en cola o en curso.
+ */
+struct ModbusGatewayTransaction
+{
+  uint8_t frame[MODBUS_MAX_BUFFER];
+  uint16_t frameLength;
+  ModbusGatewayWaiter waiters[MODBUS_GATEWAY_MAX_WAITERS];
+  uint8_t numberOfWaiters;
+  uint32_t sequence;
+  bool isUsed;
+};
+
+/**
+ * @class ModbusTcpGateway
+ *
+ * Pasarela Modbus TCP a RTU: las solicitudes de muchos clientes TCP se ponen en una
+ * cola acotada y se envían de una en una por un Stream half-duplex. La cola se
+ * reparte por turnos entre los clientes, cada unidad tiene su tiempo de espera y
+ * las lecturas (FC01..FC04) idénticas se atienden con una sola transacción en el bus.
+ */
+class ModbusTcpGateway : public ModbusTcpTransport
+{
+public:
+  ModbusTcpGateway(Stream &serialStream, uint64_t baudRate, int serialFd = -1);
+  ~ModbusTcpGateway();
+
+  bool begin(uint16_t port = MODBUS_TCP_DEFAULT_PORT, const char *address = NULL);
+  int poll(int timeoutInMilliSecond);
+
+  void setTimeout(unsigned long timeoutInMicroSecond);
+  void setUnitTimeout(uint8_t unitAddress, unsigned long timeoutInMicroSecond);
+  void setBroadcastDelay(unsigned long delayInMicroSecond);
+
+  uint8_t getQueueLength();
+  uint64_t getTotalBusTransactions();
+  uint64_t getTotalDeduplicated();
+  uint64_t getTotalTimeouts();
+
+protected:
+  bool processAdu(ModbusTcpConnection *connection, const uint8_t *adu, uint16_t aduLength,
+                  uint8_t *response, uint16_t &responseLength);
+  void connectionClosed(ModbusTcpConnection *connection);
+
+private:
+  Stream &_serialStream;
+  int _serialFd;
+  unsigned long _charTimeInMicroSecond;
+  unsigned long _silenceInMicroSecond;
+  unsigned long _timeout = MODBUS_GATEWAY_DEFAULT_TIMEOUT;
+  unsigned long _unitTimeouts[MODBUS_GATEWAY_MAX_UNIT_ADDRESS + 1];
+  unsigned long _broadcastDelay = MODBUS_GATEWAY_DEFAULT_BROADCAST_DELAY;
+
+  ModbusGatewayTransaction _queue[MODBUS_GATEWAY_QUEUE_SIZE];
+  uint32_t _sequence = 0;
+  uint8_t _nextClient = 0;
+
+  ModbusGatewayTransaction *_active = NULL;
+  unsigned long _activeTime = 0;
+  unsigned long _lastBusTime = 0;
+  uint8_t _responseBuffer[MODBUS_MAX_BUFFER];
+  uint16_t _responseLength = 0;
+
+  uint64_t _totalBusTransactions = 0;
+  uint64_t _totalDeduplicated = 0;
+  uint64_t _totalTimeouts = 0;
+
+  ModbusGatewayTransaction *nextTransaction();
+  ModbusGatewayTransaction *findDuplicate(ModbusTcpConnection *connection, uint8_t unitAddress, const uint8_t *pdu, uint16_t pduLength);
+  bool hasWaiter(const ModbusGatewayTransaction &transaction, ModbusTcpConnection *connection);
+  bool isBlocked(const ModbusGatewayTransaction &transaction);
+  unsigned long unitTimeout(uint8_t unitAddress);
+  unsigned long nextBusDeadline();
+  void serviceBus();
+  void startTransaction(ModbusGatewayTransaction *transaction);
+  uint16_t expectedResponseLength();
+  void completeTransaction(const uint8_t *pdu, uint16_t pduLength);
+  void failTransaction(uint8_t exceptionCode);
+};
+
+#endif
+#endif
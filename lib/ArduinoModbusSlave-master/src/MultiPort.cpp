@@ -0,0 +1,357 @@
+#include "ModbusSlave.h"
+
+/**
+ * ---------------------------------------------------
+ *                CONSTANTS AND MACROS
+ * ---------------------------------------------------
+ */
+
+#define MODBUS_FRAME_SIZE 4
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_ADDRESS_INDEX 0
+
+#define MODBUS_HALF_SILENCE_MULTIPLIER 3
+#define MODBUS_FULL_SILENCE_MULTIPLIER 7
+
+#define readCRC(arr, length) word(arr[(length - MODBUS_CRC_LENGTH) + 1], arr[length - MODBUS_CRC_LENGTH])
+
+/**
+ * Estados de un puerto: en reposo, recibiendo una trama, descartando una trama
+ * (dirigida a otra unidad o más larga que el búfer) y transmitiendo la respuesta.
+ */
+#define MODBUS_PORT_IDLE 0
+#define MODBUS_PORT_READING 1
+#define MODBUS_PORT_IGNORING 2
+#define MODBUS_PORT_WRITING 3
+
+/**
+ * ---------------------------------------------------
+ *                  PUBLIC METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Inicializa un puerto.
+ *
+ * @param serialStream El flujo serial del puerto.
+ * @param buffer El búfer de la trama, compartido por la solicitud y la respuesta.
+ *               MODBUS_MAX_BUFFER bytes admiten cualquier trama; con menos, las
+ *               solicitudes más largas se descartan y las respuestas que no caben
+ *               se responden con la excepción STATUS_ILLEGAL_DATA_VALUE.
+ * @param bufferSize El tamaño del búfer.
+ * @param transmissionControlPin El pin de salida digital que se utilizará para el control de transmisión RS485.
+ */
+ModbusPort::ModbusPort(Stream &serialStream, uint8_t *buffer, uint16_t bufferSize, int transmissionControlPin)
+    : _serialStream(serialStream), _buffer(buffer), _bufferSize(bufferSize), _transmissionControlPin(transmissionControlPin)
+{
+}
+
+/**
+ * Prepara el puerto para leer solicitudes. El flujo serial ya debe estar iniciado.
+ *
+ * @param baudrate La velocidad en baudios del puerto serie.
+ */
+void ModbusPort::begin(uint64_t baudrate)
+{
+    if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+    {
+        pinMode(_transmissionControlPin, OUTPUT);
+        digitalWrite(_transmissionControlPin, LOW);
+    }
+
+    _serialStream.setTimeout(0);
+    _serialStream.flush();
+    _serialTransmissionBufferLength = _serialStream.availableForWrite();
+
+    // Mismo cálculo de 0.5T que Modbus::begin().
+    if (baudrate > 19200)
+    {
+        _halfCharTimeInMicroSecond = 250;
+    }
+    else
+    {
+        _halfCharTimeInMicroSecond = 5000000 / baudrate;
+    }
+
+    // Ignora la trama que pudiera estar a medias.
+    _lastCommunicationTime = micros() + (_halfCharTimeInMicroSecond * MODBUS_FULL_SILENCE_MULTIPLIER);
+    _length = 0;
+    _writeIndex = 0;
+    _state = MODBUS_PORT_IDLE;
+}
+
+/**
+ * Devuelve verdadero si el puerto no está recibiendo ni transmitiendo una trama.
+ */
+bool ModbusPort::isIdle()
+{
+    return _state == MODBUS_PORT_IDLE && _serialStream.available() == 0;
+}
+
+/**
+ * Obtiene las estadísticas del puerto.
+ */
+ModbusPortStatistics &ModbusPort::getStatistics()
+{
+    return _statistics;
+}
+
+/**
+ * Pone a cero las estadísticas del puerto.
+ */
+void ModbusPort::resetStatistics()
+{
+    _statistics = ModbusPortStatistics();
+}
+
+/**
+ * Inicializa el servidor multipuerto.
+ *
+ * @param modbus El objeto Modbus con las definiciones de los esclavos y sus devoluciones
+ *               de llamada. Su propio flujo serial sólo se usa si también se llama a su poll().
+ * @param ports Puntero a una matriz de ModbusPort.
+ * @param numberOfPorts El número de puertos de la matriz.
+ */
+ModbusMultiPort::ModbusMultiPort(Modbus &modbus, ModbusPort *ports, uint8_t numberOfPorts)
+    : _modbus(modbus), _ports(ports), _numberOfPorts(numberOfPorts)
+{
+}
+
+/**
+ * Prepara todos los puertos con la misma velocidad. Para velocidades distintas,
+ * llame a begin() de cada ModbusPort.
+ *
+ * @param baudrate La velocidad en baudios de los puertos serie.
+ */
+void ModbusMultiPort::begin(uint64_t baudrate)
+{
+    for (uint8_t i = 0; i < _numberOfPorts; i++)
+    {
+        _ports[i].begin(baudrate);
+    }
+}
+
+/**
+ * Atiende una vez cada puerto, por turnos, empezando cada llamada por el puerto
+ * siguiente al de la llamada anterior.
+ *
+ * @return El número de bytes escritos como respuesta.
+ */
+uint16_t ModbusMultiPort::poll()
+{
+    uint16_t length = 0;
+    for (uint8_t i = 0; i < _numberOfPorts; i++)
+    {
+        length += ModbusMultiPort::pollPort(_ports[(_nextPort + i) % _numberOfPorts]);
+    }
+
+    _nextPort = (_nextPort + 1) % _numberOfPorts;
+    return length;
+}
+
+/**
+ * Obtiene el número de puertos.
+ */
+uint8_t ModbusMultiPort::getNumberOfPorts()
+{
+    return _numberOfPorts;
+}
+
+/**
+ * Obtiene un puerto, por ejemplo para leer sus estadísticas.
+ *
+ * @param index El índice del puerto en la matriz.
+ */
+ModbusPort &ModbusMultiPort::getPort(uint8_t index)
+{
+    return _ports[index];
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Avanza la máquina de estados de un puerto.
+ *
+ * @return El número de bytes escritos como respuesta.
+ */
+uint16_t ModbusMultiPort::pollPort(ModbusPort &port)
+{
+    if (port._state == MODBUS_PORT_WRITING)
+    {
+        return ModbusMultiPort::writeFrame(port);
+    }
+
+    if (ModbusMultiPort::readFrame(port))
+    {
+        ModbusMultiPort::processFrame(port);
+    }
+
+    // Empiece a transmitir en la misma llamada si ya pasó el silencio.
+    if (port._state == MODBUS_PORT_WRITING)
+    {
+        return ModbusMultiPort::writeFrame(port);
+    }
+    return 0;
+}
+
+/**
+ * Lee los bytes disponibles en el búfer del puerto.
+ *
+ * @return True si hay una trama completa en el búfer; de lo contrario falso.
+ */
+bool ModbusMultiPort::readFrame(ModbusPort &port)
+{
+    unsigned long silence = port._halfCharTimeInMicroSecond * MODBUS_HALF_SILENCE_MULTIPLIER;
+    int available = port._serialStream.available();
+
+    if (available <= 0)
+    {
+        // Sin datos durante 1.5T: la trama en curso ha terminado.
+        if (port._state != MODBUS_PORT_IDLE && (micros() - port._lastCommunicationTime) > silence)
+        {
+            bool isComplete = port._state == MODBUS_PORT_READING;
+            port._state = MODBUS_PORT_IDLE;
+            return isComplete && port._length >= MODBUS_FRAME_SIZE;
+        }
+        return false;
+    }
+
+    port._statistics.bytesReceived += available;
+
+    if (port._state == MODBUS_PORT_IDLE)
+    {
+        // Bytes que llegan antes de 1.5T de silencio no empiezan una trama nueva.
+        if ((micros() - port._lastCommunicationTime) > silence)
+        {
+            port._state = MODBUS_PORT_READING;
+            port._length = 0;
+        }
+        else
+        {
+            port._state = MODBUS_PORT_IGNORING;
+        }
+    }
+
+    if (port._state == MODBUS_PORT_READING)
+    {
+        uint16_t length = min((uint16_t)available, (uint16_t)(port._bufferSize - port._length));
+        length = port._serialStream.readBytes(port._buffer + port._length, length);
+
+        // Una trama para otra unidad se descarta sin copiarla.
+        if (port._length == 0 && length > MODBUS_ADDRESS_INDEX && !_modbus.relevantAddress(port._buffer[MODBUS_ADDRESS_INDEX]))
+        {
+            port._state = MODBUS_PORT_IGNORING;
+        }
+        port._length += length;
+        available -= length;
+
+        // La trama no cabe en el búfer.
+        if (available > 0 && port._state == MODBUS_PORT_READING)
+        {
+            port._statistics.overruns++;
+            port._state = MODBUS_PORT_IGNORING;
+        }
+    }
+
+    while (available-- > 0)
+    {
+        port._serialStream.read();
+    }
+
+    port._lastCommunicationTime = micros();
+    return false;
+}
+
+/**
+ * Verifica el CRC de la trama recibida y la procesa con el motor compartido.
+ */
+void ModbusMultiPort::processFrame(ModbusPort &port)
+{
+    if (Modbus::calculateCRC(port._buffer, port._length - MODBUS_CRC_LENGTH) != readCRC(port._buffer, port._length))
+    {
+        port._statistics.crcErrors++;
+        return;
+    }
+
+    port._statistics.requests++;
+    port._length = _modbus.processFrame(port._buffer, port._length, port._bufferSize);
+    if (port._length > 0)
+    {
+        port._writeIndex = 0;
+        port._state = MODBUS_PORT_WRITING;
+    }
+}
+
+/**
+ * Transmite la respuesta del búfer del puerto, como Modbus::writeResponse().
+ *
+ * @return El número de bytes escritos.
+ */
+uint16_t ModbusMultiPort::writeFrame(ModbusPort &port)
+{
+    unsigned long silence = port._halfCharTimeInMicroSecond * MODBUS_HALF_SILENCE_MULTIPLIER;
+
+    // Espere 1.5T antes del primer byte e inicie el modo de transmisión para RS485.
+    if (port._writeIndex == 0)
+    {
+        if ((micros() - port._lastCommunicationTime) <= silence)
+        {
+            return 0;
+        }
+        if (port._transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+        {
+            port._serialStream.flush();
+            digitalWrite(port._transmissionControlPin, HIGH);
+        }
+    }
+
+    uint16_t length = port._length - port._writeIndex;
+    if (port._serialTransmissionBufferLength > 0)
+    {
+        length = min((uint16_t)port._serialStream.availableForWrite(), length);
+        if (length > 0)
+        {
+            length = port._serialStream.write(port._buffer + port._writeIndex, length);
+            port._writeIndex += length;
+            port._statistics.bytesSent += length;
+        }
+
+        // Espere a que el búfer de transmisión se vacíe.
+        if (port._serialStream.availableForWrite() < port._serialTransmissionBufferLength)
+        {
+            port._lastCommunicationTime = micros();
+            return length;
+        }
+        port._serialStream.flush();
+    }
+    else
+    {
+        // Modo de compatibilidad para series de software sin availableForWrite().
+        if (length > 0)
+        {
+            length = port._serialStream.write(port._buffer + port._writeIndex, length);
+            port._serialStream.flush();
+        }
+        port._writeIndex += length;
+        port._statistics.bytesSent += length;
+    }
+
+    // Libere el bus cuando se haya enviado todo y hayan pasado 1.5T.
+    if (port._writeIndex >= port._length && (micros() - port._lastCommunicationTime) > silence)
+    {
+        if (port._transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
+        {
+            digitalWrite(port._transmissionControlPin, LOW);
+        }
+        port._statistics.responses++;
+        port._state = MODBUS_PORT_IDLE;
+        port._writeIndex = 0;
+        port._length = 0;
+    }
+    return length;
+}
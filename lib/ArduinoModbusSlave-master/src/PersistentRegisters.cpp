@@ -0,0 +1,268 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+/**
+ * Distribución en la EEPROM, por registro (index = dirección - firstAddress):
+ *
+ *     numberOfSlots x 2 bytes de valor, seguidos de numberOfSlots x 1 byte de estado.
+ *
+ * La ranura actual es la última de la cadena en la que cada byte de estado es el
+ * anterior más uno. Guardar un registro escribe el valor en la ranura siguiente y
+ * después su byte de estado, así un corte de energía a mitad de escritura deja el
+ * valor anterior intacto y cada celda recibe 1/numberOfSlots de las escrituras.
+ */
+#define MODBUS_PERSISTENT_SLOT_SIZE 3
+
+/**
+ * Inicializa los registros persistentes.
+ *
+ * @param eeprom La memoria no volátil.
+ * @param eepromAddress La dirección de EEPROM donde empieza la zona reservada (ver eepromSize()).
+ * @param numberOfSlots El número de ranuras rotativas por registro (al menos 2).
+ * @param registers Puntero a la copia en RAM de los registros.
+ * @param dirtyBitmap Puntero a MODBUS_DIRTY_BITMAP_SIZE(numberOfRegisters) bytes.
+ * @param firstAddress La dirección Modbus del primer registro.
+ * @param numberOfRegisters El número de registros.
+ */
+ModbusPersistentRegisters::ModbusPersistentRegisters(ModbusEeprom &eeprom, uint16_t eepromAddress, uint8_t numberOfSlots,
+                                                     uint16_t *registers, uint8_t *dirtyBitmap, uint16_t firstAddress, uint16_t numberOfRegisters)
+    : _eeprom(eeprom), _eepromAddress(eepromAddress), _numberOfSlots(numberOfSlots < 2 ? 2 : numberOfSlots),
+      _registers(registers), _dirtyBitmap(dirtyBitmap), _firstAddress(firstAddress), _numberOfRegisters(numberOfRegisters)
+{
+}
+
+/**
+ * Devuelve el número de bytes de EEPROM que ocupan los registros.
+ *
+ * @param numberOfRegisters El número de registros.
+ * @param numberOfSlots El número de ranuras rotativas por registro.
+ */
+uint16_t ModbusPersistentRegisters::eepromSize(uint16_t numberOfRegisters, uint8_t numberOfSlots)
+{
+    return numberOfRegisters * numberOfSlots * MODBUS_PERSISTENT_SLOT_SIZE;
+}
+
+/**
+ * Carga los valores guardados en la copia en RAM. Una EEPROM borrada se lee como 0xFFFF.
+ */
+void ModbusPersistentRegisters::begin()
+{
+    for (uint16_t i = 0; i < _numberOfRegisters; i++)
+    {
+        uint16_t address = slotAddress(i, currentSlot(i));
+        _registers[i] = word(_eeprom.read(address), _eeprom.read(address + 1));
+    }
+    memset(_dirtyBitmap, 0, MODBUS_DIRTY_BITMAP_SIZE(_numberOfRegisters));
+    _nextDirtyIndex = 0;
+}
+
+/**
+ * Devuelve el valor actual de un registro (cero si está fuera del rango).
+ *
+ * @param address La dirección Modbus del registro.
+ */
+uint16_t ModbusPersistentRegisters::get(uint16_t address)
+{
+    if (!contains(address, 1))
+    {
+        return 0;
+    }
+    return _registers[address - _firstAddress];
+}
+
+/**
+ * Cambia el valor de un registro y lo marca para guardarlo en el próximo flush().
+ *
+ * @param address La dirección Modbus del registro.
+ * @param value El nuevo valor.
+ */
+void ModbusPersistentRegisters::set(uint16_t address, uint16_t value)
+{
+    if (!contains(address, 1))
+    {
+        return;
+    }
+
+    uint16_t index = address - _firstAddress;
+    if (_registers[index] != value)
+    {
+        _registers[index] = value;
+        bitSet(_dirtyBitmap[index / 8], index % 8);
+    }
+}
+
+/**
+ * Devuelve verdadero si el rango de registros dado está completamente dentro de los registros persistentes.
+ *
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ */
+bool ModbusPersistentRegisters::contains(uint16_t address, uint16_t length)
+{
+    return address >= _firstAddress &&
+           (uint32_t)address + length <= (uint32_t)_firstAddress + _numberOfRegisters;
+}
+
+/**
+ * Devuelve verdadero si quedan registros por guardar.
+ */
+bool ModbusPersistentRegisters::isDirty()
+{
+    for (uint16_t i = 0; i < MODBUS_DIRTY_BITMAP_SIZE(_numberOfRegisters); i++)
+    {
+        if (_dirtyBitmap[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Guarda en la EEPROM hasta maxRegisters registros sucios, continuando donde terminó la llamada anterior.
+ * Llámelo cuando Modbus::isIdle() sea verdadero: cada registro cuesta hasta 3 escrituras de byte.
+ *
+ * @param maxRegisters El número máximo de registros a guardar en esta llamada.
+ * @return True si todavía quedan registros por guardar; de lo contrario falso.
+ */
+bool ModbusPersistentRegisters::flush(uint16_t maxRegisters)
+{
+    uint16_t written = 0;
+    for (uint16_t checked = 0; checked < _numberOfRegisters && written < maxRegisters; checked++)
+    {
+        uint16_t index = _nextDirtyIndex;
+        _nextDirtyIndex = (_nextDirtyIndex + 1) % _numberOfRegisters;
+
+        if (bitRead(_dirtyBitmap[index / 8], index % 8))
+        {
+            bitClear(_dirtyBitmap[index / 8], index % 8);
+            persist(index);
+            written++;
+        }
+    }
+    return isDirty();
+}
+
+/**
+ * Escribe en el búfer de salida los registros pedidos por una lectura FC03.
+ *
+ * @param modbus El objeto modbus que atiende la solicitud.
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t ModbusPersistentRegisters::readToBuffer(Modbus &modbus, uint16_t address, uint16_t length)
+{
+    if (!contains(address, length))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint8_t status = modbus.writeRegisterToBuffer(i, _registers[address - _firstAddress + i]);
+        if (status != STATUS_OK)
+        {
+            return status;
+        }
+    }
+    return STATUS_OK;
+}
+
+/**
+ * Aplica los valores de una escritura FC06/FC16 a la copia en RAM y los marca para guardarlos.
+ * No escribe en la EEPROM, así que la respuesta se envía de inmediato.
+ *
+ * @param modbus El objeto modbus que atiende la solicitud.
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ * @return El código de estado que representa el resultado de esta operación.
+ */
+uint8_t ModbusPersistentRegisters::writeFromBuffer(Modbus &modbus, uint16_t address, uint16_t length)
+{
+    if (!contains(address, length))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        set(address + i, modbus.readRegisterFromBuffer(i));
+    }
+    return STATUS_OK;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Devuelve la dirección de EEPROM del valor de un registro en una ranura.
+ */
+uint16_t ModbusPersistentRegisters::slotAddress(uint16_t index, uint8_t slot)
+{
+    return _eepromAddress + (index * _numberOfSlots * MODBUS_PERSISTENT_SLOT_SIZE) + (slot * 2);
+}
+
+/**
+ * Devuelve la dirección de EEPROM del byte de estado de un registro en una ranura.
+ */
+uint16_t ModbusPersistentRegisters::statusAddress(uint16_t index, uint8_t slot)
+{
+    return _eepromAddress + (index * _numberOfSlots * MODBUS_PERSISTENT_SLOT_SIZE) + (_numberOfSlots * 2) + slot;
+}
+
+/**
+ * Busca la ranura que contiene el último valor guardado de un registro.
+ */
+uint8_t ModbusPersistentRegisters::currentSlot(uint16_t index)
+{
+    uint8_t slot = 0;
+    uint8_t status = _eeprom.read(statusAddress(index, 0));
+
+    // Avanza mientras el byte de estado siguiente sea el actual más uno.
+    while (slot + 1 < _numberOfSlots)
+    {
+        uint8_t nextStatus = _eeprom.read(statusAddress(index, slot + 1));
+        if (nextStatus != (uint8_t)(status + 1))
+        {
+            break;
+        }
+        slot++;
+        status = nextStatus;
+    }
+    return slot;
+}
+
+/**
+ * Guarda el valor en RAM de un registro en la siguiente ranura.
+ */
+void ModbusPersistentRegisters::persist(uint16_t index)
+{
+    uint8_t slot = currentSlot(index);
+    uint8_t status = _eeprom.read(statusAddress(index, slot));
+
+    // Si ya está guardado, no gaste escrituras.
+    uint16_t address = slotAddress(index, slot);
+    uint16_t value = _registers[index];
+    if (word(_eeprom.read(address), _eeprom.read(address + 1)) == value)
+    {
+        return;
+    }
+
+    uint8_t nextSlot = (slot + 1) % _numberOfSlots;
+    address = slotAddress(index, nextSlot);
+
+    // Escribe sólo los bytes que cambian, y el byte de estado al final.
+    if (_eeprom.read(address) != (value >> 8))
+    {
+        _eeprom.write(address, value >> 8);
+    }
+    if (_eeprom.read(address + 1) != (value & 0xFF))
+    {
+        _eeprom.write(address + 1, value & 0xFF);
+    }
+    _eeprom.write(statusAddress(index, nextSlot), status + 1);
+}
@@ -0,0 +1,171 @@
+#include "ModbusSlave.h"
+
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+
+/**
+ * La marca de secuencia se lee con adquisición y se escribe con liberación, y las
+ * barreras ordenan los registros respecto a ella: al abrir un lote, la marca impar
+ * antes que los valores nuevos; al leer, la copia antes de la segunda lectura de la
+ * marca. AVR tiene un solo núcleo y basta la barrera del compilador. En Linux el lector
+ * cede la CPU mientras espera a que se cierre un lote.
+ */
+#if defined(__AVR__)
+#define modbusLoadSequence(sequence) (sequence)
+#define modbusStoreSequence(sequence, value) ((sequence) = (value))
+#define MODBUS_WRITE_BARRIER() __asm__ __volatile__("" ::: "memory")
+#define MODBUS_READ_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define modbusLoadSequence(sequence) __atomic_load_n(&(sequence), __ATOMIC_ACQUIRE)
+#define modbusStoreSequence(sequence, value) __atomic_store_n(&(sequence), value, __ATOMIC_RELEASE)
+#define MODBUS_WRITE_BARRIER() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define MODBUS_READ_BARRIER() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#define MODBUS_SNAPSHOT_WAIT() sched_yield()
+#else
+#define MODBUS_SNAPSHOT_WAIT()
+#endif
+
+/**
+ * Inicializa una imagen de registros sobre una matriz propiedad de la aplicación.
+ *
+ * @param registers Puntero a la matriz de valores de registro.
+ * @param firstAddress La dirección Modbus del primer registro de la matriz.
+ * @param numberOfRegisters El número de registros en la matriz.
+ */
+ModbusRegisterImage::ModbusRegisterImage(uint16_t *registers, uint16_t firstAddress, uint16_t numberOfRegisters)
+    : _registers(registers), _firstAddress(firstAddress), _numberOfRegisters(numberOfRegisters)
+{
+}
+
+/**
+ * Comienza un lote de cambios. Las lecturas Modbus que coincidan con el lote se repiten.
+ */
+void ModbusRegisterImage::beginUpdate()
+{
+    modbusStoreSequence(_sequence, (ModbusSequence)(_sequence + 1));
+    MODBUS_WRITE_BARRIER();
+}
+
+/**
+ * Cambia el valor de un registro dentro de un lote.
+ *
+ * @param address La dirección Modbus del registro.
+ * @param value El nuevo valor del registro.
+ */
+void ModbusRegisterImage::set(uint16_t address, uint16_t value)
+{
+    if (address >= _firstAddress && (uint16_t)(address - _firstAddress) < _numberOfRegisters)
+    {
+        _registers[address - _firstAddress] = value;
+    }
+}
+
+/**
+ * Publica el lote de cambios en curso.
+ */
+void ModbusRegisterImage::commit()
+{
+    modbusStoreSequence(_sequence, (ModbusSequence)(_sequence + 1));
+}
+
+/**
+ * Devuelve el valor de un registro (cero si está fuera de la imagen).
+ *
+ * @param address La dirección Modbus del registro.
+ */
+uint16_t ModbusRegisterImage::get(uint16_t address)
+{
+    if (address >= _firstAddress && (uint16_t)(address - _firstAddress) < _numberOfRegisters)
+    {
+        return _registers[address - _firstAddress];
+    }
+    return 0;
+}
+
+/**
+ * Devuelve verdadero si el rango de registros dado está completamente dentro de la imagen.
+ *
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ */
+bool ModbusRegisterImage::contains(uint16_t address, uint16_t length)
+{
+    return address >= _firstAddress &&
+           (uint32_t)address + length <= (uint32_t)_firstAddress + _numberOfRegisters;
+}
+
+/**
+ * Escribe en el búfer de salida una instantánea coherente de un rango de la imagen de registros.
+ *
+ * @param offset El offset desde el primer registro en el búfer.
+ * @param image La imagen de registros.
+ * @param address La dirección Modbus del primer registro a copiar.
+ * @param length El número de registros a copiar.
+ * @return STATUS_OK si tiene éxito, STATUS_ILLEGAL_DATA_ADDRESS si el rango no está en la imagen o no cabe
+ *         en el búfer, STATUS_SLAVE_DEVICE_BUSY si MODBUS_SNAPSHOT_RETRIES copias salieron a medias o un
+ *         lote siguió abierto durante MODBUS_SNAPSHOT_WAITS esperas.
+ */
+uint8_t Modbus::writeImageToBuffer(int offset, ModbusRegisterImage &image, uint16_t address, uint16_t length)
+{
+    // Verifique el código de la función.
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    if (functionCode != FC_READ_HOLDING_REGISTERS && functionCode != FC_READ_INPUT_REGISTERS)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    // (1 x valueBytes, n x values).
+    uint16_t index = MODBUS_DATA_INDEX + 1 + _scatterDataOffset + (offset * 2);
+
+    // Verifica que el rango esté en la imagen y quepa en el espacio restante de la respuesta.
+    if (!image.contains(address, length) || (index + (length * 2)) > (_responseBufferLength - MODBUS_CRC_LENGTH))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    const uint16_t *source = image._registers + (address - image._firstAddress);
+    uint16_t waits = 0;
+    uint8_t tornCopies = 0;
+    while (true)
+    {
+        // Una secuencia impar indica un lote en curso: espere a que se publique sin gastar reintentos.
+        ModbusSequence sequence = modbusLoadSequence(image._sequence);
+        if (sequence & 1)
+        {
+            if (++waits > MODBUS_SNAPSHOT_WAITS)
+            {
+                break;
+            }
+            MODBUS_SNAPSHOT_WAIT();
+            continue;
+        }
+
+        for (uint16_t i = 0; i < length; i++)
+        {
+            uint16_t value = source[i];
+            _responseBuffer[index + (i * 2)] = value >> 8;
+            _responseBuffer[index + (i * 2) + 1] = value & 0xFF;
+        }
+
+        // Si no se publicó ningún lote durante la copia, la instantánea es coherente.
+        MODBUS_READ_BARRIER();
+        if (modbusLoadSequence(image._sequence) == sequence)
+        {
+            return STATUS_OK;
+        }
+
+        // Sólo una copia a medias cuenta como reintento.
+        if (++tornCopies >= MODBUS_SNAPSHOT_RETRIES)
+        {
+            break;
+        }
+    }
+
+    return STATUS_SLAVE_DEVICE_BUSY;
+}
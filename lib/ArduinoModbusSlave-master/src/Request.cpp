@@ -8,16 +8,28 @@
 #define MODBUS_FUNCTION_CODE_INDEX 1
 #define MODBUS_DATA_INDEX 2
 
-#define MODBUS_BROADCAST_ADDRESS 1
+#define MODBUS_BROADCAST_ADDRESS 0
 #define MODBUS_ADDRESS_MIN 1
 #define MODBUS_ADDRESS_MAX 247
 
+#define MODBUS_MAX_READ_COILS 2000
+#define MODBUS_MAX_READ_REGISTERS 125
+
 #define MODBUS_HALF_SILENCE_MULTIPLIER 3
 #define MODBUS_FULL_SILENCE_MULTIPLIER 7
 
 #define readUInt16(arr, index) word(arr[index], arr[index + 1])
 #define readCRC(arr, length) word(arr[(length - MODBUS_CRC_LENGTH) + 1], arr[length - MODBUS_CRC_LENGTH])
 
+// Mensajes de depuración por Serial. Desactivados por defecto: Serial suele ser el propio puerto Modbus.
+#if defined(MODBUS_DEBUG)
+#define MODBUS_DEBUG_PRINT(...) Serial.print(__VA_ARGS__)
+#define MODBUS_DEBUG_PRINTLN(...) Serial.println(__VA_ARGS__)
+#else
+#define MODBUS_DEBUG_PRINT(...)
+#define MODBUS_DEBUG_PRINTLN(...)
+#endif
+
 /**
  * Comprueba si tenemos una solicitud completa, analiza la solicitud, ejecuta la
  * correspondiente devolución de llamada registrada y escribe la respuesta.
@@ -26,44 +38,361 @@
  */
 uint8_t Modbus::poll()
 {   
-    // Si todavía estamos escribiendo un mensaje, déjelo terminar primero.
-    if (_isResponseBufferWriting)
+    // Si todavía estamos escribiendo un mensaje, déjelo terminar primero. En dúplex completo
+    // la cola de respuestas avanza en cada llamada y sólo una respuesta que aún no cabe en
+    // ella detiene la recepción.
+    if (_fullDuplexQueue != NULL)
+    {
+        uint16_t length = Modbus::writeResponse();
+        if (_isResponseBufferWriting)
+        {
+            return length;
+        }
+    }
+    else if (_isResponseBufferWriting)
     {
         return Modbus::writeResponse();
     }
 
+    // Si hay una respuesta diferida, no lea nuevas solicitudes hasta que se complete o caduque.
+    if (_isResponsePending)
+    {
+        if ((micros() - _pendingStartTime) > _deferredTimeout)
+        {
+            // El maestro ya no espera esta respuesta, descártela junto con los datos recibidos mientras tanto.
+            _isResponsePending = false;
+            _responseBufferLength = 0;
+            while (_serialStream.available() > 0)
+            {
+                _serialStream.read();
+            }
+            _lastCommunicationTime = micros();
+        }
+        return 0;
+    }
+
     // Espere un paquete de solicitud completo.
     if (!Modbus::readRequest())
     {
         return 0;
     }
 
+    // Verifique el CRC de la trama RTU; si no es correcto ignore la solicitud.
+    if (!Modbus::validateCRC())
+    {
+        return 0;
+    }
+
+    // Procesa la PDU y prepara la respuesta.
+    if (!Modbus::processRequest())
+    {
+        return 0;
+    }
+
+    // Escribe la respuesta de creación en la interfaz serial.
+    return Modbus::writeResponse();
+}
+
+/**
+ * Procesa la solicitud del búfer de entrada (dirección de unidad + PDU) sin depender del
+ * encuadre RTU: la valida, ejecuta la devolución de llamada y deja la respuesta, o la
+ * excepción, en el búfer de salida. Lo comparten poll() y los front-ends como Modbus TCP.
+ *
+ * @return True si hay una respuesta lista en el búfer de salida; falso si la solicitud
+ *         se ignora o la respuesta quedó diferida.
+ */
+bool Modbus::processRequest()
+{
     // Prepara el búfer de salida.
     memset(_responseBuffer, 0, MODBUS_MAX_BUFFER);
     _responseBuffer[MODBUS_ADDRESS_INDEX] = _requestBuffer[MODBUS_ADDRESS_INDEX];
     _responseBuffer[MODBUS_FUNCTION_CODE_INDEX] = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX];
     _responseBufferLength = MODBUS_FRAME_SIZE;
+    _isResponseCRCReady = false;
 
     // Valida la solicitud entrante.
     if (!Modbus::validateRequest())
     {
-        return 0;
+        return false;
     }
 
+    // Si la misma solicitud de lectura se respondió hace poco, reenvíe la respuesta guardada.
+    if (Modbus::readResponseCache())
+    {
+        return true;
+    }
+
+    // Las escrituras invalidan las respuestas guardadas que cubren los registros escritos.
+    Modbus::invalidateResponseCacheForWrite();
+
     // Ejecuta la solicitud entrante y crea la respuesta.
     uint8_t status = Modbus::createResponse();
 
+    // La devolución de llamada completará la respuesta más tarde con completeResponse().
+    if (status == STATUS_PENDING)
+    {
+        _isResponsePending = true;
+        _pendingStartTime = micros();
+        return false;
+    }
+
+    // Una difusión ya se aplicó a todos los esclavos y no tiene respuesta: sin espera de 1.5T ni transmisión.
+    if (Modbus::isBroadcast())
+    {
+        _responseBufferLength = 0;
+        return false;
+    }
+
     // Verifique si la ejecución de la devolución de llamada tuvo éxito.
     if (status != STATUS_OK)
     {
-        return Modbus::reportException(status);
+        Modbus::setException(status);
+        return true;
     }
 
-    // Escribe la respuesta de creación en la interfaz serial.
-    //Serial.println("Iniciando escritura serial...");
+    // Guarda la respuesta en la caché si la solicitud es de lectura.
+    Modbus::writeResponseCache();
+    return true;
+}
+
+/**
+ * Procesa una PDU que llega por un transporte distinto de RTU (p. ej. Modbus TCP)
+ * con las mismas devoluciones de llamada que poll().
+ *
+ * @param unitAddress La dirección de la unidad de destino.
+ * @param pdu La PDU de la solicitud (código de función y datos).
+ * @param pduLength La longitud de la PDU.
+ * @param response Búfer de al menos MODBUS_MAX_PDU bytes para la PDU de respuesta.
+ * @return La longitud de la PDU de respuesta, o cero si no hay respuesta (solicitud ignorada o difusión).
+ */
+uint16_t Modbus::processPdu(uint8_t unitAddress, const uint8_t *pdu, uint16_t pduLength, uint8_t *response)
+{
+    if (pduLength == 0 || pduLength > MODBUS_MAX_PDU)
+    {
+        return 0;
+    }
+
+    // Los búferes están ocupados por una transacción RTU en curso o por bytes pendientes de resincronizar.
+    if (_isRequestBufferReading || _isResponseBufferWriting || _isResponsePending || _resyncLength > _resyncFrameLength)
+    {
+        response[0] = pdu[0] | 0x80;
+        response[1] = STATUS_SLAVE_DEVICE_BUSY;
+        return 2;
+    }
+
+    // Coloca la solicitud como una trama RTU sin CRC (1 x Address, n x PDU, 2 x CRC sin usar).
+    _requestBuffer[MODBUS_ADDRESS_INDEX] = unitAddress;
+    memcpy(_requestBuffer + MODBUS_FUNCTION_CODE_INDEX, pdu, pduLength);
+    _requestBufferLength = pduLength + 1 + MODBUS_CRC_LENGTH;
+    _requestBuffer[_requestBufferLength - MODBUS_CRC_LENGTH] = 0;
+    _requestBuffer[_requestBufferLength - MODBUS_CRC_LENGTH + 1] = 0;
+
+    uint16_t length = 0;
+    if (Modbus::processExternalRequest())
+    {
+        length = _responseBufferLength - 1 - MODBUS_CRC_LENGTH;
+        memcpy(response, _responseBuffer + MODBUS_FUNCTION_CODE_INDEX, length);
+    }
+
+    _responseBufferLength = 0;
+    _requestBufferLength = 0;
+    _isResponseCRCReady = false;
+    return length;
+}
+
+/**
+ * Procesa una trama RTU completa recibida por otro puerto (p. ej. ModbusMultiPort)
+ * y deja en el mismo búfer la trama de respuesta con su CRC. El CRC de la solicitud
+ * debe estar ya verificado.
+ *
+ * @param frame La trama de la solicitud; recibe la trama de la respuesta.
+ * @param frameLength La longitud de la trama de la solicitud, CRC incluido.
+ * @param frameSize El tamaño del búfer frame. Si la respuesta no cabe se responde
+ *                  con la excepción STATUS_ILLEGAL_DATA_VALUE.
+ * @return La longitud de la trama de respuesta, o cero si no hay respuesta.
+ */
+uint16_t Modbus::processFrame(uint8_t *frame, uint16_t frameLength, uint16_t frameSize)
+{
+    if (frameLength < MODBUS_FRAME_SIZE || frameLength > MODBUS_MAX_BUFFER || frameSize < MODBUS_FRAME_SIZE + 1)
+    {
+        return 0;
+    }
+
+    bool isCRCReady = false;
+
+    // Los búferes están ocupados por una transacción RTU en curso o por bytes pendientes de resincronizar.
+    if (_isRequestBufferReading || _isResponseBufferWriting || _isResponsePending || _resyncLength > _resyncFrameLength)
+    {
+        if (frame[MODBUS_ADDRESS_INDEX] == MODBUS_BROADCAST_ADDRESS)
+        {
+            return 0;
+        }
+        frame[MODBUS_FUNCTION_CODE_INDEX] |= 0x80;
+        frame[MODBUS_DATA_INDEX] = STATUS_SLAVE_DEVICE_BUSY;
+        frameLength = MODBUS_FRAME_SIZE + 1;
+    }
+    else
+    {
+        memcpy(_requestBuffer, frame, frameLength);
+        _requestBufferLength = frameLength;
+
+        frameLength = 0;
+        if (Modbus::processExternalRequest())
+        {
+            // La respuesta no cabe en el búfer del puerto.
+            if (_responseBufferLength > frameSize)
+            {
+                Modbus::setException(STATUS_ILLEGAL_DATA_VALUE);
+            }
+            frameLength = _responseBufferLength;
+            memcpy(frame, _responseBuffer, frameLength);
+            isCRCReady = _isResponseCRCReady;
+        }
+
+        _responseBufferLength = 0;
+        _requestBufferLength = 0;
+        _isResponseCRCReady = false;
+        if (frameLength == 0)
+        {
+            return 0;
+        }
+    }
+
+    // Las respuestas copiadas de la caché ya incluyen el CRC.
+    if (!isCRCReady)
+    {
+        uint16_t crc = Modbus::calculateCRC(frame, frameLength - MODBUS_CRC_LENGTH);
+        frame[frameLength - MODBUS_CRC_LENGTH] = crc & 0xFF;
+        frame[(frameLength - MODBUS_CRC_LENGTH) + 1] = crc >> 8;
+    }
+    return frameLength;
+}
+
+/**
+ * Procesa la solicitud del búfer de entrada para un transporte distinto del puerto
+ * RTU propio. Las respuestas diferidas no están disponibles fuera de ese puerto y se
+ * responden con STATUS_SLAVE_DEVICE_BUSY.
+ *
+ * @return True si hay una respuesta que enviar en el búfer de salida.
+ */
+bool Modbus::processExternalRequest()
+{
+    bool isResponseReady = Modbus::processRequest();
+
+    if (_isResponsePending)
+    {
+        _isResponsePending = false;
+        Modbus::setException(STATUS_SLAVE_DEVICE_BUSY);
+        isResponseReady = true;
+    }
+
+    return isResponseReady && !Modbus::isBroadcast();
+}
+
+/**
+ * Completa una respuesta diferida (la devolución de llamada devolvió STATUS_PENDING)
+ * y comienza a transmitirla. El búfer de solicitud y de respuesta se conservan
+ * mientras la respuesta está pendiente, así que la aplicación puede seguir usando
+ * readRegisterFromBuffer(), writeRegisterToBuffer(), etc. antes de llamar a este método.
+ *
+ * @param status El código de estado final de la operación.
+ * @return El número de bytes escritos.
+ */
+uint16_t Modbus::completeResponse(uint8_t status)
+{
+    if (!_isResponsePending)
+    {
+        return 0;
+    }
+    _isResponsePending = false;
+
+    if (status != STATUS_OK)
+    {
+        return Modbus::reportException(status);
+    }
     return Modbus::writeResponse();
 }
 
+/**
+ * Atiende el protocolo tanto como quepa en el presupuesto de tiempo dado,
+ * llamando a poll() mientras haya bytes por leer o un plazo vencido.
+ *
+ * @param budgetInMicroSecond El tiempo máximo en microsegundos que se puede dedicar.
+ * @return El tiempo absoluto (en micros()) del siguiente plazo del protocolo.
+ */
+unsigned long Modbus::service(unsigned long budgetInMicroSecond)
+{
+    unsigned long startTime = micros();
+    unsigned long deadline;
+
+    do
+    {
+        Modbus::poll();
+        deadline = Modbus::nextDeadline();
+    } while ((micros() - startTime) < budgetInMicroSecond &&
+             ((!_isResponsePending && _serialStream.available() > 0) || (long)(deadline - micros()) <= 0));
+
+    return deadline;
+}
+
+/**
+ * Calcula el siguiente momento en el que poll() tiene trabajo que hacer:
+ * fin de trama (1.5T), espera antes de transmitir, liberación del pin DE
+ * o, en reposo, el tiempo en que llegan MODBUS_SERVICE_IDLE_CHARS caracteres.
+ *
+ * @return El tiempo absoluto (en micros()) del siguiente plazo.
+ */
+unsigned long Modbus::nextDeadline()
+{
+    unsigned long charTime = _halfCharTimeInMicroSecond * 2;
+
+    // poll() actúa cuando el tiempo transcurrido supera el umbral, así que cada plazo es un microsegundo después.
+    unsigned long silenceEnd = (unsigned long)_lastCommunicationTime + (_halfCharTimeInMicroSecond * MODBUS_HALF_SILENCE_MULTIPLIER) + 1;
+
+    if (_isResponseBufferWriting && _fullDuplexQueue == NULL)
+    {
+        // Espera de 1.5T antes del primer byte de la respuesta.
+        if (_responseBufferWriteIndex == 0)
+        {
+            return silenceEnd;
+        }
+
+        // Aún quedan bytes por enviar o por vaciar del búfer de transmisión.
+        if (_responseBufferWriteIndex < _responseBufferLength ||
+            (_serialTransmissionBufferLength > 0 && _serialStream.availableForWrite() < _serialTransmissionBufferLength))
+        {
+            return micros() + charTime;
+        }
+
+        // Liberación del pin de control de transmisión.
+        return silenceEnd;
+    }
+
+    unsigned long deadline;
+    if (_isResponsePending)
+    {
+        // Caducidad de una respuesta diferida.
+        deadline = _pendingStartTime + _deferredTimeout + 1;
+    }
+    else if (_isRequestBufferReading)
+    {
+        // Fin de la trama de solicitud en curso. Con la resincronización, pasado el silencio
+        // los bytes incompletos esperan hasta el plazo.
+        deadline = _isResyncEnabled && _isResyncSilenceChecked ? (unsigned long)_lastCommunicationTime + _resyncTimeout + 1 : silenceEnd;
+    }
+    else
+    {
+        deadline = micros() + (charTime * MODBUS_SERVICE_IDLE_CHARS);
+    }
+
+    // En dúplex completo, la transmisión de la cola tiene sus propios plazos.
+    if (_fullDuplexQueue != NULL)
+    {
+        deadline = Modbus::nextFullDuplexDeadline(deadline);
+    }
+    return deadline;
+}
+
 /**
  * Escribe el búfer de salida en serial stream.
  *
@@ -71,6 +400,14 @@ uint8_t Modbus::poll()
  */
 uint16_t Modbus::writeResponse()
 {
+    // En dúplex completo la respuesta pasa por la cola de transmisión.
+    if (_fullDuplexQueue != NULL)
+    {
+        return Modbus::writeFullDuplexResponse();
+    }
+
+    MODBUS_PROFILE_SCOPE(writeResponse);
+
     /**
      * Validar
      */
@@ -88,6 +425,7 @@ uint16_t Modbus::writeResponse()
         _isResponseBufferWriting = false;
         _responseBufferWriteIndex = 0;
         _responseBufferLength = 0;
+        _isResponseCRCReady = false;
         return 0;
     }
 
@@ -103,10 +441,14 @@ uint16_t Modbus::writeResponse()
             return 0;
         }
 
-        // Calcular y añadir el CRC.
-        uint16_t crc = Modbus::calculateCRC(_responseBuffer, _responseBufferLength - MODBUS_CRC_LENGTH);
-        _responseBuffer[_responseBufferLength - MODBUS_CRC_LENGTH] = crc & 0xFF;
-        _responseBuffer[(_responseBufferLength - MODBUS_CRC_LENGTH) + 1] = crc >> 8;
+        // Calcular y añadir el CRC, salvo que la respuesta ya lo incluya (p. ej. copiada de la caché).
+        if (!_isResponseCRCReady)
+        {
+            uint16_t crc = Modbus::calculateCRC(_responseBuffer, _responseBufferLength - MODBUS_CRC_LENGTH);
+            _responseBuffer[_responseBufferLength - MODBUS_CRC_LENGTH] = crc & 0xFF;
+            _responseBuffer[(_responseBufferLength - MODBUS_CRC_LENGTH) + 1] = crc >> 8;
+            _isResponseCRCReady = true;
+        }
 
         // Inicie el modo de transmisión para RS485.
         if (_transmissionControlPin > MODBUS_CONTROL_PIN_NONE)
@@ -136,6 +478,10 @@ uint16_t Modbus::writeResponse()
             length = _serialStream.write(
                 _responseBuffer + _responseBufferWriteIndex,
                 length);
+            if (_capture != NULL)
+            {
+                _capture->record(true, _responseBuffer + _responseBufferWriteIndex, length);
+            }
             _responseBufferWriteIndex += length;
             _totalBytesSent += length;
 
@@ -161,6 +507,10 @@ uint16_t Modbus::writeResponse()
         {
             length = _serialStream.write(_responseBuffer, length);
             _serialStream.flush();
+            if (_capture != NULL)
+            {
+                _capture->record(true, _responseBuffer, length);
+            }
         }
 
         _responseBufferWriteIndex += length;
@@ -180,6 +530,7 @@ uint16_t Modbus::writeResponse()
         _isResponseBufferWriting = false;
         _responseBufferWriteIndex = 0;
         _responseBufferLength = 0;
+        _isResponseCRCReady = false;
     }
 
 
@@ -193,6 +544,12 @@ uint16_t Modbus::writeResponse()
  */
 bool Modbus::readRequest()
 {
+    // Con la resincronización, las tramas se delimitan por su contenido y no por los silencios.
+    if (_isResyncEnabled)
+    {
+        return Modbus::readResyncRequest();
+    }
+
     // Leer un paquete de datos e informar cuando se recibe por completo.
     uint16_t length = _serialStream.available();
 
@@ -211,7 +568,12 @@ bool Modbus::readRequest()
             else
             {
                 // Descartar los datos entrantes.
-                _serialStream.read();
+                int value = _serialStream.read();
+                if (_capture != NULL && value >= 0)
+                {
+                    uint8_t discarded = value;
+                    _capture->record(false, &discarded, 1);
+                }
             }
         }
 
@@ -231,6 +593,10 @@ bool Modbus::readRequest()
             // Leer los datos del flujo serial en el búfer
 
             length = _serialStream.readBytes(_requestBuffer + _requestBufferLength, MODBUS_MAX_BUFFER - _requestBufferLength);
+            if (_capture != NULL && length > 0)
+            {
+                _capture->record(false, _requestBuffer + _requestBufferLength, length);
+            }
 
             // Si este es el primer ciclo de lectura, verifique la dirección para rechazar solicitudes irrelevantes.
             if (_requestBufferLength == 0 && length > MODBUS_ADDRESS_INDEX && !Modbus::relevantAddress(_requestBuffer[MODBUS_ADDRESS_INDEX]))
@@ -285,6 +651,24 @@ bool Modbus::readRequest()
     return !_isRequestBufferReading && (_requestBufferLength >= MODBUS_FRAME_SIZE);
 }
 
+/**
+ * Verifica el CRC de la trama RTU actualmente en el búfer de entrada.
+ *
+ * @return True si el CRC es correcto; de lo contrario falso.
+ */
+bool Modbus::validateCRC()
+{
+    MODBUS_PROFILE_SCOPE(validateCRC);
+
+    uint16_t crc = readCRC(_requestBuffer, _requestBufferLength);
+    if (Modbus::calculateCRC(_requestBuffer, _requestBufferLength - MODBUS_CRC_LENGTH) != crc)
+    {
+        MODBUS_DEBUG_PRINTLN("CRC incorrecto");
+        return false;
+    }
+    return true;
+}
+
 /**
  * Valida el mensaje de solicitud actualmente en el búfer de entrada.
  *
@@ -292,61 +676,83 @@ bool Modbus::readRequest()
  */
 bool Modbus::validateRequest()
 {
+    MODBUS_PROFILE_SCOPE(validateRequest);
+
     // Comprueba que el mensaje nos haya sido dirigido
     if (!Modbus::relevantAddress(_requestBuffer[MODBUS_ADDRESS_INDEX]))
     {
         return false;
     }
+
+    // La difusión sólo es compatible con las escrituras, ignore las demás solicitudes.
+    if (_requestBuffer[MODBUS_ADDRESS_INDEX] == MODBUS_BROADCAST_ADDRESS)
+    {
+        switch (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX])
+        {
+        case FC_WRITE_COIL:
+        case FC_WRITE_REGISTER:
+        case FC_WRITE_MULTIPLE_COILS:
+        case FC_WRITE_MULTIPLE_REGISTERS:
+        case FC_WRITE_FILE_RECORD:
+            break;
+        default:
+            return false;
+        }
+    }
     // El tamaño mínimo del búfer (1 x Address, 1 x Function, n x Data, 2 x CRC).
     uint16_t expected_requestBufferSize = MODBUS_FRAME_SIZE;
-    bool report_illegal_function=false;
     
     // Verifica la validez de los datos según el código de la función.
     //Serial.print("Codigo de funcion: ");
-    Serial.print(_requestBuffer[MODBUS_FUNCTION_CODE_INDEX],DEC);
+    MODBUS_DEBUG_PRINT(_requestBuffer[MODBUS_FUNCTION_CODE_INDEX],DEC);
     switch (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX])
     {
         case FC_READ_EXCEPTION_STATUS:
-        Serial.println(" -FC_READ_EXCEPTION_STATUS"); 
-            // La transmisión no es compatible, así que ignore esta solicitud.
-            if (_requestBuffer[MODBUS_ADDRESS_INDEX] == MODBUS_BROADCAST_ADDRESS)
-            {
-                return false;
-            }
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_EXCEPTION_STATUS");
             break;
         case FC_READ_COILS:             // Read coils (digital read).
-        Serial.println(" -FC_READ_COILS"); 
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_COILS");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count).
+            expected_requestBufferSize += 4;
         break;
         case FC_READ_DISCRETE_INPUT:    // Read input state (digital read).
-        Serial.println(" -FC_READ_DISCRETE_INPUT");   
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_DISCRETE_INPUT");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count).
+            expected_requestBufferSize += 4;
         break;
         case FC_READ_HOLDING_REGISTERS: // Read holding registers (analog read).
         //Serial.println(" -FC_READ_HOLDING_REGISTERS");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count).
+            expected_requestBufferSize += 4;
         break;
         case FC_READ_INPUT_REGISTERS:{   // Read input registers (analog read).  
-        Serial.println(" -FC_READ_INPUT_REGISTERS: ");  
-            // La transmisión no es compatible, así que ignore esta solicitud.
-            if (_requestBuffer[MODBUS_ADDRESS_INDEX] == MODBUS_BROADCAST_ADDRESS)
-            {
-                return false;
-            }
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_INPUT_REGISTERS: ");
             // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count).
             expected_requestBufferSize += 4;
             }
             break;
         case FC_WRITE_COIL:     // Write coils (digital write).
-        Serial.println(" -FC_WRITE_COIL"); 
+        MODBUS_DEBUG_PRINTLN(" -FC_WRITE_COIL");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Value).
+            expected_requestBufferSize += 4;
         break;
         case FC_WRITE_REGISTER: // Write registers (digital write).
-        Serial.println(" -FC_WRITE_REGISTER"); 
+        MODBUS_DEBUG_PRINTLN(" -FC_WRITE_REGISTER");
             // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count).
             expected_requestBufferSize += 4;
             break;
         case FC_WRITE_MULTIPLE_COILS:
-        Serial.println(" -FC_WRITE_MULTIPLE_COILS");
+        MODBUS_DEBUG_PRINTLN(" -FC_WRITE_MULTIPLE_COILS");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count, 1 x Bytes).
+            expected_requestBufferSize += 5;
+            if (_requestBufferLength >= expected_requestBufferSize)
+            {
+            // Agregar bytes al tamaño de solicitud esperado (n x Bytes).
+                expected_requestBufferSize += _requestBuffer[6];
+            }
         break; 
         case FC_WRITE_MULTIPLE_REGISTERS:     
-        Serial.println(" -FC_WRITE_MULTIPLE_REGISTERS"); 
+        MODBUS_DEBUG_PRINTLN(" -FC_WRITE_MULTIPLE_REGISTERS");
             // Agregar bytes al tamaño de solicitud esperado (2 x Index, 2 x Count, 1 x Bytes).
             expected_requestBufferSize += 5;
             if (_requestBufferLength >= expected_requestBufferSize)
@@ -355,38 +761,55 @@ bool Modbus::validateRequest()
                 expected_requestBufferSize += _requestBuffer[6];
             }
             break;
+        case FC_READ_FILE_RECORD:
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_FILE_RECORD");
+            // Agregar bytes al tamaño de solicitud esperado (1 x Bytes).
+            expected_requestBufferSize += 1;
+            if (_requestBufferLength >= expected_requestBufferSize)
+            {
+            // Agregar bytes al tamaño de solicitud esperado (n x Bytes).
+                expected_requestBufferSize += _requestBuffer[MODBUS_DATA_INDEX];
+            }
+            break;
+        case FC_WRITE_FILE_RECORD:
+        MODBUS_DEBUG_PRINTLN(" -FC_WRITE_FILE_RECORD");
+            // Agregar bytes al tamaño de solicitud esperado (1 x Bytes).
+            expected_requestBufferSize += 1;
+            if (_requestBufferLength >= expected_requestBufferSize)
+            {
+            // Agregar bytes al tamaño de solicitud esperado (n x Bytes).
+                expected_requestBufferSize += _requestBuffer[MODBUS_DATA_INDEX];
+            }
+            break;
+        case FC_READ_CHANGES:
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_CHANGES");
+            // Agregar bytes al tamaño de solicitud esperado (2 x Cursor, 2 x Address).
+            expected_requestBufferSize += 4;
+            break;
+        case FC_READ_SCATTER:
+        MODBUS_DEBUG_PRINTLN(" -FC_READ_SCATTER");
+            // Agregar bytes al tamaño de solicitud esperado (1 x Bytes).
+            expected_requestBufferSize += 1;
+            if (_requestBufferLength >= expected_requestBufferSize)
+            {
+            // Agregar bytes al tamaño de solicitud esperado (n x (1 x Table, 2 x Index, 2 x Count)).
+                expected_requestBufferSize += _requestBuffer[MODBUS_DATA_INDEX];
+            }
+            break;
         default:       
             // Código de función desconocido.
-             report_illegal_function=true;
+            break;
     }
 
     // Si los datos recibidos son más pequeños de lo que esperamos, ignore esta solicitud.
     if (_requestBufferLength < expected_requestBufferSize)
     {
-        Serial.print("Buffer recibido menor al esperado ");
+        MODBUS_DEBUG_PRINT("Buffer recibido menor al esperado ");
         return false;
     }
 
-    // Verifique la crc, y si no es correcta ignore la solicitud.
-    uint16_t crc = readCRC(_requestBuffer, _requestBufferLength);
-    // Serial.print("CRC leido: ");
-    // Serial.println(crc,HEX);
-    // Serial.print("CRC calculado: ");
-    // Serial.println(Modbus::calculateCRC(_requestBuffer, _requestBufferLength - MODBUS_CRC_LENGTH),HEX);
+    // Los códigos de función desconocidos llegan a createResponse(), que responde STATUS_ILLEGAL_FUNCTION.
 
-    if (Modbus::calculateCRC(_requestBuffer, _requestBufferLength - MODBUS_CRC_LENGTH) != crc)
-    {
-        Serial.println("CRC incorrecto");
-        return false;
-    }
-    
-    // Verifique la crc, y si no es correcta ignore la solicitud.
-    if (report_illegal_function)
-    {
-        Modbus::reportException(STATUS_ILLEGAL_FUNCTION);
-        return false;
-    }
-     
     // Establezca la longitud a leer de la solicitud a la longitud esperada calculada.
     _requestBufferLength = expected_requestBufferSize;
     return true;
@@ -399,6 +822,8 @@ bool Modbus::validateRequest()
  */
 uint8_t Modbus::createResponse()
 {
+    MODBUS_PROFILE_SCOPE(createResponse);
+
     uint16_t firstAddress;
     uint16_t addressesLength;
     uint8_t callbackIndex;
@@ -409,7 +834,7 @@ uint8_t Modbus::createResponse()
     switch (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX])
     {
     case FC_READ_EXCEPTION_STATUS:        
-    Serial.println("FC_READ_EXCEPTION_STATUS ");
+    MODBUS_DEBUG_PRINTLN("FC_READ_EXCEPTION_STATUS ");
     // Rechazar solicitudes de lectura de difusión
         if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
         {
@@ -424,13 +849,33 @@ uint8_t Modbus::createResponse()
         break;
 
     case FC_READ_COILS:          // Read coils (digital out state).
-    Serial.println("FC_READ_COILS ");
-    break;
     case FC_READ_DISCRETE_INPUT: // Read input state (digital in). 
-    Serial.println("FC_READ_DISCRETE_INPUT ");     
-    break;
+        // Rechazar solicitudes de lectura de difusión
+        if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
+        {
+            return STATUS_ILLEGAL_FUNCTION;
+        }
+
+        // Leer la primera dirección y el número de entradas.
+        firstAddress = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+        addressesLength = readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2);
+
+        // La cantidad debe estar entre 1 y 2000; si no, el número de bytes no cabe en la respuesta.
+        if (addressesLength < 1 || addressesLength > MODBUS_MAX_READ_COILS)
+        {
+            return STATUS_ILLEGAL_DATA_VALUE;
+        }
+
+        // Calcula la longitud de los datos de respuesta (8 bobinas por byte) y agrégala a la longitud del búfer de salida.
+        _responseBuffer[MODBUS_DATA_INDEX] = (addressesLength + 7) / 8;
+        _responseBufferLength += 1 + _responseBuffer[MODBUS_DATA_INDEX];
+
+        // Ejecuta la devolución de llamada y devuelve el código de estado.
+        callbackIndex = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] == FC_READ_COILS ? CB_READ_COILS : CB_READ_DISCRETE_INPUTS;
+        return Modbus::executeCallback(requestUnitAddress, callbackIndex, firstAddress, addressesLength);
 
     case FC_READ_HOLDING_REGISTERS: // Read holding registers (analog out state)
+    case FC_READ_INPUT_REGISTERS:   // Read input registers (analog in)
     //Serial.println("FC_READ_HOLDING_REGISTERS ");
         // Rechazar solicitudes de lectura de difusión
         if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
@@ -446,6 +891,12 @@ uint8_t Modbus::createResponse()
         // Serial.print("Longitud de direcciones: ");
         // Serial.println(addressesLength);
 
+        // La cantidad debe estar entre 1 y 125; si no, el número de bytes no cabe en la respuesta.
+        if (addressesLength < 1 || addressesLength > MODBUS_MAX_READ_REGISTERS)
+        {
+            return STATUS_ILLEGAL_DATA_VALUE;
+        }
+
         // Calcula la longitud de los datos de respuesta y agrégala a la longitud del búfer de salida.
         _responseBuffer[MODBUS_DATA_INDEX] = 2 * addressesLength;
         _responseBufferLength += 1 + _responseBuffer[MODBUS_DATA_INDEX];
@@ -456,24 +907,97 @@ uint8_t Modbus::createResponse()
         callbackIndex = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX] == FC_READ_HOLDING_REGISTERS ? CB_READ_HOLDING_REGISTERS : CB_READ_INPUT_REGISTERS;
         return Modbus::executeCallback(requestUnitAddress, callbackIndex, firstAddress, addressesLength);
         break;
-    case FC_READ_INPUT_REGISTERS:   // Read input registers (analog in)  
-    Serial.println("FC_READ_INPUT_REGISTERS ");
-    break;
 
     case FC_WRITE_COIL: // Write one coil (digital out).       
-    Serial.println("FC_WRITE_COIL ");
-    break;
+        // Leer la dirección.
+        firstAddress = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+
+        // Suma la longitud de los datos de respuesta a la longitud de la salida (2 x Address, 2 x Value).
+        _responseBufferLength += 4;
+
+        // Copia las partes de la solicitud que forman parte de la respuesta.
+        memcpy(_responseBuffer + MODBUS_DATA_INDEX, _requestBuffer + MODBUS_DATA_INDEX, _responseBufferLength - MODBUS_FRAME_SIZE);
+
+        // Ejecuta la devolución de llamada y devuelve el código de estado.
+        return Modbus::executeCallback(requestUnitAddress, CB_WRITE_COILS, firstAddress, 1);
 
     case FC_WRITE_REGISTER: // Write one holding register (analog out).
-    Serial.println("FC_WRITE_REGISTER ");
-    break;
+        // Leer la dirección.
+        firstAddress = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+
+        // Suma la longitud de los datos de respuesta a la longitud de la salida (2 x Address, 2 x Value).
+        _responseBufferLength += 4;
+
+        // Copia las partes de la solicitud que forman parte de la respuesta.
+        memcpy(_responseBuffer + MODBUS_DATA_INDEX, _requestBuffer + MODBUS_DATA_INDEX, _responseBufferLength - MODBUS_FRAME_SIZE);
+
+        // Ejecuta la devolución de llamada y devuelve el código de estado.
+        return Modbus::executeCallback(requestUnitAddress, CB_WRITE_HOLDING_REGISTERS, firstAddress, 1);
 
     case FC_WRITE_MULTIPLE_COILS: // Write multiple coils (digital out)  
-    Serial.println("FC_WRITE_MULTIPLE_COILS ");     
-    break;
+        // Leer la primera dirección y el número de bobinas.
+        firstAddress = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+        addressesLength = readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2);
+
+        // Suma la longitud de los datos de respuesta a la longitud de la salida (2 x Address, 2 x Count).
+        _responseBufferLength += 4;
+
+        // Copia las partes de la solicitud que forman parte de la respuesta.
+        memcpy(_responseBuffer + MODBUS_DATA_INDEX, _requestBuffer + MODBUS_DATA_INDEX, _responseBufferLength - MODBUS_FRAME_SIZE);
+
+        // Ejecuta la devolución de llamada y devuelve el código de estado.
+        return Modbus::executeCallback(requestUnitAddress, CB_WRITE_COILS, firstAddress, addressesLength);
 
     case FC_WRITE_MULTIPLE_REGISTERS: // Write multiple holding registers (analog out). 
-    break;
+        // Leer la primera dirección y el número de registros.
+        firstAddress = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+        addressesLength = readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2);
+
+        // Suma la longitud de los datos de respuesta a la longitud de la salida (2 x Address, 2 x Count).
+        _responseBufferLength += 4;
+
+        // Copia las partes de la solicitud que forman parte de la respuesta.
+        memcpy(_responseBuffer + MODBUS_DATA_INDEX, _requestBuffer + MODBUS_DATA_INDEX, _responseBufferLength - MODBUS_FRAME_SIZE);
+
+        // Ejecuta la devolución de llamada y devuelve el código de estado.
+        return Modbus::executeCallback(requestUnitAddress, CB_WRITE_HOLDING_REGISTERS, firstAddress, addressesLength);
+
+    case FC_READ_FILE_RECORD: // Read file records.
+        // Rechazar solicitudes de lectura de difusión
+        if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
+        {
+            return STATUS_ILLEGAL_FUNCTION;
+        }
+
+        // El proveedor de archivos escribe los registros directamente en el búfer de salida.
+        return Modbus::readFileRecords();
+
+    case FC_WRITE_FILE_RECORD: // Write file records.
+        // El proveedor de archivos lee los registros directamente del búfer de entrada.
+        return Modbus::writeFileRecords();
+
+    case FC_READ_CHANGES: // Read the registers changed since a cursor (vendor).
+        // Rechazar solicitudes de lectura de difusión
+        if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
+        {
+            return STATUS_ILLEGAL_FUNCTION;
+        }
+
+        // La devolución de llamada recibe el cursor y la dirección desde la que continuar;
+        // writeChangesToBuffer() añade los datos a la respuesta.
+        return Modbus::executeCallback(requestUnitAddress, CB_READ_CHANGES,
+                                       readUInt16(_requestBuffer, MODBUS_DATA_INDEX),
+                                       readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2));
+
+    case FC_READ_SCATTER: // Read several ranges of several tables (vendor).
+        // Rechazar solicitudes de lectura de difusión
+        if (requestUnitAddress == MODBUS_BROADCAST_ADDRESS)
+        {
+            return STATUS_ILLEGAL_FUNCTION;
+        }
+
+        // Ejecuta una devolución de llamada por rango y devuelve el código de estado.
+        return Modbus::createScatterResponse(requestUnitAddress);
 
     default:
         return STATUS_ILLEGAL_FUNCTION;
@@ -495,12 +1019,22 @@ uint16_t Modbus::reportException(uint8_t exceptionCode)
         return 0;
     }
 
+    Modbus::setException(exceptionCode);
+    return Modbus::writeResponse();
+}
+
+/**
+ * Llena el búfer de salida con una excepción basada en la solicitud en el búfer de entrada.
+ *
+ * @param exceptionCode El código de estado para informar.
+ */
+void Modbus::setException(uint8_t exceptionCode)
+{
     // Agrega exceptionCode al búfer de salida.
     _responseBufferLength = MODBUS_FRAME_SIZE + 1;
+    _isResponseCRCReady = false;
     _responseBuffer[MODBUS_FUNCTION_CODE_INDEX] |= 0x80;
     _responseBuffer[MODBUS_DATA_INDEX] = exceptionCode;
-
-    return Modbus::writeResponse();
 }
 
 /**
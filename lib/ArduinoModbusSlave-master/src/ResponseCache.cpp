@@ -0,0 +1,225 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+#define MODBUS_FRAME_SIZE 4
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_ADDRESS_INDEX 0
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+
+#define readUInt16(arr, index) word(arr[index], arr[index + 1])
+
+/**
+ * Activa la caché de respuestas para solicitudes FC03/FC04 repetidas.
+ *
+ * @param entries Puntero a una matriz de entradas de caché, propiedad de la aplicación.
+ * @param numberOfEntries El número de entradas en la matriz.
+ * @param maxAgeInMicroSecond La validez por defecto de una respuesta guardada.
+ */
+void Modbus::enableResponseCache(ModbusCacheEntry *entries, uint8_t numberOfEntries, unsigned long maxAgeInMicroSecond)
+{
+    _cacheEntries = entries;
+    _numberOfCacheEntries = numberOfEntries;
+    _nextCacheEntry = 0;
+    _cacheMaxAge = maxAgeInMicroSecond;
+
+    Modbus::invalidateResponseCache();
+}
+
+/**
+ * Establece ventanas de validez por rango de registros. El primer rango que contiene
+ * por completo la solicitud determina su validez; si ninguno la contiene se usa la
+ * validez por defecto.
+ *
+ * @param ranges Puntero a una matriz de rangos, propiedad de la aplicación.
+ * @param numberOfRanges El número de rangos en la matriz.
+ */
+void Modbus::setResponseCacheRanges(ModbusCacheRange *ranges, uint8_t numberOfRanges)
+{
+    _cacheRanges = ranges;
+    _numberOfCacheRanges = numberOfRanges;
+}
+
+/**
+ * Descarta todas las respuestas guardadas.
+ */
+void Modbus::invalidateResponseCache()
+{
+    for (uint8_t i = 0; i < _numberOfCacheEntries; ++i)
+    {
+        _cacheEntries[i].responseLength = 0;
+    }
+}
+
+/**
+ * Descarta las respuestas guardadas que se solapan con el rango dado.
+ * La aplicación debe llamarlo cuando cambie los valores de esos registros.
+ *
+ * @param functionCode El código de función de lectura (FC_READ_HOLDING_REGISTERS o FC_READ_INPUT_REGISTERS).
+ * @param address La dirección del primer registro modificado.
+ * @param length El número de registros modificados.
+ */
+void Modbus::invalidateResponseCache(uint8_t functionCode, uint16_t address, uint16_t length)
+{
+    for (uint8_t i = 0; i < _numberOfCacheEntries; ++i)
+    {
+        ModbusCacheEntry &entry = _cacheEntries[i];
+        if (entry.responseLength == 0 || entry.request[MODBUS_FUNCTION_CODE_INDEX] != functionCode)
+        {
+            continue;
+        }
+
+        uint32_t firstAddress = readUInt16(entry.request, MODBUS_DATA_INDEX);
+        uint32_t lastAddress = firstAddress + readUInt16(entry.request, MODBUS_DATA_INDEX + 2);
+        if ((uint32_t)address < lastAddress && (uint32_t)address + length > firstAddress)
+        {
+            entry.responseLength = 0;
+        }
+    }
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Busca la validez aplicable a una solicitud de lectura.
+ *
+ * @return La validez en microsegundos, o cero si la solicitud no se guarda.
+ */
+unsigned long Modbus::responseCacheMaxAge(uint8_t functionCode, uint16_t address, uint16_t length)
+{
+    for (uint8_t i = 0; i < _numberOfCacheRanges; ++i)
+    {
+        ModbusCacheRange &range = _cacheRanges[i];
+        if (range.functionCode == functionCode &&
+            address >= range.address &&
+            (uint32_t)address + length <= (uint32_t)range.address + range.length)
+        {
+            return range.maxAge;
+        }
+    }
+    return _cacheMaxAge;
+}
+
+/**
+ * Si la solicitud actual coincide con una respuesta guardada y vigente, la copia al búfer de salida.
+ *
+ * @return True si la respuesta se tomó de la caché; de lo contrario falso.
+ */
+bool Modbus::readResponseCache()
+{
+    uint8_t functionCode = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX];
+    if (_numberOfCacheEntries == 0 ||
+        (functionCode != FC_READ_HOLDING_REGISTERS && functionCode != FC_READ_INPUT_REGISTERS) ||
+        _requestBufferLength != MODBUS_CACHE_REQUEST_SIZE)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < _numberOfCacheEntries; ++i)
+    {
+        ModbusCacheEntry &entry = _cacheEntries[i];
+        if (entry.responseLength == 0 || memcmp(entry.request, _requestBuffer, MODBUS_CACHE_REQUEST_SIZE) != 0)
+        {
+            continue;
+        }
+
+        // La respuesta caducó, libere la entrada.
+        if ((micros() - entry.storedTime) > entry.maxAge)
+        {
+            entry.responseLength = 0;
+            return false;
+        }
+
+        memcpy(_responseBuffer, entry.response, entry.responseLength);
+        _responseBufferLength = entry.responseLength;
+        _isResponseCRCReady = true;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Guarda la respuesta actual, con su CRC, si la solicitud es una lectura que se puede guardar.
+ */
+void Modbus::writeResponseCache()
+{
+    uint8_t functionCode = _requestBuffer[MODBUS_FUNCTION_CODE_INDEX];
+    if (_numberOfCacheEntries == 0 ||
+        (functionCode != FC_READ_HOLDING_REGISTERS && functionCode != FC_READ_INPUT_REGISTERS) ||
+        _requestBufferLength != MODBUS_CACHE_REQUEST_SIZE ||
+        _responseBufferLength > MODBUS_CACHE_RESPONSE_SIZE ||
+        Modbus::isBroadcast())
+    {
+        return;
+    }
+
+    unsigned long maxAge = Modbus::responseCacheMaxAge(
+        functionCode,
+        readUInt16(_requestBuffer, MODBUS_DATA_INDEX),
+        readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2));
+    if (maxAge == 0)
+    {
+        return;
+    }
+
+    // Calcula el CRC ahora para guardar la respuesta completa; writeResponse() no lo repetirá.
+    uint16_t crc = Modbus::calculateCRC(_responseBuffer, _responseBufferLength - MODBUS_CRC_LENGTH);
+    _responseBuffer[_responseBufferLength - MODBUS_CRC_LENGTH] = crc & 0xFF;
+    _responseBuffer[(_responseBufferLength - MODBUS_CRC_LENGTH) + 1] = crc >> 8;
+    _isResponseCRCReady = true;
+
+    // Reutiliza la entrada de la misma solicitud, o una libre, o la siguiente en turno.
+    ModbusCacheEntry *entry = NULL;
+    for (uint8_t i = 0; i < _numberOfCacheEntries && !entry; ++i)
+    {
+        if (memcmp(_cacheEntries[i].request, _requestBuffer, MODBUS_CACHE_REQUEST_SIZE) == 0)
+        {
+            entry = &_cacheEntries[i];
+        }
+    }
+    for (uint8_t i = 0; i < _numberOfCacheEntries && !entry; ++i)
+    {
+        if (_cacheEntries[i].responseLength == 0)
+        {
+            entry = &_cacheEntries[i];
+        }
+    }
+    if (!entry)
+    {
+        entry = &_cacheEntries[_nextCacheEntry];
+        _nextCacheEntry = (_nextCacheEntry + 1) % _numberOfCacheEntries;
+    }
+
+    memcpy(entry->request, _requestBuffer, MODBUS_CACHE_REQUEST_SIZE);
+    memcpy(entry->response, _responseBuffer, _responseBufferLength);
+    entry->responseLength = _responseBufferLength;
+    entry->storedTime = micros();
+    entry->maxAge = maxAge;
+}
+
+/**
+ * Invalida las lecturas guardadas que cubren los registros que escribe la solicitud actual.
+ */
+void Modbus::invalidateResponseCacheForWrite()
+{
+    if (_numberOfCacheEntries == 0)
+    {
+        return;
+    }
+
+    uint16_t address = readUInt16(_requestBuffer, MODBUS_DATA_INDEX);
+    switch (_requestBuffer[MODBUS_FUNCTION_CODE_INDEX])
+    {
+    case FC_WRITE_REGISTER:
+        Modbus::invalidateResponseCache(FC_READ_HOLDING_REGISTERS, address, 1);
+        break;
+    case FC_WRITE_MULTIPLE_REGISTERS:
+        Modbus::invalidateResponseCache(FC_READ_HOLDING_REGISTERS, address, readUInt16(_requestBuffer, MODBUS_DATA_INDEX + 2));
+        break;
+    }
+}
@@ -0,0 +1,241 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+#define MODBUS_FRAME_SIZE 4
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_ADDRESS_INDEX 0
+#define MODBUS_FUNCTION_CODE_INDEX 1
+#define MODBUS_DATA_INDEX 2
+#define MODBUS_BYTE_COUNT_INDEX 6
+
+#define MODBUS_ADDRESS_MAX 247
+
+#define MODBUS_HALF_SILENCE_MULTIPLIER 3
+
+#define readCRC(arr, length) word(arr[(length - MODBUS_CRC_LENGTH) + 1], arr[length - MODBUS_CRC_LENGTH])
+
+/**
+ * Activa la resincronización de tramas para enlaces que deforman los silencios
+ * (adaptadores USB-RS485, radiomódems): los bytes recibidos se acumulan y en cada
+ * desplazamiento se busca una solicitud completa (dirección, código de función,
+ * longitud y CRC), de modo que las tramas unidas o partidas se recuperan sin
+ * depender de los tiempos. Una trama con un código de función desconocido se sigue
+ * aceptando si llega entera entre silencios de 1.5T.
+ *
+ * @param isEnabled Verdadero para delimitar las tramas por su contenido.
+ * @param timeoutInMicroSecond Tiempo sin bytes tras el que se descartan los bytes
+ *                             que no completan ninguna trama.
+ */
+void Modbus::enableResync(bool isEnabled, unsigned long timeoutInMicroSecond)
+{
+    _isResyncEnabled = isEnabled;
+    _resyncTimeout = timeoutInMicroSecond;
+    _resyncLength = 0;
+    _resyncFrameLength = 0;
+    _resyncScannedLength = 0;
+    _isResyncDistorted = false;
+    _isResyncSilenceChecked = false;
+    _isRequestBufferReading = false;
+}
+
+/**
+ * Devuelve el número de bytes descartados por la resincronización (ruido, tramas dañadas).
+ */
+uint32_t Modbus::getResyncDiscardedBytes()
+{
+    return _resyncDiscardedBytes;
+}
+
+/**
+ * Devuelve el número de tramas que la resincronización recuperó y que el encuadre por
+ * silencios habría perdido: precedidas de bytes descartados, unidas a la siguiente o
+ * partidas por un silencio.
+ */
+uint32_t Modbus::getResyncRecoveredFrames()
+{
+    return _resyncRecoveredFrames;
+}
+
+/**
+ * ---------------------------------------------------
+ *                  PRIVATE METHODS
+ * ---------------------------------------------------
+ */
+
+/**
+ * Lee los bytes nuevos y busca la primera solicitud completa en el flujo acumulado.
+ * La trama encontrada queda al principio de _requestBuffer y los bytes que la siguen
+ * se conservan para la próxima llamada.
+ *
+ * @return True si el búfer contiene una solicitud lista para ser procesada; de lo contrario falso.
+ */
+bool Modbus::readResyncRequest()
+{
+    // Retira la trama entregada a poll() en la llamada anterior.
+    if (_resyncFrameLength > 0)
+    {
+        Modbus::discardResyncBytes(_resyncFrameLength);
+        _resyncFrameLength = 0;
+    }
+
+    unsigned long silence = _halfCharTimeInMicroSecond * MODBUS_HALF_SILENCE_MULTIPLIER;
+    uint16_t length = _serialStream.available();
+    if (length > 0)
+    {
+        // Sin sitio para los bytes nuevos, descarta hasta el siguiente posible comienzo de trama.
+        if (_resyncLength == MODBUS_MAX_BUFFER)
+        {
+            uint16_t offset = 1;
+            while (offset < _resyncLength && Modbus::resyncFrameLength(offset) == 0)
+            {
+                offset++;
+            }
+            _resyncDiscardedBytes += offset;
+            Modbus::discardResyncBytes(offset);
+        }
+
+        length = _serialStream.readBytes(_requestBuffer + _resyncLength, min(length, MODBUS_MAX_BUFFER - _resyncLength));
+        if (_capture != NULL && length > 0)
+        {
+            _capture->record(false, _requestBuffer + _resyncLength, length);
+        }
+
+        // Un silencio en medio de una trama la habría partido en dos; sin silencio tras la
+        // trama anterior, la habría unido a ella.
+        bool isSilent = (micros() - _lastCommunicationTime) > silence;
+        if (_resyncLength > 0 ? isSilent : !isSilent)
+        {
+            _isResyncDistorted = true;
+        }
+
+        _resyncLength += length;
+        _totalBytesReceived += length;
+        _lastCommunicationTime = micros();
+        _isResyncSilenceChecked = false;
+    }
+    _isRequestBufferReading = _resyncLength > 0;
+
+    // Busca en cada desplazamiento una trama completa con un CRC correcto. Las que terminan
+    // dentro de la parte ya examinada no se vuelven a comprobar.
+    uint16_t offset = 0;
+    while (_resyncScannedLength < _resyncLength && offset + MODBUS_FRAME_SIZE <= _resyncLength)
+    {
+        uint16_t frameLength = Modbus::resyncFrameLength(offset);
+        uint8_t *frame = _requestBuffer + offset;
+        if (frameLength == 0 || offset + frameLength > _resyncLength || offset + frameLength <= _resyncScannedLength ||
+            Modbus::calculateCRC(frame, frameLength - MODBUS_CRC_LENGTH) != readCRC(frame, frameLength))
+        {
+            offset++;
+            continue;
+        }
+
+        bool isRecovered = offset > 0 || _isResyncDistorted;
+        _resyncDiscardedBytes += offset;
+        _resyncScannedLength = offset + frameLength;
+        Modbus::discardResyncBytes(offset);
+        offset = 0;
+
+        // Una solicitud para otra unidad del bus se salta entera.
+        if (!Modbus::relevantAddress(_requestBuffer[MODBUS_ADDRESS_INDEX]))
+        {
+            Modbus::discardResyncBytes(frameLength);
+            _isResyncDistorted = _resyncLength > 0;
+            continue;
+        }
+
+        if (isRecovered || _resyncLength > frameLength)
+        {
+            _resyncRecoveredFrames++;
+        }
+        _isResyncDistorted = false;
+        _requestBufferLength = frameLength;
+        _resyncFrameLength = frameLength;
+        _isRequestBufferReading = false;
+        return true;
+    }
+    _resyncScannedLength = _resyncLength;
+    _isRequestBufferReading = _resyncLength > 0;
+
+    if (_resyncLength == 0 || (micros() - _lastCommunicationTime) <= silence)
+    {
+        return false;
+    }
+
+    // Tras 1.5T de silencio, una trama entera con un código de función que no sabemos medir se acepta como sin resincronización.
+    if (!_isResyncSilenceChecked)
+    {
+        _isResyncSilenceChecked = true;
+        if (_resyncLength >= MODBUS_FRAME_SIZE && Modbus::resyncFrameLength(0) == 0 &&
+            Modbus::relevantAddress(_requestBuffer[MODBUS_ADDRESS_INDEX]) &&
+            Modbus::calculateCRC(_requestBuffer, _resyncLength - MODBUS_CRC_LENGTH) == readCRC(_requestBuffer, _resyncLength))
+        {
+            _requestBufferLength = _resyncLength;
+            _resyncFrameLength = _resyncLength;
+            _isRequestBufferReading = false;
+            return true;
+        }
+    }
+
+    // Los bytes que no completan ninguna trama se descartan tras el plazo.
+    if ((micros() - _lastCommunicationTime) > _resyncTimeout)
+    {
+        _resyncDiscardedBytes += _resyncLength;
+        Modbus::discardResyncBytes(_resyncLength);
+        _isResyncDistorted = false;
+        _isRequestBufferReading = false;
+    }
+    return false;
+}
+
+/**
+ * Calcula la longitud de la solicitud que empezaría en offset según su código de función.
+ * Si la cabecera aún no ha llegado entera, devuelve la longitud mínima.
+ *
+ * @return La longitud de la trama, CRC incluido, o cero si ahí no puede empezar una solicitud.
+ */
+uint16_t Modbus::resyncFrameLength(uint16_t offset)
+{
+    const uint8_t *frame = _requestBuffer + offset;
+    uint16_t length = _resyncLength - offset;
+    if (length <= MODBUS_FUNCTION_CODE_INDEX || frame[MODBUS_ADDRESS_INDEX] > MODBUS_ADDRESS_MAX)
+    {
+        return 0;
+    }
+
+    switch (frame[MODBUS_FUNCTION_CODE_INDEX])
+    {
+    case FC_READ_EXCEPTION_STATUS:
+        return MODBUS_FRAME_SIZE;
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUT:
+    case FC_READ_HOLDING_REGISTERS:
+    case FC_READ_INPUT_REGISTERS:
+    case FC_WRITE_COIL:
+    case FC_WRITE_REGISTER:
+    case FC_READ_CHANGES:
+        // 2 x Index, 2 x Count (o Value, o Cursor y Address).
+        return MODBUS_FRAME_SIZE + 4;
+    case FC_WRITE_MULTIPLE_COILS:
+    case FC_WRITE_MULTIPLE_REGISTERS:
+        // 2 x Index, 2 x Count, 1 x Bytes, n x Bytes.
+        return MODBUS_FRAME_SIZE + 5 + (length > MODBUS_BYTE_COUNT_INDEX ? frame[MODBUS_BYTE_COUNT_INDEX] : 0);
+    case FC_READ_FILE_RECORD:
+    case FC_WRITE_FILE_RECORD:
+    case FC_READ_SCATTER:
+        // 1 x Bytes, n x Bytes.
+        return MODBUS_FRAME_SIZE + 1 + (length > MODBUS_DATA_INDEX ? frame[MODBUS_DATA_INDEX] : 0);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Descarta los primeros length bytes acumulados.
+ */
+void Modbus::discardResyncBytes(uint16_t length)
+{
+    _resyncLength -= length;
+    memmove(_requestBuffer, _requestBuffer + length, _resyncLength);
+    _resyncScannedLength = _resyncScannedLength > length ? _resyncScannedLength - length : 0;
+}
@@ -0,0 +1,99 @@
+#include "ModbusSlave.h"
+
+#define MODBUS_FRAME_SIZE 4
+
+#define MODBUS_DATA_INDEX 2
+
+/**
+ * Solicitud de FC_READ_SCATTER (tras la dirección y el código de función):
+ *
+ *     1 x byteCount, n x (1 x table, 2 x address, 2 x count)
+ *
+ * table es el código de función de lectura de la tabla (FC01..FC04). La respuesta es
+ * 1 x byteCount seguido de los datos de cada rango, en el orden de la solicitud y con
+ * el mismo formato que la respuesta de FC01..FC04 (las bobinas de cada rango empiezan
+ * en un byte nuevo).
+ */
+#define MODBUS_SCATTER_TUPLE_SIZE 5
+#define MODBUS_SCATTER_MAX_DATA (MODBUS_MAX_BUFFER - MODBUS_FRAME_SIZE - 1)
+
+#define readUInt16(arr, index) word(arr[index], arr[index + 1])
+
+/**
+ * Crea la respuesta a FC_READ_SCATTER ejecutando, para cada rango, la misma devolución
+ * de llamada que una lectura FC01..FC04 de ese rango. Durante la devolución de llamada,
+ * readFunctionCode() devuelve el código de la tabla y write*ToBuffer() escriben con el
+ * offset relativo al rango, así que las devoluciones de llamada existentes sirven sin cambios.
+ * Una devolución de llamada no puede diferir la respuesta (STATUS_PENDING) dentro de esta lectura.
+ *
+ * @param unitAddress La dirección de la unidad de la solicitud.
+ * @return STATUS_OK si tiene éxito; STATUS_ILLEGAL_DATA_VALUE si un rango no es válido o
+ *         la respuesta no cabe en MODBUS_MAX_BUFFER; si no, el código de la devolución de llamada.
+ */
+uint8_t Modbus::createScatterResponse(uint8_t unitAddress)
+{
+    uint8_t byteCount = _requestBuffer[MODBUS_DATA_INDEX];
+    if (byteCount == 0 || byteCount % MODBUS_SCATTER_TUPLE_SIZE != 0 || byteCount > MODBUS_SCATTER_MAX_DATA)
+    {
+        return STATUS_ILLEGAL_DATA_VALUE;
+    }
+
+    uint16_t dataLength = 0;
+    uint8_t status = STATUS_OK;
+
+    for (uint16_t index = MODBUS_DATA_INDEX + 1; index < MODBUS_DATA_INDEX + 1 + byteCount; index += MODBUS_SCATTER_TUPLE_SIZE)
+    {
+        uint8_t table = _requestBuffer[index];
+        uint16_t address = readUInt16(_requestBuffer, index + 1);
+        uint16_t length = readUInt16(_requestBuffer, index + 3);
+
+        uint8_t callbackIndex = CB_MAX;
+        uint32_t rangeLength = 0;
+        switch (table)
+        {
+        case FC_READ_COILS:
+        case FC_READ_DISCRETE_INPUT:
+            callbackIndex = table == FC_READ_COILS ? CB_READ_COILS : CB_READ_DISCRETE_INPUTS;
+            rangeLength = ((uint32_t)length + 7) / 8;
+            break;
+        case FC_READ_HOLDING_REGISTERS:
+        case FC_READ_INPUT_REGISTERS:
+            callbackIndex = table == FC_READ_HOLDING_REGISTERS ? CB_READ_HOLDING_REGISTERS : CB_READ_INPUT_REGISTERS;
+            rangeLength = (uint32_t)length * 2;
+            break;
+        default:
+            status = STATUS_ILLEGAL_DATA_VALUE;
+            break;
+        }
+
+        // Los datos de todos los rangos tienen que caber en una respuesta de MODBUS_MAX_BUFFER bytes.
+        if (status != STATUS_OK || length == 0 || dataLength + rangeLength > MODBUS_SCATTER_MAX_DATA)
+        {
+            status = STATUS_ILLEGAL_DATA_VALUE;
+            break;
+        }
+
+        // La devolución de llamada ve sólo su rango: el final de la respuesta es el final del rango.
+        _scatterFunctionCode = table;
+        _scatterDataOffset = dataLength;
+        _responseBufferLength = MODBUS_FRAME_SIZE + 1 + dataLength + rangeLength;
+
+        status = Modbus::executeCallback(unitAddress, callbackIndex, address, length);
+        if (status != STATUS_OK)
+        {
+            break;
+        }
+        dataLength += rangeLength;
+    }
+
+    _scatterFunctionCode = FC_INVALID;
+    _scatterDataOffset = 0;
+
+    if (status == STATUS_PENDING)
+    {
+        return STATUS_SLAVE_DEVICE_FAILURE;
+    }
+    _responseBuffer[MODBUS_DATA_INDEX] = dataLength;
+    _responseBufferLength = MODBUS_FRAME_SIZE + 1 + dataLength;
+    return status;
+}
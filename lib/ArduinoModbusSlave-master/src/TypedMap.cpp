@@ -0,0 +1,317 @@
+#include <string.h>
+#include "ModbusSlave.h"
+
+#define MODBUS_CRC_LENGTH 2
+
+#define MODBUS_DATA_INDEX 2
+
+// En hosts little-endian con GCC o Clang cada orden de palabras es un bswap y/o un
+// intercambio de los bytes de cada palabra por valor, en bucles que el compilador vectoriza
+// con -O3 (pshufb con SSSE3, rev16/rev32/rev64 en NEON). En AVR, y en cualquier otro caso,
+// los bytes se recolocan con una tabla de permutación.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ && !defined(__AVR__)
+#define MODBUS_TYPED_BSWAP
+#endif
+
+#define MODBUS_TYPED_MAX_VALUE_SIZE 8
+
+#if defined(MODBUS_TYPED_BSWAP)
+/**
+ * Intercambia los dos bytes de cada palabra de 16 bits.
+ */
+static inline uint32_t modbusSwapWordBytes32(uint32_t value)
+{
+    return ((value & 0x00FF00FFUL) << 8) | ((value >> 8) & 0x00FF00FFUL);
+}
+
+static inline uint64_t modbusSwapWordBytes64(uint64_t value)
+{
+    return ((value & 0x00FF00FF00FF00FFULL) << 8) | ((value >> 8) & 0x00FF00FF00FF00FFULL);
+}
+
+/**
+ * Convierte count valores de 32 bits. Cada orden de palabras es su propia inversa, así que
+ * la misma función sirve para codificar y para decodificar. Un bucle por combinación para
+ * que el compilador vectorice cada uno.
+ */
+static void modbusConvertValues32(uint8_t *destination, const uint8_t *source, uint16_t count, bool isReversed, bool isWordSwapped)
+{
+    uint32_t value;
+    if (isReversed && isWordSwapped)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 4, 4);
+            value = modbusSwapWordBytes32(__builtin_bswap32(value));
+            memcpy(destination + i * 4, &value, 4);
+        }
+    }
+    else if (isReversed)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 4, 4);
+            value = __builtin_bswap32(value);
+            memcpy(destination + i * 4, &value, 4);
+        }
+    }
+    else if (isWordSwapped)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 4, 4);
+            value = modbusSwapWordBytes32(value);
+            memcpy(destination + i * 4, &value, 4);
+        }
+    }
+    else
+    {
+        memcpy(destination, source, count * 4);
+    }
+}
+
+static void modbusConvertValues64(uint8_t *destination, const uint8_t *source, uint16_t count, bool isReversed, bool isWordSwapped)
+{
+    uint64_t value;
+    if (isReversed && isWordSwapped)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 8, 8);
+            value = modbusSwapWordBytes64(__builtin_bswap64(value));
+            memcpy(destination + i * 8, &value, 8);
+        }
+    }
+    else if (isReversed)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 8, 8);
+            value = __builtin_bswap64(value);
+            memcpy(destination + i * 8, &value, 8);
+        }
+    }
+    else if (isWordSwapped)
+    {
+        for (uint16_t i = 0; i < count; i++)
+        {
+            memcpy(&value, source + i * 8, 8);
+            value = modbusSwapWordBytes64(value);
+            memcpy(destination + i * 8, &value, 8);
+        }
+    }
+    else
+    {
+        memcpy(destination, source, count * 8);
+    }
+}
+#else
+/**
+ * Calcula, para cada byte de un valor en la trama, el byte del valor en memoria del que procede.
+ */
+static void modbusWirePermutation(uint8_t *permutation, uint8_t valueSize, uint8_t wordOrder)
+{
+    bool isHighWordFirst = wordOrder == WORD_ORDER_ABCD || wordOrder == WORD_ORDER_BADC;
+    bool isHighByteFirst = wordOrder == WORD_ORDER_ABCD || wordOrder == WORD_ORDER_CDAB;
+    uint8_t words = valueSize / 2;
+    for (uint8_t i = 0; i < valueSize; i++)
+    {
+        uint8_t word = isHighWordFirst ? words - 1 - i / 2 : i / 2;
+        uint8_t significance = word * 2 + (isHighByteFirst ? 1 - i % 2 : i % 2);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        permutation[i] = valueSize - 1 - significance;
+#else
+        permutation[i] = significance;
+#endif
+    }
+}
+#endif
+
+/**
+ * Copia count valores de la matriz del mapa a la carga de la trama en el orden de palabras del mapa.
+ */
+static void modbusEncodeValues(uint8_t *payload, const uint8_t *values, uint16_t count, uint8_t valueSize, uint8_t wordOrder)
+{
+#if defined(MODBUS_TYPED_BSWAP)
+    bool isReversed = wordOrder == WORD_ORDER_ABCD || wordOrder == WORD_ORDER_BADC;
+    bool isWordSwapped = wordOrder == WORD_ORDER_CDAB || wordOrder == WORD_ORDER_BADC;
+    if (valueSize == 8)
+    {
+        modbusConvertValues64(payload, values, count, isReversed, isWordSwapped);
+        return;
+    }
+    modbusConvertValues32(payload, values, count, isReversed, isWordSwapped);
+#else
+    uint8_t permutation[MODBUS_TYPED_MAX_VALUE_SIZE];
+    modbusWirePermutation(permutation, valueSize, wordOrder);
+    for (uint16_t i = 0; i < count; i++, payload += valueSize, values += valueSize)
+    {
+        for (uint8_t j = 0; j < valueSize; j++)
+        {
+            payload[j] = values[permutation[j]];
+        }
+    }
+#endif
+}
+
+/**
+ * Copia count valores de la carga de la trama a la matriz del mapa.
+ */
+static void modbusDecodeValues(uint8_t *values, const uint8_t *payload, uint16_t count, uint8_t valueSize, uint8_t wordOrder)
+{
+#if defined(MODBUS_TYPED_BSWAP)
+    modbusEncodeValues(values, payload, count, valueSize, wordOrder);
+#else
+    uint8_t permutation[MODBUS_TYPED_MAX_VALUE_SIZE];
+    modbusWirePermutation(permutation, valueSize, wordOrder);
+    for (uint16_t i = 0; i < count; i++, payload += valueSize, values += valueSize)
+    {
+        for (uint8_t j = 0; j < valueSize; j++)
+        {
+            values[permutation[j]] = payload[j];
+        }
+    }
+#endif
+}
+
+/**
+ * Inicializa una vista sobre una matriz de valores propiedad de la aplicación.
+ *
+ * @param values Puntero a la matriz de valores.
+ * @param firstAddress La dirección Modbus del primer registro del primer valor.
+ * @param numberOfValues El número de valores de la matriz.
+ * @param wordOrder El orden de los bytes en los registros (WORD_ORDER_ABCD por defecto).
+ */
+ModbusTypedMap::ModbusTypedMap(int32_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder)
+    : _values((uint8_t *)values), _valueSize(sizeof(*values)), _firstAddress(firstAddress), _numberOfValues(numberOfValues), _wordOrder(wordOrder)
+{
+}
+
+ModbusTypedMap::ModbusTypedMap(uint32_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder)
+    : _values((uint8_t *)values), _valueSize(sizeof(*values)), _firstAddress(firstAddress), _numberOfValues(numberOfValues), _wordOrder(wordOrder)
+{
+}
+
+ModbusTypedMap::ModbusTypedMap(float *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder)
+    : _values((uint8_t *)values), _valueSize(sizeof(*values)), _firstAddress(firstAddress), _numberOfValues(numberOfValues), _wordOrder(wordOrder)
+{
+}
+
+/**
+ * En AVR double es un float de 32 bits y ocupa dos registros, no cuatro.
+ */
+ModbusTypedMap::ModbusTypedMap(double *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder)
+    : _values((uint8_t *)values), _valueSize(sizeof(*values)), _firstAddress(firstAddress), _numberOfValues(numberOfValues), _wordOrder(wordOrder)
+{
+}
+
+ModbusTypedMap::ModbusTypedMap(int64_t *values, uint16_t firstAddress, uint16_t numberOfValues, uint8_t wordOrder)
+    : _values((uint8_t *)values), _valueSize(sizeof(*values)), _firstAddress(firstAddress), _numberOfValues(numberOfValues), _wordOrder(wordOrder)
+{
+}
+
+/**
+ * Cambia el orden de palabras del mapa (WORD_ORDER_ABCD, _CDAB, _BADC o _DCBA).
+ */
+void ModbusTypedMap::setWordOrder(uint8_t wordOrder)
+{
+    _wordOrder = wordOrder;
+}
+
+/**
+ * Devuelve el orden de palabras del mapa.
+ */
+uint8_t ModbusTypedMap::getWordOrder()
+{
+    return _wordOrder;
+}
+
+/**
+ * Devuelve el número de registros que ocupa cada valor (2 o 4).
+ */
+uint8_t ModbusTypedMap::registersPerValue()
+{
+    return _valueSize / 2;
+}
+
+/**
+ * Devuelve verdadero si el rango de registros dado cubre valores enteros del mapa.
+ *
+ * @param address La dirección Modbus del primer registro.
+ * @param length El número de registros.
+ */
+bool ModbusTypedMap::contains(uint16_t address, uint16_t length)
+{
+    uint8_t registers = ModbusTypedMap::registersPerValue();
+    if (address < _firstAddress || length == 0 || (address - _firstAddress) % registers != 0 || length % registers != 0)
+    {
+        return false;
+    }
+    return (uint32_t)(address - _firstAddress) + length <= (uint32_t)_numberOfValues * registers;
+}
+
+/**
+ * Escribe en el búfer de salida los valores de un rango del mapa, ya en el orden de palabras del mapa.
+ *
+ * @param offset El offset desde el primer registro en el búfer.
+ * @param map El mapa de valores.
+ * @param address La dirección Modbus del primer registro, la que recibe la devolución de llamada.
+ * @param length El número de registros, el que recibe la devolución de llamada.
+ * @return STATUS_OK si tiene éxito, STATUS_ILLEGAL_DATA_ADDRESS si el rango no cubre valores enteros
+ *         del mapa o no cabe en el búfer.
+ */
+uint8_t Modbus::writeTypedToBuffer(int offset, ModbusTypedMap &map, uint16_t address, uint16_t length)
+{
+    // Verifique el código de la función.
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    if (functionCode != FC_READ_HOLDING_REGISTERS && functionCode != FC_READ_INPUT_REGISTERS)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    // (1 x valueBytes, n x values).
+    uint16_t index = MODBUS_DATA_INDEX + 1 + _scatterDataOffset + (offset * 2);
+
+    // Verifica que el rango cubra valores del mapa y quepa en el espacio restante de la respuesta.
+    if (!map.contains(address, length) || (index + (length * 2)) > (_responseBufferLength - MODBUS_CRC_LENGTH))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    uint16_t first = (address - map._firstAddress) / map.registersPerValue();
+    modbusEncodeValues(_responseBuffer + index, map._values + first * map._valueSize,
+                       length / map.registersPerValue(), map._valueSize, map._wordOrder);
+    return STATUS_OK;
+}
+
+/**
+ * Lee de una solicitud FC16 los valores de un rango del mapa y los guarda en la matriz del mapa.
+ *
+ * @param offset El offset desde el primer registro en el búfer.
+ * @param map El mapa de valores.
+ * @param address La dirección Modbus del primer registro, la que recibe la devolución de llamada.
+ * @param length El número de registros, el que recibe la devolución de llamada.
+ * @return STATUS_OK si tiene éxito, STATUS_ILLEGAL_DATA_ADDRESS si el rango no cubre valores enteros
+ *         del mapa (p. ej. un FC06) o no está en la solicitud, STATUS_ILLEGAL_FUNCTION si la solicitud
+ *         no es una escritura de registros.
+ */
+uint8_t Modbus::readTypedFromBuffer(int offset, ModbusTypedMap &map, uint16_t address, uint16_t length)
+{
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    if (functionCode != FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        return functionCode == FC_WRITE_REGISTER ? STATUS_ILLEGAL_DATA_ADDRESS : STATUS_ILLEGAL_FUNCTION;
+    }
+
+    // (2 x firstRegisterAddress, 2 x registersCount, 1 x valueBytes, n x values).
+    uint16_t index = MODBUS_DATA_INDEX + 5 + (offset * 2);
+    if (!map.contains(address, length) || (index + (length * 2)) > (_requestBufferLength - MODBUS_CRC_LENGTH))
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+
+    uint16_t first = (address - map._firstAddress) / map.registersPerValue();
+    modbusDecodeValues(map._values + first * map._valueSize, _requestBuffer + index,
+                       length / map.registersPerValue(), map._valueSize, map._wordOrder);
+    return STATUS_OK;
+}
@@ -0,0 +1,126 @@
+#include "ModbusSlave.h"
+
+/**
+ * Los índices de la cola se publican con semántica de adquisición/liberación: el
+ * consumidor ve las entradas antes que el índice que las incluye. En AVR un acceso de
+ * 16 bits no es atómico, así que se hace con las interrupciones deshabilitadas.
+ */
+#if defined(__AVR__)
+#include <util/atomic.h>
+#define modbusLoadIndex(index) modbusAtomicLoad(&(index))
+#define modbusStoreIndex(index, value) modbusAtomicStore(&(index), value)
+
+static uint16_t modbusAtomicLoad(volatile uint16_t *index)
+{
+    uint16_t value;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        value = *index;
+    }
+    return value;
+}
+
+static void modbusAtomicStore(volatile uint16_t *index, uint16_t value)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *index = value;
+    }
+}
+#else
+#define modbusLoadIndex(index) __atomic_load_n(&(index), __ATOMIC_ACQUIRE)
+#define modbusStoreIndex(index, value) __atomic_store_n(&(index), value, __ATOMIC_RELEASE)
+#endif
+
+/**
+ * Inicializa una cola vacía sobre entradas propiedad de la aplicación.
+ *
+ * @param entries Puntero a las entradas.
+ * @param size El número de entradas (caben size - 1 escrituras).
+ */
+ModbusWriteQueue::ModbusWriteQueue(ModbusWrite *entries, uint16_t size)
+    : _entries(entries), _size(size)
+{
+}
+
+/**
+ * Saca la escritura más antigua. Sólo la llama el hilo consumidor.
+ *
+ * @param write Recibe la escritura.
+ * @return Falso si la cola está vacía.
+ */
+bool ModbusWriteQueue::pop(ModbusWrite &write)
+{
+    uint16_t tail = _tail;
+    if (tail == modbusLoadIndex(_head))
+    {
+        return false;
+    }
+    write = _entries[tail];
+    modbusStoreIndex(_tail, (uint16_t)((tail + 1) % _size));
+    return true;
+}
+
+/**
+ * Devuelve el número de escrituras pendientes. Sólo la llama el hilo consumidor.
+ */
+uint16_t ModbusWriteQueue::available()
+{
+    return (modbusLoadIndex(_head) + _size - _tail) % _size;
+}
+
+/**
+ * Devuelve el número de solicitudes respondidas con STATUS_SLAVE_DEVICE_BUSY por falta de espacio.
+ */
+uint32_t ModbusWriteQueue::getRejectedRequests()
+{
+    return _rejectedRequests;
+}
+
+/**
+ * Pasa a la cola las bobinas (FC05, FC15) o registros (FC06, FC16) de la solicitud en curso,
+ * todos o ninguno: el consumidor ve la solicitud entera a la vez. Sólo la llama el hilo de
+ * comunicaciones, desde CB_WRITE_COILS o CB_WRITE_HOLDING_REGISTERS.
+ *
+ * @param queue La cola.
+ * @param address La dirección del primer elemento, la que recibe la devolución de llamada.
+ * @param length El número de elementos, el que recibe la devolución de llamada.
+ * @return STATUS_OK si tiene éxito, STATUS_SLAVE_DEVICE_BUSY si no caben ahora (el maestro reintentará),
+ *         STATUS_ILLEGAL_DATA_VALUE si no caben ni con la cola vacía o STATUS_ILLEGAL_FUNCTION si la
+ *         solicitud no es una escritura.
+ */
+uint8_t Modbus::queueWritesFromBuffer(ModbusWriteQueue &queue, uint16_t address, uint16_t length)
+{
+    uint8_t functionCode = Modbus::currentFunctionCode();
+    bool isCoil = functionCode == FC_WRITE_COIL || functionCode == FC_WRITE_MULTIPLE_COILS;
+    if (!isCoil && functionCode != FC_WRITE_REGISTER && functionCode != FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        return STATUS_ILLEGAL_FUNCTION;
+    }
+
+    // Una solicitud que no cabría ni con la cola vacía no es congestión: reintentarla no sirve.
+    if (length > queue._size - 1)
+    {
+        return STATUS_ILLEGAL_DATA_VALUE;
+    }
+
+    uint16_t head = queue._head;
+    uint16_t free = (modbusLoadIndex(queue._tail) + queue._size - head - 1) % queue._size;
+    if (length > free)
+    {
+        queue._rejectedRequests++;
+        return STATUS_SLAVE_DEVICE_BUSY;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        ModbusWrite &write = queue._entries[(head + i) % queue._size];
+        write.functionCode = functionCode;
+        write.address = address + i;
+        write.value = isCoil ? Modbus::readCoilFromBuffer(i) : Modbus::readRegisterFromBuffer(i);
+    }
+
+    // Publica la solicitud entera de una vez.
+    modbusStoreIndex(queue._head, (uint16_t)((head + length) % queue._size));
+    return STATUS_OK;
+}
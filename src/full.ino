@@ -9,16 +9,39 @@
 // El diseño de EEPROM es el siguiente
 // Los primeros 50 bytes están reservados para almacenar pin digital pinMode_setting
 // Byte 51 y posteriores son libres para escribir cualquier uint16_t.
+#define EEPROM_REGISTERS_ADDRESS 51
+#define PERSISTENT_FIRST_REGISTER 51
+#define PERSISTENT_REGISTERS 10
+#define PERSISTENT_SLOTS 4
 
 // // No debería tener que cambiar nada debajo de esto para que este ejemplo funcione
 
+// Acceso a la EEPROM interna para los registros persistentes.
+class ArduinoEeprom : public ModbusEeprom
+{
+public:
+    uint8_t read(uint16_t address) { return EEPROM.read(address); }
+    void write(uint16_t address, uint8_t value) { EEPROM.write(address, value); }
+};
+
 // Declaración de objeto Modbus
 Modbus slave(SERIAL_PORT, SLAVE_ID, RS485_CTRL_PIN);
 
+// Registros de retención persistentes (escritura diferida con nivelación de desgaste).
+ArduinoEeprom eeprom;
+uint16_t persistentValues[PERSISTENT_REGISTERS];
+uint8_t persistentDirty[MODBUS_DIRTY_BITMAP_SIZE(PERSISTENT_REGISTERS)];
+ModbusPersistentRegisters persistent(eeprom, EEPROM_REGISTERS_ADDRESS, PERSISTENT_SLOTS,
+                                     persistentValues, persistentDirty, PERSISTENT_FIRST_REGISTER, PERSISTENT_REGISTERS);
+
 void setup()
 {
     // Registra funciones para llamar cuando se recibe un determinado código de función
     slave.cbVector[CB_READ_HOLDING_REGISTERS] = addValues;
+    slave.cbVector[CB_WRITE_HOLDING_REGISTERS] = writeValues;
+
+    // Carga los registros persistentes de la EEPROM.
+    persistent.begin();
 
     // Establezca el puerto serie y el esclavo a la velocidad de transmisión dada.
     SERIAL_PORT.begin(SERIAL_BAUDRATE);
@@ -31,6 +54,12 @@ void loop()
     // Cuando se recibe una solicitud, se validará.
     // Y si hay una función registrada en el código de función recibido, esta función se ejecutará.
     slave.poll();
+
+    // Guarda en la EEPROM los registros escritos por el maestro cuando el bus está libre.
+    if (slave.isIdle())
+    {
+        persistent.flush();
+    }
 }
 
 // Funciones del manejador Modbus
@@ -49,6 +78,10 @@ uint8_t addValues(uint8_t fc, uint16_t address, uint16_t length)
         if (address + i <= 50)
         {
         }
+        else if (persistent.contains(address + i, 1))
+        {
+            slave.writeRegisterToBuffer(i, persistent.get(address + i));
+        }
         else
         {
             uint16_t value=(398);
@@ -60,3 +93,10 @@ uint8_t addValues(uint8_t fc, uint16_t address, uint16_t length)
     return STATUS_OK;
 }
 
+// Manejar los códigos de función Write Register (FC = 06) y Write Multiple Registers (FC = 16).
+// Los valores se guardan en RAM y se escriben en la EEPROM más tarde, así la respuesta no espera a la EEPROM.
+uint8_t writeValues(uint8_t fc, uint16_t address, uint16_t length)
+{
+    return persistent.writeFromBuffer(slave, address, length);
+}
+
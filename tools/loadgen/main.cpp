@@ -0,0 +1,449 @@
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <algorithm>
+#include <vector>
+#include <ModbusSlave.h>
+#include <LinuxSerialStream.h>
+
+/**
+ * Generador de carga para Linux: un maestro RTU que satura el bus con una mezcla de
+ * solicitudes FC01-FC16, dejando sólo el silencio de 3.5T entre la respuesta y la
+ * solicitud siguiente, e informa el rendimiento, la tasa de plazos vencidos y los
+ * percentiles del tiempo de respuesta. El esclavo corre en otro proceso, p. ej. modbusd:
+ *
+ *     pio run -e modbusd && pio run -e loadgen
+ *     .pio/build/modbusd/program --pty --baud 115200 &
+ *     .pio/build/loadgen/program --device /dev/pts/3 --baud 115200 --mix 3:60,16:30,5:10
+ *
+ * El tiempo de respuesta se mide desde que el último byte de la solicitud sale del
+ * puerto (tcdrain) hasta que se lee el último byte de la respuesta.
+ */
+
+#define LOADGEN_DEFAULT_BAUDRATE 115200
+#define LOADGEN_DEFAULT_LENGTH 10
+#define LOADGEN_DEFAULT_REGISTERS 1024
+#define LOADGEN_DEFAULT_DURATION 10
+#define LOADGEN_DEFAULT_TIMEOUT 100
+#define LOADGEN_DEFAULT_MIX "1:10,2:5,3:40,4:10,5:5,6:5,15:5,16:20"
+#define LOADGEN_MAX_FUNCTION_CODE 17
+#define LOADGEN_MAX_REGISTERS 123
+#define LOADGEN_EXCEPTION_LENGTH 5
+
+/**
+ * Resultados de un código de función; las latencias están en microsegundos.
+ */
+struct LoadStatistics
+{
+    uint64_t requests = 0;
+    uint64_t timeouts = 0;
+    uint64_t errors = 0;
+    uint64_t exceptions = 0;
+    std::vector<uint32_t> latencies;
+};
+
+static LinuxSerialStream serial;
+static LoadStatistics statistics[LOADGEN_MAX_FUNCTION_CODE];
+static unsigned int weights[LOADGEN_MAX_FUNCTION_CODE];
+static volatile bool isRunning = true;
+
+static void stop(int signal)
+{
+    isRunning = false;
+}
+
+static void usage(const char *program)
+{
+    printf("usage: %s --device PATH [options]\n\n"
+           "  --device PATH    serial port or pty of the slave, e.g. the path printed by modbusd --pty\n"
+           "  --baud N         baud rate (default %d)\n"
+           "  --parity N|E|O   parity (default N)\n"
+           "  --stop-bits 1|2  stop bits (default 1)\n"
+           "  --unit N         unit address (default %d)\n"
+           "  --mix LIST       weighted function codes, FC:WEIGHT,... (default %s)\n"
+           "  --length N       registers or coils per request (default %d)\n"
+           "  --registers N    addresses are drawn from 0..N-1 (default %d)\n"
+           "  --duration S     seconds to run (default %d)\n"
+           "  --count N        stop after N requests\n"
+           "  --timeout MS     response timeout (default %d)\n",
+           program, LOADGEN_DEFAULT_BAUDRATE, MODBUS_DEFAULT_UNIT_ADDRESS, LOADGEN_DEFAULT_MIX,
+           LOADGEN_DEFAULT_LENGTH, LOADGEN_DEFAULT_REGISTERS, LOADGEN_DEFAULT_DURATION, LOADGEN_DEFAULT_TIMEOUT);
+}
+
+/**
+ * Lee la mezcla "FC:PESO,...". Sólo se admiten los códigos de función que atiende Modbus
+ * sin proveedores adicionales (FC01-FC07, FC15, FC16).
+ *
+ * @return Falso si la lista no es válida o todos los pesos son cero.
+ */
+static bool parseMix(const char *mix)
+{
+    memset(weights, 0, sizeof(weights));
+    unsigned int total = 0;
+    while (*mix != '\0')
+    {
+        char *end;
+        long functionCode = strtol(mix, &end, 10);
+        if (end == mix || *end != ':' ||
+            functionCode < FC_READ_COILS || (functionCode > FC_READ_EXCEPTION_STATUS &&
+                                             functionCode != FC_WRITE_MULTIPLE_COILS &&
+                                             functionCode != FC_WRITE_MULTIPLE_REGISTERS))
+        {
+            return false;
+        }
+        mix = end + 1;
+        long weight = strtol(mix, &end, 10);
+        if (end == mix || weight < 0 || (*end != ',' && *end != '\0'))
+        {
+            return false;
+        }
+        weights[functionCode] = weight;
+        total += weight;
+        mix = *end == ',' ? end + 1 : end;
+    }
+    return total > 0;
+}
+
+static uint8_t pickFunctionCode()
+{
+    unsigned int total = 0;
+    for (int i = 0; i < LOADGEN_MAX_FUNCTION_CODE; i++)
+    {
+        total += weights[i];
+    }
+    unsigned int value = rand() % total;
+    for (int i = 0; i < LOADGEN_MAX_FUNCTION_CODE; i++)
+    {
+        if (value < weights[i])
+        {
+            return i;
+        }
+        value -= weights[i];
+    }
+    return FC_READ_HOLDING_REGISTERS;
+}
+
+static void appendUInt16(std::vector<uint8_t> &frame, uint16_t value)
+{
+    frame.push_back(value >> 8);
+    frame.push_back(value & 0xFF);
+}
+
+/**
+ * Crea una solicitud al azar del código de función dado.
+ *
+ * @return La longitud de la respuesta normal (sin excepción), CRC incluido.
+ */
+static size_t createRequest(std::vector<uint8_t> &frame, uint8_t unitAddress, uint8_t functionCode,
+                            uint16_t length, uint16_t numberOfRegisters)
+{
+    uint16_t address = rand() % (numberOfRegisters - length + 1);
+    size_t responseLength = 8;
+
+    frame.clear();
+    frame.push_back(unitAddress);
+    frame.push_back(functionCode);
+    switch (functionCode)
+    {
+    case FC_READ_COILS:
+    case FC_READ_DISCRETE_INPUT:
+        appendUInt16(frame, address);
+        appendUInt16(frame, length);
+        responseLength = 5 + (length + 7) / 8;
+        break;
+    case FC_READ_HOLDING_REGISTERS:
+    case FC_READ_INPUT_REGISTERS:
+        appendUInt16(frame, address);
+        appendUInt16(frame, length);
+        responseLength = 5 + length * 2;
+        break;
+    case FC_WRITE_COIL:
+        appendUInt16(frame, address);
+        appendUInt16(frame, rand() & 1 ? COIL_ON : COIL_OFF);
+        break;
+    case FC_WRITE_REGISTER:
+        appendUInt16(frame, address);
+        appendUInt16(frame, rand());
+        break;
+    case FC_READ_EXCEPTION_STATUS:
+        responseLength = 5;
+        break;
+    case FC_WRITE_MULTIPLE_COILS:
+        appendUInt16(frame, address);
+        appendUInt16(frame, length);
+        frame.push_back((length + 7) / 8);
+        for (uint16_t i = 0; i < (length + 7) / 8; i++)
+        {
+            frame.push_back(rand());
+        }
+        break;
+    default:
+        appendUInt16(frame, address);
+        appendUInt16(frame, length);
+        frame.push_back(length * 2);
+        for (uint16_t i = 0; i < length; i++)
+        {
+            appendUInt16(frame, rand());
+        }
+        break;
+    }
+
+    uint16_t crc = Modbus::calculateCRC(frame.data(), frame.size());
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+    return responseLength;
+}
+
+/**
+ * Comprueba si la respuesta está completa: la longitud esperada o una excepción.
+ */
+static bool isComplete(const std::vector<uint8_t> &response, size_t expected)
+{
+    return response.size() >= expected ||
+           (response.size() >= LOADGEN_EXCEPTION_LENGTH && (response[1] & 0x80));
+}
+
+/**
+ * Duerme hasta el instante dado de micros().
+ */
+static void sleepUntil(unsigned long target)
+{
+    long wait = (long)(target - micros());
+    if (wait > 0)
+    {
+        struct timespec duration = {wait / 1000000, (wait % 1000000) * 1000};
+        nanosleep(&duration, NULL);
+    }
+}
+
+/**
+ * Descarta los bytes que llegan fuera de una transacción (respuestas tardías o ruido).
+ *
+ * @return El número de bytes descartados.
+ */
+static uint64_t drain()
+{
+    uint64_t count = 0;
+    while (serial.available() > 0)
+    {
+        serial.read();
+        count++;
+    }
+    return count;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t index = (size_t)ceil(fraction * sorted.size());
+    return sorted[index > 0 ? index - 1 : 0];
+}
+
+static void printStatistics(const char *name, LoadStatistics &result)
+{
+    std::sort(result.latencies.begin(), result.latencies.end());
+    printf("%-6s %10llu %10llu %8llu %10llu %9u %9u %9u %9u\n", name,
+           (unsigned long long)result.requests, (unsigned long long)result.timeouts,
+           (unsigned long long)result.errors, (unsigned long long)result.exceptions,
+           percentile(result.latencies, 0.5), percentile(result.latencies, 0.99),
+           percentile(result.latencies, 0.999), result.latencies.empty() ? 0 : result.latencies.back());
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    unsigned long baudRate = LOADGEN_DEFAULT_BAUDRATE;
+    char parity = 'N';
+    int stopBits = 1;
+    int unitAddress = MODBUS_DEFAULT_UNIT_ADDRESS;
+    const char *mix = LOADGEN_DEFAULT_MIX;
+    int length = LOADGEN_DEFAULT_LENGTH;
+    long numberOfRegisters = LOADGEN_DEFAULT_REGISTERS;
+    double duration = LOADGEN_DEFAULT_DURATION;
+    unsigned long long count = 0;
+    long timeout = LOADGEN_DEFAULT_TIMEOUT;
+
+    static const struct option options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"baud", required_argument, NULL, 'b'},
+        {"parity", required_argument, NULL, 'P'},
+        {"stop-bits", required_argument, NULL, 's'},
+        {"unit", required_argument, NULL, 'u'},
+        {"mix", required_argument, NULL, 'm'},
+        {"length", required_argument, NULL, 'l'},
+        {"registers", required_argument, NULL, 'n'},
+        {"duration", required_argument, NULL, 'D'},
+        {"count", required_argument, NULL, 'c'},
+        {"timeout", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "d:b:P:s:u:m:l:n:D:c:t:h", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'd':
+            device = optarg;
+            break;
+        case 'b':
+            baudRate = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            parity = optarg[0];
+            break;
+        case 's':
+            stopBits = atoi(optarg);
+            break;
+        case 'u':
+            unitAddress = atoi(optarg);
+            break;
+        case 'm':
+            mix = optarg;
+            break;
+        case 'l':
+            length = atoi(optarg);
+            break;
+        case 'n':
+            numberOfRegisters = atol(optarg);
+            break;
+        case 'D':
+            duration = atof(optarg);
+            break;
+        case 'c':
+            count = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            timeout = atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 1;
+        }
+    }
+    if (device == NULL || baudRate == 0 || unitAddress < 1 || unitAddress > 247 || !parseMix(mix) ||
+        length < 1 || length > LOADGEN_MAX_REGISTERS || numberOfRegisters < length || numberOfRegisters > 0xFFFF ||
+        duration <= 0 || timeout < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!serial.begin(device, baudRate, parity, stopBits))
+    {
+        perror(device);
+        return 1;
+    }
+
+    // Los mismos tiempos que Modbus::begin(): 3.5T, con 1750 us por encima de 19200 baudios.
+    unsigned int bitsPerChar = 1 + 8 + (parity == 'N' ? 0 : 1) + stopBits;
+    unsigned long silence = 7 * (baudRate > 19200 ? 250 : 5000000UL / baudRate);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    std::vector<uint8_t> request;
+    std::vector<uint8_t> response;
+    uint64_t lineBytes = 0;
+    uint64_t lateBytes = 0;
+    uint64_t requests = 0;
+    srand(1);
+
+    unsigned long start = micros();
+    unsigned long lastActivity = start;
+    while (isRunning && (count == 0 || requests < count) && (micros() - start) < duration * 1e6)
+    {
+        uint8_t functionCode = pickFunctionCode();
+        size_t expected = createRequest(request, unitAddress, functionCode, length, numberOfRegisters);
+        LoadStatistics &result = statistics[functionCode];
+
+        // El único hueco entre transacciones es el silencio de fin de trama.
+        sleepUntil(lastActivity + silence);
+        lateBytes += drain();
+
+        serial.write(request.data(), request.size());
+        serial.flush();
+        unsigned long sent = micros();
+        lineBytes += request.size();
+        requests++;
+        result.requests++;
+
+        response.clear();
+        unsigned long lastByte = sent;
+        while (!isComplete(response, expected))
+        {
+            long remaining = (long)(sent + timeout * 1000 - micros());
+            if (remaining <= 0)
+            {
+                break;
+            }
+            if (!serial.waitForData((remaining + 999) / 1000))
+            {
+                continue;
+            }
+            while (serial.available() > 0 && !isComplete(response, expected))
+            {
+                response.push_back(serial.read());
+            }
+            lastByte = serial.getLastReceiveTime();
+        }
+        lineBytes += response.size();
+        lastActivity = lastByte;
+
+        if (!isComplete(response, expected))
+        {
+            result.timeouts++;
+            lastActivity = micros();
+            continue;
+        }
+
+        uint16_t crc = Modbus::calculateCRC(response.data(), response.size() - 2);
+        if (response[0] != unitAddress || (response[1] & 0x7F) != functionCode ||
+            word(response[response.size() - 1], response[response.size() - 2]) != crc)
+        {
+            result.errors++;
+            continue;
+        }
+        result.exceptions += (response[1] & 0x80) != 0;
+        result.latencies.push_back(lastByte - sent);
+    }
+    double elapsed = (micros() - start) / 1e6;
+
+    printf("%s at %lu baud, unit %d, %.1f s\n", device, baudRate, unitAddress, elapsed);
+    printf("%-6s %10s %10s %8s %10s %9s %9s %9s %9s\n",
+           "fc", "requests", "timeouts", "errors", "exceptions", "p50 us", "p99 us", "p999 us", "max us");
+
+    LoadStatistics total;
+    for (int i = 0; i < LOADGEN_MAX_FUNCTION_CODE; i++)
+    {
+        LoadStatistics &result = statistics[i];
+        if (result.requests == 0)
+        {
+            continue;
+        }
+        char name[8];
+        snprintf(name, sizeof(name), "%d", i);
+        printStatistics(name, result);
+
+        total.requests += result.requests;
+        total.timeouts += result.timeouts;
+        total.errors += result.errors;
+        total.exceptions += result.exceptions;
+        total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+    }
+    printStatistics("all", total);
+
+    uint64_t answered = total.requests - total.timeouts - total.errors;
+    printf("%.1f transactions/s, timeout rate %.3f%%, line utilisation %.1f%%, %llu late bytes\n",
+           answered / elapsed, total.requests ? 100.0 * total.timeouts / total.requests : 0.0,
+           100.0 * lineBytes * bitsPerChar / baudRate / elapsed, (unsigned long long)lateBytes);
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <ModbusSlave.h>
+#include <ModbusTcp.h>
+#include <LinuxSerialStream.h>
+
+/**
+ * Demonio Modbus para Linux: sirve un mapa de registros en RAM como esclavo RTU
+ * por un puerto serie (o un pseudoterminal) y, opcionalmente, por Modbus TCP.
+ *
+ *     pio run -e modbusd
+ *     .pio/build/modbusd/program --device /dev/ttyUSB0 --baud 921600 --unit 17
+ *     .pio/build/modbusd/program --pty --tcp 1502
+ *
+ * Bobinas/entradas discretas y registros de retención/entrada comparten la misma tabla.
+ */
+
+#define MODBUSD_DEFAULT_BAUDRATE 115200
+#define MODBUSD_DEFAULT_REGISTERS 1024
+#define MODBUSD_MAX_WAIT 100
+
+static LinuxSerialStream serial;
+static Modbus *slave;
+static uint16_t *registers;
+static uint16_t numberOfRegisters = MODBUSD_DEFAULT_REGISTERS;
+static uint8_t responseQueue[2 * (MODBUS_MAX_BUFFER + 2)];
+static volatile bool isRunning = true;
+
+static uint8_t readCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    if ((uint32_t)address + length > numberOfRegisters)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        slave->writeCoilToBuffer(i, registers[address + i] != 0);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t readRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    if ((uint32_t)address + length > numberOfRegisters)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    return slave->writeArrayToBuffer(0, registers + address, length);
+}
+
+static uint8_t writeCoils(uint8_t fc, uint16_t address, uint16_t length)
+{
+    if ((uint32_t)address + length > numberOfRegisters)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[address + i] = slave->readCoilFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static uint8_t writeRegisters(uint8_t fc, uint16_t address, uint16_t length)
+{
+    if ((uint32_t)address + length > numberOfRegisters)
+    {
+        return STATUS_ILLEGAL_DATA_ADDRESS;
+    }
+    for (uint16_t i = 0; i < length; i++)
+    {
+        registers[address + i] = slave->readRegisterFromBuffer(i);
+    }
+    return STATUS_OK;
+}
+
+static void stop(int signal)
+{
+    isRunning = false;
+}
+
+static void usage(const char *program)
+{
+    printf("usage: %s (--device PATH | --pty) [options]\n\n"
+           "  --device PATH    serial port, e.g. /dev/ttyUSB0\n"
+           "  --pty            create a pseudo-terminal and print the path of its slave side\n"
+           "  --baud N         baud rate (default %d)\n"
+           "  --parity N|E|O   parity (default N)\n"
+           "  --stop-bits 1|2  stop bits (default 1)\n"
+           "  --rs485          let the driver drive the RS485 DE pin\n"
+           "  --resync         find frames by content instead of silences (USB adapters, radio modems)\n"
+           "  --full-duplex    keep receiving requests while responses are sent (RS422, 4-wire)\n"
+           "  --unit N         unit address (default %d)\n"
+           "  --registers N    size of the register table (default %d)\n"
+           "  --tcp PORT       also serve Modbus TCP on PORT\n",
+           program, MODBUSD_DEFAULT_BAUDRATE, MODBUS_DEFAULT_UNIT_ADDRESS, MODBUSD_DEFAULT_REGISTERS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *device = NULL;
+    bool isPty = false;
+    unsigned long baudRate = MODBUSD_DEFAULT_BAUDRATE;
+    char parity = 'N';
+    int stopBits = 1;
+    bool isRs485 = false;
+    bool isResyncEnabled = false;
+    bool isFullDuplex = false;
+    int unitAddress = MODBUS_DEFAULT_UNIT_ADDRESS;
+    int tcpPort = -1;
+
+    static const struct option options[] = {
+        {"device", required_argument, NULL, 'd'},
+        {"pty", no_argument, NULL, 'p'},
+        {"baud", required_argument, NULL, 'b'},
+        {"parity", required_argument, NULL, 'P'},
+        {"stop-bits", required_argument, NULL, 's'},
+        {"rs485", no_argument, NULL, 'r'},
+        {"resync", no_argument, NULL, 'R'},
+        {"full-duplex", no_argument, NULL, 'F'},
+        {"unit", required_argument, NULL, 'u'},
+        {"registers", required_argument, NULL, 'n'},
+        {"tcp", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int option;
+    while ((option = getopt_long(argc, argv, "d:pb:P:s:rRFu:n:t:h", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+        case 'd':
+            device = optarg;
+            break;
+        case 'p':
+            isPty = true;
+            break;
+        case 'b':
+            baudRate = strtoul(optarg, NULL, 10);
+            break;
+        case 'P':
+            parity = optarg[0];
+            break;
+        case 's':
+            stopBits = atoi(optarg);
+            break;
+        case 'r':
+            isRs485 = true;
+            break;
+        case 'R':
+            isResyncEnabled = true;
+            break;
+        case 'F':
+            isFullDuplex = true;
+            break;
+        case 'u':
+            unitAddress = atoi(optarg);
+            break;
+        case 'n':
+            numberOfRegisters = atoi(optarg);
+            break;
+        case 't':
+            tcpPort = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 1;
+        }
+    }
+    if (!device == !isPty || unitAddress < 1 || unitAddress > 247 || numberOfRegisters == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char slaveName[64];
+    if (isPty ? !serial.beginPty(slaveName, sizeof(slaveName)) : !serial.begin(device, baudRate, parity, stopBits))
+    {
+        perror(isPty ? "pty" : device);
+        return 1;
+    }
+    if (isPty)
+    {
+        printf("pty: %s\n", slaveName);
+    }
+    if (isRs485 && !serial.setRs485(true))
+    {
+        perror("rs485");
+        return 1;
+    }
+
+    registers = new uint16_t[numberOfRegisters]();
+    slave = new Modbus(serial, unitAddress);
+    slave->cbVector[CB_READ_COILS] = readCoils;
+    slave->cbVector[CB_READ_DISCRETE_INPUTS] = readCoils;
+    slave->cbVector[CB_READ_HOLDING_REGISTERS] = readRegisters;
+    slave->cbVector[CB_READ_INPUT_REGISTERS] = readRegisters;
+    slave->cbVector[CB_WRITE_COILS] = writeCoils;
+    slave->cbVector[CB_WRITE_HOLDING_REGISTERS] = writeRegisters;
+    slave->enableResync(isResyncEnabled);
+    slave->enableFullDuplex(isFullDuplex ? responseQueue : NULL, sizeof(responseQueue));
+    slave->begin(baudRate);
+
+    // El servidor TCP comparte el motor de PDU y vigila también el puerto serie.
+    ModbusTcpServer server(*slave);
+    if (tcpPort >= 0)
+    {
+        if (!server.begin(tcpPort) || !server.watch(serial.getFd()))
+        {
+            perror("tcp");
+            return 1;
+        }
+        printf("tcp: %u\n", server.getPort());
+    }
+    fflush(stdout);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    while (isRunning)
+    {
+        // Atiende el bus y duerme en epoll hasta el siguiente plazo o la llegada de bytes.
+        unsigned long deadline = slave->service(1000);
+        long wait = (long)(deadline - micros());
+        int timeout = wait > 0 ? (wait + 999) / 1000 : 0;
+        if (timeout > MODBUSD_MAX_WAIT)
+        {
+            timeout = MODBUSD_MAX_WAIT;
+        }
+
+        if (tcpPort >= 0)
+        {
+            server.poll(timeout);
+        }
+        else
+        {
+            serial.waitForData(timeout);
+        }
+    }
+
+    printf("received %llu bytes, sent %llu bytes",
+           (unsigned long long)slave->getTotalBytesReceived(), (unsigned long long)slave->getTotalBytesSent());
+    if (tcpPort >= 0)
+    {
+        printf(", %llu tcp transactions", (unsigned long long)server.getTotalTransactions());
+    }
+    printf("\n");
+    return 0;
+}